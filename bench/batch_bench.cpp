@@ -0,0 +1,168 @@
+//
+// Batch benchmark: the same function over many rows, per-row lmx_call against lmx_call_batch, results as JSON
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../include/lmx.h"
+
+namespace {
+
+struct Case {
+    std::string name;
+    std::string source;
+    std::string function;
+    // 第 row 行的第 arg 个参数
+    int64_t (*input)(size_t row, size_t arg);
+    size_t argc;
+};
+
+// 直线代码，每行走的路径完全一样
+int64_t poly_input(const size_t row, const size_t arg) { return static_cast<int64_t>(row * 7 + arg * 13) % 2001 - 1000; }
+// 分支按行分开，几步之后汇合
+int64_t clamp_input(const size_t row, const size_t arg) { return arg == 0 ? static_cast<int64_t>(row % 997) - 500 : arg == 1 ? -200 : 300; }
+// 循环次数随行变化，先结束的行等其他行
+int64_t sum_input(const size_t row, size_t) { return static_cast<int64_t>(row % 64); }
+// 每轮都分支、循环次数差得很多，最不适合批量的情形
+int64_t collatz_input(const size_t row, size_t) { return static_cast<int64_t>(row % 3000) + 1; }
+
+std::vector<Case> suite() {
+    return {
+        {"poly", "func poly(x, y) { return (x * x * 3 + x * y * 5 - y * 7 + 11) % 1000003 }\n", "poly", poly_input, 2},
+        {"clamp",
+         "func clamp(x, lo, hi) {\n"
+         "    if (x < lo) { return lo }\n"
+         "    if (x > hi) { return hi }\n"
+         "    return x\n"
+         "}\n",
+         "clamp", clamp_input, 3},
+        {"sum_loop",
+         "func sum(n) {\n"
+         "    s = 0\n"
+         "    for (i in 0..n) { s = s + i * 3 }\n"
+         "    return s\n"
+         "}\n",
+         "sum", sum_input, 1},
+        {"collatz",
+         "func steps(n) {\n"
+         "    c = 0\n"
+         "    while (n > 1) {\n"
+         "        if (n % 2 == 0) { n = n / 2 } else { n = 3 * n + 1 }\n"
+         "        c = c + 1\n"
+         "    }\n"
+         "    return c\n"
+         "}\n",
+         "steps", collatz_input, 1},
+    };
+}
+
+struct Result {
+    double scalar_ns{0};
+    double batch_ns{0};
+};
+
+double median(std::vector<double>& times) {
+    std::ranges::sort(times);
+    return times[times.size() / 2];
+}
+
+bool run_case(const Case& c, const size_t rows, const int reps, Result& r) {
+    lmx_program* program;
+    if (lmx_compile(c.source.data(), c.source.size(), &program) != LMX_OK) {
+        std::cerr << c.name << ": " << lmx_last_error() << "\n";
+        return false;
+    }
+    lmx_vm* vm = lmx_vm_new(program);
+    const auto fn = lmx_find_function(program, c.function.c_str());
+
+    std::vector<std::vector<int64_t>> columns(c.argc, std::vector<int64_t>(rows));
+    std::vector<const int64_t*> column_ptrs;
+    for (size_t i = 0; i < c.argc; i++) {
+        for (size_t row = 0; row < rows; row++) columns[i][row] = c.input(row, i);
+        column_ptrs.push_back(columns[i].data());
+    }
+    std::vector<int64_t> scalar(rows), batch(rows);
+
+    bool ok = true;
+    std::vector<double> scalar_times, batch_times;
+    std::vector<lmx_value> args(c.argc);
+    // 第一轮兼作预热
+    for (int rep = 0; rep <= reps && ok; rep++) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t row = 0; row < rows && ok; row++) {
+            for (size_t i = 0; i < c.argc; i++) args[i] = lmx_int(columns[i][row]);
+            lmx_value result;
+            ok = lmx_call(vm, fn, args.data(), c.argc, &result) == LMX_OK;
+            scalar[row] = result.as.i;
+        }
+        auto end = std::chrono::steady_clock::now();
+        if (rep) scalar_times.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+
+        start = std::chrono::steady_clock::now();
+        ok = ok && lmx_call_batch(vm, fn, column_ptrs.data(), c.argc, rows, batch.data()) == LMX_OK;
+        end = std::chrono::steady_clock::now();
+        if (rep) batch_times.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+    }
+    if (!ok) std::cerr << c.name << ": " << lmx_last_error() << "\n";
+    // 批量执行必须和逐行调用逐位一致，否则计时没有意义
+    if (ok && scalar != batch) {
+        std::cerr << c.name << ": batch results differ from lmx_call\n";
+        ok = false;
+    }
+    lmx_vm_free(vm);
+    lmx_program_free(program);
+    if (!ok) return false;
+    r.scalar_ns = median(scalar_times) / static_cast<double>(rows);
+    r.batch_ns = median(batch_times) / static_cast<double>(rows);
+    return true;
+}
+
+void usage() {
+    std::cerr << "usage: lm_batch_bench [--rows N] [--reps N] [--filter SUBSTR]\n"
+                 "cases: poly, clamp, sum_loop, collatz\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    size_t rows = 100000;
+    int reps = 5;
+    std::string filter;
+    for (int i = 1; i < argc; i++) {
+        const std::string_view arg = argv[i];
+        if (i + 1 < argc && arg == "--rows") rows = std::max(1L, std::atol(argv[++i]));
+        else if (i + 1 < argc && arg == "--reps") reps = std::max(1, std::atoi(argv[++i]));
+        else if (i + 1 < argc && arg == "--filter") filter = argv[++i];
+        else {
+            usage();
+            return arg == "--help" || arg == "-h" ? 0 : 2;
+        }
+    }
+
+    std::cout.precision(6);
+    std::cout << "{\n  \"rows\": " << rows << ",\n  \"reps\": " << reps << ",\n  \"cases\": [";
+    bool ok = true;
+    bool first = true;
+    for (const auto& c : suite()) {
+        if (!filter.empty() && c.name.find(filter) == std::string::npos) continue;
+        Result r;
+        if (!run_case(c, rows, reps, r)) {
+            ok = false;
+            continue;
+        }
+        std::cout << (first ? "\n" : ",\n") << "    {\"name\": \"" << c.name << "\""
+                  << ", \"scalar_ns_per_row\": " << r.scalar_ns
+                  << ", \"batch_ns_per_row\": " << r.batch_ns
+                  << ", \"speedup\": " << r.scalar_ns / r.batch_ns << "}";
+        first = false;
+        std::cerr << c.name << ": " << r.scalar_ns << " ns/row scalar, " << r.batch_ns << " ns/row batch\n";
+    }
+    std::cout << "\n  ]\n}\n";
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,224 @@
+//
+// Front-end scalability benchmark: lexer, parser and codegen timed separately on generated scripts
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include "../compiler/lexer.hpp"
+#include "../compiler/parser.hpp"
+#include "../compiler/generator/generator.hpp"
+
+// 替换全局 operator new 统计分配次数，编译器库里的分配也会走到这里
+static std::atomic<uint64_t> allocations{0};
+
+void* operator new(const size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](const size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+struct Params {
+    size_t bytes = 8 << 20;
+    int depth = 200;        // deep: 每个表达式的括号嵌套层数
+    int branches = 200;     // ifchain: 每个函数的 else if 个数
+    int reps = 3;
+};
+
+using Shape = std::function<std::string(const Params&)>;
+
+// 函数体由 body(i) 生成，重复到指定大小
+std::string repeat_funcs(const size_t bytes, const std::function<void(std::string&, const std::string&)>& body) {
+    std::string src;
+    src.reserve(bytes + 4096);
+    for (size_t i = 0; src.size() < bytes; i++) body(src, std::to_string(i));
+    return src;
+}
+
+std::string deep_nesting(const Params& p) {
+    return repeat_funcs(p.bytes, [&](std::string& src, const std::string& n) {
+        src += "func deep" + n + "(v) {\n    return ";
+        src.append(p.depth, '(');
+        src += "v";
+        for (int d = 0; d < p.depth; d++) src += " + " + std::to_string(d % 9 + 1) + ")";
+        src += "\n}\n";
+    });
+}
+
+std::string many_functions(const Params& p) {
+    return repeat_funcs(p.bytes, [](std::string& src, const std::string& n) {
+        src += "func helper" + n + "(alpha, beta) {\n";
+        src += "    total = alpha * " + n + "\n";
+        src += "    while (total >= 1000) { total = total / 2 }\n";
+        src += "    return total + beta\n";
+        src += "}\n";
+    });
+}
+
+std::string if_chains(const Params& p) {
+    return repeat_funcs(p.bytes, [&](std::string& src, const std::string& n) {
+        src += "func pick" + n + "(x) {\n    if (x == 0) { return " + n + " }\n";
+        for (int b = 1; b < p.branches; b++) {
+            src += "    else if (x == " + std::to_string(b) + ") { return x * " + std::to_string(b) + " }\n";
+        }
+        src += "    else { return 0 }\n}\n";
+    });
+}
+
+// 语法里只有整数字面量能出现在表达式中，用最长不溢出的 18 位数字拉长数字扫描路径
+std::string huge_literals(const Params& p) {
+    return repeat_funcs(p.bytes, [](std::string& src, const std::string& n) {
+        src += "func lit" + n + "(v) {\n    return v";
+        for (int k = 0; k < 64; k++) src += " + " + std::to_string(100000000000000000LL + k * 7919 + n.size());
+        src += "\n}\n";
+    });
+}
+
+struct Stage {
+    double best_ns{1e300};
+    uint64_t allocs{0};
+    long peak_rss_kb{0};
+};
+
+// 把峰值 RSS 清零，之后读到的峰值只反映这一阶段（Linux 专有，其他平台读到的是进程峰值）
+void reset_peak_rss() {
+#ifdef __linux__
+    std::ofstream("/proc/self/clear_refs") << "5";
+#endif
+}
+
+long peak_rss_kb() {
+#ifdef __linux__
+    std::ifstream status("/proc/self/status");
+    for (std::string line; std::getline(status, line);) {
+        if (line.starts_with("VmHWM:")) return std::strtol(line.c_str() + 6, nullptr, 10);
+    }
+#endif
+#ifndef _WIN32
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+#else
+    return 0;
+#endif
+}
+
+template<class F>
+void measure(Stage& stage, const bool first, F&& f) {
+    if (first) reset_peak_rss();
+    const auto allocs_before = allocations.load(std::memory_order_relaxed);
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    const auto end = std::chrono::steady_clock::now();
+    stage.best_ns = std::min(stage.best_ns, std::chrono::duration<double, std::nano>(end - start).count());
+    if (first) {
+        stage.allocs = allocations.load(std::memory_order_relaxed) - allocs_before;
+        stage.peak_rss_kb = peak_rss_kb();
+    }
+}
+
+void print_stage(const char* name, const Stage& s, const size_t bytes, const size_t tokens) {
+    std::cout << "\"" << name << "\": {\"ns\": " << s.best_ns
+              << ", \"mb_per_sec\": " << static_cast<double>(bytes) / (1 << 20) / (s.best_ns * 1e-9)
+              << ", \"peak_rss_kb\": " << s.peak_rss_kb
+              << ", \"allocs\": " << s.allocs
+              << ", \"allocs_per_token\": " << static_cast<double>(s.allocs) / static_cast<double>(std::max<size_t>(tokens, 1))
+              << "}";
+}
+
+bool run_shape(const std::string& name, const Shape& shape, const Params& p, const bool first_shape) {
+    const auto src = shape(p);
+    Stage lex, parse, gen;
+    size_t tokens = 0, ops = 0;
+    for (int r = 0; r < p.reps; r++) {
+        const bool first = r == 0;
+        // 每轮都从头构造，上一轮的 token、AST 和字节码已经释放
+        std::vector<lmx::Token> ts;
+        lmx::Lexer lexer(src);
+        measure(lex, first, [&] { lexer.tokenize(ts); });
+        lmx::Parser parser(ts);
+        lmx::ProgramASTNode* program = nullptr;
+        measure(parse, first, [&] { program = parser.parse_program(); });
+        if (parser.error()) {
+            std::cerr << name << ": parse error\n";
+            return false;
+        }
+        lmx::Generator gener;
+        measure(gen, first, [&] { [[maybe_unused]] auto _1 = program->gen(gener); });
+        tokens = ts.size();
+        ops = gener.ops.size();
+    }
+
+    std::cout << (first_shape ? "\n" : ",\n") << "    {\"shape\": \"" << name << "\", \"bytes\": " << src.size()
+              << ", \"tokens\": " << tokens << ", \"ops\": " << ops << ",\n     ";
+    print_stage("tokenize", lex, src.size(), tokens);
+    std::cout << ",\n     ";
+    print_stage("parse", parse, src.size(), tokens);
+    std::cout << ",\n     ";
+    print_stage("gen", gen, src.size(), tokens);
+    std::cout << "}";
+    std::cerr << name << ": " << src.size() / 1024 << " KB, lex " << lex.best_ns / 1e6 << " ms, parse "
+              << parse.best_ns / 1e6 << " ms, gen " << gen.best_ns / 1e6 << " ms\n";
+    return true;
+}
+
+void usage() {
+    std::cerr << "usage: lm_front_bench [--mb N] [--reps N] [--depth N] [--branches N] [--shape NAME]\n"
+                 "shapes: deep, funcs, ifchain, literals\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Params p;
+    std::string only;
+    for (int i = 1; i < argc; i++) {
+        const std::string_view arg = argv[i];
+        if (i + 1 < argc && arg == "--mb") p.bytes = std::max(1ul, std::strtoul(argv[++i], nullptr, 10)) << 20;
+        else if (i + 1 < argc && arg == "--reps") p.reps = std::max(1, std::atoi(argv[++i]));
+        else if (i + 1 < argc && arg == "--depth") p.depth = std::max(1, std::atoi(argv[++i]));
+        else if (i + 1 < argc && arg == "--branches") p.branches = std::max(1, std::atoi(argv[++i]));
+        else if (i + 1 < argc && arg == "--shape") only = argv[++i];
+        else {
+            usage();
+            return arg == "--help" || arg == "-h" ? 0 : 2;
+        }
+    }
+
+    const std::vector<std::pair<std::string, Shape>> shapes = {
+        {"deep", deep_nesting},
+        {"funcs", many_functions},
+        {"ifchain", if_chains},
+        {"literals", huge_literals},
+    };
+    std::cout.precision(6);
+    std::cout << "{\n  \"mb\": " << (p.bytes >> 20) << ",\n  \"reps\": " << p.reps << ",\n  \"shapes\": [";
+    bool ok = true;
+    bool first = true;
+    for (const auto& [name, shape] : shapes) {
+        if (!only.empty() && name != only) continue;
+        if (run_shape(name, shape, p, first)) first = false;
+        else ok = false;
+    }
+    std::cout << "\n  ]\n}\n";
+    return ok ? 0 : 1;
+}
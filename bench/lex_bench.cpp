@@ -0,0 +1,55 @@
+//
+// Lexer throughput benchmark: tokens per second on a generated script
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "../compiler/lexer.hpp"
+
+// 生成一段包含函数、循环、分支和长算术表达式的脚本，重复到指定大小
+static std::string generate(const size_t bytes) {
+    std::string src;
+    src.reserve(bytes + 256);
+    for (size_t i = 0; src.size() < bytes; i++) {
+        const auto n = std::to_string(i);
+        src += "func helper" + n + "(alpha, beta) {\n";
+        src += "    total = 0 # running sum\n";
+        src += "    for (k in 0..beta) {\n";
+        src += "        if (k % 3 == 0) { total = total + alpha * k } else { total = total - 12345 }\n";
+        src += "    }\n";
+        src += "    while (total >= 1000000) { total = total / 2 }\n";
+        src += "    return total + " + n + "\n";
+        src += "}\n";
+        src += "let value" + n + " = helper" + n + "(" + n + ", 64) * (value - 7) ^ 2\n";
+    }
+    return src;
+}
+
+int main(int argc, char** argv) {
+    const size_t mb = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 8;
+    const int reps = argc > 2 ? std::atoi(argv[2]) : 5;
+    const auto src = generate(mb << 20);
+
+    lmx::Lexer lexer(src);
+    std::vector<lmx::Token> ts;
+    lexer.tokenize(ts);     // 预热，同时让缓冲区的页都已映射
+    double best = 1e300;
+    for (int r = 0; r < reps; r++) {
+        const auto start = std::chrono::steady_clock::now();
+        lexer.tokenize(ts);
+        const auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(end - start).count());
+    }
+    const auto tokens = ts.size();
+
+    std::cout << "source      " << src.size() << " bytes\n"
+              << "tokens      " << tokens << " (" << sizeof(lmx::Token) << " bytes each)\n"
+              << "best of " << reps << "   " << best * 1e3 << " ms\n"
+              << "throughput  " << tokens / best / 1e6 << " Mtokens/s, "
+              << src.size() / best / (1 << 20) << " MB/s\n";
+    return 0;
+}
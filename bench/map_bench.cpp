@@ -0,0 +1,153 @@
+//
+// Map benchmark: IntMap against std::unordered_map on insert, hit, miss and erase, results as JSON
+//
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../runtime/value/map.hpp"
+
+namespace {
+
+using lmx::runtime::IntMap;
+
+struct Keys {
+    std::string name;
+    std::vector<int64_t> present;   // 插入的键
+    std::vector<int64_t> absent;    // 一个都不在表里
+    std::vector<int64_t> probe;     // present 打乱顺序，查找和删除按这个顺序
+};
+
+Keys make_keys(const std::string& name, const size_t n, std::mt19937_64& rng) {
+    Keys k{name};
+    for (size_t i = 0; i < n; i++) {
+        const auto v = static_cast<int64_t>(i);
+        if (name == "sequential") {
+            k.present.push_back(v);
+            k.absent.push_back(v + static_cast<int64_t>(n));
+        } else if (name == "strided") {
+            // 低位全为 0 的键，哈希只取低位时全部撞在一起
+            k.present.push_back(v << 12);
+            k.absent.push_back(v << 12 | 1);
+        } else {
+            // 最低位区分两组，保证互不相交
+            k.present.push_back(static_cast<int64_t>(rng() << 1));
+            k.absent.push_back(static_cast<int64_t>(rng() << 1 | 1));
+        }
+    }
+    k.probe = k.present;
+    std::ranges::shuffle(k.probe, rng);
+    std::ranges::shuffle(k.absent, rng);
+    return k;
+}
+
+struct SwissMap {
+    IntMap m;
+    void insert(const int64_t k, const int64_t v) { m.set(k, v); }
+    [[nodiscard]] int64_t get(const int64_t k) const { return m.get(k); }
+    bool erase(const int64_t k) { return m.erase(k); }
+};
+
+struct StdMap {
+    std::unordered_map<int64_t, int64_t> m;
+    void insert(const int64_t k, const int64_t v) { m.insert_or_assign(k, v); }
+    [[nodiscard]] int64_t get(const int64_t k) const {
+        const auto it = m.find(k);
+        return it == m.end() ? 0 : it->second;
+    }
+    bool erase(const int64_t k) { return m.erase(k) != 0; }
+};
+
+enum Phase { INSERT, HIT, MISS, ERASE, PHASES };
+constexpr const char* PHASE_NAMES[PHASES] = {"insert", "hit", "miss", "erase"};
+
+double median(std::vector<double>& times) {
+    std::ranges::sort(times);
+    return times[times.size() / 2];
+}
+
+// 每一轮从空表开始走完四个阶段，返回各阶段每次操作的纳秒数（取中位数）；check 为查找结果的校验和
+template <class Map>
+std::array<double, PHASES> run(const Keys& k, const int reps, int64_t& check) {
+    std::array<std::vector<double>, PHASES> times;
+    const auto n = static_cast<double>(k.present.size());
+    // 第一轮兼作预热
+    for (int rep = 0; rep <= reps; rep++) {
+        Map map;
+        int64_t sum = 0;
+        const auto phase = [&](const Phase p, auto&& body) {
+            const auto start = std::chrono::steady_clock::now();
+            body();
+            const auto end = std::chrono::steady_clock::now();
+            if (rep) times[p].push_back(std::chrono::duration<double, std::nano>(end - start).count() / n);
+        };
+        phase(INSERT, [&] { for (size_t i = 0; i < k.present.size(); i++) map.insert(k.present[i], static_cast<int64_t>(i)); });
+        phase(HIT, [&] { for (const auto key : k.probe) sum += map.get(key); });
+        phase(MISS, [&] { for (const auto key : k.absent) sum += map.get(key); });
+        phase(ERASE, [&] { for (const auto key : k.probe) sum += map.erase(key); });
+        check = sum;
+    }
+    std::array<double, PHASES> out{};
+    for (size_t p = 0; p < PHASES; p++) out[p] = median(times[p]);
+    return out;
+}
+
+void usage() {
+    std::cerr << "usage: lm_map_bench [--size N] [--reps N] [--filter SUBSTR]\n"
+                 "keys: sequential, strided, random\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    size_t size = 1 << 16;
+    int reps = 5;
+    std::string filter;
+    for (int i = 1; i < argc; i++) {
+        const std::string_view arg = argv[i];
+        if (i + 1 < argc && arg == "--size") size = std::max(1L, std::atol(argv[++i]));
+        else if (i + 1 < argc && arg == "--reps") reps = std::max(1, std::atoi(argv[++i]));
+        else if (i + 1 < argc && arg == "--filter") filter = argv[++i];
+        else {
+            usage();
+            return arg == "--help" || arg == "-h" ? 0 : 2;
+        }
+    }
+
+    std::mt19937_64 rng(42);
+    std::cout.precision(6);
+    std::cout << "{\n  \"size\": " << size << ",\n  \"reps\": " << reps << ",\n  \"cases\": [";
+    bool ok = true;
+    bool first = true;
+    for (const auto* name : {"sequential", "strided", "random"}) {
+        if (!filter.empty() && std::string(name).find(filter) == std::string::npos) continue;
+        const auto keys = make_keys(name, size, rng);
+        int64_t swiss_check = 0, std_check = 0;
+        const auto swiss = run<SwissMap>(keys, reps, swiss_check);
+        const auto stdm = run<StdMap>(keys, reps, std_check);
+        // 两边查到的值必须一样，否则计时没有意义
+        if (swiss_check != std_check) {
+            std::cerr << name << ": IntMap and std::unordered_map disagree\n";
+            ok = false;
+            continue;
+        }
+        for (size_t p = 0; p < PHASES; p++) {
+            std::cout << (first ? "\n" : ",\n") << "    {\"name\": \"" << name << "/" << PHASE_NAMES[p] << "\""
+                      << ", \"intmap_ns_per_op\": " << swiss[p]
+                      << ", \"unordered_map_ns_per_op\": " << stdm[p]
+                      << ", \"speedup\": " << stdm[p] / swiss[p] << "}";
+            first = false;
+            std::cerr << name << "/" << PHASE_NAMES[p] << ": " << swiss[p] << " ns/op IntMap, " << stdm[p]
+                      << " ns/op std::unordered_map\n";
+        }
+    }
+    std::cout << "\n  ]\n}\n";
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,293 @@
+//
+// Interpreter benchmark suite: a fixed set of scripts run with warmup and repetitions, results as JSON
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../compiler/lexer.hpp"
+#include "../compiler/parser.hpp"
+#include "../compiler/generator/generator.hpp"
+#include "../compiler/ir/builder.hpp"
+#include "../compiler/ir/lower.hpp"
+#include "../compiler/ir/passes.hpp"
+#include "../runtime/vm.hpp"
+
+namespace {
+
+struct Case {
+    std::string name;
+    std::string source;
+};
+
+// 大量活跃变量跨越循环和调用，逼着寄存器分配用满寄存器并在调用前后保存
+std::string register_pressure(const int vars) {
+    std::string src = "func down(n) {\n    if (n == 0) { return 0 }\n    return down(n - 1) + 1\n}\n";
+    src += "func pressure(n) {\n";
+    for (int i = 0; i < vars; i++) src += "    v" + std::to_string(i) + " = n + " + std::to_string(i) + "\n";
+    src += "    for (i in 0..n) {\n";
+    for (int i = 0; i < vars; i++) {
+        src += "        v" + std::to_string(i) + " = (v" + std::to_string(i) + " + v" +
+               std::to_string((i + 1) % vars) + ") % 1000003\n";
+    }
+    src += "        v0 = v0 + down(2)\n    }\n    return v0";
+    for (int i = 1; i < vars; i++) src += " + v" + std::to_string(i);
+    src += "\n}\npressure(2000)\n";
+    return src;
+}
+
+std::vector<Case> suite() {
+    return {
+        {"fib",
+         "func fib(n) {\n"
+         "    if (n < 2) { return n }\n"
+         "    return fib(n - 1) + fib(n - 2)\n"
+         "}\n"
+         "fib(25)\n"},
+        // 递归链不会被内联，每层都是一次真实的 FCALL/FRET
+        {"call_chain",
+         "func down(n) {\n"
+         "    if (n == 0) { return 0 }\n"
+         "    return down(n - 1) + 1\n"
+         "}\n"
+         "func chains(n) {\n"
+         "    s = 0\n"
+         "    for (i in 0..n) { s = s + down(64) }\n"
+         "    return s\n"
+         "}\n"
+         "chains(5000)\n"},
+        {"arith",
+         "func arith(n) {\n"
+         "    s = 0\n"
+         "    for (i in 0..n) {\n"
+         "        s = (s * 31 + i * 7 - i % 13 + (i / 3) * (i % 5)) % 1000003\n"
+         "    }\n"
+         "    return s\n"
+         "}\n"
+         "arith(300000)\n"},
+        {"branch",
+         "func branch(n) {\n"
+         "    s = 0\n"
+         "    for (i in 0..n) {\n"
+         "        k = i % 8\n"
+         "        if (k == 0) { s = s + 1 }\n"
+         "        else if (k == 1) { s = s + 3 }\n"
+         "        else if (k == 2) { s = s - 2 }\n"
+         "        else if (k < 5) { s = s + k }\n"
+         "        else if (k == 5) { s = s * 2 % 1000003 }\n"
+         "        else { s = s - 1 }\n"
+         "    }\n"
+         "    return s\n"
+         "}\n"
+         "branch(300000)\n"},
+        {"register_pressure", register_pressure(64)},
+    };
+}
+
+// 必须以运行时错误结束、不能让进程崩溃的脚本，优化和直接生成两条路径都要跑；
+// 结果没人用的除法也在里面，优化不能把报错删掉
+std::vector<Case> faults() {
+    return {
+        {"div_zero", "x = 0\n10 / x\n"},
+        {"div_zero_unused", "x = 0\ny = 10 / x\n"},
+        {"mod_zero_call", "func f(a, b) { return a % b }\nf(5, 0)\n"},
+        {"div_zero_literal", "10 / 0\n"},
+        // 溢出后进入大整数模式，小整数除零走标记模式的路径
+        {"div_zero_big_mode", "x = 9223372036854775807\ny = x + 1\nz = 0\n5 / z\n"},
+        {"mod_zero_bigint", "x = 9223372036854775807\ny = x + 1\nz = 0\ny % z\n"},
+    };
+}
+
+bool compile(const std::string& source, std::vector<lmx::runtime::Op>& ops) {
+    lmx::Lexer lexer(source);
+    lmx::Parser parser(lexer);
+    lmx::ir::IRModule mod;
+    lmx::ir::IRBuilder builder(mod);
+    builder.begin();
+    while (const auto stmt = parser.next_statement()) {
+        if (parser.error()) return false;
+        builder.add(stmt);
+    }
+    if (!builder.finish() || parser.error()) return false;
+    lmx::ir::optimize(mod);
+    return lmx::ir::lower(mod, ops);
+}
+
+// 不经过 IR，用直接生成器编译
+bool compile_direct(const std::string& source, std::vector<lmx::runtime::Op>& ops) {
+    lmx::Lexer lexer(source);
+    lmx::Parser parser(lexer);
+    lmx::Generator gener;
+    while (const auto stmt = parser.next_statement()) {
+        if (parser.error() || !gener.infer(stmt)) return false;
+        [[maybe_unused]] auto _1 = stmt->gen(gener);
+        if (gener.has_error()) return false;
+    }
+    if (parser.error()) return false;
+    gener.ops.emplace_back(lmx::runtime::Opcode::HALT);
+    ops = std::move(gener.ops);
+    return true;
+}
+
+// 用不经过 IR 的直接生成器再跑一遍，结果不一致说明优化出了错，计时也就没有意义
+bool reference_result(const std::string& source, int64_t& result) {
+    std::vector<lmx::runtime::Op> ops;
+    if (!compile_direct(source, ops)) return false;
+    lmx::runtime::VirtualCore vm;
+    vm.set_program(&ops);
+    if (vm.run() != 0) return false;
+    result = vm.look_register(0);
+    return true;
+}
+
+struct Result {
+    size_t ops{0};
+    int64_t value{0};
+    bool checked{false};
+    lmx::runtime::VMStats stats;
+    double min_ns{0};
+    double median_ns{0};
+};
+
+bool run_case(const Case& c, const int warmup, const int reps, Result& r) {
+    std::vector<lmx::runtime::Op> ops;
+    if (!compile(c.source, ops)) {
+        std::cerr << c.name << ": compile failed\n";
+        return false;
+    }
+    r.ops = ops.size();
+
+    lmx::runtime::VirtualCore vm;
+    for (int i = 0; i < warmup; i++) {
+        vm.set_program(&ops);
+        vm.run();
+    }
+    std::vector<double> times;
+    times.reserve(reps);
+    for (int i = 0; i < reps; i++) {
+        vm.set_program(&ops);
+        vm.reset_stats();
+        const auto start = std::chrono::steady_clock::now();
+        const int rc = vm.run();
+        const auto end = std::chrono::steady_clock::now();
+        if (rc != 0) {
+            std::cerr << c.name << ": run returned " << rc << "\n";
+            return false;
+        }
+        times.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+    }
+    // 每次运行的指令序列都一样，计数取最后一次即可
+    r.stats = vm.stats();
+    r.value = vm.look_register(0);
+    std::ranges::sort(times);
+    r.min_ns = times.front();
+    r.median_ns = times[times.size() / 2];
+
+    if (int64_t expected; reference_result(c.source, expected)) {
+        if (expected != r.value) {
+            std::cerr << c.name << ": result " << r.value << " differs from unoptimized " << expected << "\n";
+            return false;
+        }
+        r.checked = true;
+    }
+    return true;
+}
+
+// 两条路径都编译成功，并且运行返回 -1（报了运行时错误）才算通过
+bool run_fault(const Case& c) {
+    for (const bool direct : {false, true}) {
+        const auto path = direct ? "direct" : "ir";
+        std::vector<lmx::runtime::Op> ops;
+        if (!(direct ? compile_direct(c.source, ops) : compile(c.source, ops))) {
+            std::cerr << c.name << " (" << path << "): compile failed\n";
+            return false;
+        }
+        lmx::runtime::VirtualCore vm;
+        vm.set_program(&ops);
+        if (const int rc = vm.run(); rc != -1) {
+            std::cerr << c.name << " (" << path << "): run returned " << rc << ", expected a runtime error\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+// 分母为 0 时输出 null，比如 LMX_VM_STATS 关闭后没有指令计数，或者没有调用
+void json_ratio(std::ostream& out, const double num, const double den) {
+    if (num > 0 && den > 0) out << num / den;
+    else out << "null";
+}
+
+void usage() {
+    std::cerr << "usage: lm_bench [--reps N] [--warmup N] [--filter SUBSTR]\n"
+                 "cases: fib, call_chain, arith, branch, register_pressure\n"
+                 "before timing, every fault script must end in a runtime error on both compile paths;\n"
+                 "their [RuntimeError] lines on stderr are expected\n"
+                 "per-instruction figures need a build with -DLMX_VM_STATS=ON\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    int warmup = 3;
+    int reps = 15;
+    std::string filter;
+    for (int i = 1; i < argc; i++) {
+        const std::string_view arg = argv[i];
+        if (i + 1 < argc && arg == "--reps") reps = std::max(1, std::atoi(argv[++i]));
+        else if (i + 1 < argc && arg == "--warmup") warmup = std::max(0, std::atoi(argv[++i]));
+        else if (i + 1 < argc && arg == "--filter") filter = argv[++i];
+        else {
+            usage();
+            return arg == "--help" || arg == "-h" ? 0 : 2;
+        }
+    }
+
+    bool ok = true;
+    size_t faults_ok = 0;
+    const auto fault_cases = faults();
+    for (const auto& c : fault_cases) {
+        if (run_fault(c)) faults_ok++;
+        else ok = false;
+    }
+    std::cerr << "faults: " << faults_ok << "/" << fault_cases.size() << " scripts reported a runtime error\n";
+
+    std::cout.precision(6);
+    std::cout << "{\n  \"warmup\": " << warmup << ",\n  \"reps\": " << reps << ",\n  \"cases\": [";
+    bool first = true;
+    for (const auto& c : suite()) {
+        if (!filter.empty() && c.name.find(filter) == std::string::npos) continue;
+        Result r;
+        if (!run_case(c, warmup, reps, r)) {
+            ok = false;
+            continue;
+        }
+        const auto instr = static_cast<double>(r.stats.instructions);
+        const auto calls = static_cast<double>(r.stats.calls);
+        std::cout << (first ? "\n" : ",\n") << "    {\"name\": \"" << c.name << "\""
+                  << ", \"bytecode_ops\": " << r.ops
+                  << ", \"result\": " << r.value
+                  << ", \"checked\": " << (r.checked ? "true" : "false")
+                  << ", \"instructions\": " << r.stats.instructions
+                  << ", \"calls\": " << r.stats.calls
+                  << ", \"ns_min\": " << r.min_ns
+                  << ", \"ns_median\": " << r.median_ns
+                  << ", \"ns_per_op\": ";
+        json_ratio(std::cout, r.median_ns, instr);
+        std::cout << ", \"instr_per_sec\": ";
+        json_ratio(std::cout, instr, r.median_ns * 1e-9);
+        std::cout << ", \"dispatches_per_call\": ";
+        json_ratio(std::cout, instr, calls);
+        std::cout << "}";
+        first = false;
+        std::cerr << c.name << ": " << r.median_ns / 1e6 << " ms median, " << r.stats.instructions
+                  << " instructions\n";
+    }
+    std::cout << "\n  ]\n}\n";
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,195 @@
+#include "compile_cache.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <system_error>
+
+#ifndef LMX_COMPILER_VERSION
+#define LMX_COMPILER_VERSION "unknown"
+#endif
+
+namespace {
+
+constexpr uint64_t K1 = 0x87C37B91114253D5ULL;
+constexpr uint64_t K2 = 0x4CF5AD432745937FULL;
+
+uint64_t mix(uint64_t h, const uint64_t w) {
+    h ^= w * K1;
+    h = std::rotl(h, 31);
+    return h * K2 + 0x52DCE729;
+}
+
+uint64_t avalanche(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    return h ^ (h >> 33);
+}
+
+uint64_t load64(const unsigned char* p) {
+    uint64_t w;
+    std::memcpy(&w, p, sizeof(w));
+    return w;
+}
+
+// 条目文件格式：Header 后紧跟 count 条 Op 的原始字节；模块条目后面是 count 字节的模块数据
+struct Header {
+    char magic[4];
+    uint32_t format;
+    uint32_t op_size;
+    uint32_t reserved;
+    CacheKey key;
+    uint64_t count;
+};
+
+constexpr char MAGIC[4] = {'L', 'M', 'X', 'C'};
+constexpr char MODULE_MAGIC[4] = {'L', 'M', 'X', 'M'};
+constexpr uint32_t FORMAT = 1;
+
+// 读出条目的数据部分，每个计数单位一个 T；格式、key 或长度对不上都按未命中处理
+template<class T>
+bool read_entry(const std::filesystem::path& path, const char (&magic)[4], const CacheKey& key, std::vector<T>& data,
+                const T& fill) {
+    std::error_code ec;
+    const auto file_size = std::filesystem::file_size(path, ec);
+    if (ec || file_size < sizeof(Header)) return false;
+    std::ifstream in(path, std::ios::binary);
+    Header h{};
+    if (!in.read(reinterpret_cast<char*>(&h), sizeof(h))) return false;
+    if (std::memcmp(h.magic, magic, sizeof(magic)) != 0 || h.format != FORMAT ||
+        h.op_size != sizeof(lmx::runtime::Op) || h.key.lo != key.lo || h.key.hi != key.hi) return false;
+    // 长度对不上说明条目被截断或改写过
+    if ((file_size - sizeof(Header)) / sizeof(T) != h.count || (file_size - sizeof(Header)) % sizeof(T) != 0) return false;
+
+    std::vector<T> loaded(h.count, fill);
+    if (!in.read(reinterpret_cast<char*>(loaded.data()), static_cast<std::streamsize>(h.count * sizeof(T)))) return false;
+    data = std::move(loaded);
+    return true;
+}
+
+// 临时文件名带随机后缀，同时写同一条目的进程互不干扰，最后一个 rename 生效
+bool write_entry(const std::filesystem::path& dir, const std::string& name, const char (&magic)[4],
+                 const CacheKey& key, const uint64_t count, const void* data, const size_t bytes) {
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    if (ec) return false;
+
+    const auto final_path = dir / name;
+    const auto tmp_path = dir / (name + ".tmp." + std::to_string(std::random_device{}()));
+    {
+        std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+        Header h{};
+        std::memcpy(h.magic, magic, sizeof(magic));
+        h.format = FORMAT;
+        h.op_size = sizeof(lmx::runtime::Op);
+        h.key = key;
+        h.count = count;
+        out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        out.write(static_cast<const char*>(data), static_cast<std::streamsize>(bytes));
+        out.close();
+        if (!out) {
+            std::filesystem::remove(tmp_path, ec);
+            return false;
+        }
+    }
+    std::filesystem::rename(tmp_path, final_path, ec);
+    if (ec) {
+        std::filesystem::remove(tmp_path, ec);
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+std::string CacheKey::hex() const {
+    static constexpr char digits[] = "0123456789abcdef";
+    std::string s(32, '0');
+    for (int i = 0; i < 16; i++) {
+        s[15 - i] = digits[hi >> (i * 4) & 0xF];
+        s[31 - i] = digits[lo >> (i * 4) & 0xF];
+    }
+    return s;
+}
+
+SourceHasher::SourceHasher(const std::string_view salt): a(0x9E3779B97F4A7C15ULL), b(0xC2B2AE3D27D4EB4FULL) {
+    update(salt);
+    // 盐和源码之间补齐到块边界，避免两者的分界可以挪动
+    if (tail_len) {
+        std::memset(tail + tail_len, 0, sizeof(tail) - tail_len);
+        block(tail);
+        tail_len = 0;
+    }
+    length = 0;
+}
+
+void SourceHasher::block(const unsigned char* p) {
+    a = mix(a, load64(p));
+    b = mix(b, load64(p + 8)) ^ a;
+}
+
+void SourceHasher::update(std::string_view data) {
+    length += data.size();
+    auto p = reinterpret_cast<const unsigned char*>(data.data());
+    auto n = data.size();
+    if (tail_len) {
+        const auto take = std::min(n, sizeof(tail) - tail_len);
+        std::memcpy(tail + tail_len, p, take);
+        tail_len += take;
+        p += take;
+        n -= take;
+        if (tail_len < sizeof(tail)) return;
+        block(tail);
+        tail_len = 0;
+    }
+    for (; n >= 16; p += 16, n -= 16) block(p);
+    std::memcpy(tail, p, n);
+    tail_len = n;
+}
+
+CacheKey SourceHasher::finish() {
+    std::memset(tail + tail_len, 0, sizeof(tail) - tail_len);
+    block(tail);
+    a = mix(a, length);
+    b = mix(b, a);
+    return {avalanche(a + b), avalanche(b ^ std::rotl(a, 17))};
+}
+
+CompileCache::CompileCache() {
+    if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg) {
+        dir = std::filesystem::path(xdg) / "lamina";
+    } else if (const char* home = std::getenv("HOME"); home && *home) {
+        dir = std::filesystem::path(home) / ".cache" / "lamina";
+    } else if (const char* local = std::getenv("LOCALAPPDATA"); local && *local) {
+        dir = std::filesystem::path(local) / "lamina";
+    }
+}
+
+bool CompileCache::load(const CacheKey& key, std::vector<lmx::runtime::Op>& ops) const {
+    return enabled() &&
+           read_entry(dir / (key.hex() + ".lmc"), MAGIC, key, ops, lmx::runtime::Op(lmx::runtime::Opcode::HALT));
+}
+
+bool CompileCache::store(const CacheKey& key, const std::vector<lmx::runtime::Op>& ops) const {
+    if (!enabled()) return false;
+    return write_entry(dir, key.hex() + ".lmc", MAGIC, key, ops.size(), ops.data(), ops.size() * sizeof(lmx::runtime::Op));
+}
+
+bool CompileCache::load_module(const CacheKey& key, std::vector<char>& data) const {
+    return enabled() && read_entry(dir / (key.hex() + ".lmm"), MODULE_MAGIC, key, data, '\0');
+}
+
+bool CompileCache::store_module(const CacheKey& key, const std::string_view data) const {
+    if (!enabled()) return false;
+    return write_entry(dir, key.hex() + ".lmm", MODULE_MAGIC, key, data.size(), data.data(), data.size());
+}
+
+const char* compiler_version() {
+    static const std::string version = LMX_COMPILER_VERSION "/bc" + std::to_string(lmx::runtime::BYTECODE_FORMAT);
+    return version.c_str();
+}
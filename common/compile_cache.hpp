@@ -0,0 +1,57 @@
+//
+// Content-addressed on-disk cache of compiled programs
+//
+
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../include/opcode.hpp"
+
+struct CacheKey {
+    uint64_t lo{0}, hi{0};
+    [[nodiscard]] std::string hex() const;
+};
+
+/*
+ * 128 位的快速散列，每次处理 16 字节，可以分段喂入。
+ * 只用于缓存寻址，不抗刻意构造的碰撞。
+ */
+class SourceHasher {
+    uint64_t a, b;
+    uint64_t length{0};
+    unsigned char tail[16]{};
+    size_t tail_len{0};
+
+    void block(const unsigned char* p);
+public:
+    // salt 区分编译器版本和编译选项
+    explicit SourceHasher(std::string_view salt);
+    void update(std::string_view data);
+    [[nodiscard]] CacheKey finish();
+};
+
+/*
+ * 每个条目一个文件，文件名就是 key。写入先落到同目录的临时文件再 rename，
+ * 并发的 lm 进程要么看到完整的条目，要么看不到；读到损坏或格式不符的条目按未命中处理。
+ */
+class CompileCache {
+    std::filesystem::path dir;
+public:
+    // $XDG_CACHE_HOME/lamina，没有时用 ~/.cache/lamina（Windows 为 %LOCALAPPDATA%\lamina），都没有则不缓存
+    CompileCache();
+    explicit CompileCache(std::filesystem::path dir): dir(std::move(dir)) {}
+
+    [[nodiscard]] bool enabled() const { return !dir.empty(); }
+    bool load(const CacheKey& key, std::vector<lmx::runtime::Op>& ops) const;
+    bool store(const CacheKey& key, const std::vector<lmx::runtime::Op>& ops) const;
+    // 单个模块的编译产物，内容由调用方编码，这里只负责按 key 存取
+    bool load_module(const CacheKey& key, std::vector<char>& data) const;
+    bool store_module(const CacheKey& key, std::string_view data) const;
+};
+
+// 编译器版本：构建时由 CMake 写入的 git 版本加上字节码格式版本；版本不同的条目互不命中
+const char* compiler_version();
@@ -1,11 +1,29 @@
-#include "file_run.hpp"
-
-#include <string>
-#include <fstream>
-
-#include "../compiler/lexer.hpp"
-#include "../compiler/parser.hpp"
-#include "../compiler/generator/generator.hpp"
+#include "file_run.hpp"
+#include "compile_cache.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "../compiler/lexer.hpp"
+#include "../compiler/parser.hpp"
+#include "../compiler/generator/generator.hpp"
+#include "../compiler/ir/builder.hpp"
+#include "../compiler/ir/lower.hpp"
+#include "../compiler/ir/passes.hpp"
 #include "../runtime/vm.hpp"
 
 static std::string read_file(const std::string& file_name) {
@@ -13,19 +31,485 @@ static std::string read_file(const std::string& file_name) {
     return std::string(std::istreambuf_iterator(file),std::istreambuf_iterator<char>());
 }
 
-int file_run(const std::string& file_name) {
-    auto src = read_file(file_name);
-    lmx::Lexer lexer(src);
-    auto ts = lexer.tokenize(src);
-    lmx::Parser parser(ts);
+/*
+ * 源码只读映射进内存，编译过的部分按页交还给系统，巨大的脚本也不会整份常驻。
+ * 映射的是文件本身，交还后再读到这些位置（比如符号表里的名字）会重新从文件载入。
+ * 不支持 mmap 的平台整体读入字符串。
+ */
+class SourceFile {
+    std::string buffer;
+    const char* data{nullptr};
+    size_t size{0};
+    size_t released{0};
+    bool mapped{false};
+
+public:
+    explicit SourceFile(const std::string& file_name) {
+#ifndef _WIN32
+        if (const int fd = open(file_name.c_str(), O_RDONLY); fd >= 0) {
+            struct stat st{};
+            if (fstat(fd, &st) == 0 && st.st_size > 0) {
+                void* p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p != MAP_FAILED) {
+                    madvise(p, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+                    data = static_cast<const char*>(p);
+                    size = static_cast<size_t>(st.st_size);
+                    mapped = true;
+                }
+            }
+            close(fd);
+            if (mapped) return;
+        }
+#endif
+        buffer = read_file(file_name);
+        data = buffer.data();
+        size = buffer.size();
+    }
+    ~SourceFile() {
+#ifndef _WIN32
+        if (mapped) munmap(const_cast<char*>(data), size);
+#endif
+    }
+    SourceFile(const SourceFile&) = delete;
+    SourceFile& operator=(const SourceFile&) = delete;
+
+    [[nodiscard]] std::string_view view() const { return {data, size}; }
+    // 从头再读一遍之前调用，之后的 release 重新从文件开头算起
+    void rewind() { released = 0; }
+
+    // 交还 offset 之前的页，攒够一段才做一次系统调用
+    void release([[maybe_unused]] const size_t offset) {
+#ifndef _WIN32
+        constexpr size_t RELEASE_STEP = 1 << 20;
+        if (!mapped) return;
+        const auto page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        const auto upto = std::min(offset, size) / page * page;
+        if (upto < released + RELEASE_STEP) return;
+        madvise(const_cast<char*>(data) + released, upto - released, MADV_DONTNEED);
+        released = upto;
+#endif
+    }
+};
+
+namespace fs = std::filesystem;
+
+// import 写的路径相对于所在文件；找不到时报错
+static bool resolve_import(const std::string& from, const std::string_view written, std::string& out) {
+    const auto path = fs::path(from).parent_path() / fs::path(std::string(written));
+    std::error_code ec;
+    if (!fs::is_regular_file(path, ec)) {
+        std::cerr << "Error: cannot open module `" << written << "` imported from " << from << std::endl;
+        return false;
+    }
+    const auto canonical = fs::weakly_canonical(path, ec);
+    out = (ec ? path : canonical).string();
+    return true;
+}
+
+// 规范化后的路径作为模块的身份，同一个文件不管怎么写都只加载一次
+static std::string module_id(const std::string& file_name) {
+    std::error_code ec;
+    const auto canonical = fs::weakly_canonical(file_name, ec);
+    return ec ? file_name : canonical.string();
+}
+
+static void report_cycle(const std::vector<std::string>& chain, const std::string& path) {
+    std::cerr << "Error: import cycle: ";
+    for (auto it = std::ranges::find(chain, path); it != chain.end(); ++it) std::cerr << *it << " -> ";
+    std::cerr << path << std::endl;
+}
+
+/*
+ * 直接生成不分模块：遇到 import 就地生成被导入的模块，每个模块只生成一次，
+ * 函数体本来就由 JMP 跳过，所有函数共用一个命名空间。
+ */
+struct DirectImports {
+    std::unordered_map<std::string, bool> done;     // 路径 -> 是否已生成完
+    std::vector<std::string> chain;                 // 正在生成的模块，报告循环 import 用
+};
+
+// 逐条顶层语句解析并直接生成字节码，每条语句的 AST 生成完即释放
+static bool compile_direct(SourceFile& src, const std::string& path, lmx::Generator& gener, DirectImports& imports,
+                           const bool is_main) {
+    lmx::Lexer lexer(src.view());
+    lmx::Parser parser(lexer);
+    imports.chain.push_back(path);
+    while (const auto stmt = parser.next_statement()) {
+        if (parser.error()) return false;
+        if (stmt->kind == lmx::ASTKind::Import) {
+            std::string dep;
+            if (!resolve_import(path, static_cast<const lmx::ImportNode*>(stmt)->path, dep)) return false;
+            if (const auto it = imports.done.find(dep); it != imports.done.end()) {
+                if (it->second) continue;
+                report_cycle(imports.chain, dep);
+                return false;
+            }
+            imports.done.emplace(dep, false);
+            SourceFile dep_src(dep);
+            if (!compile_direct(dep_src, dep, gener, imports, false)) return false;
+            imports.done[dep] = true;
+        } else if (!is_main && stmt->kind != lmx::ASTKind::FuncDecl) {
+            std::cerr << "Error: " << path << ": only functions and imports are allowed in an imported module" << std::endl;
+            return false;
+        } else {
+            // 顶层表达式语句的结果没人用，释放它的临时寄存器
+            if (!gener.infer(stmt)) return false;
+            gener.regs.free(stmt->gen(gener));
+            if (gener.has_error()) return false;
+        }
+        src.release(lexer.offset());
+    }
+    if (parser.error()) return false;
+    imports.chain.pop_back();
+    if (is_main) gener.ops.emplace_back(lmx::runtime::Opcode::HALT);
+    return true;
+}
+
+static bool compile_direct(SourceFile& src, const std::string& path, lmx::Generator& gener, bool* has_imports = nullptr) {
+    DirectImports imports;
+    const auto ok = compile_direct(src, path, gener, imports, true);
+    if (has_imports) *has_imports = !imports.done.empty();
+    return ok;
+}
+
+static size_t direct_op_count(SourceFile& src, const std::string& path) {
+    lmx::Generator gener;
+    compile_direct(src, path, gener);
+    return gener.ops.size();
+}
+
+// 源码和编译器版本、编译选项一起散列；边散列边交还读过的页
+static CacheKey source_key(SourceFile& src, const std::string& salt) {
+    constexpr size_t CHUNK = 1 << 20;
+    SourceHasher hasher(std::string(compiler_version()) + salt);
+    const auto text = src.view();
+    for (size_t off = 0; off < text.size(); off += CHUNK) {
+        hasher.update(text.substr(off, CHUNK));
+        src.release(off + CHUNK);
+    }
+    src.rewind();
+    return hasher.finish();
+}
+
+/*
+ * 模块缓存条目的内容：import 列表（写的路径和编译时对方的接口散列）、
+ * 可重定位的字节码、重定位项、外部调用和导出表，整数都按 u64 存放。
+ */
+struct ModuleArtifact {
+    lmx::ir::ModuleCode code;
+    std::vector<std::string> imports;       // 顺序即 ExternalCall::imported
+    std::vector<uint64_t> interfaces;
+};
+
+static void put_u64(std::string& out, const uint64_t v) {
+    out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+static void put_str(std::string& out, const std::string_view s) {
+    put_u64(out, s.size());
+    out.append(s);
+}
+
+// 整数一律按 u64 存，读回时转成字段自己的类型
+template<class T>
+static bool get_u64(std::string_view& in, T& v) {
+    uint64_t u;
+    if (in.size() < sizeof(u)) return false;
+    std::memcpy(&u, in.data(), sizeof(u));
+    in.remove_prefix(sizeof(u));
+    v = static_cast<T>(u);
+    return true;
+}
+
+static bool get_str(std::string_view& in, std::string& s) {
+    size_t len;
+    if (!get_u64(in, len) || len > in.size()) return false;
+    s.assign(in.substr(0, len));
+    in.remove_prefix(len);
+    return true;
+}
+
+static std::string encode(const ModuleArtifact& a) {
+    std::string out;
+    put_u64(out, a.imports.size());
+    for (size_t i = 0; i < a.imports.size(); i++) {
+        put_str(out, a.imports[i]);
+        put_u64(out, a.interfaces[i]);
+    }
+    put_str(out, {reinterpret_cast<const char*>(a.code.ops.data()), a.code.ops.size() * sizeof(lmx::runtime::Op)});
+    put_u64(out, a.code.relocs.size());
+    for (const auto& [at, offset] : a.code.relocs) {
+        put_u64(out, at);
+        put_u64(out, offset);
+    }
+    put_u64(out, a.code.calls.size());
+    for (const auto& call : a.code.calls) {
+        put_u64(out, call.at);
+        put_u64(out, call.imported);
+        put_u64(out, call.param_count);
+        put_str(out, call.name);
+    }
+    put_u64(out, a.code.exports.size());
+    for (const auto& fn : a.code.exports) {
+        put_u64(out, fn.addr);
+        put_u64(out, fn.param_count);
+        put_str(out, fn.name);
+    }
+    return out;
+}
+
+// 下标都检查一遍，损坏的条目按未命中处理
+static bool decode(std::string_view in, ModuleArtifact& a) {
+    constexpr size_t ADDR_END = sizeof(lmx::runtime::Op::operands) - sizeof(size_t);
+    size_t n;
+    if (!get_u64(in, n) || n > in.size()) return false;
+    a.imports.resize(n);
+    a.interfaces.resize(n);
+    for (size_t i = 0; i < n; i++)
+        if (!get_str(in, a.imports[i]) || !get_u64(in, a.interfaces[i])) return false;
+
+    std::string ops;
+    if (!get_str(in, ops) || ops.size() % sizeof(lmx::runtime::Op) != 0) return false;
+    a.code.ops.assign(ops.size() / sizeof(lmx::runtime::Op), lmx::runtime::Op(lmx::runtime::Opcode::HALT));
+    std::memcpy(a.code.ops.data(), ops.data(), ops.size());
+    const auto op_count = a.code.ops.size();
+
+    if (!get_u64(in, n) || n > in.size()) return false;
+    a.code.relocs.resize(n);
+    for (auto& [at, offset] : a.code.relocs)
+        if (!get_u64(in, at) || !get_u64(in, offset) || at >= op_count || offset > ADDR_END) return false;
+    if (!get_u64(in, n) || n > in.size()) return false;
+    a.code.calls.resize(n);
+    for (auto& call : a.code.calls) {
+        if (!get_u64(in, call.at) || !get_u64(in, call.imported) || !get_u64(in, call.param_count) ||
+            !get_str(in, call.name) || call.at >= op_count || call.imported >= a.imports.size()) return false;
+    }
+    if (!get_u64(in, n) || n > in.size()) return false;
+    a.code.exports.resize(n);
+    for (auto& fn : a.code.exports)
+        if (!get_u64(in, fn.addr) || !get_u64(in, fn.param_count) || !get_str(in, fn.name) || fn.addr >= op_count) return false;
+    return in.empty();
+}
+
+// 模块的接口：导出函数的名字和参数个数。接口不变，导入它的模块就不用重新编译
+static uint64_t interface_of(const lmx::ir::ModuleCode& code) {
+    uint64_t h = 0xCBF29CE484222325ULL;
+    auto mix = [&h](const std::string_view bytes) {
+        for (const auto c : bytes) h = (h ^ static_cast<unsigned char>(c)) * 0x100000001B3ULL;
+    };
+    for (const auto& fn : code.exports) {
+        mix(fn.name);
+        mix({reinterpret_cast<const char*>(&fn.param_count), sizeof(fn.param_count)});
+    }
+    return h;
+}
+
+/*
+ * import 构成的模块图。每个模块单独经 IR 编译成可重定位的 ModuleCode，按自己的源码散列单独缓存：
+ * 改动一个模块只重新编译它自己，除非它的接口变了，那时导入它的模块也会因接口散列不符而重新编译。
+ * 所有模块就绪后按名字解析跨模块调用、拼接成一个程序，主模块在最前。
+ * 被导入的模块只能包含函数和 import，它的顶层函数对导入它的模块可见，import 不传递；循环 import 报错。
+ * 跨模块的调用不内联。
+ */
+class ModuleGraph {
+    struct Module {
+        std::string path;
+        ModuleArtifact artifact;
+        std::vector<size_t> deps;       // 各条 import 对应的模块下标
+        uint64_t interface{0};
+        bool loading{true};
+    };
+
+    const RunOptions& opts;
+    CompileCache cache;
+    bool use_cache;
+    std::vector<std::unique_ptr<Module>> modules;
+    std::unordered_map<std::string, size_t> by_path;
+    std::vector<std::string> chain;     // 正在加载的模块，报告循环 import 用
+    bool failed{false};
+    bool no_registers{false};
+
+    bool load(const std::string& path, bool is_main, size_t& index);
+    bool load_cached(Module& m, const CacheKey& key);
+    bool compile(Module& m, SourceFile& src, bool is_main);
+    bool import(const Module& m, std::string_view written, size_t& index);
+
+public:
+    explicit ModuleGraph(const RunOptions& opts)
+        : opts(opts), use_cache(opts.use_cache && !opts.dump_ir && cache.enabled()) {}
+
+    bool build(const std::string& file_name, std::vector<lmx::runtime::Op>& ops);
+    // build() 失败是因为某个模块的寄存器不够，可以退回直接生成
+    [[nodiscard]] bool out_of_registers() const { return no_registers; }
+};
+
+bool ModuleGraph::import(const Module& m, const std::string_view written, size_t& index) {
+    std::string path;
+    if (!resolve_import(m.path, written, path)) {
+        failed = true;
+        return false;
+    }
+    return load(path, false, index);
+}
+
+// 缓存的产物只有在各被导入模块的接口与编译时一致时才能用
+bool ModuleGraph::load_cached(Module& m, const CacheKey& key) {
+    std::vector<char> data;
+    if (!cache.load_module(key, data) || !decode({data.data(), data.size()}, m.artifact)) return false;
+    m.deps.clear();
+    bool fresh = true;
+    for (size_t k = 0; k < m.artifact.imports.size(); k++) {
+        size_t dep;
+        if (!import(m, m.artifact.imports[k], dep)) return false;
+        m.deps.push_back(dep);
+        fresh = fresh && modules[dep]->interface == m.artifact.interfaces[k];
+    }
+    return fresh;
+}
+
+bool ModuleGraph::compile(Module& m, SourceFile& src, const bool is_main) {
+    m.artifact = {};
+    m.deps.clear();
+    lmx::ir::IRModule mod;
+    {
+        lmx::Lexer lexer(src.view());
+        lmx::Parser parser(lexer);
+        lmx::ir::IRBuilder builder(mod);
+        builder.begin();
+        while (const auto stmt = parser.next_statement()) {
+            if (parser.error()) break;
+            if (stmt->kind == lmx::ASTKind::Import) {
+                size_t dep;
+                if (!import(m, static_cast<const lmx::ImportNode*>(stmt)->path, dep)) return false;
+                // 重复的 import 不再声明一遍
+                if (std::ranges::find(m.deps, dep) == m.deps.end()) {
+                    const auto k = static_cast<uint32_t>(m.deps.size());
+                    m.deps.push_back(dep);
+                    m.artifact.imports.emplace_back(static_cast<const lmx::ImportNode*>(stmt)->path);
+                    m.artifact.interfaces.push_back(modules[dep]->interface);
+                    // 名字指向被导入模块的导出表，模块对象在整个构建期间都在
+                    for (const auto& fn : modules[dep]->artifact.code.exports) builder.declare_external(fn.name, fn.param_count, k);
+                }
+            } else if (!is_main && stmt->kind != lmx::ASTKind::FuncDecl) {
+                std::cerr << "Error: " << m.path << ": only functions and imports are allowed in an imported module" << std::endl;
+                failed = true;
+                return false;
+            } else {
+                builder.add(stmt);
+            }
+            src.release(lexer.offset());
+        }
+        if (!builder.finish() || parser.error()) {
+            failed = true;
+            return false;
+        }
+    }
+    const auto before = lmx::ir::inst_count(mod);
+    if (opts.dump_ir) {
+        std::cout << "; ==== module " << m.path << " ====\n";
+        std::cout << "; ---- IR before optimization ----\n";
+        lmx::ir::dump(std::cout, mod);
+    }
+    // 被导入模块的函数都可能被别的模块调用
+    lmx::ir::optimize(mod, {.keep_functions = !is_main});
+    if (opts.dump_ir) {
+        std::cout << "; ---- IR after optimization ----\n";
+        lmx::ir::dump(std::cout, mod);
+    }
+    if (!lmx::ir::lower_module(mod, m.artifact.code, is_main)) {
+        no_registers = failed = true;
+        return false;
+    }
+    if (opts.dump_ir) {
+        std::cout << "; ir insts " << before << " -> " << lmx::ir::inst_count(mod) << ", bytecode ";
+        // 带 import 的模块单独直接生成不了
+        if (m.deps.empty()) {
+            src.rewind();
+            std::cout << direct_op_count(src, m.path) << " (direct) -> ";
+        }
+        std::cout << m.artifact.code.ops.size() << " (ir)\n";
+    }
+    return true;
+}
+
+bool ModuleGraph::load(const std::string& path, const bool is_main, size_t& index) {
+    const auto id = module_id(path);
+    if (const auto it = by_path.find(id); it != by_path.end()) {
+        if (modules[it->second]->loading) {
+            report_cycle(chain, id);
+            failed = true;
+            return false;
+        }
+        index = it->second;
+        return true;
+    }
+    index = modules.size();
+    by_path.emplace(id, index);
+    modules.push_back(std::make_unique<Module>());
+    auto& m = *modules.back();
+    m.path = id;
+    chain.push_back(id);
+
+    SourceFile src(path);
+    // 主模块带顶层代码，同一个文件作为主程序和被导入时产物不同
+    const auto key = source_key(src, is_main ? "/O1/main" : "/O1/module");
+    bool ok = use_cache && load_cached(m, key);
+    if (!ok && !failed) {
+        ok = compile(m, src, is_main);
+        if (ok && use_cache) cache.store_module(key, encode(m.artifact));
+    }
+    chain.pop_back();
+    m.interface = interface_of(m.artifact.code);
+    m.loading = false;
+    return ok;
+}
+
+bool ModuleGraph::build(const std::string& file_name, std::vector<lmx::runtime::Op>& ops) {
+    size_t main;
+    if (!load(file_name, true, main)) return false;
+    std::vector<const lmx::ir::ModuleCode*> code;
+    std::vector<std::vector<size_t>> imports;
+    for (const auto& m : modules) {
+        code.push_back(&m->artifact.code);
+        imports.push_back(m->deps);
+    }
+    std::string error;
+    if (!lmx::ir::link(code, imports, ops, error)) {
+        std::cerr << "Error: " << error << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int file_run(const std::string& file_name, const RunOptions& opts) {
     lmx::Generator gener;
-    auto node = parser.parse_program();
-    if (!node || parser.error()) return -1;
-    [[maybe_unused]] auto _1 = node->gen(gener);
-    gener.ops.emplace_back(lmx::runtime::Opcode::HALT);
+    if (opts.optimize) {
+        // AST -> SSA -> 优化 -> 字节码，按模块编译和缓存
+        ModuleGraph graph(opts);
+        if (!graph.build(file_name, gener.ops)) {
+            if (!graph.out_of_registers()) return -1;
+            std::cerr << "Warning: IR lowering ran out of registers, falling back to direct codegen" << std::endl;
+            gener = lmx::Generator();
+            SourceFile src(file_name);
+            if (!compile_direct(src, module_id(file_name), gener)) return -1;
+        }
+    } else if (const CompileCache cache; opts.use_cache && cache.enabled()) {
+        // 整个程序一份缓存，key 只覆盖主文件：带 import 的程序查不出依赖是否改过，不写缓存
+        SourceFile src(file_name);
+        const auto key = source_key(src, "/O0");
+        if (!cache.load(key, gener.ops)) {
+            bool has_imports;
+            if (!compile_direct(src, module_id(file_name), gener, &has_imports)) return -1;
+            // 生成出错的程序不写缓存，否则下次命中时只剩 VerifyError，看不到原来的报错
+            if (!has_imports && !gener.has_error()) cache.store(key, gener.ops);
+        }
+    } else {
+        SourceFile src(file_name);
+        if (!compile_direct(src, module_id(file_name), gener)) return -1;
+    }
     lmx::runtime::VirtualCore vm;
     vm.set_program(&gener.ops);
 
-    vm.run();
-    return 0;
+    // 校验失败或运行时出错时 run() 返回负数，退出码跟着非零
+    return vm.run() < 0 ? -1 : 0;
 }
@@ -1,4 +1,10 @@
 #pragma once
 #include <string>
 
-int file_run(const std::string& file_name);
+struct RunOptions {
+    bool dump_ir{false};    // --dump-ir: 打印优化前后的 IR 以及指令数变化
+    bool optimize{true};    // -O0: 跳过 IR 管线，直接由 AST 生成字节码
+    bool use_cache{true};   // --no-cache: 不读也不写编译缓存
+};
+
+int file_run(const std::string& file_name, const RunOptions& opts = {});
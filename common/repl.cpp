@@ -7,43 +7,80 @@
 #include "../compiler/ast.hpp"
 #include <chrono>
 
+// :stats 打印会话累计的 VM 计数，构建时关闭了 LMX_VM_STATS 则给出提示
+static void print_stats(const lmx::runtime::VMStats& s) {
+    if (!lmx::runtime::VirtualCore::stats_enabled()) {
+        std::cout << "VM statistics are disabled in this build (LMX_VM_STATS=OFF)" << std::endl;
+        return;
+    }
+    std::cout << "instructions       " << s.instructions << "\n"
+              << "calls              " << s.calls << "\n"
+              << "returns            " << s.returns << "\n"
+              << "max call depth     " << s.max_depth << "\n"
+              << "branches taken     " << s.branches_taken << "\n"
+              << "branches not taken " << s.branches_not_taken << "\n"
+              << "quickened          " << s.quickened << "\n"
+              << "deoptimized        " << s.deopts << "\n"
+              << "elapsed            " << s.elapsed_ns << "ns" << std::endl;
+}
+
 int run_repl() {
     std::string expr;
     lmx::Lexer l(expr);
     lmx::Generator gener;
     lmx::runtime::VirtualCore core;
     core.set_program(&gener.ops);
+    bool show_time = true;
 
     while (true) {
 
         std::cout << std::flush << ">>>";
         if (!std::getline(std::cin, expr)) break;
         if (expr == ":vars")
-            for (const auto& [k, v]: gener.vars) 
-            std::cout << k << " = " << core.look_register(v.second) << std::endl;
-        else if (expr == ":lastret") std::cout << core.look_register(0) << std::endl;
+            gener.each_var([&](const std::string_view name, const lmx::Generator::Var& v) {
+                const bool as_float = gener.types.global(name) == lmx::Type::Float;
+                std::cout << name << " = " << (v.in_frame() ? core.frame_string(v.slot, as_float) : core.register_string(v.reg, as_float)) << std::endl;
+            });
+        else if (expr == ":lastret") std::cout << core.register_string(0) << std::endl;
         else if (expr == ":exit") break;
-        else if (expr == ":scope") std::cout << gener.cur_scope << std::endl;
+        else if (expr == ":scope") std::cout << gener.scope_path() << std::endl;
+        else if (expr == ":stats") print_stats(core.stats());
+        else if (expr == ":stats reset") core.reset_stats();
+        else if (expr == ":time") {
+            show_time = !show_time;
+            std::cout << "timing " << (show_time ? "on" : "off") << std::endl;
+        }
         else {
+            // token 指向 expr，解析完之前不能改写它
             std::vector<lmx::Token> tks = l.tokenize(expr);
             lmx::Parser parser(tks);
             const auto node = parser.parse();
             if (!node || parser.error()) continue;
-            const auto op = node->gen(gener);
-            if (lmx::node_has_error) continue;
+            // 出错的语句生成的指令和绑定全部丢掉，下一行从这里接着生成
+            const auto cp = gener.checkpoint();
+            size_t op = 0;
+            if (gener.infer(node)) op = node->gen(gener);
+            else gener.fail();
+            if (gener.has_error()) {
+                gener.rollback(cp);
+                continue;
+            }
             gener.ops.emplace_back(lmx::runtime::Opcode::HALT);
+            core.program_changed();
 
 
-            const auto start = std::chrono::high_resolution_clock::now();
+            const auto start = std::chrono::steady_clock::now();
             core.run();
-            const auto end = std::chrono::high_resolution_clock::now();
+            const auto end = std::chrono::steady_clock::now();
 
-            const auto result = op > -1 ? core.look_register(op) : core.look_register(0);
+            // 没有值的语句（函数定义、循环、住在帧里的变量等）gen 返回 -1，这时显示 r0
+            const bool has_value = op < REG_COUNT;
+            const auto result = has_value ? core.register_string(op, lmx::value_type(node) == lmx::Type::Float) : core.register_string(0);
 
             std::cout << result << std::endl;
-            std::cout << "time " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start) << std::endl;
+            if (show_time) std::cout << "time " << std::chrono::duration_cast<std::chrono::nanoseconds>(end - start) << std::endl;
 
-            if (op > -1) gener.regs.free(op);
+            if (has_value) gener.regs.free(op);
             if (gener.ops.back().op == lmx::runtime::Opcode::HALT) gener.ops.pop_back();
         }
     }
@@ -0,0 +1,98 @@
+//
+// Bump allocator for compiler data that lives and dies together (AST nodes)
+//
+
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace lmx {
+
+/*
+ * 从大块内存里顺序切分，不支持单独释放，整体随 Arena 一起销毁。
+ * 对象的析构函数不会被调用，所以只允许放平凡析构的类型。
+ */
+class Arena {
+    static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+    struct Block {
+        std::unique_ptr<std::byte[]> data;
+        size_t size;
+    };
+    std::vector<Block> blocks;
+    uintptr_t cur{0};
+    uintptr_t end{0};
+    size_t reserved{0};
+
+    void* grow(const size_t size, const size_t align) {
+        // 超大的请求单独占一块，不浪费当前块的剩余空间
+        const auto bytes = std::max(BLOCK_SIZE, size + align);
+        blocks.push_back({std::make_unique_for_overwrite<std::byte[]>(bytes), bytes});
+        reserved += bytes;
+        const auto base = reinterpret_cast<uintptr_t>(blocks.back().data.get());
+        const auto p = (base + align - 1) & ~(align - 1);
+        if (bytes == BLOCK_SIZE) {
+            cur = p + size;
+            end = base + bytes;
+        }
+        return reinterpret_cast<void*>(p);
+    }
+
+public:
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    Arena(Arena&&) noexcept = default;
+    Arena& operator=(Arena&&) noexcept = default;
+
+    void* allocate(const size_t size, const size_t align) {
+        const auto p = (cur + align - 1) & ~(align - 1);
+        if (p + size > end) return grow(size, align);
+        cur = p + size;
+        return reinterpret_cast<void*>(p);
+    }
+
+    template<class T, class... Args>
+    T* make(Args&&... args) {
+        static_assert(std::is_trivially_destructible_v<T>, "arena objects are never destroyed");
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    // 把临时缓冲区中的元素复制进 arena，返回定长视图
+    template<class T>
+    std::span<T> copy(std::span<const T> items) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        if (items.empty()) return {};
+        const auto p = static_cast<T*>(allocate(items.size_bytes(), alignof(T)));
+        std::memcpy(p, items.data(), items.size_bytes());
+        return {p, items.size()};
+    }
+
+    // 丢弃全部对象，只留一块标准大小的内存给之后的分配复用
+    void reset() {
+        const auto keep = std::ranges::find(blocks, BLOCK_SIZE, &Block::size);
+        if (keep == blocks.end()) {
+            blocks.clear();
+            cur = end = 0;
+            reserved = 0;
+            return;
+        }
+        if (keep != blocks.begin()) std::swap(*keep, blocks.front());
+        blocks.resize(1);
+        cur = reinterpret_cast<uintptr_t>(blocks.front().data.get());
+        end = cur + BLOCK_SIZE;
+        reserved = BLOCK_SIZE;
+    }
+
+    [[nodiscard]] size_t bytes_reserved() const { return reserved; }
+};
+
+} // namespace lmx
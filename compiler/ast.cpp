@@ -2,21 +2,56 @@
 // Created by geguj on 2025/12/28.
 //
 
-#include "ast.hpp"
-#include <cmath>
-#include <iostream>
-#include <ostream>
-
-#include "generator/generator.hpp"
+#include "ast.hpp"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <iostream>
+#include <ostream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "generator/generator.hpp"
 #include "generator/emit.hpp"
 
 namespace lmx {
 
 
-void node_error(const char* msg) {
-    std::cerr << msg << std::endl;
-    node_has_error = true;
+// 按 kind 转成具体节点类型后调用 f，代替虚函数分派
+template<class F>
+static auto visit(const ASTNode* node, F&& f) {
+    using R = decltype(f(static_cast<const NumberNode*>(node)));
+    switch (node->kind) {
+    case Program:       return f(static_cast<const ProgramASTNode*>(node));
+    case Binary:        return f(static_cast<const BinaryNode*>(node));
+    case Unary:         return f(static_cast<const UnaryNode*>(node));
+    case NumLiteral:    return f(static_cast<const NumberNode*>(node));
+    case RPNExpr:       return f(static_cast<const RPNExprNode*>(node));
+    case ExprStmt:      return f(static_cast<const struct ExprStmt*>(node));
+    case BlockStmt:     return f(static_cast<const BlockStmtNode*>(node));
+    case IfStmt:        return f(static_cast<const IfStmtNode*>(node));
+    case WhileStmt:     return f(static_cast<const WhileStmtNode*>(node));
+    case ForStmt:       return f(static_cast<const ForStmtNode*>(node));
+    case VarDecl:       return f(static_cast<const VarDeclNode*>(node));
+    case VarRef:        return f(static_cast<const VarRefNode*>(node));
+    case FuncDecl:      return f(static_cast<const FuncDeclNode*>(node));
+    case FuncCallExpr:  return f(static_cast<const FuncCallExprNode*>(node));
+    case Return:        return f(static_cast<const ReturnStmtNode*>(node));
+    case Import:        return f(static_cast<const ImportNode*>(node));
+    case FloatLiteral:  return f(static_cast<const FloatNode*>(node));
+    default:            return R{};
+    }
+}
+
+int64_t ASTNode::eval() const {
+    return visit(this, [](const auto* node) { return node->eval(); });
+}
+
+size_t ASTNode::gen(Generator& gener) const {
+    return visit(this, [&gener](const auto* node) { return node->gen(gener); });
 }
+
 int64_t ProgramASTNode::eval() const {
     int64_t result = 0;
     for (const auto& child : children) {
@@ -26,7 +61,11 @@ int64_t ProgramASTNode::eval() const {
 }
 
 int64_t NumberNode::eval() const {
-    return std::stoll(num);
+    return value;
+}
+
+int64_t FloatNode::eval() const {
+    return static_cast<int64_t>(value);
 }
 
 int64_t BinaryNode::eval() const {
@@ -45,21 +84,21 @@ int64_t BinaryNode::eval() const {
             return left->eval() % right->eval();
 
         case '<': {
-            if (op[1] == '=') 
+            if (op.size() > 1 && op[1] == '=') 
                 return left->eval() <= right->eval();
             return left->eval() < right->eval();
         }
         case '>': {
-            if (op[1] == '=') 
+            if (op.size() > 1 && op[1] == '=') 
                 return left->eval() >= right->eval();
             return left->eval() > right->eval();
         }
         case '=': {
-            if (op[1] == '=') 
+            if (op.size() > 1 && op[1] == '=') 
                 return left->eval() == right->eval();
         }
         case '!': {
-            if (op[1] == '=') 
+            if (op.size() > 1 && op[1] == '=') 
                 return left->eval() != right->eval();
         }
         default: 
@@ -84,7 +123,7 @@ int64_t RPNExprNode::eval() const {
     std::vector<int64_t> stack;
     for (const auto& token : tokens) {
         if (token.type == RPNTokenType::Number) {
-            stack.push_back(std::stoll(token.text));
+            stack.push_back(std::stoll(std::string(token.text)));
         } else if (token.type == RPNTokenType::Operator) {
             int64_t b = stack.back();
             stack.pop_back();
@@ -140,143 +179,345 @@ int64_t IfStmtNode::eval() const {
 
 // -----------------------------------------------------------------------------//
 
+// 临时寄存器；全部占用时报错，不把 -1 写进操作数
+static size_t alloc_temp(Generator& gener) {
+    if (gener.regs.available() == 0) {
+        gener.error("Generate Error: expression needs more registers than the VM has");
+        return 0;
+    }
+    return gener.regs.alloc();
+}
+
+static size_t push_slot(Generator& gener) {
+    const auto slot = gener.push_slot();
+    if (slot >= Generator::MAX_SLOTS) gener.error("Generate Error: function needs more frame slots than a frame has");
+    return slot;
+}
+
+/*
+ * 先求 first 再求 second，两个结果一起用。first 的结果要等 second 整个算完才用到，
+ * 是此刻活着的值里下次使用最远的一个：寄存器紧张时先把它写进帧里，算完 second 再读回来。
+ */
+static std::pair<size_t, size_t> gen_pair(Generator& gener, const ASTNode* first, const ASTNode* second) {
+    auto lr = first->gen(gener);
+    if (!gener.regs.is_temp(lr) || gener.regs.available() >= Generator::SPILL_REGS) return {lr, second->gen(gener)};
+    const auto slot = push_slot(gener);
+    LMXOpcodeEmitter::emit_mov_mr(gener.ops, runtime::FRAME_BASE, slot, lr);
+    gener.regs.free(lr);
+    const auto rr = second->gen(gener);
+    lr = alloc_temp(gener);
+    LMXOpcodeEmitter::emit_mov_rm(gener.ops, lr, runtime::FRAME_BASE, slot);
+    gener.pop_slot();
+    return {lr, rr};
+}
+
+/*
+ * reg 里类型为 from 的值交给类型为 to 的位置：整数或 Dynamic 转成浮点写进临时寄存器；
+ * 浮点交给 Dynamic 的位置时就地打上浮点标记，标记不影响按浮点读它的指令。
+ * 浮点不会交给整数的位置，类型推导已经报过错。
+ */
+static size_t convert(Generator& gener, const size_t reg, Type from, Type to) {
+    from = concrete(from);
+    to = concrete(to);
+    if (to == Type::Float && from != Type::Float) {
+        const auto result = gener.regs.is_temp(reg) ? reg : alloc_temp(gener);
+        LMXOpcodeEmitter::emit_to_float(gener.ops, result, reg);
+        return result;
+    }
+    if (to == Type::Dynamic && from == Type::Float) LMXOpcodeEmitter::emit_box_float(gener.ops, reg);
+    return reg;
+}
+
+static Type type_of(const ASTNode* node) {
+    return static_cast<const ExprNode*>(node)->type;
+}
+
 size_t RPNExprNode::gen(Generator& gener) const {
     size_t result = 0;
     return 0;
 }
 
 size_t NumberNode::gen(Generator& gener) const {
-    const size_t result = gener.regs.alloc();
-    LMXOpcodeEmitter::emit_mov_ri(gener.ops, result, std::stoll(num));
+    const size_t result = alloc_temp(gener);
+    LMXOpcodeEmitter::emit_mov_ri(gener.ops, result, value);
+    return result;
+}
+
+size_t FloatNode::gen(Generator& gener) const {
+    const size_t result = alloc_temp(gener);
+    LMXOpcodeEmitter::emit_mov_ri(gener.ops, result, std::bit_cast<int64_t>(value));
     return result;
 }
 
 size_t UnaryNode::gen(Generator& gener) const {
-    const auto operand_reg = operand->gen(gener);
+    const auto operand_reg = convert(gener, operand->gen(gener), type_of(operand), type);
     
     switch (op[0]) {
         case '+': 
             return operand_reg;
         case '-': {
-            const size_t result = gener.regs.alloc();
+            // 0.0 的位模式也是 0
+            const size_t result = alloc_temp(gener);
             LMXOpcodeEmitter::emit_mov_ri(gener.ops, result, 0);
-            LMXOpcodeEmitter::emit_sub(gener.ops, result, result, operand_reg);
+            switch (concrete(type)) {
+            case Type::Float: LMXOpcodeEmitter::emit_fsub(gener.ops, result, result, operand_reg); break;
+            case Type::Dynamic: LMXOpcodeEmitter::emit_dsub(gener.ops, result, result, operand_reg); break;
+            default: LMXOpcodeEmitter::emit_sub(gener.ops, result, result, operand_reg); break;
+            }
             gener.regs.free(operand_reg);
             return result;
         }
         case '!': {
-            const size_t result = gener.regs.alloc();
+            const size_t result = alloc_temp(gener);
             LMXOpcodeEmitter::emit_mov_ri(gener.ops, result, 0);
             LMXOpcodeEmitter::emit_mov_rr(gener.ops, result, operand_reg);
             gener.regs.free(operand_reg);
             return result;
         }
     default:
-            node_error((std::string("unknown operator") + op).c_str());
+            gener.error(std::string("unknown operator").append(op));
             return 0;
     }
 }
 
-size_t BinaryNode::gen(Generator& gener) const {
-    const auto result = gener.regs.alloc();
-    const auto lr = left->gen(gener);
-    const auto rr = right->gen(gener);
+// 比较的两边有一边是浮点时都转成浮点比较
+static bool float_compare(const BinaryNode* node) {
+    return concrete(type_of(node->left)) == Type::Float || concrete(type_of(node->right)) == Type::Float;
+}
 
+size_t BinaryNode::gen(Generator& gener) const {
+    auto [lr, rr] = gen_pair(gener, left, right);
+    // 算术按结果类型选指令，比较按操作数类型选指令，操作数先转成同一类型
+    const bool arith = std::string_view("+-*/%^").find(op[0]) != std::string_view::npos;
+    const auto kind = arith ? concrete(type) : float_compare(this) ? Type::Float : Type::Int;
+    lr = convert(gener, lr, type_of(left), kind);
+    rr = convert(gener, rr, type_of(right), kind);
+    // 子表达式求值完之后再定结果寄存器：优先复用左右操作数的临时寄存器
+    const auto result = gener.regs.is_temp(lr) ? lr : gener.regs.is_temp(rr) ? rr : alloc_temp(gener);
+
+    using Emit = void (*)(std::vector<runtime::Op>&, uint8_t, uint8_t, uint8_t);
+    // 依次为整数、Dynamic、浮点的指令
+    const auto pick = [kind](const Emit i, const Emit d, const Emit f) {
+        return kind == Type::Float ? f : kind == Type::Dynamic ? d : i;
+    };
+    const bool eq = op.size() > 1 && op[1] == '=';
+    Emit emit = nullptr;
     switch (op[0]) {
         case '+': 
-            LMXOpcodeEmitter::emit_add(gener.ops, result, lr, rr);
+            emit = pick(LMXOpcodeEmitter::emit_add, LMXOpcodeEmitter::emit_dadd, LMXOpcodeEmitter::emit_fadd);
             break;
         case '-': 
-            LMXOpcodeEmitter::emit_sub(gener.ops, result, lr, rr);
+            emit = pick(LMXOpcodeEmitter::emit_sub, LMXOpcodeEmitter::emit_dsub, LMXOpcodeEmitter::emit_fsub);
             break;
         case '*': 
-            LMXOpcodeEmitter::emit_mul(gener.ops, result, lr, rr);
+            emit = pick(LMXOpcodeEmitter::emit_mul, LMXOpcodeEmitter::emit_dmul, LMXOpcodeEmitter::emit_fmul);
             break;
         case '/': 
-            LMXOpcodeEmitter::emit_div(gener.ops, result, lr, rr);
+            emit = pick(LMXOpcodeEmitter::emit_div, LMXOpcodeEmitter::emit_ddiv, LMXOpcodeEmitter::emit_fdiv);
             break;
         case '^': 
-            LMXOpcodeEmitter::emit_pow(gener.ops, result, lr, rr);
+            emit = LMXOpcodeEmitter::emit_pow;
             break;
         case '%': 
-            LMXOpcodeEmitter::emit_mod(gener.ops, result, lr, rr);
+            emit = pick(LMXOpcodeEmitter::emit_mod, LMXOpcodeEmitter::emit_dmod, LMXOpcodeEmitter::emit_fmod);
             break;
+        // 整数和 Dynamic 的比较是同一条指令
         case '>': {
-            if (op[1] == '=') LMXOpcodeEmitter::emit_cmp_ge(gener.ops, result, lr, rr);
-            else LMXOpcodeEmitter::emit_cmp_gt(gener.ops, result, lr, rr);
+            if (eq) emit = pick(LMXOpcodeEmitter::emit_cmp_ge, LMXOpcodeEmitter::emit_cmp_ge, LMXOpcodeEmitter::emit_fcmp_ge);
+            else emit = pick(LMXOpcodeEmitter::emit_cmp_gt, LMXOpcodeEmitter::emit_cmp_gt, LMXOpcodeEmitter::emit_fcmp_gt);
             break;
         }
         case '<': {
-            if (op[1] == '=') LMXOpcodeEmitter::emit_cmp_le(gener.ops, result, lr, rr);
-            else LMXOpcodeEmitter::emit_cmp_lt(gener.ops, result, lr, rr);
+            if (eq) emit = pick(LMXOpcodeEmitter::emit_cmp_le, LMXOpcodeEmitter::emit_cmp_le, LMXOpcodeEmitter::emit_fcmp_le);
+            else emit = pick(LMXOpcodeEmitter::emit_cmp_lt, LMXOpcodeEmitter::emit_cmp_lt, LMXOpcodeEmitter::emit_fcmp_lt);
             break;
         }
         case '=': {
-            if (op[1] == '=') LMXOpcodeEmitter::emit_cmp_eq(gener.ops, result, lr, rr);
-            else node_error((std::string("unknown operator") + op).c_str());
+            if (eq) emit = pick(LMXOpcodeEmitter::emit_cmp_eq, LMXOpcodeEmitter::emit_cmp_eq, LMXOpcodeEmitter::emit_fcmp_eq);
+            else gener.error(std::string("unknown operator").append(op));
             break;
         }
         case '!': {
-            if (op[1] == '=') LMXOpcodeEmitter::emit_cmp_ne(gener.ops, result, lr, rr);
-            else node_error((std::string("unknown operator") + op).c_str());
+            if (eq) emit = pick(LMXOpcodeEmitter::emit_cmp_ne, LMXOpcodeEmitter::emit_cmp_ne, LMXOpcodeEmitter::emit_fcmp_ne);
+            else gener.error(std::string("unknown operator").append(op));
             break;
         }
         default: {
-            node_error((std::string("unknown operator") + op).c_str());
+            gener.error(std::string("unknown operator").append(op));
             break;
         }
     }
-    if (left->kind != ASTKind::VarDecl && left->kind != ASTKind::VarRef)
-        gener.regs.free(lr);
-    if (right->kind != ASTKind::VarDecl && right->kind != ASTKind::VarRef)
-        gener.regs.free(rr);
+    if (emit) emit(gener.ops, result, lr, rr);
+    if (lr != result) gener.regs.free(lr);
+    if (rr != result) gener.regs.free(rr);
     return result;
 }
 
 size_t VarDeclNode::gen(Generator& gener) const {
-    if (const auto it = gener.vars.find(gener.make_scope(name)); it != gener.vars.end() && !it->second.first) {
-        node_error(std::string("Generate Error: the var `" + name + "` not mutable").c_str());
+    if (const auto var = gener.find_var(name); var && !var->is_mut) {
+        gener.error("Generate Error: the var `" + std::string(name) + "` not mutable");
         return -1;
     }
-    auto result = value->gen(gener);
-    gener.vars[gener.make_scope(name)] = std::pair(is_mut, result);
+    auto result = convert(gener, value->gen(gener), value->type, type);
+    if (const auto var = gener.find_var(name)) {
+        var->is_mut = is_mut;
+        if (var->in_frame()) {
+            LMXOpcodeEmitter::emit_mov_mr(gener.ops, runtime::FRAME_BASE, var->slot, result);
+            gener.regs.free(result);
+            return -1;
+        }
+        // 重新赋值写回原寄存器，分支和循环汇合处变量的位置才一致
+        const auto home = var->reg;
+        if (result != home) {
+            LMXOpcodeEmitter::emit_mov_rr(gener.ops, home, result);
+            gener.regs.free(result);
+        }
+        return home;
+    }
+    // 变量的位置在第一次绑定时定下，之后不再改变
+    if (gener.wants_frame(name)) {
+        const auto slot = push_slot(gener);
+        LMXOpcodeEmitter::emit_mov_mr(gener.ops, runtime::FRAME_BASE, slot, result);
+        gener.regs.free(result);
+        gener.bind_var(name, is_mut, Generator::IN_FRAME, slot);
+        return -1;
+    }
+    if (!gener.regs.is_temp(result)) {
+        // 结果是别的变量的寄存器，复制一份，避免两个变量共用
+        const auto copy = alloc_temp(gener);
+        LMXOpcodeEmitter::emit_mov_rr(gener.ops, copy, result);
+        result = copy;
+    }
+    gener.regs.pin(result);
+    gener.bind_var(name, is_mut, result);
     return result;
 }
 
 size_t VarRefNode::gen(Generator& gener) const {
-    const auto it = gener.vars.find(gener.make_scope(name));
-    if (it == gener.vars.end()) {
-        node_error(std::string("Generate Error: undefined var `" + name + "`").c_str());
+    const auto var = gener.find_var(name);
+    if (!var) {
+        gener.error("Generate Error: undefined var `" + std::string(name) + "`");
         return -1;
     }
-    return it->second.second;
+    if (var->in_frame()) {
+        const auto reg = alloc_temp(gener);
+        LMXOpcodeEmitter::emit_mov_rm(gener.ops, reg, runtime::FRAME_BASE, var->slot);
+        return reg;
+    }
+    return var->reg;
 }
 
-size_t FuncCallExprNode::gen(Generator& gener) const {
-    const auto it1 = gener.funcs.find(gener.make_scope(name));
-    const auto it2 = gener.funcs.find(gener.last_scope + '@' + name);
+// 单独一段源码没有所在目录，也没有别的模块可链接
+size_t ImportNode::gen(Generator& gener) const {
+    gener.error("Generate Error: import `" + std::string(path) + "` is only supported when running a file");
+    return -1;
+}
 
-    auto it = it1;
-    if (it1 == gener.funcs.end()) {
-        if (it2 == gener.funcs.end()) {
-            std::cerr << "Generate Error: undefined function `" << name << "`" << std::endl;
-            return -1;
+// 内置函数直接生成对应的 map 指令，不走调用约定
+static size_t gen_builtin(Generator& gener, const FuncCallExprNode* call) {
+    const auto& args = call->args;
+    switch (call->builtin) {
+    case Builtin::MapNew: {
+        const auto result = alloc_temp(gener);
+        LMXOpcodeEmitter::emit_map_new(gener.ops, result);
+        return result;
+    }
+    case Builtin::MapLen: {
+        const auto map = args[0]->gen(gener);
+        const auto result = gener.regs.is_temp(map) ? map : alloc_temp(gener);
+        LMXOpcodeEmitter::emit_map_len(gener.ops, result, map);
+        return result;
+    }
+    case Builtin::MapGet:
+    case Builtin::MapDel: {
+        const auto [map, key] = gen_pair(gener, args[0], args[1]);
+        const auto result = gener.regs.is_temp(map) ? map : gener.regs.is_temp(key) ? key : alloc_temp(gener);
+        if (call->builtin == Builtin::MapGet) LMXOpcodeEmitter::emit_map_get(gener.ops, result, map, key);
+        else LMXOpcodeEmitter::emit_map_del(gener.ops, result, map, key);
+        if (map != result) gener.regs.free(map);
+        if (key != result) gener.regs.free(key);
+        return result;
+    }
+    case Builtin::MapSet: {
+        const auto [map, key] = gen_pair(gener, args[0], args[1]);
+        const auto value = args[2]->gen(gener);
+        LMXOpcodeEmitter::emit_map_set(gener.ops, map, key, value);
+        gener.regs.free(map);
+        gener.regs.free(key);
+        return value;
+    }
+    default: return 0;
+    }
+}
+
+size_t FuncCallExprNode::gen(Generator& gener) const {
+    if (builtin != Builtin::None) return gen_builtin(gener, this);
+    const auto func = gener.find_func(name);
+    if (!func) {
+        gener.error("Generate Error: undefined function `" + std::string(name) + "`");
+        return -1;
+    }
+    const auto addr = func->addr;
+    // 先求出全部实参，再写传参寄存器，避免覆盖还要读取的参数。
+    // 寄存器紧张时已求出的实参先写进帧里（记为 IN_FRAME），传参时直接读进传参寄存器
+    const auto spill_mark = gener.frame_size();
+    std::vector<size_t> arg_regs, arg_slots(args.size());
+    for (size_t i = 0; i < args.size(); i++) {
+        auto reg = convert(gener, args[i]->gen(gener), args[i]->type, i < params.size() ? params[i] : Type::Int);
+        if (i + 1 < args.size() && gener.regs.is_temp(reg) && gener.regs.available() < Generator::SPILL_REGS) {
+            arg_slots[i] = push_slot(gener);
+            LMXOpcodeEmitter::emit_mov_mr(gener.ops, runtime::FRAME_BASE, arg_slots[i], reg);
+            gener.regs.free(reg);
+            reg = Generator::IN_FRAME;
         }
-        it = it2;
+        arg_regs.push_back(reg);
     }
-    size_t i = REG_COUNT - 1;
-    for (const auto& arg : args) {
-        const auto re = arg->gen(gener);
-        LMXOpcodeEmitter::emit_mov_rr(gener.ops, i--, re);
-        gener.regs.free(re);
+    for (size_t i = 1; i < arg_regs.size(); i++) {
+        if (arg_regs[i] <= REG_COUNT - 1 - i || arg_regs[i] >= REG_COUNT) continue;
+        // 该寄存器会被前面的实参覆盖
+        const auto tmp = alloc_temp(gener);
+        LMXOpcodeEmitter::emit_mov_rr(gener.ops, tmp, arg_regs[i]);
+        gener.regs.free(arg_regs[i]);
+        arg_regs[i] = tmp;
     }
-    
-    LMXOpcodeEmitter::emit_fcall(gener.ops, it->second.second);
-    return 0;  // 返回值存储在寄存器0中
+
+    // 调用者保存：被调用者与调用者共用寄存器，仍在使用、且会被传参或被调用者改写的寄存器写入本帧已用槽位之后
+    auto clobbers = gener.clobbers(addr);
+    for (size_t i = 0; i < args.size(); i++) clobbers.set(REG_COUNT - 1 - i);
+    std::vector<uint8_t> saves;
+    for (size_t r = 1; r < REG_COUNT; r++) {
+        if (clobbers.test(r) && gener.regs.in_use(r) &&
+            (!gener.regs.is_temp(r) || std::ranges::find(arg_regs, r) == arg_regs.end()))
+            saves.push_back(r);
+    }
+    const auto base = gener.frame_size();
+    if (base + saves.size() > Generator::MAX_SLOTS)
+        gener.error("Generate Error: call to `" + std::string(name) + "` needs more frame slots than a frame has");
+    for (size_t k = 0; k < saves.size(); k++)
+        LMXOpcodeEmitter::emit_mov_mr(gener.ops, runtime::FRAME_BASE, base + k, saves[k]);
+
+    for (size_t i = 0; i < arg_regs.size(); i++) {
+        if (arg_regs[i] == Generator::IN_FRAME) continue;
+        LMXOpcodeEmitter::emit_mov_rr(gener.ops, REG_COUNT - 1 - i, arg_regs[i]);
+        gener.regs.free(arg_regs[i]);
+    }
+    for (size_t i = 0; i < arg_regs.size(); i++) {
+        if (arg_regs[i] == Generator::IN_FRAME)
+            LMXOpcodeEmitter::emit_mov_rm(gener.ops, REG_COUNT - 1 - i, runtime::FRAME_BASE, arg_slots[i]);
+    }
+    LMXOpcodeEmitter::emit_fcall(gener.ops, addr, base + saves.size());
+
+    // 返回值在寄存器0中，后续调用会覆盖它，所以转存到临时寄存器
+    const auto result = alloc_temp(gener);
+    LMXOpcodeEmitter::emit_mov_rr(gener.ops, result, 0);
+    for (size_t k = 0; k < saves.size(); k++)
+        LMXOpcodeEmitter::emit_mov_rm(gener.ops, saves[k], runtime::FRAME_BASE, base + k);
+    while (gener.frame_size() > spill_mark) gener.pop_slot();
+    return result;
 }
 
 size_t ReturnStmtNode::gen(Generator& gener) const {
-    const auto re = expr->gen(gener);
+    const auto re = convert(gener, expr->gen(gener), expr->type, type);
     LMXOpcodeEmitter::emit_mov_rr(gener.ops, 0, re);
     gener.regs.free(re);
     LMXOpcodeEmitter::emit_fret(gener.ops);
@@ -284,12 +525,207 @@ size_t ReturnStmtNode::gen(Generator& gener) const {
 }
 
 size_t BlockStmtNode::gen(Generator& gener) const {
+    // 表达式语句的结果没人用，临时寄存器随即释放；变量的寄存器被绑定，不会释放
     for (const auto& child : children) {
-        child->gen(gener);
+        gener.regs.free(child->gen(gener));
+        gener.release_after(child);
     }
     return gener.ops.size();
 }
 
+/*
+ * 大函数的帧变量规划。按生成顺序给函数体的节点编号，记下每个局部变量的声明位置、
+ * 每次使用的位置和权重（循环里的按层数加权），以及它活到哪条语句之后：
+ * 最后一次使用所在的语句；循环外声明、循环里使用的变量每轮回到开头还要用，活到这样的最外层循环结束。
+ * 只数声明时 full 为 false，小函数据此跳过细看。
+ */
+class LiveScan {
+public:
+    static constexpr size_t NONE = SIZE_MAX;
+    static constexpr size_t LOOP_WEIGHT = 8, MAX_LOOPS = 4;
+
+    struct Local {
+        std::string_view name;
+        size_t first;
+        size_t last_stmt{NONE};                         // stmts 的下标
+        std::vector<std::pair<size_t, double>> uses;    // 位置和权重，按位置递增
+        bool counter{false};                            // for 的循环变量
+    };
+    struct Stmt {
+        const ASTNode* node;
+        size_t begin, end{NONE};
+    };
+
+    std::vector<Local> locals;
+    std::vector<Stmt> stmts;
+    size_t decls{0};
+
+    LiveScan(Generator& gener, const bool full): gener(gener), full(full) {}
+
+    void scan(const BlockStmtNode* body) { visit(body); }
+    [[nodiscard]] size_t end_of(const Local& local) const { return stmts[local.last_stmt].end; }
+
+private:
+    Generator& gener;
+    bool full;
+    size_t pos{0};
+    std::unordered_map<std::string_view, size_t> index;
+    std::vector<size_t> open, loops;    // 正在访问的语句和其中的循环，stmts 的下标
+
+    void stmt(const ASTNode* node) {
+        if (full) {
+            stmts.push_back({node, pos});
+            open.push_back(stmts.size() - 1);
+        }
+        visit(node);
+        if (full) {
+            stmts[open.back()].end = pos;
+            open.pop_back();
+        }
+    }
+
+    void visit(const ASTNode* node) {
+        if (!node) return;
+        pos++;
+        switch (node->kind) {
+        case ExprStmt: visit(static_cast<const struct ExprStmt*>(node)->hs); break;
+        case BlockStmt:
+            for (const auto child : static_cast<const BlockStmtNode*>(node)->children) stmt(child);
+            break;
+        case IfStmt: {
+            const auto n = static_cast<const IfStmtNode*>(node);
+            visit(n->condition);
+            visit(n->thenBlock);
+            visit(n->elseBlock);
+            break;
+        }
+        case WhileStmt:
+            // 条件生成在循环体之后
+            if (full) loops.push_back(open.back());
+            visit(static_cast<const WhileStmtNode*>(node)->body);
+            visit(static_cast<const WhileStmtNode*>(node)->condition);
+            if (full) loops.pop_back();
+            break;
+        case ForStmt: {
+            const auto n = static_cast<const ForStmtNode*>(node);
+            visit(n->start);
+            declare(n->var, true);
+            visit(n->end);
+            if (full) loops.push_back(open.back());
+            visit(n->body);
+            if (full) loops.pop_back();
+            break;
+        }
+        case VarDecl:
+            visit(static_cast<const VarDeclNode*>(node)->value);
+            declare(static_cast<const VarDeclNode*>(node)->name, false);
+            break;
+        case VarRef:
+            if (full) {
+                if (const auto it = index.find(static_cast<const VarRefNode*>(node)->name); it != index.end())
+                    use(locals[it->second]);
+            }
+            break;
+        case FuncCallExpr:
+            for (const auto arg : static_cast<const FuncCallExprNode*>(node)->args) visit(arg);
+            break;
+        case Return: visit(static_cast<const ReturnStmtNode*>(node)->expr); break;
+        case Binary:
+            visit(static_cast<const BinaryNode*>(node)->left);
+            visit(static_cast<const BinaryNode*>(node)->right);
+            break;
+        case Unary: visit(static_cast<const UnaryNode*>(node)->operand); break;
+        default: break;     // 嵌套函数有自己的规划
+        }
+    }
+
+    void declare(const std::string_view name, const bool counter) {
+        decls++;
+        if (!full) return;
+        auto it = index.find(name);
+        if (it == index.end()) {
+            // 参数已经绑定在寄存器里
+            if (gener.find_var(name)) return;
+            it = index.emplace(name, locals.size()).first;
+            locals.push_back({name, pos});
+        }
+        locals[it->second].counter |= counter;
+        use(locals[it->second]);
+    }
+
+    void use(Local& local) {
+        double weight = 1;
+        for (size_t i = 0; i < std::min(loops.size(), MAX_LOOPS); i++) weight *= LOOP_WEIGHT;
+        local.uses.emplace_back(pos, weight);
+        auto last = open.back();
+        for (const auto loop : loops) {
+            if (stmts[loop].begin > local.first) {
+                last = loop;
+                break;
+            }
+        }
+        // 之前记下的语句还没结束就包含了这一条，结束得更晚
+        if (local.last_stmt == NONE || stmts[local.last_stmt].end != NONE) local.last_stmt = last;
+    }
+};
+
+/*
+ * 函数开头决定哪些局部变量住进帧里、寄存器变量用完之后在哪条语句后释放。
+ * 按声明顺序扫过活跃区间，同时活着的寄存器变量超过预算时，挑下次使用最远、
+ * 剩下的加权使用最少的那个进帧：它每次读写多一次访存，但隔得最远、用得最少，总代价最小。
+ * for 的循环变量每轮都用，留在寄存器里。寄存器放得下全部局部变量的小函数什么也不做。
+ */
+static void plan_frame_homes(Generator& gener, const BlockStmtNode* body) {
+    const auto available = gener.regs.available();
+    const auto budget = available > Generator::RESERVED_REGS ? available - Generator::RESERVED_REGS : 0;
+    // 声明数是局部变量数的上界
+    LiveScan count(gener, false);
+    count.scan(body);
+    if (count.decls <= budget) return;
+
+    LiveScan live(gener, true);
+    live.scan(body);
+    const auto& locals = live.locals;
+    // 变量在位置 at 之后下次使用的距离，除以剩下的加权使用次数
+    const auto cost = [&](const LiveScan::Local& local, const size_t at) {
+        const auto next = std::ranges::upper_bound(local.uses, at, {}, &std::pair<size_t, double>::first);
+        if (next == local.uses.end()) {
+            // 只因为所在的循环还要回到开头才活着
+            double total = 0;
+            for (const auto& [_, w] : local.uses) total += w;
+            return static_cast<double>(live.end_of(local) - at) / total;
+        }
+        double rest = 0;
+        for (auto it = next; it != local.uses.end(); ++it) rest += it->second;
+        return static_cast<double>(next->first - at) / rest;
+    };
+
+    std::vector<bool> in_frame(locals.size());
+    std::vector<size_t> active;
+    for (size_t i = 0; i < locals.size(); i++) {
+        const auto at = locals[i].first;
+        std::erase_if(active, [&](const size_t a) { return live.end_of(locals[a]) < at; });
+        active.push_back(i);
+        if (active.size() <= budget) continue;
+        size_t victim = LiveScan::NONE;
+        double worst = -1;
+        for (const auto a : active) {
+            if (locals[a].counter) continue;
+            if (const auto c = cost(locals[a], at); c > worst) {
+                worst = c;
+                victim = a;
+            }
+        }
+        if (victim == LiveScan::NONE) continue;
+        in_frame[victim] = true;
+        std::erase(active, victim);
+    }
+    for (size_t i = 0; i < locals.size(); i++) {
+        if (in_frame[i]) gener.plan_in_frame(locals[i].name);
+        else gener.plan_release(live.stmts[locals[i].last_stmt].node, locals[i].name);
+    }
+}
+
 size_t FuncDeclNode::gen(Generator& gener) const {
     LMXOpcodeEmitter::emit_jmp(gener.ops, 0); // 暂时填零
     auto jump_point = gener.ops.size() - 1;
@@ -298,48 +734,50 @@ size_t FuncDeclNode::gen(Generator& gener) const {
         函数加载逻辑即jmp跳过函数体
     */
     
-    const auto it = gener.funcs.find(gener.make_scope(name));
-    if (it != gener.funcs.end()) {
-        std::cerr << "Generate Error: redefined function `" << name << "`" << std::endl;
+    // 记录函数地址和参数数量，函数名属于外层作用域，函数体内可以递归调用
+    if (!gener.declare_func(name, args.size(), jump_point + 1)) {
+        gener.error("Generate Error: redefined function `" + std::string(name) + "`");
         return -1;
     } // 检查是否重定义 
-    
-    const auto copy_scope = gener.last_scope;
-    gener.new_scope(name); // 新建函数作用域
 
-    // 记录函数地址和参数数量
-    gener.funcs[gener.cur_scope] = std::make_pair(args.size(), jump_point + 1);
-    
+    const Generator::ScopeFrame frame(gener, name); // 新建函数作用域，返回时离开
+
     // 记录参数寄存器
     size_t i = REG_COUNT - 1;
     for (const auto& ps : args) {
-        gener.regs.alloc(i);
-        gener.vars[gener.make_scope(ps)] = std::make_pair(true, i--);
+        gener.regs.pin(i);
+        gener.bind_var(ps, true, i--);
     }
+    plan_frame_homes(gener, body);
 
     // 生成函数体
     const auto jump_pos = body->gen(gener) + 1; // block->gen()返回size
-    if (node_has_error)return -1;
 
     LMXOpcodeEmitter::emit_fret(gener.ops);
 
     // 填充跳转位置
     memcpy(gener.ops[jump_point].operands, &jump_pos, sizeof(size_t));
+    if (gener.has_error()) return -1;
+    gener.finish_func(jump_point + 1, gener.ops.size());
 
-    // 恢复参数寄存器
-    i = REG_COUNT - 1;
-    for (const auto& ps : args) {
-        gener.vars.erase(gener.make_scope(ps));
-        gener.regs.free(i--);
-    }
-    
-    // 恢复作用域
-    gener.free_scope(copy_scope);
+    // 离开作用域时释放参数与局部变量占用的寄存器
     return -1;  
 }
 
+// 条件的值：浮点先和 0.0 比较，整数和 Dynamic 直接交给 IF_TRUE
+static size_t gen_condition(Generator& gener, const ExprNode* condition) {
+    const auto reg = condition->gen(gener);
+    if (concrete(condition->type) != Type::Float) return reg;
+    const auto zero = alloc_temp(gener);
+    LMXOpcodeEmitter::emit_mov_ri(gener.ops, zero, 0);
+    const auto result = gener.regs.is_temp(reg) ? reg : zero;
+    LMXOpcodeEmitter::emit_fcmp_ne(gener.ops, result, reg, zero);
+    if (result != zero) gener.regs.free(zero);
+    return result;
+}
+
 size_t IfStmtNode::gen(Generator& gener) const {
-    const auto cond_reg = condition->gen(gener);
+    const auto cond_reg = gen_condition(gener, condition);
     LMXOpcodeEmitter::emit_if_true(gener.ops, cond_reg, 0); // 后续填充
     gener.regs.free(cond_reg);
     auto point1 = gener.ops.size() - 1;
@@ -350,13 +788,137 @@ size_t IfStmtNode::gen(Generator& gener) const {
     memcpy(gener.ops[point1].operands + 1, &addr1, sizeof(size_t));
 
     auto addr2 = thenBlock->gen(gener) ;
+    if (elseBlock) {
+        // then 分支结束后跳过 else 分支
+        LMXOpcodeEmitter::emit_jmp(gener.ops, 0);   //后续填充
+        const auto point3 = gener.ops.size() - 1;
+        addr2 = point3 + 1;
+        const auto addr3 = elseBlock->gen(gener);
+        memcpy(gener.ops[point3].operands, &addr3, sizeof(size_t));
+    }
     memcpy(gener.ops[point2].operands, &addr2, sizeof(size_t));
 
     return -1;
 }
 
+// 条件成立时跳到 target：整数和 Dynamic 的比较表达式直接生成比较跳转指令
+static void gen_branch_if(Generator& gener, const ExprNode* condition, const size_t target) {
+    if (condition->kind == ASTKind::Binary && !float_compare(static_cast<const BinaryNode*>(condition))) {
+        const auto bin = static_cast<const BinaryNode*>(condition);
+        const auto& op = bin->op;
+        const bool eq = op.size() > 1 && op.size() > 1 && op[1] == '=';
+        using Branch = void (*)(std::vector<runtime::Op>&, uint8_t, uint8_t, uint64_t);
+        Branch branch = nullptr;
+        switch (op[0]) {
+        case '<': branch = eq ? LMXOpcodeEmitter::emit_ble : LMXOpcodeEmitter::emit_blt; break;
+        case '>': branch = eq ? LMXOpcodeEmitter::emit_bge : LMXOpcodeEmitter::emit_bgt; break;
+        case '=': if (eq) branch = LMXOpcodeEmitter::emit_beq; break;
+        case '!': if (eq) branch = LMXOpcodeEmitter::emit_bne; break;
+        default: break;
+        }
+        if (branch) {
+            const auto [lr, rr] = gen_pair(gener, bin->left, bin->right);
+            branch(gener.ops, lr, rr, target);
+            gener.regs.free(lr);
+            gener.regs.free(rr);
+            return;
+        }
+    }
+    const auto cond_reg = gen_condition(gener, condition);
+    LMXOpcodeEmitter::emit_if_true(gener.ops, cond_reg, target);
+    gener.regs.free(cond_reg);
+}
+
+size_t WhileStmtNode::gen(Generator& gener) const {
+    // 条件放在循环体之后，每轮只需一次比较跳转
+    LMXOpcodeEmitter::emit_jmp(gener.ops, 0);   //后续填充
+    const auto entry = gener.ops.size() - 1;
+    const auto body_addr = gener.ops.size();
+    const auto cond_addr = body->gen(gener);
+    memcpy(gener.ops[entry].operands, &cond_addr, sizeof(size_t));
+    gen_branch_if(gener, condition, body_addr);
+    return -1;
+}
+
+size_t ForStmtNode::gen(Generator& gener) const {
+    if (const auto v = gener.find_var(var); v && !v->is_mut) {
+        gener.error("Generate Error: the var `" + std::string(var) + "` not mutable");
+        return -1;
+    }
+    const auto start_reg = start->gen(gener);
+    size_t counter;
+    // 循环变量住在帧里时，循环在寄存器副本上计数：每轮开头写回变量，回边前读回循环体里的赋值
+    bool in_frame = false;
+    size_t slot = 0;
+    if (const auto v = gener.find_var(var); v && v->in_frame()) {
+        in_frame = true;
+        slot = v->slot;
+    } else if (v) {
+        counter = v->reg;
+        if (counter != start_reg) LMXOpcodeEmitter::emit_mov_rr(gener.ops, counter, start_reg);
+        gener.regs.free(start_reg);
+    } else if (gener.wants_frame(var)) {
+        in_frame = true;
+        slot = push_slot(gener);
+        gener.bind_var(var, true, Generator::IN_FRAME, slot);
+    } else {
+        counter = start_reg;
+        if (!gener.regs.is_temp(counter)) {
+            counter = alloc_temp(gener);
+            LMXOpcodeEmitter::emit_mov_rr(gener.ops, counter, start_reg);
+        }
+        gener.regs.pin(counter);
+        gener.bind_var(var, true, counter);
+    }
+    if (in_frame) {
+        counter = start_reg;
+        if (!gener.regs.is_temp(counter)) {
+            counter = alloc_temp(gener);
+            LMXOpcodeEmitter::emit_mov_rr(gener.ops, counter, start_reg);
+        }
+        gener.regs.pin(counter);
+    }
+
+    // 上界只求值一次，放进循环体写不到的寄存器
+    auto limit = end->gen(gener);
+    if (!gener.regs.is_temp(limit)) {
+        const auto copy = alloc_temp(gener);
+        LMXOpcodeEmitter::emit_mov_rr(gener.ops, copy, limit);
+        limit = copy;
+    }
+    gener.regs.pin(limit);
+
+    LMXOpcodeEmitter::emit_bge(gener.ops, counter, limit, 0);  //后续填充
+    const auto guard = gener.ops.size() - 1;
+    const auto body_addr = gener.ops.size();
+    if (in_frame) LMXOpcodeEmitter::emit_mov_mr(gener.ops, runtime::FRAME_BASE, slot, counter);
+    auto latch = body->gen(gener);
+    if (in_frame) {
+        LMXOpcodeEmitter::emit_mov_rm(gener.ops, counter, runtime::FRAME_BASE, slot);
+        latch = gener.ops.size();
+    }
+    LMXOpcodeEmitter::emit_loop_lt(gener.ops, counter, limit, body_addr);
+    const auto exit_addr = latch + 1;
+    memcpy(gener.ops[guard].operands + 2, &exit_addr, sizeof(size_t));
+
+    if (in_frame) {
+        // 出口处变量取循环结束时的值；一轮都没有执行时就是起点
+        LMXOpcodeEmitter::emit_mov_mr(gener.ops, runtime::FRAME_BASE, slot, counter);
+        gener.regs.unpin(counter);
+        gener.regs.free(counter);
+    }
+    gener.regs.unpin(limit);
+    gener.regs.free(limit);
+    return -1;
+}
+
 size_t ProgramASTNode::gen(Generator &gener) const {
+    // 类型逐条推导，推导的结果只在这条语句生成完之前有效
     for (const auto& child : children) {
+        if (!gener.infer(child)) {
+            gener.fail();
+            continue;
+        }
         child->gen(gener);
     }
     return 0;
@@ -4,21 +4,21 @@
 
 #pragma once
 #include <cstdint>
-#include <memory>
-#include <vector>
+#include <span>
 #include <string>
+#include <string_view>
 
 #include "../include/lmx_export.hpp"
+#include "types.hpp"
 
 // Forward declarations to avoid circular dependencies
 namespace lmx {
     class Generator;
-    enum class TokenType;
+    enum class TokenType : uint8_t;
     struct Token;
 }
 
 namespace lmx {
-static bool node_has_error = false;
 enum ASTKind {
     Program,
     Binary, Unary, NumLiteral, StringLiteral, Ident, BoolLiteral,
@@ -26,21 +26,30 @@ enum ASTKind {
     ExprStmt,
     BlockStmt,
     IfStmt,
+    WhileStmt,
+    ForStmt,
     VarDecl,
     VarRef,
     FuncDecl,
     FuncCallExpr,
     Return,
+    Import,
+    FloatLiteral,
 };
 
+/*
+ * 节点由 Parser 在 Arena 中分配，随 Parser 一起释放；子节点列表是 arena 中的定长数组。
+ * 名字和运算符是指向源码的视图，源码在 AST 用完之前不能改写。
+ * 节点没有虚表，eval/gen 按 kind 分派到具体节点的同名函数。
+ * 各节点上的类型由 TypeInfer 在生成代码之前写入。
+ */
 struct LMC_API ASTNode {
     ASTKind kind;
     
-    virtual ~ASTNode() = default;
     explicit ASTNode(ASTKind kind) : kind(kind) {}
     
-    [[nodiscard]] virtual int64_t eval() const = 0;
-    virtual size_t gen(Generator& gener) const = 0;
+    [[nodiscard]] int64_t eval() const;
+    size_t gen(Generator& gener) const;
 };
 
 struct TypeNode {
@@ -53,187 +62,259 @@ struct TypeNode {
 };
 
 struct LMC_API ProgramASTNode final : public ASTNode {
-    std::vector<std::shared_ptr<ASTNode>> children;
+    std::span<ASTNode* const> children;
     
     explicit ProgramASTNode(
-        std::vector<std::shared_ptr<ASTNode>> children
+        std::span<ASTNode* const> children
     ) : ASTNode(Program),
-        children(std::move(children)) {}
+        children(children) {}
     
-    [[nodiscard]] int64_t eval() const override;
-    [[nodiscard]] size_t gen(Generator& gener) const override;
+    [[nodiscard]] int64_t eval() const;
+    [[nodiscard]] size_t gen(Generator& gener) const;
 };
 
 struct StmtNode : public ASTNode {
     explicit StmtNode(ASTKind kind) : ASTNode(kind) {}
-    
-    ~StmtNode() override = default;
-    virtual int64_t eval() const = 0;
-    virtual size_t gen(Generator& gener) const = 0;
 };
 
 struct ExprNode : public ASTNode {
+    Type type{Type::Unknown};   // 表达式的值的类型
     explicit ExprNode(ASTKind kind) : ASTNode(kind) {}
-    
-    ~ExprNode() override = default;
-    virtual int64_t eval() const override = 0;
-    virtual size_t gen(Generator& gener) const override = 0;
 };
 
 struct ExprStmt final : public StmtNode {
-    std::shared_ptr<ExprNode> hs;
+    ExprNode* hs;
     
-    explicit ExprStmt(std::shared_ptr<ExprNode> hs) 
+    explicit ExprStmt(ExprNode* hs) 
         : StmtNode(ASTKind::ExprStmt), 
-          hs(std::move(hs)) {}
+          hs(hs) {}
     
-    [[nodiscard]] int64_t eval() const override;
-    [[nodiscard]] size_t gen(Generator& gener) const override;
+    [[nodiscard]] int64_t eval() const { return hs->eval(); }
+    [[nodiscard]] size_t gen(Generator& gener) const { return hs->gen(gener); }
 };
 
 struct BlockStmtNode final : public StmtNode {
-    std::vector<std::shared_ptr<ASTNode>> children;
+    std::span<ASTNode* const> children;
     
-    explicit BlockStmtNode(std::vector<std::shared_ptr<ASTNode>> children) 
+    explicit BlockStmtNode(std::span<ASTNode* const> children) 
         : StmtNode(ASTKind::BlockStmt), 
-          children(std::move(children)) {}
+          children(children) {}
     
-    [[nodiscard]] int64_t eval() const override { return 0; }
-    [[nodiscard]] size_t gen(Generator& gener) const override;
+    [[nodiscard]] int64_t eval() const { return 0; }
+    [[nodiscard]] size_t gen(Generator& gener) const;
 };
 
 struct IfStmtNode : public StmtNode {
-    std::shared_ptr<ExprNode> condition;
-    std::shared_ptr<BlockStmtNode> thenBlock;
-    std::shared_ptr<BlockStmtNode> elseBlock;
+    ExprNode* condition;
+    BlockStmtNode* thenBlock;
+    BlockStmtNode* elseBlock;
     
     explicit IfStmtNode(
-        std::shared_ptr<ExprNode> condition,
-        std::shared_ptr<BlockStmtNode> thenBlock,
-        std::shared_ptr<BlockStmtNode> elseBlock
+        ExprNode* condition,
+        BlockStmtNode* thenBlock,
+        BlockStmtNode* elseBlock
     ) : StmtNode(ASTKind::IfStmt),
-        condition(std::move(condition)),
-        thenBlock(std::move(thenBlock)),
-        elseBlock(std::move(elseBlock)) {}
+        condition(condition),
+        thenBlock(thenBlock),
+        elseBlock(elseBlock) {}
     
-    [[nodiscard]] int64_t eval() const override;
-    [[nodiscard]] size_t gen(Generator& gener) const override;
+    [[nodiscard]] int64_t eval() const;
+    [[nodiscard]] size_t gen(Generator& gener) const;
+};
+
+struct WhileStmtNode final : public StmtNode {
+    ExprNode* condition;
+    BlockStmtNode* body;
+
+    explicit WhileStmtNode(
+        ExprNode* condition,
+        BlockStmtNode* body
+    ) : StmtNode(ASTKind::WhileStmt),
+        condition(condition),
+        body(body) {}
+
+    [[nodiscard]] int64_t eval() const { return 0; }
+    [[nodiscard]] size_t gen(Generator& gener) const;
+};
+
+// for (var in start..end) {...}，var 依次取 [start, end)，end 只求值一次
+struct ForStmtNode final : public StmtNode {
+    std::string_view var;
+    ExprNode* start;
+    ExprNode* end;
+    BlockStmtNode* body;
+    Type type{Type::Unknown};   // 循环变量的类型，Int 或 Dynamic
+
+    explicit ForStmtNode(
+        std::string_view var,
+        ExprNode* start,
+        ExprNode* end,
+        BlockStmtNode* body
+    ) : StmtNode(ASTKind::ForStmt),
+        var(var),
+        start(start),
+        end(end),
+        body(body) {}
+
+    [[nodiscard]] int64_t eval() const { return 0; }
+    [[nodiscard]] size_t gen(Generator& gener) const;
 };
 
 struct FuncDeclNode final : public ASTNode {
-    std::string name;
-    std::vector<std::string> args;
-    std::shared_ptr<BlockStmtNode> body;
+    std::string_view name;
+    std::span<const std::string_view> args;
+    BlockStmtNode* body;
+    Type ret{Type::Unknown};
+    std::span<const Type> params;
     
     explicit FuncDeclNode(
-        std::string name,
-        std::vector<std::string> args,
-        std::shared_ptr<BlockStmtNode> body
+        std::string_view name,
+        std::span<const std::string_view> args,
+        BlockStmtNode* body
     ) : ASTNode(ASTKind::FuncDecl),
-        name(std::move(name)), 
-        args(std::move(args)), 
-        body(std::move(body)) {}
+        name(name), 
+        args(args), 
+        body(body) {}
     
-    [[nodiscard]] int64_t eval() const override { return 0; }
-    [[nodiscard]] size_t gen(Generator& gener) const override;
+    [[nodiscard]] int64_t eval() const { return 0; }
+    [[nodiscard]] size_t gen(Generator& gener) const;
 };
 
 struct ReturnStmtNode final : public StmtNode {
-    std::shared_ptr<ExprNode> expr;
+    ExprNode* expr;
+    Type type{Type::Unknown};   // 所在函数的返回类型，expr 的值按它转换
     
-    explicit ReturnStmtNode(std::shared_ptr<ExprNode> expr) 
+    explicit ReturnStmtNode(ExprNode* expr) 
         : StmtNode(ASTKind::Return), 
-          expr(std::move(expr)) {}
+          expr(expr) {}
     
-    [[nodiscard]] int64_t eval() const override { return 0; }
-    [[nodiscard]] size_t gen(Generator& gener) const override;
+    [[nodiscard]] int64_t eval() const { return 0; }
+    [[nodiscard]] size_t gen(Generator& gener) const;
+};
+
+// import "path"：只能出现在顶层，路径相对于所在文件，由运行文件的驱动按模块图处理
+struct ImportNode final : public StmtNode {
+    std::string_view path;
+
+    explicit ImportNode(std::string_view path)
+        : StmtNode(ASTKind::Import),
+          path(path) {}
+
+    [[nodiscard]] int64_t eval() const { return 0; }
+    [[nodiscard]] size_t gen(Generator& gener) const;
+};
+
+// 内置函数，由 Parser 按名字和语法识别；参数个数在解析时已检查过
+enum class Builtin : uint8_t {
+    None,
+    MapNew,     // map()
+    MapGet,     // m[k]，键不存在时为 0
+    MapSet,     // m[k] = v，值为 v
+    MapDel,     // del(m, k)，删除了为 1
+    MapLen,     // len(m)
 };
 
 struct FuncCallExprNode final : public ExprNode {
-    std::string name;
-    std::vector<std::shared_ptr<ExprNode>> args;
+    std::string_view name;
+    std::span<ExprNode* const> args;
+    Builtin builtin;
+    std::span<const Type> params;   // 被调函数的参数类型，实参按它转换；内置函数为空
     
     FuncCallExprNode(
-        std::string name,
-        std::vector<std::shared_ptr<ExprNode>> args
+        std::string_view name,
+        std::span<ExprNode* const> args,
+        Builtin builtin = Builtin::None
     ) : ExprNode(ASTKind::FuncCallExpr), 
-        name(std::move(name)), 
-        args(std::move(args)) {}
+        name(name), 
+        args(args),
+        builtin(builtin) {}
     
-    [[nodiscard]] int64_t eval() const override { return 0; }
-    [[nodiscard]] size_t gen(Generator& gener) const override;
+    [[nodiscard]] int64_t eval() const { return 0; }
+    [[nodiscard]] size_t gen(Generator& gener) const;
 };
 
 struct VarDeclNode final : public ASTNode {
-    std::string name;
-    std::shared_ptr<ExprNode> value;
+    std::string_view name;
+    ExprNode* value;
     bool is_mut;
+    Type type{Type::Unknown};   // 变量的类型，value 按它转换
     
     explicit VarDeclNode(
-        std::string name,
-        std::shared_ptr<ExprNode> value,
+        std::string_view name,
+        ExprNode* value,
         bool is_mut = true
     ) : ASTNode(VarDecl), 
-        name(std::move(name)), 
-        value(std::move(value)), 
+        name(name), 
+        value(value), 
         is_mut(is_mut) {}
     
-    [[nodiscard]] int64_t eval() const override;
-    [[nodiscard]] size_t gen(Generator& gener) const override;
+    [[nodiscard]] int64_t eval() const;
+    [[nodiscard]] size_t gen(Generator& gener) const;
 };
 
 struct VarRefNode final : public ExprNode {
-    std::string name;
+    std::string_view name;
     
-    explicit VarRefNode(std::string name) 
+    explicit VarRefNode(std::string_view name) 
         : ExprNode(ASTKind::VarRef), 
-          name(std::move(name)) {}
+          name(name) {}
     
-    [[nodiscard]] int64_t eval() const override;
-    [[nodiscard]] size_t gen(Generator& gener) const override;
+    [[nodiscard]] int64_t eval() const;
+    [[nodiscard]] size_t gen(Generator& gener) const;
 };
 
 struct NumberNode final : public ExprNode {
-    std::string num;
+    int64_t value;
     
-    explicit NumberNode(std::string num) 
+    explicit NumberNode(const int64_t value) 
         : ExprNode(ASTKind::NumLiteral), 
-          num(std::move(num)) {}
+          value(value) {}
     
-    ~NumberNode() override = default;
-    [[nodiscard]] int64_t eval() const override;
-    [[nodiscard]] size_t gen(Generator& gener) const override;
+    [[nodiscard]] int64_t eval() const;
+    [[nodiscard]] size_t gen(Generator& gener) const;
+};
+
+struct FloatNode final : public ExprNode {
+    double value;
+
+    explicit FloatNode(const double value)
+        : ExprNode(ASTKind::FloatLiteral),
+          value(value) {}
+
+    // 按整数求值时截断
+    [[nodiscard]] int64_t eval() const;
+    [[nodiscard]] size_t gen(Generator& gener) const;
 };
 
 struct BinaryNode final : public ExprNode {
-    std::shared_ptr<ASTNode> left;
-    std::shared_ptr<ASTNode> right;
-    std::string op;
+    ASTNode* left;
+    ASTNode* right;
+    std::string_view op;
     
     BinaryNode(
-        std::shared_ptr<ASTNode> left,
-        std::shared_ptr<ASTNode> right,
-        std::string op
+        ASTNode* left,
+        ASTNode* right,
+        std::string_view op
     ) : ExprNode(ASTKind::Binary), 
-        left(std::move(left)), 
-        right(std::move(right)), 
-        op(std::move(op)) {}
+        left(left), 
+        right(right), 
+        op(op) {}
     
-    [[nodiscard]] int64_t eval() const override;
-    [[nodiscard]] size_t gen(Generator& gener) const override;
+    [[nodiscard]] int64_t eval() const;
+    [[nodiscard]] size_t gen(Generator& gener) const;
 };
 
 struct UnaryNode final : public ExprNode {
-    std::string op;
-    std::shared_ptr<ASTNode> operand;
+    std::string_view op;
+    ASTNode* operand;
     
-    explicit UnaryNode(std::string op, std::shared_ptr<ASTNode> operand) 
+    explicit UnaryNode(std::string_view op, ASTNode* operand) 
         : ExprNode(ASTKind::Unary), 
-          op(std::move(op)), 
-          operand(std::move(operand)) {}
+          op(op), 
+          operand(operand) {}
     
-    [[nodiscard]] int64_t eval() const override;
-    [[nodiscard]] size_t gen(Generator& gener) const override;
+    [[nodiscard]] int64_t eval() const;
+    [[nodiscard]] size_t gen(Generator& gener) const;
 };
 
 struct RPNExprNode final : public ExprNode {
@@ -244,17 +325,17 @@ struct RPNExprNode final : public ExprNode {
     
     struct RPNToken {
         RPNTokenType type;
-        std::string text;
+        std::string_view text;
     };
     
-    std::vector<RPNToken> tokens;
+    std::span<const RPNToken> tokens;
     
-    explicit RPNExprNode(std::vector<RPNToken> tokens) 
+    explicit RPNExprNode(std::span<const RPNToken> tokens) 
         : ExprNode(ASTKind::RPNExpr), 
-          tokens(std::move(tokens)) {}
+          tokens(tokens) {}
     
-    [[nodiscard]] int64_t eval() const override;
-    [[nodiscard]] size_t gen(Generator& gener) const override;
+    [[nodiscard]] int64_t eval() const;
+    [[nodiscard]] size_t gen(Generator& gener) const;
 };
 
 } // namespace lmx
@@ -12,6 +12,11 @@ void LMXOpcodeEmitter::write_imm(uint8_t *dst, int64_t imm) {
     memcpy(dst, &imm, sizeof(imm));
 }
 
+void LMXOpcodeEmitter::write_mem(uint8_t *dst, uint8_t base, uint16_t offset) {
+    dst[0] = base;
+    memcpy(dst + 2, &offset, sizeof(offset));
+}
+
 template<class... Args>
  void LMXOpcodeEmitter::write_regs(uint8_t *dst, Args... args) {
     ((*dst++ = std::forward<Args>(args)), ...);
@@ -28,6 +33,43 @@ void LMXOpcodeEmitter::emit_mov_rr(std::vector<lmx::runtime::Op> &ops, uint8_t r
     op.operands[1] = r2;
     ops.push_back(op);
 }
+void LMXOpcodeEmitter::emit_mov_rm(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint16_t offest) {
+    lmx::runtime::Op op(lmx::runtime::Opcode::MOV_RM);
+    op.operands[0] = r1;
+    op.operands[1] = r2;
+    memcpy(op.operands + 2, &offest, sizeof(offest));
+    ops.push_back(op);
+}
+void LMXOpcodeEmitter::emit_mov_rc(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint64_t idx) {
+    lmx::runtime::Op op(lmx::runtime::Opcode::MOV_RC);
+    op.operands[0] = r1;
+    write_imm(op.operands + 1, std::bit_cast<int64_t>(idx));
+    ops.push_back(op);
+}
+void LMXOpcodeEmitter::emit_mov_mi(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint16_t offest1, int64_t imm) {
+    lmx::runtime::Op op(lmx::runtime::Opcode::MOV_MI);
+    write_mem(op.operands, r1, offest1);
+    write_imm(op.operands + 4, imm);
+    ops.push_back(op);
+}
+void LMXOpcodeEmitter::emit_mov_mr(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint16_t offest1, uint8_t r2) {
+    lmx::runtime::Op op(lmx::runtime::Opcode::MOV_MR);
+    write_mem(op.operands, r1, offest1);
+    op.operands[4] = r2;
+    ops.push_back(op);
+}
+void LMXOpcodeEmitter::emit_mov_mm(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint16_t offest1, uint8_t r2, uint16_t offest2) {
+    lmx::runtime::Op op(lmx::runtime::Opcode::MOV_MM);
+    write_mem(op.operands, r1, offest1);
+    write_mem(op.operands + 4, r2, offest2);
+    ops.push_back(op);
+}
+void LMXOpcodeEmitter::emit_mov_mc(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint16_t offest1, uint64_t idx) {
+    lmx::runtime::Op op(lmx::runtime::Opcode::MOV_MC);
+    write_mem(op.operands, r1, offest1);
+    write_imm(op.operands + 4, std::bit_cast<int64_t>(idx));
+    ops.push_back(op);
+}
 void LMXOpcodeEmitter::emit_div(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint8_t r3) {
     lmx::runtime::Op op(lmx::runtime::Opcode::DIV);
     write_regs(op.operands, r1, r2, r3);
@@ -58,9 +100,10 @@ void LMXOpcodeEmitter::emit_pow(std::vector<lmx::runtime::Op> &ops, uint8_t r1,
     write_regs(op.operands, r1, r2, r3);
     ops.push_back(op);
 }
-void LMXOpcodeEmitter::emit_fcall(std::vector<lmx::runtime::Op> &ops, uint64_t idx) {
+void LMXOpcodeEmitter::emit_fcall(std::vector<lmx::runtime::Op> &ops, uint64_t idx, uint16_t frame_size) {
     lmx::runtime::Op op(lmx::runtime::Opcode::FCALL);
     write_imm(op.operands, std::bit_cast<int64_t>(idx));
+    memcpy(op.operands + 8, &frame_size, sizeof(frame_size));
     ops.push_back(op);
 }
 void LMXOpcodeEmitter::emit_halt(std::vector<lmx::runtime::Op> &ops) {
@@ -71,9 +114,10 @@ void LMXOpcodeEmitter::emit_fret(std::vector<lmx::runtime::Op> &ops) {
     lmx::runtime::Op op(lmx::runtime::Opcode::FRET);
     ops.push_back(op);
 }
-void LMXOpcodeEmitter::emit_debug_log(std::vector<lmx::runtime::Op> &ops, uint64_t idx) {
+void LMXOpcodeEmitter::emit_debug_log(std::vector<lmx::runtime::Op> &ops, uint64_t idx, uint8_t payload) {
     lmx::runtime::Op op(lmx::runtime::Opcode::DEBUG_LOG);
     write_imm(op.operands, std::bit_cast<int64_t>(idx));
+    op.operands[8] = payload;
     ops.push_back(op);
 }
 
@@ -132,6 +176,193 @@ void LMXOpcodeEmitter::emit_if_false(std::vector<lmx::runtime::Op> &ops, uint8_t
     write_imm(op.operands + 1, std::bit_cast<int64_t>(idx));
     ops.push_back(op);
 }
+
+void LMXOpcodeEmitter::emit_blt(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint64_t idx) {
+    lmx::runtime::Op op(lmx::runtime::Opcode::BLT);
+    write_regs(op.operands, r1, r2);
+    write_imm(op.operands + 2, std::bit_cast<int64_t>(idx));
+    ops.push_back(op);
+}
+
+void LMXOpcodeEmitter::emit_ble(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint64_t idx) {
+    lmx::runtime::Op op(lmx::runtime::Opcode::BLE);
+    write_regs(op.operands, r1, r2);
+    write_imm(op.operands + 2, std::bit_cast<int64_t>(idx));
+    ops.push_back(op);
+}
+
+void LMXOpcodeEmitter::emit_bgt(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint64_t idx) {
+    lmx::runtime::Op op(lmx::runtime::Opcode::BGT);
+    write_regs(op.operands, r1, r2);
+    write_imm(op.operands + 2, std::bit_cast<int64_t>(idx));
+    ops.push_back(op);
+}
+
+void LMXOpcodeEmitter::emit_bge(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint64_t idx) {
+    lmx::runtime::Op op(lmx::runtime::Opcode::BGE);
+    write_regs(op.operands, r1, r2);
+    write_imm(op.operands + 2, std::bit_cast<int64_t>(idx));
+    ops.push_back(op);
+}
+
+void LMXOpcodeEmitter::emit_beq(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint64_t idx) {
+    lmx::runtime::Op op(lmx::runtime::Opcode::BEQ);
+    write_regs(op.operands, r1, r2);
+    write_imm(op.operands + 2, std::bit_cast<int64_t>(idx));
+    ops.push_back(op);
+}
+
+void LMXOpcodeEmitter::emit_bne(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint64_t idx) {
+    lmx::runtime::Op op(lmx::runtime::Opcode::BNE);
+    write_regs(op.operands, r1, r2);
+    write_imm(op.operands + 2, std::bit_cast<int64_t>(idx));
+    ops.push_back(op);
+}
+
+void LMXOpcodeEmitter::emit_loop_lt(std::vector<lmx::runtime::Op> &ops, uint8_t counter, uint8_t limit, uint64_t idx) {
+    lmx::runtime::Op op(lmx::runtime::Opcode::LOOP_LT);
+    write_regs(op.operands, counter, limit);
+    write_imm(op.operands + 2, std::bit_cast<int64_t>(idx));
+    ops.push_back(op);
+}
+
+void LMXOpcodeEmitter::emit_map_new(std::vector<lmx::runtime::Op> &ops, uint8_t dst) {
+    lmx::runtime::Op op(lmx::runtime::Opcode::MAP_NEW);
+    op.operands[0] = dst;
+    ops.push_back(op);
+}
+
+void LMXOpcodeEmitter::emit_map_get(std::vector<lmx::runtime::Op> &ops, uint8_t dst, uint8_t map, uint8_t key) {
+    lmx::runtime::Op op(lmx::runtime::Opcode::MAP_GET);
+    write_regs(op.operands, dst, map, key);
+    ops.push_back(op);
+}
+
+void LMXOpcodeEmitter::emit_map_set(std::vector<lmx::runtime::Op> &ops, uint8_t map, uint8_t key, uint8_t value) {
+    lmx::runtime::Op op(lmx::runtime::Opcode::MAP_SET);
+    write_regs(op.operands, map, key, value);
+    ops.push_back(op);
+}
+
+void LMXOpcodeEmitter::emit_map_del(std::vector<lmx::runtime::Op> &ops, uint8_t dst, uint8_t map, uint8_t key) {
+    lmx::runtime::Op op(lmx::runtime::Opcode::MAP_DEL);
+    write_regs(op.operands, dst, map, key);
+    ops.push_back(op);
+}
+
+void LMXOpcodeEmitter::emit_map_len(std::vector<lmx::runtime::Op> &ops, uint8_t dst, uint8_t map) {
+    lmx::runtime::Op op(lmx::runtime::Opcode::MAP_LEN);
+    write_regs(op.operands, dst, map);
+    ops.push_back(op);
+}
+
+void LMXOpcodeEmitter::emit_fadd(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint8_t r3) {
+    lmx::runtime::Op op(lmx::runtime::Opcode::FADD);
+    write_regs(op.operands, r1, r2, r3);
+    ops.push_back(op);
+}
+
+void LMXOpcodeEmitter::emit_fsub(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint8_t r3) {
+    lmx::runtime::Op op(lmx::runtime::Opcode::FSUB);
+    write_regs(op.operands, r1, r2, r3);
+    ops.push_back(op);
+}
+
+void LMXOpcodeEmitter::emit_fmul(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint8_t r3) {
+    lmx::runtime::Op op(lmx::runtime::Opcode::FMUL);
+    write_regs(op.operands, r1, r2, r3);
+    ops.push_back(op);
+}
+
+void LMXOpcodeEmitter::emit_fdiv(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint8_t r3) {
+    lmx::runtime::Op op(lmx::runtime::Opcode::FDIV);
+    write_regs(op.operands, r1, r2, r3);
+    ops.push_back(op);
+}
+
+void LMXOpcodeEmitter::emit_fmod(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint8_t r3) {
+    lmx::runtime::Op op(lmx::runtime::Opcode::FMOD);
+    write_regs(op.operands, r1, r2, r3);
+    ops.push_back(op);
+}
+
+void LMXOpcodeEmitter::emit_fcmp_gt(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint8_t r3) {
+    lmx::runtime::Op op(lmx::runtime::Opcode::FCMP_GT);
+    write_regs(op.operands, r1, r2, r3);
+    ops.push_back(op);
+}
+
+void LMXOpcodeEmitter::emit_fcmp_ge(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint8_t r3) {
+    lmx::runtime::Op op(lmx::runtime::Opcode::FCMP_GE);
+    write_regs(op.operands, r1, r2, r3);
+    ops.push_back(op);
+}
+
+void LMXOpcodeEmitter::emit_fcmp_lt(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint8_t r3) {
+    lmx::runtime::Op op(lmx::runtime::Opcode::FCMP_LT);
+    write_regs(op.operands, r1, r2, r3);
+    ops.push_back(op);
+}
+
+void LMXOpcodeEmitter::emit_fcmp_le(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint8_t r3) {
+    lmx::runtime::Op op(lmx::runtime::Opcode::FCMP_LE);
+    write_regs(op.operands, r1, r2, r3);
+    ops.push_back(op);
+}
+
+void LMXOpcodeEmitter::emit_fcmp_eq(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint8_t r3) {
+    lmx::runtime::Op op(lmx::runtime::Opcode::FCMP_EQ);
+    write_regs(op.operands, r1, r2, r3);
+    ops.push_back(op);
+}
+
+void LMXOpcodeEmitter::emit_fcmp_ne(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint8_t r3) {
+    lmx::runtime::Op op(lmx::runtime::Opcode::FCMP_NE);
+    write_regs(op.operands, r1, r2, r3);
+    ops.push_back(op);
+}
+
+void LMXOpcodeEmitter::emit_dadd(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint8_t r3) {
+    lmx::runtime::Op op(lmx::runtime::Opcode::DADD);
+    write_regs(op.operands, r1, r2, r3);
+    ops.push_back(op);
+}
+
+void LMXOpcodeEmitter::emit_dsub(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint8_t r3) {
+    lmx::runtime::Op op(lmx::runtime::Opcode::DSUB);
+    write_regs(op.operands, r1, r2, r3);
+    ops.push_back(op);
+}
+
+void LMXOpcodeEmitter::emit_dmul(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint8_t r3) {
+    lmx::runtime::Op op(lmx::runtime::Opcode::DMUL);
+    write_regs(op.operands, r1, r2, r3);
+    ops.push_back(op);
+}
+
+void LMXOpcodeEmitter::emit_ddiv(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint8_t r3) {
+    lmx::runtime::Op op(lmx::runtime::Opcode::DDIV);
+    write_regs(op.operands, r1, r2, r3);
+    ops.push_back(op);
+}
+
+void LMXOpcodeEmitter::emit_dmod(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint8_t r3) {
+    lmx::runtime::Op op(lmx::runtime::Opcode::DMOD);
+    write_regs(op.operands, r1, r2, r3);
+    ops.push_back(op);
+}
+
+void LMXOpcodeEmitter::emit_to_float(std::vector<lmx::runtime::Op> &ops, uint8_t dst, uint8_t src) {
+    lmx::runtime::Op op(lmx::runtime::Opcode::TO_FLOAT);
+    write_regs(op.operands, dst, src);
+    ops.push_back(op);
+}
+
+void LMXOpcodeEmitter::emit_box_float(std::vector<lmx::runtime::Op> &ops, uint8_t r) {
+    lmx::runtime::Op op(lmx::runtime::Opcode::BOX_FLOAT);
+    op.operands[0] = r;
+    ops.push_back(op);
+}
 } // namespace lmx
 
 
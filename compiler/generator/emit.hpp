@@ -14,18 +14,20 @@ namespace lmx {
 
 class LMXOpcodeEmitter {
     static void write_imm(uint8_t* dst, int64_t imm);
+    // M 操作数：基址寄存器在 dst[0]，两字节偏移在 dst[2]
+    static void write_mem(uint8_t* dst, uint8_t base, uint16_t offset);
     template<class... Args>
     static void write_regs(uint8_t* dst, Args... args);
     public:
     static void emit_mov_ri(std::vector<lmx::runtime::Op>& ops, uint8_t r1, int64_t imm);
     static void emit_mov_rr(std::vector<lmx::runtime::Op>& ops, uint8_t r1, uint8_t r2);
-    static void emit_mov_rm(std::vector<lmx::runtime::Op>& ops, uint8_t r1, uint8_t r2, int8_t offest);
+    static void emit_mov_rm(std::vector<lmx::runtime::Op>& ops, uint8_t r1, uint8_t r2, uint16_t offest);
     static void emit_mov_rc(std::vector<lmx::runtime::Op>& ops, uint8_t r1, uint64_t idx);
 
-    static void emit_mov_mi(std::vector<lmx::runtime::Op>& ops, uint8_t r1, int8_t offest1, int64_t imm);
-    static void emit_mov_mr(std::vector<lmx::runtime::Op>& ops, uint8_t r1, int8_t offest1, uint8_t r2);
-    static void emit_mov_mm(std::vector<lmx::runtime::Op>& ops, uint8_t r1, int8_t offest1, uint8_t r2, int8_t offest2);
-    static void emit_mov_mc(std::vector<lmx::runtime::Op>& ops, uint8_t r1, int8_t offest1, uint64_t idx);
+    static void emit_mov_mi(std::vector<lmx::runtime::Op>& ops, uint8_t r1, uint16_t offest1, int64_t imm);
+    static void emit_mov_mr(std::vector<lmx::runtime::Op>& ops, uint8_t r1, uint16_t offest1, uint8_t r2);
+    static void emit_mov_mm(std::vector<lmx::runtime::Op>& ops, uint8_t r1, uint16_t offest1, uint8_t r2, uint16_t offest2);
+    static void emit_mov_mc(std::vector<lmx::runtime::Op>& ops, uint8_t r1, uint16_t offest1, uint64_t idx);
 
     static void emit_add(std::vector<lmx::runtime::Op>& ops, uint8_t r1, uint8_t r2, uint8_t r3);
     static void emit_sub(std::vector<lmx::runtime::Op>& ops, uint8_t r1, uint8_t r2, uint8_t r3);
@@ -35,10 +37,10 @@ class LMXOpcodeEmitter {
     static void emit_pow(std::vector<lmx::runtime::Op>& ops, uint8_t r1, uint8_t r2, uint8_t r3);
 
     static void emit_halt (std::vector<lmx::runtime::Op>& ops);
-    static void emit_fcall(std::vector<lmx::runtime::Op>& ops, uint64_t idx);
+    static void emit_fcall(std::vector<lmx::runtime::Op>& ops, uint64_t idx, uint16_t frame_size = 0);
     static void emit_fret (std::vector<lmx::runtime::Op>& ops);
 
-    static void emit_debug_log(std::vector<lmx::runtime::Op> &ops, uint64_t idx);
+    static void emit_debug_log(std::vector<lmx::runtime::Op> &ops, uint64_t idx, uint8_t payload = lmx::runtime::LOG_NO_PAYLOAD);
 
     static void emit_jmp(std::vector<lmx::runtime::Op> &ops, uint64_t idx);
 
@@ -52,8 +54,45 @@ class LMXOpcodeEmitter {
     static void emit_if_true(std::vector<lmx::runtime::Op> &ops, uint8_t r, uint64_t idx);
 
     static void emit_if_false(std::vector<lmx::runtime::Op> &ops, uint8_t r, uint64_t idx);
+
+    static void emit_blt(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint64_t idx);
+    static void emit_ble(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint64_t idx);
+    static void emit_bgt(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint64_t idx);
+    static void emit_bge(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint64_t idx);
+    static void emit_beq(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint64_t idx);
+    static void emit_bne(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint64_t idx);
+
+    static void emit_loop_lt(std::vector<lmx::runtime::Op> &ops, uint8_t counter, uint8_t limit, uint64_t idx);
+
+    static void emit_map_new(std::vector<lmx::runtime::Op> &ops, uint8_t dst);
+    static void emit_map_get(std::vector<lmx::runtime::Op> &ops, uint8_t dst, uint8_t map, uint8_t key);
+    static void emit_map_set(std::vector<lmx::runtime::Op> &ops, uint8_t map, uint8_t key, uint8_t value);
+    static void emit_map_del(std::vector<lmx::runtime::Op> &ops, uint8_t dst, uint8_t map, uint8_t key);
+    static void emit_map_len(std::vector<lmx::runtime::Op> &ops, uint8_t dst, uint8_t map);
+
+    static void emit_fadd(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint8_t r3);
+    static void emit_fsub(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint8_t r3);
+    static void emit_fmul(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint8_t r3);
+    static void emit_fdiv(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint8_t r3);
+    static void emit_fmod(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint8_t r3);
+
+    static void emit_fcmp_gt(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint8_t r3);
+    static void emit_fcmp_ge(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint8_t r3);
+    static void emit_fcmp_lt(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint8_t r3);
+    static void emit_fcmp_le(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint8_t r3);
+    static void emit_fcmp_eq(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint8_t r3);
+    static void emit_fcmp_ne(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint8_t r3);
+
+    static void emit_dadd(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint8_t r3);
+    static void emit_dsub(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint8_t r3);
+    static void emit_dmul(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint8_t r3);
+    static void emit_ddiv(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint8_t r3);
+    static void emit_dmod(std::vector<lmx::runtime::Op> &ops, uint8_t r1, uint8_t r2, uint8_t r3);
+
+    static void emit_to_float(std::vector<lmx::runtime::Op> &ops, uint8_t dst, uint8_t src);
+    static void emit_box_float(std::vector<lmx::runtime::Op> &ops, uint8_t r);
 };
 
 } // namespace lmx
 
-#endif //LMX_EMIT_HPP
\ No newline at end of file
+#endif //LMX_EMIT_HPP
\ No newline at end of file
@@ -3,10 +3,14 @@
 //
 
 #include "generator.hpp"
+#include <algorithm>
 #include <bitset>
+#include <cstring>
+#include <iostream>
 #include <unordered_map>
 #include <vector>
 
+#include "emit.hpp"
 #include "../../include/opcode.hpp"
 
 namespace lmx {
@@ -32,11 +36,25 @@ size_t Allocator::alloc(size_t i) {
 }
 
 void Allocator::free(size_t i) {
-    if (i > 0 && bitset.test(i)) {
+    if (i > 0 && i < REG_COUNT && bitset.test(i) && !pins[i]) {
         bitset.reset(i);
     }
 }
 
+void Allocator::pin(size_t i) {
+    if (i >= REG_COUNT) return;
+    bitset.set(i);
+    pins[i]++;
+}
+
+void Allocator::unpin(size_t i) {
+    if (i < REG_COUNT && pins[i]) pins[i]--;
+}
+
+bool Allocator::is_temp(size_t i) const {
+    return i > 0 && i < REG_COUNT && bitset.test(i) && !pins[i];
+}
+
 bool Allocator::is_free(size_t i) {
     return bitset.test(i);
 }
@@ -45,18 +63,213 @@ void Generator::write(runtime::Op& op) {
     ops.push_back(op);
 }
 
-void Generator::new_scope(const std::string& new_scope) {
-    last_scope = cur_scope;
-    cur_scope = make_scope(new_scope);
+SymbolId SymbolTable::intern(const std::string_view name) {
+    if (const auto it = ids.find(name); it != ids.end()) return it->second;
+    const auto id = static_cast<SymbolId>(names.size());
+    ids.emplace(names.emplace_back(name), id);
+    return id;
+}
+
+SymbolId SymbolTable::find(const std::string_view name) const {
+    const auto it = ids.find(name);
+    return it == ids.end() ? NONE : it->second;
+}
+
+Generator::Generator() {
+    enter_scope("global");
+}
+
+bool Generator::infer(ASTNode* stmt) {
+    if (!types.infer(stmt)) return false;
+    for (const auto& name : types.widened()) {
+        const auto var = find_var(name);
+        if (!var) continue;
+        if (!var->in_frame()) {
+            LMXOpcodeEmitter::emit_to_float(ops, var->reg, var->reg);
+            continue;
+        }
+        if (regs.available() == 0) {
+            error("Generate Error: no register left to convert `" + name + "` to a float");
+            return false;
+        }
+        const auto reg = regs.alloc();
+        LMXOpcodeEmitter::emit_mov_rm(ops, reg, runtime::FRAME_BASE, var->slot);
+        LMXOpcodeEmitter::emit_to_float(ops, reg, reg);
+        LMXOpcodeEmitter::emit_mov_mr(ops, runtime::FRAME_BASE, var->slot, reg);
+        regs.free(reg);
+    }
+    return true;
+}
+
+SymbolId Generator::intern(const std::string_view name) {
+    const auto id = symbols.intern(name);
+    if (id >= var_head.size()) {
+        var_head.resize(symbols.size(), UNBOUND);
+        func_head.resize(symbols.size(), UNBOUND);
+    }
+    return id;
+}
+
+Generator::Var* Generator::find_var(const std::string_view name) {
+    const auto sym = symbols.find(name);
+    if (sym == SymbolTable::NONE) return nullptr;
+    const auto b = var_head[sym];
+    return b != UNBOUND && var_stack[b].depth == depth() ? &var_stack[b].value : nullptr;
+}
+
+void Generator::bind_var(const std::string_view name, const bool is_mut, const size_t reg, const uint16_t slot) {
+    const auto sym = intern(name);
+    if (const auto b = var_head[sym]; b != UNBOUND && var_stack[b].depth == depth()) {
+        var_stack[b].value = {is_mut, reg, slot};
+        return;
+    }
+    var_stack.push_back({{is_mut, reg, slot}, sym, var_head[sym], depth()});
+    var_head[sym] = static_cast<uint32_t>(var_stack.size() - 1);
+}
+
+const Generator::Func* Generator::find_func(const std::string_view name) const {
+    const auto sym = symbols.find(name);
+    if (sym == SymbolTable::NONE || func_head[sym] == UNBOUND) return nullptr;
+    return &func_stack[func_head[sym]].value;
+}
+
+bool Generator::declare_func(const std::string_view name, const size_t arg_count, const size_t addr) {
+    const auto sym = intern(name);
+    if (const auto b = func_head[sym]; b != UNBOUND && func_stack[b].depth == depth()) return false;
+    func_stack.push_back({{arg_count, addr}, sym, func_head[sym], depth()});
+    func_head[sym] = static_cast<uint32_t>(func_stack.size() - 1);
+    // REPL 丢掉出错的语句后地址会被重新使用，之前记下的不再算数
+    clobbered.erase(addr);
+    return true;
+}
+
+void Generator::finish_func(const size_t addr, const size_t end) {
+    std::bitset<REG_COUNT> written;
+    written.set(0);     // 返回值
+    for (size_t pc = addr; pc < end; pc++) {
+        const auto& [op, o] = ops[pc];
+        switch (op) {
+            using enum runtime::Opcode;
+        case FCALL: {
+            size_t callee;
+            std::memcpy(&callee, o, sizeof(callee));
+            written |= clobbers(callee);
+            break;
+        }
+        // 不写寄存器
+        case MOV_MI: case MOV_MM: case MOV_MR: case MOV_MC:
+        case HALT: case FRET: case DEBUG_LOG: case JMP: case IF_TRUE: case IF_FALSE:
+        case BLT: case BLE: case BGT: case BGE: case BEQ: case BNE: case MAP_SET:
+            break;
+        // 其余指令都写 operands[0]，LOOP_LT 给计数器加一，BOX_FLOAT 改标记
+        default:
+            if (o[0] < REG_COUNT) written.set(o[0]);
+            break;
+        }
+    }
+    clobbered[addr] = written;
+}
+
+std::bitset<REG_COUNT> Generator::clobbers(const size_t addr) const {
+    if (const auto it = clobbered.find(addr); it != clobbered.end()) return it->second;
+    return std::bitset<REG_COUNT>().set();
+}
+
+Generator::Checkpoint Generator::checkpoint() const {
+    return {ops.size(), static_cast<uint32_t>(var_stack.size()), static_cast<uint32_t>(func_stack.size()), slots};
+}
+
+void Generator::rollback(const Checkpoint& cp) {
+    while (var_stack.size() > cp.vars) {
+        const auto& b = var_stack.back();
+        if (!b.value.in_frame()) regs.unpin(b.value.reg);
+        var_head[b.sym] = b.prev;
+        var_stack.pop_back();
+    }
+    while (func_stack.size() > cp.funcs) {
+        clobbered.erase(func_stack.back().value.addr);
+        func_head[func_stack.back().sym] = func_stack.back().prev;
+        func_stack.pop_back();
+    }
+    for (size_t r = 0; r < REG_COUNT; r++)
+        if (regs.is_temp(r)) regs.free(r);
+    slots = cp.slots;
+    ops.erase(ops.begin() + static_cast<ptrdiff_t>(cp.ops), ops.end());
+    failed = false;
+}
+
+void Generator::error(const std::string& msg) {
+    // 第一处错误之后生成的代码不会被使用，后面的报错多是它的连锁反应，只报第一处
+    if (!failed) std::cerr << msg << std::endl;
+    failed = true;
+}
+
+void Generator::plan_in_frame(const std::string_view name) {
+    planned.push_back(intern(name));
 }
 
-void Generator::free_scope(const std::string& original_scope) {
-    cur_scope = last_scope;
-    last_scope = original_scope;
+bool Generator::wants_frame(const std::string_view name) const {
+    if (regs.available() <= RESERVED_REGS) return true;
+    const auto sym = symbols.find(name);
+    return sym != SymbolTable::NONE && std::find(planned.begin() + scopes.back().plan_mark, planned.end(), sym) != planned.end();
 }
 
-std::string Generator::make_scope(const std::string& name) const {
-    return cur_scope + '@' + name;
+void Generator::plan_release(const ASTNode* stmt, const std::string_view name) {
+    releases.emplace_back(stmt, intern(name));
+}
+
+void Generator::release_after(const ASTNode* stmt) {
+    for (size_t i = scopes.back().release_mark; i < releases.size();) {
+        if (releases[i].first != stmt) {
+            i++;
+            continue;
+        }
+        const auto b = var_head[releases[i].second];
+        if (b != UNBOUND && var_stack[b].depth == depth() && !var_stack[b].value.in_frame()) {
+            // 绑定还留着，离开作用域时对已释放的寄存器再做一次是无害的
+            regs.unpin(var_stack[b].value.reg);
+            regs.free(var_stack[b].value.reg);
+        }
+        releases[i] = releases.back();
+        releases.pop_back();
+    }
+}
+
+void Generator::enter_scope(const std::string_view name) {
+    // 每个函数有自己的帧，槽位从零开始
+    scopes.push_back({intern(name), static_cast<uint32_t>(var_stack.size()), static_cast<uint32_t>(func_stack.size()),
+                      static_cast<uint32_t>(planned.size()), static_cast<uint32_t>(releases.size()), slots});
+    slots = 0;
+}
+
+void Generator::leave_scope() {
+    const auto scope = scopes.back();
+    scopes.pop_back();
+    while (var_stack.size() > scope.var_mark) {
+        const auto& b = var_stack.back();
+        if (!b.value.in_frame()) {
+            regs.unpin(b.value.reg);
+            regs.free(b.value.reg);
+        }
+        var_head[b.sym] = b.prev;
+        var_stack.pop_back();
+    }
+    planned.resize(scope.plan_mark);
+    releases.resize(scope.release_mark);
+    slots = scope.outer_slots;
+    while (func_stack.size() > scope.func_mark) {
+        func_head[func_stack.back().sym] = func_stack.back().prev;
+        func_stack.pop_back();
+    }
+}
+
+std::string Generator::scope_path() const {
+    std::string path;
+    for (const auto& scope : scopes) {
+        if (!path.empty()) path += '@';
+        path += symbols.name(scope.name);
+    }
+    return path;
 }
 
 std::vector<lmx::runtime::Op> Generator::get_ops() {
@@ -66,4 +279,4 @@ std::vector<lmx::runtime::Op> Generator::get_ops() {
     return ops;
 }
 
-} // namespace lmx
\ No newline at end of file
+} // namespace lmx
\ No newline at end of file
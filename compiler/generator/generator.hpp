@@ -3,44 +3,205 @@
 //
 
 #pragma once
+#include <array>
 #include <bitset>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "../../include/lmx_export.hpp"
 #include "../../include/opcode.hpp"
+#include "../types.hpp"
 
 namespace lmx {
 namespace runtime {
 struct Op;
 }
+struct ASTNode;
 #define REG_COUNT 255
 class LMC_API Allocator {
     std::bitset<REG_COUNT> bitset;
+    std::array<uint16_t, REG_COUNT> pins{};     // 绑定到该寄存器的变量数
 public:
     Allocator();
+    // 全部占用时返回 -1，调用方先用 available() 确认还有空位
     size_t alloc();
     size_t alloc(size_t i);
-    void free(size_t i);
+    void free(size_t i);    // 被变量绑定的寄存器不会被释放
     bool is_free(size_t i);
+
+    void pin(size_t i);
+    void unpin(size_t i);
+    // 已分配且没有变量绑定，即表达式求值产生的临时寄存器
+    [[nodiscard]] bool is_temp(size_t i) const;
+    [[nodiscard]] bool in_use(size_t i) const { return i < REG_COUNT && bitset.test(i); }
+    [[nodiscard]] size_t available() const { return REG_COUNT - bitset.count(); }
+};
+
+using SymbolId = uint32_t;
+
+/*
+ * 标识符驻留为连续的整数 ID。名字在第一次出现时复制一份，之后的查找只散列一次视图，
+ * 不再分配字符串；源码（或 REPL 的输入行）可以在生成之后改写。
+ */
+class LMC_API SymbolTable {
+    std::deque<std::string> names;      // deque 扩容不移动已有元素，ids 的键一直有效
+    std::unordered_map<std::string_view, SymbolId> ids;
+public:
+    static constexpr SymbolId NONE = UINT32_MAX;
+
+    SymbolId intern(std::string_view name);
+    // 没见过的名字返回 NONE
+    [[nodiscard]] SymbolId find(std::string_view name) const;
+    [[nodiscard]] std::string_view name(const SymbolId id) const { return names[id]; }
+    [[nodiscard]] size_t size() const { return names.size(); }
 };
+
 class LMC_API Generator {
+public:
+    // 变量不占寄存器、住在帧槽位里时 Var::reg 的取值
+    static constexpr size_t IN_FRAME = REG_COUNT;
+    // 绑定新变量时至少给表达式求值留下的寄存器数，少于这个数新变量直接住进帧里
+    static constexpr size_t RESERVED_REGS = 16;
+    // 空闲寄存器少于这个数时，要跨子表达式保留的临时值先写进帧里
+    static constexpr size_t SPILL_REGS = 4;
+    // 槽位偏移和 FCALL 的帧大小都是两个字节，一帧最多这么多槽位
+    static constexpr size_t MAX_SLOTS = UINT16_MAX;
+
+    struct Var {
+        bool is_mut;
+        size_t reg;
+        uint16_t slot{0};   // reg == IN_FRAME 时变量的槽位
+        [[nodiscard]] bool in_frame() const { return reg == IN_FRAME; }
+    };
+    struct Func {
+        size_t arg_count;
+        size_t addr;
+    };
+
+private:
+    static constexpr uint32_t UNBOUND = UINT32_MAX;
+
+    /*
+     * 绑定按声明顺序压栈，每个符号的 head 指向它最内层的绑定，prev 串起被遮住的外层绑定。
+     * 离开作用域时弹出本层的绑定并恢复 head，查找只需按 ID 取一次下标。
+     */
+    template<class T>
+    struct Binding {
+        T value;
+        SymbolId sym;
+        uint32_t prev;
+        uint32_t depth;     // 所在作用域的层数，顶层为 0
+    };
+
+    // 作用域帧：进入时两个绑定栈和规划栈的高度，以及外层函数已用的帧槽位数
+    struct Scope {
+        SymbolId name;
+        uint32_t var_mark, func_mark, plan_mark, release_mark;
+        uint32_t outer_slots;
+    };
+
+    SymbolTable symbols;
+    std::vector<Binding<Var>> var_stack;
+    std::vector<Binding<Func>> func_stack;
+    std::vector<uint32_t> var_head, func_head;      // 按 SymbolId 下标
+    std::vector<Scope> scopes;
+    std::vector<SymbolId> planned;      // 各层函数事先决定住进帧里的变量
+    std::vector<std::pair<const ASTNode*, SymbolId>> releases;     // 语句生成完后释放哪个变量的寄存器
+    uint32_t slots{0};                  // 当前函数的帧里已用的槽位：帧变量和溢出的临时值，按栈分配
+    // 生成完的函数（按入口地址）执行期间会写的寄存器，包括它调用的函数写的
+    std::unordered_map<size_t, std::bitset<REG_COUNT>> clobbered;
+    bool failed{false};
+
+    SymbolId intern(std::string_view name);
+    [[nodiscard]] uint32_t depth() const { return static_cast<uint32_t>(scopes.size() - 1); }
 
 public:
-    std::unordered_map<std::string, std::pair<bool, size_t>> vars;  // name <mutable, index register>
-    std::unordered_map<std::string, std::pair<size_t, size_t>> funcs;  // name <arg_count， address>
-    std::string last_scope;
-    std::string cur_scope{"global"};
     Allocator regs;
-    Generator() = default;
+    TypeInfer types;
+    Generator();
     ~Generator() = default;
 
     std::vector<runtime::Op> ops;
     void write(runtime::Op& op);
 
-    void new_scope(const std::string& new_scope);
-    void free_scope(const std::string& original_scope);
-    std::string make_scope(const std::string& name) const;
+    // 顶层语句生成前推导类型；被拓宽成浮点的顶层变量先就地转换。类型错误时返回 false，不能生成
+    bool infer(ASTNode* stmt);
+
+    // 报告生成错误并记下，出过错的 ops 不能执行
+    void error(const std::string& msg);
+    // 错误已经由别处（比如类型推导）报告过，只记下
+    void fail() { failed = true; }
+    [[nodiscard]] bool has_error() const { return failed; }
+
+    // 顶层语句生成前的位置：指令数、两个绑定栈的高度和帧槽位数
+    struct Checkpoint {
+        size_t ops;
+        uint32_t vars, funcs, slots;
+    };
+    [[nodiscard]] Checkpoint checkpoint() const;
+    /*
+     * REPL 丢掉出错的语句后继续：删掉之后生成的指令和新增的绑定，释放临时寄存器，清除错误。
+     * 顶层语句之间没有活着的临时值；已有变量在这条语句里改过的位置不恢复。
+     */
+    void rollback(const Checkpoint& cp);
+
+    // 变量只在所在的函数内可见，外层同名变量被遮住
+    Var* find_var(std::string_view name);
+    // reg 为 IN_FRAME 时变量住在槽位 slot
+    void bind_var(std::string_view name, bool is_mut, size_t reg, uint16_t slot = 0);
+    // 函数沿作用域链向外查找，内层可以调用外层以及自身所在层定义的函数
+    [[nodiscard]] const Func* find_func(std::string_view name) const;
+    // 当前作用域已有同名函数时返回 false
+    bool declare_func(std::string_view name, size_t arg_count, size_t addr);
+    // 函数体 [addr, end) 生成完后记下它会写的寄存器
+    void finish_func(size_t addr, size_t end);
+    // 调用 addr 处的函数可能改写的寄存器；函数还没生成完（比如递归调用）时是全部寄存器
+    [[nodiscard]] std::bitset<REG_COUNT> clobbers(size_t addr) const;
+
+    /*
+     * 帧槽位：帧变量和溢出的临时值在本函数帧的低端按栈分配，调用时保存的寄存器紧接其后，
+     * FCALL 的帧大小包含两者。
+     */
+    // 返回的槽位不小于 MAX_SLOTS 说明帧放不下，调用方报错
+    size_t push_slot() { return slots++; }
+    void pop_slot() { slots--; }
+    [[nodiscard]] size_t frame_size() const { return slots; }
+
+    // 当前函数里名为 name 的变量绑定时住进帧里，函数开头按使用距离规划
+    void plan_in_frame(std::string_view name);
+    // 规划过，或者寄存器已经不够给新变量
+    [[nodiscard]] bool wants_frame(std::string_view name) const;
+    // 当前函数里名为 name 的寄存器变量在 stmt 之后不再使用，生成完 stmt 就释放它的寄存器
+    void plan_release(const ASTNode* stmt, std::string_view name);
+    void release_after(const ASTNode* stmt);
+
+    void enter_scope(std::string_view name);
+    // 弹出本层的绑定，释放局部变量占用的寄存器
+    void leave_scope();
+    // 当前作用域的路径，形如 global@outer@inner
+    [[nodiscard]] std::string scope_path() const;
+
+    // 按声明顺序遍历当前作用域可见的变量
+    template<class F>
+    void each_var(F&& f) const {
+        for (uint32_t i = scopes.back().var_mark; i < var_stack.size(); i++)
+            if (var_head[var_stack[i].sym] == i) f(symbols.name(var_stack[i].sym), var_stack[i].value);
+    }
+
+    // 函数体的作用域帧放在 C++ 栈上，提前返回时也会离开作用域
+    class ScopeFrame {
+        Generator& gener;
+    public:
+        ScopeFrame(Generator& gener, const std::string_view name): gener(gener) { gener.enter_scope(name); }
+        ~ScopeFrame() { gener.leave_scope(); }
+        ScopeFrame(const ScopeFrame&) = delete;
+        ScopeFrame& operator=(const ScopeFrame&) = delete;
+    };
 
     std::vector<lmx::runtime::Op> get_ops();
 };
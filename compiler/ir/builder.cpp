@@ -0,0 +1,527 @@
+//
+// AST -> SSA lowering
+//
+
+#include "builder.hpp"
+
+#include <bit>
+#include <iostream>
+
+namespace lmx::ir {
+
+void IRBuilder::error(const std::string& msg) {
+    std::cerr << "Generate Error: " << msg << std::endl;
+    has_err = true;
+}
+
+VReg IRBuilder::emit(const IROp op, std::vector<VReg> args, const int64_t imm) {
+    IRInst inst{op};
+    inst.args = std::move(args);
+    inst.imm = imm;
+    if (op != IROp::Ret && op != IROp::Halt && op != IROp::MapSet) inst.dst = fn().new_vreg();
+    const auto dst = inst.dst;
+    cur_block().insts.push_back(std::move(inst));
+    return dst;
+}
+
+VReg IRBuilder::convert(const VReg v, Type from, Type to) {
+    from = concrete(from);
+    to = concrete(to);
+    if (v == NO_VREG) return v;
+    if (to == Type::Float && from != Type::Float) return emit(IROp::ToFloat, {v});
+    if (to == Type::Dynamic && from == Type::Float) return emit(IROp::BoxFloat, {v});
+    return v;
+}
+
+void IRBuilder::emit_jmp(const BlockId target) {
+    IRInst inst{IROp::Jmp};
+    inst.target[0] = target;
+    cur_block().insts.push_back(std::move(inst));
+    fn().add_edge(fs->cur, target);
+}
+
+void IRBuilder::emit_br(const VReg cond, const BlockId t, const BlockId f) {
+    IRInst inst{IROp::Br};
+    inst.args = {cond};
+    inst.target[0] = t;
+    inst.target[1] = f;
+    cur_block().insts.push_back(std::move(inst));
+    fn().add_edge(fs->cur, t);
+    fn().add_edge(fs->cur, f);
+}
+
+void IRBuilder::seal(const BlockId b) {
+    if (const auto it = fs->incomplete_phis.find(b); it != fs->incomplete_phis.end()) {
+        const auto pending = std::move(it->second);
+        fs->incomplete_phis.erase(it);
+        for (const auto& [name, phi] : pending) add_phi_operands(name, b, phi);
+    }
+    fn().blocks[b].sealed = true;
+}
+
+void IRBuilder::write_var(const std::string_view name, const BlockId b, const VReg v) {
+    fs->defs[name][b] = v;
+}
+
+VReg IRBuilder::read_var(const std::string_view name, const BlockId b) {
+    if (const auto it = fs->defs.find(name); it != fs->defs.end()) {
+        if (const auto it2 = it->second.find(b); it2 != it->second.end()) return it2->second;
+    }
+    return read_var_recursive(name, b);
+}
+
+VReg IRBuilder::read_var_recursive(const std::string_view name, const BlockId b) {
+    auto& block = fn().blocks[b];
+    VReg v;
+    if (!block.sealed) {
+        IRInst phi{IROp::Phi};
+        v = phi.dst = fn().new_vreg();
+        block.phis.push_back(std::move(phi));
+        fs->incomplete_phis[b].emplace_back(name, block.phis.size() - 1);
+    } else if (block.preds.size() == 1) {
+        v = read_var(name, block.preds[0]);
+    } else if (block.preds.empty()) {
+        // 某条路径上未定义：寄存器初值为 0
+        IRInst zero{IROp::Const};
+        v = zero.dst = fn().new_vreg();
+        auto& entry = fn().blocks[0].insts;
+        entry.insert(entry.begin(), std::move(zero));
+    } else {
+        IRInst phi{IROp::Phi};
+        v = phi.dst = fn().new_vreg();
+        block.phis.push_back(std::move(phi));
+        const auto idx = block.phis.size() - 1;
+        write_var(name, b, v);  // 先写入以打断循环
+        add_phi_operands(name, b, idx);
+    }
+    write_var(name, b, v);
+    return v;
+}
+
+void IRBuilder::add_phi_operands(const std::string_view name, const BlockId b, const size_t phi) {
+    // read_var 可能向同一块追加 phi，这里不能持有引用
+    const auto preds = fn().blocks[b].preds;
+    std::vector<VReg> args;
+    args.reserve(preds.size());
+    for (const auto p : preds) args.push_back(read_var(name, p));
+    fn().blocks[b].phis[phi].args = std::move(args);
+}
+
+void IRBuilder::declare_funcs(std::span<ASTNode* const> stmts) {
+    for (const auto& stmt : stmts) {
+        if (!stmt || stmt->kind != ASTKind::FuncDecl) continue;
+        const auto decl = static_cast<const FuncDeclNode*>(stmt);
+        auto& scope = func_scopes.back();
+        if (func_scopes.size() == 1) {
+            if (const auto it = forward_funcs.find(decl->name); it != forward_funcs.end()) {
+                if (mod.funcs[it->second].param_count != decl->args.size()) {
+                    error("function `" + std::string(decl->name) + "` called with " +
+                          std::to_string(mod.funcs[it->second].param_count) + " arguments before its definition");
+                }
+                mod.funcs[it->second].param_count = decl->args.size();
+                forward_funcs.erase(it);
+                continue;
+            }
+        }
+        if (scope.contains(decl->name)) {
+            error("redefined function `" + std::string(decl->name) + "`");
+            continue;
+        }
+        IRFunction f;
+        f.name = fs->index == 0 ? std::string(decl->name) : (fn().name + '@').append(decl->name);
+        f.param_count = decl->args.size();
+        scope[decl->name] = mod.funcs.size();
+        mod.funcs.push_back(std::move(f));
+    }
+}
+
+const size_t* IRBuilder::find_func(const std::string_view name) const {
+    for (auto it = func_scopes.rbegin(); it != func_scopes.rend(); ++it) {
+        if (const auto f = it->find(name); f != it->end()) return &f->second;
+    }
+    return nullptr;
+}
+
+VReg IRBuilder::lower_stmts(std::span<ASTNode* const> stmts) {
+    declare_funcs(stmts);
+    VReg last = NO_VREG;
+    for (const auto& stmt : stmts) {
+        // return 之后的语句不可达
+        if (cur_block().terminated()) break;
+        if (stmt) last = lower(stmt);
+    }
+    return last;
+}
+
+VReg IRBuilder::lower_binary(const BinaryNode* node) {
+    const auto left = static_cast<const ExprNode*>(node->left);
+    const auto right = static_cast<const ExprNode*>(node->right);
+    const auto l = lower(left);
+    const auto r = lower(right);
+    const auto& op = node->op;
+    // 算术按结果类型选择，比较的两边有一边是浮点时按浮点比较，整数和 Dynamic 共用比较
+    const bool is_float_cmp = concrete(left->type) == Type::Float || concrete(right->type) == Type::Float;
+    auto kind = Type::Int;
+    IROp irop;
+    const auto arith = [&](const IROp i, const IROp d, const IROp f) {
+        kind = concrete(node->type);
+        return kind == Type::Float ? f : kind == Type::Dynamic ? d : i;
+    };
+    const auto cmp = [&](const IROp i, const IROp f) {
+        kind = is_float_cmp ? Type::Float : Type::Int;
+        return is_float_cmp ? f : i;
+    };
+    const bool eq = op.size() > 1 && op[1] == '=';
+    switch (op[0]) {
+    case '+': irop = arith(IROp::Add, IROp::DAdd, IROp::FAdd); break;
+    case '-': irop = arith(IROp::Sub, IROp::DSub, IROp::FSub); break;
+    case '*': irop = arith(IROp::Mul, IROp::DMul, IROp::FMul); break;
+    case '/': irop = arith(IROp::Div, IROp::DDiv, IROp::FDiv); break;
+    case '%': irop = arith(IROp::Mod, IROp::DMod, IROp::FMod); break;
+    case '^': irop = arith(IROp::Pow, IROp::Pow, IROp::Pow); break;
+    case '>': irop = eq ? cmp(IROp::CmpGE, IROp::FCmpGE) : cmp(IROp::CmpGT, IROp::FCmpGT); break;
+    case '<': irop = eq ? cmp(IROp::CmpLE, IROp::FCmpLE) : cmp(IROp::CmpLT, IROp::FCmpLT); break;
+    case '=':
+        if (eq) { irop = cmp(IROp::CmpEQ, IROp::FCmpEQ); break; }
+        [[fallthrough]];
+    case '!':
+        if (eq) { irop = cmp(IROp::CmpNE, IROp::FCmpNE); break; }
+        [[fallthrough]];
+    default:
+        error("unknown operator " + std::string(op));
+        return NO_VREG;
+    }
+    if (l == NO_VREG || r == NO_VREG) return NO_VREG;
+    return emit(irop, {convert(l, left->type, kind), convert(r, right->type, kind)});
+}
+
+VReg IRBuilder::lower_builtin(const FuncCallExprNode* node) {
+    std::vector<VReg> args;
+    for (const auto& arg : node->args) {
+        const auto v = lower(arg);
+        if (v == NO_VREG) return NO_VREG;
+        args.push_back(v);
+    }
+    switch (node->builtin) {
+    case Builtin::MapNew: return emit(IROp::MapNew);
+    case Builtin::MapGet: return emit(IROp::MapGet, std::move(args));
+    case Builtin::MapDel: return emit(IROp::MapDel, std::move(args));
+    case Builtin::MapLen: return emit(IROp::MapLen, std::move(args));
+    case Builtin::MapSet: {
+        // 赋值表达式的值就是写入的值
+        const auto value = args[2];
+        emit(IROp::MapSet, std::move(args));
+        return value;
+    }
+    default: return NO_VREG;
+    }
+}
+
+VReg IRBuilder::lower_call(const FuncCallExprNode* node) {
+    if (node->builtin != Builtin::None) return lower_builtin(node);
+    auto idx = find_func(node->name);
+    if (!idx && top) {
+        // 可能是后面才定义的顶层函数
+        IRFunction f;
+        f.name = std::string(node->name);
+        f.param_count = node->args.size();
+        auto& globals = func_scopes.front();
+        globals[node->name] = mod.funcs.size();
+        forward_funcs[node->name] = mod.funcs.size();
+        mod.funcs.push_back(std::move(f));
+        idx = &globals[node->name];
+    }
+    if (!idx) {
+        error("undefined function `" + std::string(node->name) + "`");
+        return NO_VREG;
+    }
+    if (mod.funcs[*idx].param_count != node->args.size()) {
+        error("function `" + std::string(node->name) + "` expects " + std::to_string(mod.funcs[*idx].param_count) +
+              " arguments, got " + std::to_string(node->args.size()));
+        return NO_VREG;
+    }
+    std::vector<VReg> args;
+    for (size_t i = 0; i < node->args.size(); i++) {
+        const auto v = lower(node->args[i]);
+        if (v == NO_VREG) return NO_VREG;
+        args.push_back(convert(v, node->args[i]->type, i < node->params.size() ? node->params[i] : Type::Int));
+    }
+    return emit(IROp::Call, std::move(args), static_cast<int64_t>(*idx));
+}
+
+// 浮点条件先和 0.0 比较
+VReg IRBuilder::lower_condition(const ExprNode* node) {
+    const auto v = lower(node);
+    if (v == NO_VREG || concrete(node->type) != Type::Float) return v;
+    return emit(IROp::FCmpNE, {v, emit(IROp::Const)});
+}
+
+void IRBuilder::lower_if(const IfStmtNode* node) {
+    const auto cond = lower_condition(node->condition);
+    if (cond == NO_VREG) return;
+    const auto then_b = fn().new_block();
+    const auto else_b = node->elseBlock ? fn().new_block() : NO_BLOCK;
+    const auto merge = fn().new_block();
+
+    emit_br(cond, then_b, else_b != NO_BLOCK ? else_b : merge);
+    seal(then_b);
+    if (else_b != NO_BLOCK) seal(else_b);
+
+    fs->cur = then_b;
+    lower_stmts(node->thenBlock->children);
+    if (!cur_block().terminated()) emit_jmp(merge);
+
+    if (else_b != NO_BLOCK) {
+        fs->cur = else_b;
+        lower_stmts(node->elseBlock->children);
+        if (!cur_block().terminated()) emit_jmp(merge);
+    }
+    seal(merge);
+    fs->cur = merge;
+}
+
+/*
+ * 循环按旋转后的形式构造：入口处判断一次，条件复制到循环体末尾作为回边，
+ * 这样每轮只有一次条件跳转。循环体在回边接上之前不能封闭。
+ */
+void IRBuilder::lower_while(const WhileStmtNode* node) {
+    const auto cond = lower_condition(node->condition);
+    if (cond == NO_VREG) return;
+    const auto body = fn().new_block();
+    const auto exit = fn().new_block();
+    emit_br(cond, body, exit);
+
+    fs->cur = body;
+    lower_stmts(node->body->children);
+    if (!cur_block().terminated()) {
+        const auto again = lower_condition(node->condition);
+        if (again == NO_VREG) return;
+        emit_br(again, body, exit);
+    }
+    seal(body);
+    seal(exit);
+    fs->cur = exit;
+}
+
+void IRBuilder::lower_for(const ForStmtNode* node) {
+    if (const auto it = fs->mutability.find(node->var); it != fs->mutability.end() && !it->second) {
+        error("the var `" + std::string(node->var) + "` not mutable");
+        return;
+    }
+    const auto start = convert(lower(node->start), node->start->type, node->type);
+    const auto end = lower(node->end);
+    if (start == NO_VREG || end == NO_VREG) return;
+    fs->mutability[node->var] = true;
+    write_var(node->var, fs->cur, start);
+
+    const auto body = fn().new_block();
+    const auto exit = fn().new_block();
+    emit_br(emit(IROp::CmpLT, {start, end}), body, exit);
+
+    fs->cur = body;
+    lower_stmts(node->body->children);
+    if (!cur_block().terminated()) {
+        // i + 1 < end 紧挨着回边，降低时合并成 LOOP_LT
+        const auto inc = node->type == Type::Dynamic ? IROp::DAdd : IROp::Add;
+        const auto next = emit(inc, {read_var(node->var, fs->cur), emit(IROp::Const, {}, 1)});
+        write_var(node->var, fs->cur, next);
+        emit_br(emit(IROp::CmpLT, {next, end}), body, exit);
+    }
+    seal(body);
+    seal(exit);
+    fs->cur = exit;
+}
+
+void IRBuilder::lower_func(const FuncDeclNode* node) {
+    const auto idx = func_scopes.back().at(node->name);
+    FuncState state{idx};
+    auto* const outer = fs;
+    fs = &state;
+    func_scopes.emplace_back();
+
+    fn().ret = node->ret;
+    fn().params.assign(node->params.begin(), node->params.end());
+    fn().new_block();
+    seal(0);
+    for (size_t i = 0; i < node->args.size(); i++) {
+        write_var(node->args[i], 0, emit(IROp::Param, {}, static_cast<int64_t>(i)));
+        state.mutability[node->args[i]] = true;
+    }
+    lower_stmts(node->body->children);
+    if (!cur_block().terminated()) emit(IROp::Ret);
+
+    func_scopes.pop_back();
+    fs = outer;
+}
+
+VReg IRBuilder::lower(const ASTNode* node) {
+    switch (node->kind) {
+    case ASTKind::NumLiteral:
+        return emit(IROp::Const, {}, static_cast<const NumberNode*>(node)->value);
+    case ASTKind::FloatLiteral:
+        return emit(IROp::Const, {}, std::bit_cast<int64_t>(static_cast<const FloatNode*>(node)->value));
+    case ASTKind::VarRef: {
+        const auto& name = static_cast<const VarRefNode*>(node)->name;
+        if (!fs->mutability.contains(name)) {
+            error("undefined var `" + std::string(name) + "`");
+            return NO_VREG;
+        }
+        return read_var(name, fs->cur);
+    }
+    case ASTKind::Binary:
+        return lower_binary(static_cast<const BinaryNode*>(node));
+    case ASTKind::Unary: {
+        const auto unary = static_cast<const UnaryNode*>(node);
+        const auto operand = static_cast<const ExprNode*>(unary->operand);
+        const auto v = lower(operand);
+        if (v == NO_VREG) return NO_VREG;
+        const auto t = concrete(unary->type);
+        // 0.0 的位模式也是 0
+        switch (unary->op[0]) {
+        case '+': return convert(v, operand->type, t);
+        case '-': {
+            const auto sub = t == Type::Float ? IROp::FSub : t == Type::Dynamic ? IROp::DSub : IROp::Sub;
+            return emit(sub, {emit(IROp::Const), convert(v, operand->type, t)});
+        }
+        case '!':
+            return emit(concrete(operand->type) == Type::Float ? IROp::FCmpEQ : IROp::CmpEQ, {v, emit(IROp::Const)});
+        default:
+            error("unknown operator " + std::string(unary->op));
+            return NO_VREG;
+        }
+    }
+    case ASTKind::FuncCallExpr:
+        return lower_call(static_cast<const FuncCallExprNode*>(node));
+    case ASTKind::VarDecl: {
+        const auto decl = static_cast<const VarDeclNode*>(node);
+        if (const auto it = fs->mutability.find(decl->name); it != fs->mutability.end() && !it->second) {
+            error("the var `" + std::string(decl->name) + "` not mutable");
+            return NO_VREG;
+        }
+        const auto v = convert(lower(decl->value), decl->value->type, decl->type);
+        if (v == NO_VREG) return NO_VREG;
+        fs->mutability[decl->name] = decl->is_mut;
+        write_var(decl->name, fs->cur, v);
+        return NO_VREG;
+    }
+    case ASTKind::Return: {
+        const auto ret = static_cast<const ReturnStmtNode*>(node);
+        const auto v = convert(lower(ret->expr), ret->expr->type, ret->type);
+        if (v == NO_VREG) return NO_VREG;
+        emit(IROp::Ret, {v});
+        return NO_VREG;
+    }
+    case ASTKind::IfStmt:
+        lower_if(static_cast<const IfStmtNode*>(node));
+        return NO_VREG;
+    case ASTKind::WhileStmt:
+        lower_while(static_cast<const WhileStmtNode*>(node));
+        return NO_VREG;
+    case ASTKind::ForStmt:
+        lower_for(static_cast<const ForStmtNode*>(node));
+        return NO_VREG;
+    case ASTKind::BlockStmt:
+        lower_stmts(static_cast<const BlockStmtNode*>(node)->children);
+        return NO_VREG;
+    case ASTKind::FuncDecl:
+        lower_func(static_cast<const FuncDeclNode*>(node));
+        return NO_VREG;
+    case ASTKind::Import:
+        // 顶层的 import 由驱动在交给 add() 之前处理掉
+        error("import `" + std::string(static_cast<const ImportNode*>(node)->path) +
+              "` is only allowed at the top level of a file being run");
+        return NO_VREG;
+    default:
+        error("unsupported node kind " + std::to_string(node->kind));
+        return NO_VREG;
+    }
+}
+
+void IRBuilder::lower_top(ASTNode* stmt) {
+    // return 之后的语句不可达
+    if (!stmt || cur_block().terminated()) return;
+    if (!types.infer(stmt)) {
+        has_err = true;
+        return;
+    }
+    // 被这条语句拓宽成浮点的顶层变量，从这里开始的定义都是浮点
+    for (const auto& name : types.widened()) {
+        // 名字视图要一直有效，用变量表里指向源码的那一份
+        const auto it = fs->mutability.find(name);
+        if (it == fs->mutability.end()) continue;
+        write_var(it->first, fs->cur, emit(IROp::ToFloat, {read_var(it->first, fs->cur)}));
+    }
+    last = lower(stmt);
+    // 程序的结果按 Dynamic 交出，宿主看寄存器的标记就能区分整数和浮点
+    if (value_type(stmt) == Type::Float) last = convert(last, Type::Float, Type::Dynamic);
+}
+
+void IRBuilder::begin() {
+    IRFunction global;
+    global.name = "global";
+    mod.funcs.push_back(std::move(global));
+    top = std::make_unique<FuncState>(FuncState{0});
+    fs = top.get();
+    func_scopes.emplace_back();
+    last = NO_VREG;
+
+    fn().new_block();
+    seal(0);
+}
+
+void IRBuilder::add(ASTNode* stmt) {
+    declare_funcs(std::span<ASTNode* const>(&stmt, 1));
+    lower_top(stmt);
+}
+
+bool IRBuilder::declare_external(const std::string_view name, const size_t param_count, const uint32_t imported) {
+    auto& globals = func_scopes.front();
+    // 导入之前已经调用过，把登记的前向函数转成外部函数
+    if (const auto it = forward_funcs.find(name); it != forward_funcs.end()) {
+        auto& f = mod.funcs[it->second];
+        if (f.param_count != param_count) {
+            error("function `" + std::string(name) + "` called with " + std::to_string(f.param_count) +
+                  " arguments before its import");
+        }
+        f.param_count = param_count;
+        f.imported = imported;
+        forward_funcs.erase(it);
+        return !has_err;
+    }
+    if (globals.contains(name)) {
+        error("imported function `" + std::string(name) + "` is already defined");
+        return false;
+    }
+    IRFunction f;
+    f.name = std::string(name);
+    f.param_count = param_count;
+    f.imported = imported;
+    globals[name] = mod.funcs.size();
+    mod.funcs.push_back(std::move(f));
+    return true;
+}
+
+bool IRBuilder::finish() {
+    for (const auto& [name, idx] : forward_funcs) error("undefined function `" + std::string(name) + "`");
+    forward_funcs.clear();
+    if (!cur_block().terminated()) {
+        // 最后一个表达式语句的值作为程序结果写入 r0
+        if (last != NO_VREG) emit(IROp::Halt, {last});
+        else emit(IROp::Halt);
+    }
+
+    func_scopes.clear();
+    fs = nullptr;
+    top.reset();
+    return !has_err;
+}
+
+bool IRBuilder::build(const ProgramASTNode& program) {
+    begin();
+    // 整个程序已经在手，顶层函数统一提前声明，调用可以出现在定义之前
+    declare_funcs(program.children);
+    for (const auto stmt : program.children) lower_top(stmt);
+    return finish();
+}
+
+} // namespace lmx::ir
@@ -0,0 +1,95 @@
+//
+// AST -> SSA lowering
+//
+
+#pragma once
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "../../include/lmx_export.hpp"
+#include "../ast.hpp"
+#include "ir.hpp"
+
+namespace lmx::ir {
+
+/*
+ * 按 Braun et al. "Simple and Efficient Construction of SSA Form" 的做法
+ * 在遍历 AST 的同时直接构造 SSA：变量的定义按块记录，读取时沿前驱查找，
+ * 未封闭（sealed）的块先放置不完整的 phi，封闭时再补全操作数。
+ */
+class LMC_API IRBuilder {
+    struct FuncState {
+        size_t index;
+        BlockId cur{0};
+        std::unordered_map<std::string_view, std::unordered_map<BlockId, VReg>> defs;
+        std::unordered_map<BlockId, std::vector<std::pair<std::string_view, size_t>>> incomplete_phis;
+        std::unordered_map<std::string_view, bool> mutability;    // name -> is_mut
+    };
+
+    IRModule& mod;
+    FuncState* fs{nullptr};
+    std::unique_ptr<FuncState> top;     // 顶层代码，流式构造时跨越多次 add()
+    VReg last{NO_VREG};                 // 最近一条顶层语句的值
+    // 流式构造时先调用、后定义的顶层函数 -> funcs 下标，定义出现时转正
+    std::unordered_map<std::string_view, size_t> forward_funcs;
+    std::vector<std::unordered_map<std::string_view, size_t>> func_scopes;   // name -> funcs 下标
+    bool has_err{false};
+    TypeInfer types;                    // 逐条顶层语句推导，结果写在 AST 节点上
+
+    IRFunction& fn() const { return mod.funcs[fs->index]; }
+    BasicBlock& cur_block() const { return fn().blocks[fs->cur]; }
+
+    VReg emit(IROp op, std::vector<VReg> args = {}, int64_t imm = 0);
+    // 类型为 from 的值交给类型为 to 的位置，需要时插入 ToFloat / BoxFloat
+    VReg convert(VReg v, Type from, Type to);
+    VReg lower_condition(const ExprNode* node);
+    void emit_jmp(BlockId target);
+    void emit_br(VReg cond, BlockId t, BlockId f);
+    void seal(BlockId b);
+
+    void write_var(const std::string_view name, BlockId b, VReg v);
+    VReg read_var(const std::string_view name, BlockId b);
+    VReg read_var_recursive(const std::string_view name, BlockId b);
+    void add_phi_operands(const std::string_view name, BlockId b, size_t phi);
+
+    void declare_funcs(std::span<ASTNode* const> stmts);
+    const size_t* find_func(const std::string_view name) const;
+
+    VReg lower(const ASTNode* node);
+    VReg lower_stmts(std::span<ASTNode* const> stmts);
+    VReg lower_binary(const BinaryNode* node);
+    VReg lower_call(const FuncCallExprNode* node);
+    VReg lower_builtin(const FuncCallExprNode* node);
+    void lower_if(const IfStmtNode* node);
+    void lower_while(const WhileStmtNode* node);
+    void lower_for(const ForStmtNode* node);
+    void lower_func(const FuncDeclNode* node);
+    void lower_top(ASTNode* stmt);
+
+    void error(const std::string& msg);
+public:
+    explicit IRBuilder(IRModule& mod): mod(mod) {}
+
+    bool build(const ProgramASTNode& program);
+
+    /*
+     * 流式构造：begin() 之后逐条 add() 顶层语句，最后 finish()。
+     * add() 返回后语句的 AST 就可以释放，但名字仍指向源码，源码要保留到 finish()。
+     * 顶层函数无法提前声明，调用时还没定义的函数先登记，finish() 时检查是否都已定义。
+     */
+    void begin();
+    void add(ASTNode* stmt);
+    bool finish();
+
+    /*
+     * 声明其他模块的函数，在 begin() 之后、用到之前调用。imported 为模块在 import 列表中的下标。
+     * 只记录名字视图，name 要保留到 finish()。与本模块或先前导入的函数重名时报错。
+     */
+    bool declare_external(std::string_view name, size_t param_count, uint32_t imported);
+};
+
+}
@@ -0,0 +1,199 @@
+//
+// Call-site inlining and removal of unreferenced functions
+//
+
+#include "passes.hpp"
+
+#include <algorithm>
+#include <atomic>
+
+#include "parallel.hpp"
+
+namespace lmx::ir {
+
+namespace {
+
+// 直接或间接调用自身的函数
+std::vector<bool> find_recursive(const IRModule& mod) {
+    const auto n = mod.funcs.size();
+    std::vector<std::vector<size_t>> callees(n);
+    for (size_t f = 0; f < n; f++)
+        for (const auto& bb : mod.funcs[f].blocks)
+            for (const auto& inst : bb.insts)
+                if (inst.op == IROp::Call) callees[f].push_back(inst.imm);
+
+    std::vector<bool> recursive(n, false);
+    for (size_t f = 0; f < n; f++) {
+        std::vector<bool> seen(n, false);
+        std::vector<size_t> stack(callees[f].begin(), callees[f].end());
+        while (!stack.empty() && !recursive[f]) {
+            const auto g = stack.back();
+            stack.pop_back();
+            if (g == f) recursive[f] = true;
+            if (seen[g]) continue;
+            seen[g] = true;
+            stack.insert(stack.end(), callees[g].begin(), callees[g].end());
+        }
+    }
+    return recursive;
+}
+
+size_t body_size(const IRFunction& fn) {
+    size_t n = 0;
+    for (const auto& bb : fn.blocks) {
+        for (const auto& inst : bb.insts)
+            if (inst.op != IROp::Param && inst.op != IROp::Jmp) n++;
+    }
+    return n;
+}
+
+// 把 caller 中 blocks[b].insts[i] 处的调用替换为 callee 函数体
+void inline_call(IRFunction& caller, const BlockId b, const size_t i, const IRFunction& callee) {
+    const auto call = caller.blocks[b].insts[i];
+
+    // 调用点之后的指令移到续接块，原后继的前驱随之改为续接块
+    const auto cont = caller.new_block();
+    auto& tail = caller.blocks[b].insts;
+    caller.blocks[cont].insts.assign(tail.begin() + static_cast<ptrdiff_t>(i) + 1, tail.end());
+    tail.erase(tail.begin() + static_cast<ptrdiff_t>(i), tail.end());
+    caller.blocks[cont].sealed = true;
+    for (const auto s : caller.blocks[cont].succs())
+        std::ranges::replace(caller.blocks[s].preds, b, cont);
+
+    // 被调函数的块和 vreg 整体平移
+    const auto block_base = static_cast<BlockId>(caller.blocks.size());
+    const auto vreg_base = caller.vreg_count;
+    caller.vreg_count += callee.vreg_count;
+    for (size_t k = 0; k < callee.blocks.size(); k++) caller.new_block();
+
+    std::vector<std::pair<BlockId, VReg>> returns;
+    for (const auto& src : callee.blocks) {
+        const auto id = block_base + src.id;
+        auto& dst = caller.blocks[id];
+        dst.sealed = true;
+        for (const auto p : src.preds) dst.preds.push_back(block_base + p);
+        dst.phis = src.phis;
+        for (auto& phi : dst.phis) {
+            phi.dst += vreg_base;
+            for (auto& a : phi.args) a += vreg_base;
+        }
+        for (auto inst : src.insts) {
+            if (inst.dst != NO_VREG) inst.dst += vreg_base;
+            for (auto& a : inst.args) a += vreg_base;
+            for (auto& t : inst.target)
+                if (t != NO_BLOCK) t += block_base;
+            if (inst.op == IROp::Param) {
+                // 参数直接取调用点的实参
+                inst.op = IROp::Copy;
+                inst.args = {call.args[inst.imm]};
+                inst.imm = 0;
+            } else if (inst.op == IROp::Ret) {
+                VReg value;
+                if (inst.args.empty()) {
+                    value = caller.new_vreg();
+                    dst.insts.push_back({IROp::Const, value});
+                } else {
+                    value = inst.args[0];
+                }
+                returns.emplace_back(id, value);
+                inst = {IROp::Jmp};
+                inst.target[0] = cont;
+            }
+            dst.insts.push_back(std::move(inst));
+        }
+    }
+
+    IRInst jmp{IROp::Jmp};
+    jmp.target[0] = block_base;
+    caller.blocks[b].insts.push_back(std::move(jmp));
+    caller.blocks[block_base].preds.push_back(b);
+
+    // 多个 return 汇合为一个 phi
+    auto& join = caller.blocks[cont];
+    IRInst result{returns.size() == 1 ? IROp::Copy : IROp::Phi, call.dst};
+    for (const auto& [from, value] : returns) {
+        join.preds.push_back(from);
+        result.args.push_back(value);
+    }
+    if (call.dst == NO_VREG || returns.empty()) return;
+    if (result.op == IROp::Phi) join.phis.push_back(std::move(result));
+    else join.insts.insert(join.insts.begin(), std::move(result));
+}
+
+} // namespace
+
+bool inline_calls(IRModule& mod, const InlineOptions& options) {
+    const auto recursive = find_recursive(mod);
+    std::vector<bool> inlinable(mod.funcs.size(), false);
+    for (size_t f = 1; f < mod.funcs.size(); f++) {
+        const auto& fn = mod.funcs[f];
+        // 导入的函数体在别的模块里，看不到
+        inlinable[f] = !fn.external() && !recursive[f] && fn.blocks[0].preds.empty() &&
+                       body_size(fn) <= options.max_callee_size;
+    }
+
+    // 被调函数先按原样保存，避免内联进 caller 的同时修改正在被复制的函数
+    const auto originals = mod.funcs;
+    // 每个调用者只读 originals、只改自己，可以并行展开
+    std::atomic<bool> changed{false};
+    parallel_for(mod.funcs.size(), compile_threads(), [&](const size_t f) {
+        auto& caller = mod.funcs[f];
+        // 记录每个块来自第几层展开，新块追加在末尾，同一遍扫描即可覆盖
+        std::vector<size_t> depth(caller.blocks.size(), 0);
+        auto size = body_size(caller);
+        for (BlockId b = 0; b < caller.blocks.size(); b++) {
+            if (depth[b] >= options.max_depth) continue;
+            for (size_t i = 0; i < caller.blocks[b].insts.size(); i++) {
+                const auto& inst = caller.blocks[b].insts[i];
+                if (inst.op != IROp::Call || !inlinable[inst.imm]) continue;
+                const auto& callee = originals[inst.imm];
+                const auto callee_size = body_size(callee);
+                if (size + callee_size > options.max_caller_size) continue;
+                inline_call(caller, b, i, callee);
+                size += callee_size;
+                // 续接块与当前块同层，被调函数的块深一层
+                const auto level = depth[b];
+                depth.push_back(level);
+                depth.resize(caller.blocks.size(), level + 1);
+                changed.store(true, std::memory_order_relaxed);
+                break;
+            }
+        }
+    });
+    return changed;
+}
+
+bool remove_unused_functions(IRModule& mod) {
+    const auto n = mod.funcs.size();
+    std::vector<bool> live(n, false);
+    std::vector<size_t> work{0};
+    live[0] = true;
+    while (!work.empty()) {
+        const auto f = work.back();
+        work.pop_back();
+        for (const auto& bb : mod.funcs[f].blocks) {
+            for (const auto& inst : bb.insts) {
+                if (inst.op != IROp::Call || live[inst.imm]) continue;
+                live[inst.imm] = true;
+                work.push_back(inst.imm);
+            }
+        }
+    }
+    if (std::ranges::all_of(live, [](const bool l) { return l; })) return false;
+
+    std::vector<size_t> remap(n, 0);
+    std::vector<IRFunction> funcs;
+    for (size_t f = 0; f < n; f++) {
+        if (!live[f]) continue;
+        remap[f] = funcs.size();
+        funcs.push_back(std::move(mod.funcs[f]));
+    }
+    for (auto& fn : funcs)
+        for (auto& bb : fn.blocks)
+            for (auto& inst : bb.insts)
+                if (inst.op == IROp::Call) inst.imm = static_cast<int64_t>(remap[inst.imm]);
+    mod.funcs = std::move(funcs);
+    return true;
+}
+
+} // namespace lmx::ir
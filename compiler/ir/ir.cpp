@@ -0,0 +1,209 @@
+//
+// SSA intermediate representation between the AST and VM bytecode
+//
+
+#include "ir.hpp"
+
+#include <ostream>
+
+namespace lmx::ir {
+
+std::vector<BlockId> BasicBlock::succs() const {
+    if (!terminated()) return {};
+    const auto& term = insts.back();
+    switch (term.op) {
+    case IROp::Jmp: return {term.target[0]};
+    case IROp::Br: return {term.target[0], term.target[1]};
+    default: return {};
+    }
+}
+
+BlockId IRFunction::new_block() {
+    const auto id = static_cast<BlockId>(blocks.size());
+    blocks.push_back(BasicBlock{id});
+    return id;
+}
+
+void IRFunction::add_edge(const BlockId from, const BlockId to) {
+    blocks[to].preds.push_back(from);
+}
+
+const char* op_name(const IROp op) {
+    switch (op) {
+    case IROp::Const: return "const";
+    case IROp::Param: return "param";
+    case IROp::Copy: return "copy";
+    case IROp::Phi: return "phi";
+    case IROp::Add: return "add";
+    case IROp::Sub: return "sub";
+    case IROp::Mul: return "mul";
+    case IROp::Div: return "div";
+    case IROp::Mod: return "mod";
+    case IROp::Pow: return "pow";
+    case IROp::CmpGT: return "cmp.gt";
+    case IROp::CmpGE: return "cmp.ge";
+    case IROp::CmpLT: return "cmp.lt";
+    case IROp::CmpLE: return "cmp.le";
+    case IROp::CmpEQ: return "cmp.eq";
+    case IROp::CmpNE: return "cmp.ne";
+    case IROp::FAdd: return "fadd";
+    case IROp::FSub: return "fsub";
+    case IROp::FMul: return "fmul";
+    case IROp::FDiv: return "fdiv";
+    case IROp::FMod: return "fmod";
+    case IROp::FCmpGT: return "fcmp.gt";
+    case IROp::FCmpGE: return "fcmp.ge";
+    case IROp::FCmpLT: return "fcmp.lt";
+    case IROp::FCmpLE: return "fcmp.le";
+    case IROp::FCmpEQ: return "fcmp.eq";
+    case IROp::FCmpNE: return "fcmp.ne";
+    case IROp::ToFloat: return "to.float";
+    case IROp::BoxFloat: return "box.float";
+    case IROp::DAdd: return "dadd";
+    case IROp::DSub: return "dsub";
+    case IROp::DMul: return "dmul";
+    case IROp::DDiv: return "ddiv";
+    case IROp::DMod: return "dmod";
+    case IROp::Call: return "call";
+    case IROp::MapNew: return "map.new";
+    case IROp::MapGet: return "map.get";
+    case IROp::MapSet: return "map.set";
+    case IROp::MapDel: return "map.del";
+    case IROp::MapLen: return "map.len";
+    case IROp::Ret: return "ret";
+    case IROp::Jmp: return "jmp";
+    case IROp::Br: return "br";
+    case IROp::Halt: return "halt";
+    }
+    return "?";
+}
+
+static void dump_inst(std::ostream& os, const IRInst& inst, const IRModule* mod) {
+    os << "  ";
+    if (inst.dst != NO_VREG) os << '%' << inst.dst << " = ";
+    os << op_name(inst.op);
+    switch (inst.op) {
+    case IROp::Const:
+    case IROp::Param:
+        os << ' ' << inst.imm;
+        break;
+    case IROp::Call:
+        if (mod) os << ' ' << mod->funcs[inst.imm].name;
+        else os << " #" << inst.imm;
+        break;
+    default: break;
+    }
+    for (size_t i = 0; i < inst.args.size(); i++) {
+        os << (i == 0 && inst.op != IROp::Call ? " " : ", ") << '%' << inst.args[i];
+    }
+    if (inst.op == IROp::Jmp) os << " bb" << inst.target[0];
+    if (inst.op == IROp::Br) os << ", bb" << inst.target[0] << ", bb" << inst.target[1];
+    os << '\n';
+}
+
+static void dump_fn(std::ostream& os, const IRFunction& fn, const IRModule* mod) {
+    if (fn.external()) {
+        os << "extern func " << fn.name << " (params " << fn.param_count << ", import " << fn.imported << ")\n";
+        return;
+    }
+    os << "func " << fn.name << " (params " << fn.param_count << ", vregs " << fn.vreg_count << ")\n";
+    for (const auto& bb : fn.blocks) {
+        os << "bb" << bb.id << ':';
+        if (!bb.preds.empty()) {
+            os << "  ; preds";
+            for (const auto p : bb.preds) os << " bb" << p;
+        }
+        os << '\n';
+        for (const auto& phi : bb.phis) dump_inst(os, phi, mod);
+        for (const auto& inst : bb.insts) dump_inst(os, inst, mod);
+    }
+}
+
+void dump(std::ostream& os, const IRFunction& fn) {
+    dump_fn(os, fn, nullptr);
+}
+
+void dump(std::ostream& os, const IRModule& mod) {
+    for (const auto& fn : mod.funcs) {
+        dump_fn(os, fn, &mod);
+        os << '\n';
+    }
+}
+
+size_t inst_count(const IRModule& mod) {
+    size_t n = 0;
+    for (const auto& fn : mod.funcs)
+        for (const auto& bb : fn.blocks) n += bb.phis.size() + bb.insts.size();
+    return n;
+}
+
+std::vector<BlockId> reverse_post_order(const IRFunction& fn) {
+    std::vector<BlockId> order;
+    if (fn.blocks.empty()) return order;
+    std::vector<uint8_t> state(fn.blocks.size(), 0);
+    // 显式栈避免深度递归
+    std::vector<std::pair<BlockId, size_t>> stack{{0, 0}};
+    state[0] = 1;
+    while (!stack.empty()) {
+        auto& [b, i] = stack.back();
+        const auto succs = fn.blocks[b].succs();
+        if (i < succs.size()) {
+            // 逆序访问后继，使 RPO 中 then 分支排在 else 分支之前
+            const auto s = succs[succs.size() - 1 - i++];
+            if (!state[s]) {
+                state[s] = 1;
+                stack.emplace_back(s, 0);
+            }
+        } else {
+            order.push_back(b);
+            stack.pop_back();
+        }
+    }
+    return {order.rbegin(), order.rend()};
+}
+
+// Cooper, Harvey, Kennedy: "A Simple, Fast Dominance Algorithm"
+std::vector<BlockId> dominators(const IRFunction& fn, const std::vector<BlockId>& rpo) {
+    std::vector<BlockId> idom(fn.blocks.size(), NO_BLOCK);
+    std::vector<size_t> rpo_index(fn.blocks.size(), SIZE_MAX);
+    for (size_t i = 0; i < rpo.size(); i++) rpo_index[rpo[i]] = i;
+    if (rpo.empty()) return idom;
+    idom[rpo[0]] = rpo[0];
+
+    auto intersect = [&](BlockId a, BlockId b) {
+        while (a != b) {
+            while (rpo_index[a] > rpo_index[b]) a = idom[a];
+            while (rpo_index[b] > rpo_index[a]) b = idom[b];
+        }
+        return a;
+    };
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 1; i < rpo.size(); i++) {
+            const auto b = rpo[i];
+            BlockId new_idom = NO_BLOCK;
+            for (const auto p : fn.blocks[b].preds) {
+                if (idom[p] == NO_BLOCK) continue;
+                new_idom = new_idom == NO_BLOCK ? p : intersect(p, new_idom);
+            }
+            if (new_idom != idom[b]) {
+                idom[b] = new_idom;
+                changed = true;
+            }
+        }
+    }
+    return idom;
+}
+
+bool dominates(const std::vector<BlockId>& idom, const BlockId a, BlockId b) {
+    if (idom[b] == NO_BLOCK) return false;
+    while (true) {
+        if (a == b) return true;
+        if (idom[b] == b) return false;
+        b = idom[b];
+    }
+}
+
+} // namespace lmx::ir
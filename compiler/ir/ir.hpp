@@ -0,0 +1,110 @@
+//
+// SSA intermediate representation between the AST and VM bytecode
+//
+
+#pragma once
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "../../include/lmx_export.hpp"
+#include "../types.hpp"
+
+namespace lmx::ir {
+
+using VReg = uint32_t;
+using BlockId = uint32_t;
+constexpr VReg NO_VREG = UINT32_MAX;
+constexpr BlockId NO_BLOCK = UINT32_MAX;
+constexpr uint32_t NO_IMPORT = UINT32_MAX;
+
+enum class IROp : uint8_t {
+    Const,  // dst = imm
+    Param,  // dst = 第 imm 个参数
+    Copy,   // dst = args[0]
+    Phi,    // dst = phi(args...)，args 与 block.preds 一一对应
+    Add, Sub, Mul, Div, Mod, Pow,
+    CmpGT, CmpGE, CmpLT, CmpLE, CmpEQ, CmpNE,
+    // 按静态类型选择的运算：浮点运算和比较（比较结果为整数），Dynamic 的通用运算
+    FAdd, FSub, FMul, FDiv, FMod,
+    FCmpGT, FCmpGE, FCmpLT, FCmpLE, FCmpEQ, FCmpNE,
+    ToFloat,    // dst = 整数或 Dynamic 的 args[0] 转成浮点
+    BoxFloat,   // dst = 浮点 args[0]，带上标记交给 Dynamic 的位置
+    DAdd, DSub, DMul, DDiv, DMod,
+    Call,   // dst = call funcs[imm](args...)
+    MapNew, // dst = 新建的空表
+    MapGet, // dst = args[0][args[1]]，键不存在时为 0
+    MapSet, // args[0][args[1]] = args[2]，没有 dst
+    MapDel, // dst = 删除 args[0][args[1]]，删除了为 1
+    MapLen, // dst = args[0] 的键数
+    // 以下为终结指令
+    Ret,    // return args[0]（可为空）
+    Jmp,    // goto target[0]
+    Br,     // if args[0] goto target[0] else target[1]
+    Halt,   // 主程序结束，args[0]（可为空）写入 r0
+};
+
+struct IRInst {
+    IROp op;
+    VReg dst{NO_VREG};
+    std::vector<VReg> args;
+    int64_t imm{0};
+    BlockId target[2]{NO_BLOCK, NO_BLOCK};
+
+    [[nodiscard]] bool is_terminator() const { return op >= IROp::Ret; }
+    // 无副作用、只依赖操作数的指令，可以被 CSE / DCE / LICM 处理
+    [[nodiscard]] bool is_pure() const {
+        return op == IROp::Const || op == IROp::Copy || (op >= IROp::Add && op <= IROp::DMod);
+    }
+    // 可能触发运行时异常（除零），不能提前到可能不执行的位置
+    [[nodiscard]] bool may_trap() const {
+        return op == IROp::Div || op == IROp::Mod || op == IROp::DDiv || op == IROp::DMod;
+    }
+};
+
+struct BasicBlock {
+    BlockId id;
+    std::vector<IRInst> phis;
+    std::vector<IRInst> insts;      // 最后一条为终结指令
+    std::vector<BlockId> preds;
+    bool sealed{false};
+
+    [[nodiscard]] bool terminated() const { return !insts.empty() && insts.back().is_terminator(); }
+    [[nodiscard]] std::vector<BlockId> succs() const;
+};
+
+struct IRFunction {
+    std::string name;
+    size_t param_count{0};
+    // 推导出的返回值和参数类型，宿主直接调用时按它们转换；顶层函数都是 Dynamic 参数
+    Type ret{Type::Int};
+    std::vector<Type> params;
+    std::vector<BasicBlock> blocks;    // blocks[0] 为入口
+    VReg vreg_count{0};
+    // 从其他模块导入的函数没有函数体，imported 是该模块在本模块 import 列表中的下标
+    uint32_t imported{NO_IMPORT};
+
+    [[nodiscard]] bool external() const { return imported != NO_IMPORT; }
+
+    VReg new_vreg() { return vreg_count++; }
+    BlockId new_block();
+    void add_edge(BlockId from, BlockId to);
+};
+
+struct IRModule {
+    std::vector<IRFunction> funcs;     // funcs[0] 为顶层代码
+};
+
+LMC_API const char* op_name(IROp op);
+LMC_API void dump(std::ostream& os, const IRFunction& fn);
+LMC_API void dump(std::ostream& os, const IRModule& mod);
+LMC_API size_t inst_count(const IRModule& mod);
+
+// CFG 分析
+std::vector<BlockId> reverse_post_order(const IRFunction& fn);
+// idom[b] 为 b 的直接支配者，入口为自身，不可达块为 NO_BLOCK
+std::vector<BlockId> dominators(const IRFunction& fn, const std::vector<BlockId>& rpo);
+bool dominates(const std::vector<BlockId>& idom, BlockId a, BlockId b);
+
+} // namespace lmx::ir
@@ -0,0 +1,432 @@
+//
+// SSA -> VM bytecode
+//
+
+#include "lower.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+
+#include "../generator/emit.hpp"
+#include "../generator/generator.hpp"
+#include "parallel.hpp"
+#include "passes.hpp"
+#include "regalloc.hpp"
+
+namespace lmx::ir {
+
+namespace {
+
+constexpr size_t ARG_REG_TOP = REG_COUNT - 1;
+
+struct Move {
+    uint8_t dst, src;
+};
+
+// 把一组并行复制展开成顺序的 MOV_RR，成环时借助 scratch 寄存器
+void emit_parallel_moves(std::vector<runtime::Op>& ops, std::vector<Move> moves, const uint8_t scratch) {
+    std::erase_if(moves, [](const Move& m) { return m.dst == m.src; });
+    while (!moves.empty()) {
+        const auto ready = std::ranges::find_if(moves, [&](const Move& m) {
+            return std::ranges::none_of(moves, [&](const Move& o) { return o.src == m.dst; });
+        });
+        if (ready != moves.end()) {
+            LMXOpcodeEmitter::emit_mov_rr(ops, ready->dst, ready->src);
+            moves.erase(ready);
+            continue;
+        }
+        const auto blocked = moves.front().dst;
+        LMXOpcodeEmitter::emit_mov_rr(ops, scratch, blocked);
+        for (auto& m : moves)
+            if (m.src == blocked) m.src = scratch;
+    }
+}
+
+struct CompareBranch {
+    using Emit = void (*)(std::vector<runtime::Op>&, uint8_t, uint8_t, uint64_t);
+    Emit taken, inverse;
+};
+
+const CompareBranch* compare_branch(const IROp op) {
+    static constexpr CompareBranch lt{LMXOpcodeEmitter::emit_blt, LMXOpcodeEmitter::emit_bge};
+    static constexpr CompareBranch le{LMXOpcodeEmitter::emit_ble, LMXOpcodeEmitter::emit_bgt};
+    static constexpr CompareBranch gt{LMXOpcodeEmitter::emit_bgt, LMXOpcodeEmitter::emit_ble};
+    static constexpr CompareBranch ge{LMXOpcodeEmitter::emit_bge, LMXOpcodeEmitter::emit_blt};
+    static constexpr CompareBranch eq{LMXOpcodeEmitter::emit_beq, LMXOpcodeEmitter::emit_bne};
+    static constexpr CompareBranch ne{LMXOpcodeEmitter::emit_bne, LMXOpcodeEmitter::emit_beq};
+    switch (op) {
+    case IROp::CmpLT: return &lt;
+    case IROp::CmpLE: return &le;
+    case IROp::CmpGT: return &gt;
+    case IROp::CmpGE: return &ge;
+    case IROp::CmpEQ: return &eq;
+    case IROp::CmpNE: return &ne;
+    default: return nullptr;
+    }
+}
+
+// phi 所在块的前驱若有多个后继，则复制无处安放：插入一个中间块
+void split_critical_edges(IRFunction& fn) {
+    const auto count = fn.blocks.size();
+    for (BlockId b = 0; b < count; b++) {
+        if (fn.blocks[b].phis.empty()) continue;
+        for (size_t i = 0; i < fn.blocks[b].preds.size(); i++) {
+            const auto p = fn.blocks[b].preds[i];
+            if (fn.blocks[p].succs().size() < 2) continue;
+            const auto mid = fn.new_block();
+            fn.blocks[mid].preds.push_back(p);
+            IRInst jmp{IROp::Jmp};
+            jmp.target[0] = b;
+            fn.blocks[mid].insts.push_back(std::move(jmp));
+            for (auto& t : fn.blocks[p].insts.back().target)
+                if (t == b) t = mid;
+            fn.blocks[b].preds[i] = mid;
+        }
+    }
+}
+
+// 单个函数的字节码。函数内跳转先按相对函数起点的地址填写，链接时整体平移
+struct FuncCode {
+    std::vector<runtime::Op> ops;
+    std::vector<std::pair<size_t, size_t>> relocs;          // op 下标, 地址操作数偏移
+    std::vector<std::pair<size_t, size_t>> call_fixups;     // op 下标, 函数下标
+};
+
+void patch(runtime::Op& op, const size_t offset, const size_t addr) {
+    memcpy(op.operands + offset, &addr, sizeof(size_t));
+}
+
+class Lowering {
+    const IRModule& mod;
+    FuncCode& code;
+    std::vector<runtime::Op>& ops;
+    uint8_t scratch;
+
+public:
+    Lowering(const IRModule& mod, FuncCode& code, const uint8_t scratch)
+        : mod(mod), code(code), ops(code.ops), scratch(scratch) {}
+
+    bool lower_fn(size_t index);
+};
+
+bool Lowering::lower_fn(const size_t index) {
+    auto fn = mod.funcs[index];
+    remove_unreachable(fn);
+    split_critical_edges(fn);
+
+    const auto layout = reverse_post_order(fn);
+    RegAllocation alloc;
+    if (!allocate_registers(fn, layout, scratch, alloc)) return false;
+    const auto& reg = alloc.reg;
+
+    std::vector<uint32_t> uses(fn.vreg_count, 0);
+    std::vector<const IRInst*> def(fn.vreg_count, nullptr);
+    for (const auto& bb : fn.blocks) {
+        for (const auto& phi : bb.phis)
+            for (const auto a : phi.args) uses[a]++;
+        for (const auto& inst : bb.insts) {
+            for (const auto a : inst.args) uses[a]++;
+            if (inst.dst != NO_VREG) def[inst.dst] = &inst;
+        }
+    }
+
+    auto phi_moves = [&](const BlockId from, const BlockId to) {
+        const auto& target = fn.blocks[to];
+        std::vector<Move> moves;
+        if (target.phis.empty()) return moves;
+        const auto k = std::ranges::find(target.preds, from) - target.preds.begin();
+        for (const auto& phi : target.phis)
+            if (reg[phi.dst] != NO_REG && reg[phi.dst] != reg[phi.args[k]]) moves.push_back({reg[phi.dst], reg[phi.args[k]]});
+        return moves;
+    };
+
+    // 只有一条无需复制的 jmp 的块（多为拆分关键边留下的）不生成代码，跳转直接指向最终目标
+    std::vector<BlockId> forward(fn.blocks.size(), NO_BLOCK);
+    auto resolve = [&](BlockId b) {
+        while (forward[b] != NO_BLOCK) b = forward[b];
+        return b;
+    };
+    std::vector<BlockId> order;
+    for (size_t li = 0; li < layout.size(); li++) {
+        const auto& bb = fn.blocks[layout[li]];
+        if (li > 0 && bb.phis.empty() && bb.insts.size() == 1 && bb.insts[0].op == IROp::Jmp &&
+            resolve(bb.insts[0].target[0]) != bb.id && phi_moves(bb.id, bb.insts[0].target[0]).empty()) {
+            forward[bb.id] = bb.insts[0].target[0];
+            continue;
+        }
+        order.push_back(bb.id);
+    }
+
+    std::vector<size_t> label(fn.blocks.size(), 0);
+    std::vector<std::tuple<size_t, size_t, BlockId>> jump_fixups;  // op 下标, 操作数偏移, 目标块
+
+    auto jump = [&](const BlockId target) {
+        jump_fixups.emplace_back(ops.size(), 0, target);
+        LMXOpcodeEmitter::emit_jmp(ops, 0);
+    };
+
+    for (size_t li = 0; li < order.size(); li++) {
+        const auto& bb = fn.blocks[order[li]];
+        const auto next = li + 1 < order.size() ? order[li + 1] : NO_BLOCK;
+        label[bb.id] = ops.size();
+        for (size_t k = 0; k < bb.insts.size(); k++) {
+            const auto& inst = bb.insts[k];
+            const auto d = inst.dst != NO_VREG ? reg[inst.dst] : NO_REG;
+            auto r = [&](const size_t i) { return reg[inst.args[i]]; };
+            // 结果无人使用的纯指令没有分配寄存器
+            if (inst.dst != NO_VREG && d == NO_REG && (inst.is_pure() || inst.op == IROp::Param)) continue;
+
+            // 紧跟在 br 前且只被它使用的比较，合并为比较跳转
+            const auto* br = k + 1 < bb.insts.size() && bb.insts[k + 1].op == IROp::Br ? &bb.insts[k + 1] : nullptr;
+            const auto fusable = br && br->args[0] == inst.dst && uses[inst.dst] == 1;
+            if (fusable) {
+                const auto t = resolve(br->target[0]), f = resolve(br->target[1]);
+                // i = i + 1; i < n; br 且自增写回原寄存器：整个回边就是一条 LOOP_LT（它也接受 Dynamic 的循环变量）
+                const auto* inc = k > 0 ? &bb.insts[k - 1] : nullptr;
+                if (inst.op == IROp::CmpLT && t != next && inc && (inc->op == IROp::Add || inc->op == IROp::DAdd) &&
+                    inc->dst == inst.args[0] &&
+                    reg[inc->dst] != NO_REG && reg[inc->dst] == reg[inc->args[0]] && def[inc->args[1]] &&
+                    def[inc->args[1]]->op == IROp::Const && def[inc->args[1]]->imm == 1) {
+                    ops.pop_back();     // 撤掉刚生成的 ADD
+                    jump_fixups.emplace_back(ops.size(), 2, t);
+                    LMXOpcodeEmitter::emit_loop_lt(ops, reg[inc->dst], r(1), 0);
+                    if (f != next) jump(f);
+                    k++;
+                    continue;
+                }
+                if (const auto branch = compare_branch(inst.op)) {
+                    if (t == next) {
+                        jump_fixups.emplace_back(ops.size(), 2, f);
+                        branch->inverse(ops, r(0), r(1), 0);
+                    } else {
+                        jump_fixups.emplace_back(ops.size(), 2, t);
+                        branch->taken(ops, r(0), r(1), 0);
+                        if (f != next) jump(f);
+                    }
+                    k++;
+                    continue;
+                }
+            }
+
+            switch (inst.op) {
+            case IROp::Const:
+                LMXOpcodeEmitter::emit_mov_ri(ops, d, inst.imm);
+                break;
+            case IROp::Param:
+                if (d != ARG_REG_TOP - inst.imm) LMXOpcodeEmitter::emit_mov_rr(ops, d, ARG_REG_TOP - inst.imm);
+                break;
+            case IROp::Copy:
+                if (d != r(0)) LMXOpcodeEmitter::emit_mov_rr(ops, d, r(0));
+                break;
+            case IROp::Phi: break;
+            case IROp::Add: LMXOpcodeEmitter::emit_add(ops, d, r(0), r(1)); break;
+            case IROp::Sub: LMXOpcodeEmitter::emit_sub(ops, d, r(0), r(1)); break;
+            case IROp::Mul: LMXOpcodeEmitter::emit_mul(ops, d, r(0), r(1)); break;
+            case IROp::Div: LMXOpcodeEmitter::emit_div(ops, d, r(0), r(1)); break;
+            case IROp::Mod: LMXOpcodeEmitter::emit_mod(ops, d, r(0), r(1)); break;
+            case IROp::Pow: LMXOpcodeEmitter::emit_pow(ops, d, r(0), r(1)); break;
+            case IROp::CmpGT: LMXOpcodeEmitter::emit_cmp_gt(ops, d, r(0), r(1)); break;
+            case IROp::CmpGE: LMXOpcodeEmitter::emit_cmp_ge(ops, d, r(0), r(1)); break;
+            case IROp::CmpLT: LMXOpcodeEmitter::emit_cmp_lt(ops, d, r(0), r(1)); break;
+            case IROp::CmpLE: LMXOpcodeEmitter::emit_cmp_le(ops, d, r(0), r(1)); break;
+            case IROp::CmpEQ: LMXOpcodeEmitter::emit_cmp_eq(ops, d, r(0), r(1)); break;
+            case IROp::CmpNE: LMXOpcodeEmitter::emit_cmp_ne(ops, d, r(0), r(1)); break;
+            case IROp::FAdd: LMXOpcodeEmitter::emit_fadd(ops, d, r(0), r(1)); break;
+            case IROp::FSub: LMXOpcodeEmitter::emit_fsub(ops, d, r(0), r(1)); break;
+            case IROp::FMul: LMXOpcodeEmitter::emit_fmul(ops, d, r(0), r(1)); break;
+            case IROp::FDiv: LMXOpcodeEmitter::emit_fdiv(ops, d, r(0), r(1)); break;
+            case IROp::FMod: LMXOpcodeEmitter::emit_fmod(ops, d, r(0), r(1)); break;
+            case IROp::FCmpGT: LMXOpcodeEmitter::emit_fcmp_gt(ops, d, r(0), r(1)); break;
+            case IROp::FCmpGE: LMXOpcodeEmitter::emit_fcmp_ge(ops, d, r(0), r(1)); break;
+            case IROp::FCmpLT: LMXOpcodeEmitter::emit_fcmp_lt(ops, d, r(0), r(1)); break;
+            case IROp::FCmpLE: LMXOpcodeEmitter::emit_fcmp_le(ops, d, r(0), r(1)); break;
+            case IROp::FCmpEQ: LMXOpcodeEmitter::emit_fcmp_eq(ops, d, r(0), r(1)); break;
+            case IROp::FCmpNE: LMXOpcodeEmitter::emit_fcmp_ne(ops, d, r(0), r(1)); break;
+            case IROp::ToFloat: LMXOpcodeEmitter::emit_to_float(ops, d, r(0)); break;
+            case IROp::BoxFloat:
+                // 标记打在结果寄存器上
+                if (d != r(0)) LMXOpcodeEmitter::emit_mov_rr(ops, d, r(0));
+                LMXOpcodeEmitter::emit_box_float(ops, d);
+                break;
+            case IROp::DAdd: LMXOpcodeEmitter::emit_dadd(ops, d, r(0), r(1)); break;
+            case IROp::DSub: LMXOpcodeEmitter::emit_dsub(ops, d, r(0), r(1)); break;
+            case IROp::DMul: LMXOpcodeEmitter::emit_dmul(ops, d, r(0), r(1)); break;
+            case IROp::DDiv: LMXOpcodeEmitter::emit_ddiv(ops, d, r(0), r(1)); break;
+            case IROp::DMod: LMXOpcodeEmitter::emit_dmod(ops, d, r(0), r(1)); break;
+            case IROp::Call: {
+                // 调用者保存：跨越调用的值先写入本帧，返回后再取回
+                const auto& saves = alloc.call_saves.at(&inst);
+                for (size_t i = 0; i < saves.size(); i++)
+                    LMXOpcodeEmitter::emit_mov_mr(ops, runtime::FRAME_BASE, i, saves[i]);
+                for (size_t i = 0; i < inst.args.size(); i++)
+                    LMXOpcodeEmitter::emit_mov_rr(ops, ARG_REG_TOP - i, r(i));
+                code.call_fixups.emplace_back(ops.size(), inst.imm);
+                LMXOpcodeEmitter::emit_fcall(ops, 0, alloc.frame_size);
+                if (d != NO_REG) LMXOpcodeEmitter::emit_mov_rr(ops, d, 0);
+                for (size_t i = 0; i < saves.size(); i++)
+                    LMXOpcodeEmitter::emit_mov_rm(ops, saves[i], runtime::FRAME_BASE, i);
+                break;
+            }
+            // 结果没人用时也要执行（句柄无效会报错），写到 scratch 里
+            case IROp::MapNew: LMXOpcodeEmitter::emit_map_new(ops, d != NO_REG ? d : scratch); break;
+            case IROp::MapGet: LMXOpcodeEmitter::emit_map_get(ops, d != NO_REG ? d : scratch, r(0), r(1)); break;
+            case IROp::MapSet: LMXOpcodeEmitter::emit_map_set(ops, r(0), r(1), r(2)); break;
+            case IROp::MapDel: LMXOpcodeEmitter::emit_map_del(ops, d != NO_REG ? d : scratch, r(0), r(1)); break;
+            case IROp::MapLen: LMXOpcodeEmitter::emit_map_len(ops, d != NO_REG ? d : scratch, r(0)); break;
+            case IROp::Ret:
+                if (!inst.args.empty() && r(0) != 0) LMXOpcodeEmitter::emit_mov_rr(ops, 0, r(0));
+                LMXOpcodeEmitter::emit_fret(ops);
+                break;
+            case IROp::Halt:
+                if (!inst.args.empty() && r(0) != 0) LMXOpcodeEmitter::emit_mov_rr(ops, 0, r(0));
+                LMXOpcodeEmitter::emit_halt(ops);
+                break;
+            case IROp::Jmp: {
+                const auto t = resolve(inst.target[0]);
+                emit_parallel_moves(ops, phi_moves(bb.id, inst.target[0]), scratch);
+                if (t != next) jump(t);
+                break;
+            }
+            case IROp::Br: {
+                const auto t = resolve(inst.target[0]), f = resolve(inst.target[1]);
+                if (t == next) {
+                    jump_fixups.emplace_back(ops.size(), 1, f);
+                    LMXOpcodeEmitter::emit_if_false(ops, r(0), 0);
+                } else {
+                    jump_fixups.emplace_back(ops.size(), 1, t);
+                    LMXOpcodeEmitter::emit_if_true(ops, r(0), 0);
+                    if (f != next) jump(f);
+                }
+                break;
+            }
+            }
+        }
+    }
+    for (const auto& [at, offset, target] : jump_fixups) {
+        patch(ops[at], offset, label[target]);
+        code.relocs.emplace_back(at, offset);
+    }
+    return true;
+}
+
+// 按函数下标顺序拼接到 ops 末尾，平移函数内跳转，填入 FCALL 的目标；返回各函数的起始地址。
+// module 不为空时把写入的地址都记为重定位项，调用导入函数的 FCALL 记为外部调用
+std::vector<size_t> link(const IRModule& mod, std::vector<FuncCode>& code, std::vector<runtime::Op>& ops,
+                         ModuleCode* module = nullptr) {
+    std::vector<size_t> func_addr(code.size());
+    auto total = ops.size();
+    for (size_t i = 0; i < code.size(); i++) {
+        func_addr[i] = total;
+        total += code[i].ops.size();
+    }
+    ops.reserve(total);
+    for (size_t i = 0; i < code.size(); i++) {
+        auto& c = code[i];
+        for (const auto& [at, offset] : c.relocs) {
+            size_t addr;
+            memcpy(&addr, c.ops[at].operands + offset, sizeof(size_t));
+            patch(c.ops[at], offset, addr + func_addr[i]);
+            if (module) module->relocs.emplace_back(func_addr[i] + at, offset);
+        }
+        for (const auto& [at, callee] : c.call_fixups) {
+            const auto& target = mod.funcs[callee];
+            if (!target.external()) {
+                patch(c.ops[at], 0, func_addr[callee]);
+                if (module) module->relocs.emplace_back(func_addr[i] + at, 0);
+            } else if (module) {
+                module->calls.push_back({func_addr[i] + at, target.imported, target.name, target.param_count});
+            }
+        }
+        ops.insert(ops.end(), c.ops.begin(), c.ops.end());
+    }
+    return func_addr;
+}
+
+// 各函数独立分配寄存器、生成到自己的缓冲区；导入的函数没有函数体，缓冲区留空
+bool lower_functions(const IRModule& mod, std::vector<FuncCode>& code) {
+    size_t max_params = 0;
+    for (const auto& fn : mod.funcs) max_params = std::max(max_params, fn.param_count);
+    if (max_params >= ARG_REG_TOP) return false;
+
+    const auto scratch = static_cast<uint8_t>(ARG_REG_TOP - max_params);
+    code.assign(mod.funcs.size(), {});
+    std::atomic<bool> ok{true};
+    parallel_for(mod.funcs.size(), compile_threads(), [&](const size_t i) {
+        if (mod.funcs[i].external()) return;
+        if (ok.load(std::memory_order_relaxed) && !Lowering(mod, code[i], scratch).lower_fn(i))
+            ok.store(false, std::memory_order_relaxed);
+    });
+    return ok;
+}
+
+} // namespace
+
+bool lower(const IRModule& mod, std::vector<runtime::Op>& ops) {
+    std::vector<FunctionEntry> entries;
+    return lower(mod, ops, entries);
+}
+
+bool lower(const IRModule& mod, std::vector<runtime::Op>& ops, std::vector<FunctionEntry>& entries) {
+    // 整个程序在一个模块里，调用不到别处
+    if (std::ranges::any_of(mod.funcs, [](const IRFunction& fn) { return fn.external(); })) return false;
+    std::vector<FuncCode> code;
+    if (!lower_functions(mod, code)) return false;
+    const auto func_addr = link(mod, code, ops);
+    entries.clear();
+    for (size_t i = 1; i < mod.funcs.size(); i++)
+        entries.push_back({mod.funcs[i].name, func_addr[i], mod.funcs[i].param_count, mod.funcs[i].ret, mod.funcs[i].params});
+    return true;
+}
+
+bool lower_module(const IRModule& mod, ModuleCode& out, const bool with_top) {
+    std::vector<FuncCode> code;
+    if (!lower_functions(mod, code)) return false;
+    if (!with_top) code[0] = {};
+    out = {};
+    const auto func_addr = link(mod, code, out.ops, &out);
+    for (size_t i = 1; i < mod.funcs.size(); i++) {
+        const auto& fn = mod.funcs[i];
+        // 嵌套函数只在外层函数里可见，不导出
+        if (fn.external() || fn.name.find('@') != std::string::npos) continue;
+        out.exports.push_back({fn.name, func_addr[i], fn.param_count, fn.ret, fn.params});
+    }
+    return true;
+}
+
+bool link(std::span<const ModuleCode* const> modules, std::span<const std::vector<size_t>> imports,
+          std::vector<runtime::Op>& ops, std::string& error) {
+    std::vector<size_t> base(modules.size());
+    std::vector<std::unordered_map<std::string_view, const FunctionEntry*>> exports(modules.size());
+    auto total = ops.size();
+    for (size_t i = 0; i < modules.size(); i++) {
+        base[i] = total;
+        total += modules[i]->ops.size();
+        for (const auto& fn : modules[i]->exports) exports[i].emplace(fn.name, &fn);
+    }
+    ops.reserve(total);
+    for (size_t i = 0; i < modules.size(); i++) {
+        const auto& m = *modules[i];
+        const auto start = ops.size();
+        ops.insert(ops.end(), m.ops.begin(), m.ops.end());
+        for (const auto& [at, offset] : m.relocs) {
+            size_t addr;
+            memcpy(&addr, ops[start + at].operands + offset, sizeof(size_t));
+            patch(ops[start + at], offset, addr + base[i]);
+        }
+        for (const auto& call : m.calls) {
+            const auto dep = call.imported < imports[i].size() ? imports[i][call.imported] : modules.size();
+            const auto it = dep < modules.size() ? exports[dep].find(call.name) : exports[i].end();
+            if (dep == modules.size() || it == exports[dep].end() || it->second->param_count != call.param_count) {
+                error = "unresolved function `" + call.name + "` (" + std::to_string(call.param_count) + " arguments)";
+                return false;
+            }
+            patch(ops[start + call.at], 0, base[dep] + it->second->addr);
+        }
+    }
+    return true;
+}
+
+} // namespace lmx::ir
@@ -0,0 +1,67 @@
+//
+// SSA -> VM bytecode
+//
+
+#pragma once
+#include <span>
+#include <string>
+#include <vector>
+
+#include "../../include/lmx_export.hpp"
+#include "../../include/opcode.hpp"
+#include "ir.hpp"
+
+namespace lmx::ir {
+
+/*
+ * 把 IR 模块降低为字节码并追加到 ops 末尾：顶层代码在前，以 HALT 结束，
+ * 其后依次是各函数体。调用约定与 Generator 相同：第 i 个参数放在
+ * REG_COUNT - 1 - i 号寄存器，返回值放在 0 号寄存器。
+ * 寄存器不足或调用了导入的函数（应当用 lower_module）时返回 false，ops 保持原样。
+ */
+LMC_API bool lower(const IRModule& mod, std::vector<runtime::Op>& ops);
+
+// 函数体在字节码中的入口，宿主按名字直接调用时使用
+struct FunctionEntry {
+    std::string name;
+    size_t addr;
+    size_t param_count;
+    Type ret{Type::Int};
+    std::vector<Type> params;   // 嵌套函数的参数可能是浮点，顶层函数都是 Dynamic
+};
+
+// 同上，另外按 funcs[1..] 的顺序给出各函数的入口
+LMC_API bool lower(const IRModule& mod, std::vector<runtime::Op>& ops, std::vector<FunctionEntry>& entries);
+
+// 对其他模块函数的调用，链接时按名字填入地址
+struct ExternalCall {
+    size_t at;              // FCALL 在模块内的下标
+    uint32_t imported;      // 被调函数所在模块在 import 列表中的下标
+    std::string name;
+    size_t param_count;
+};
+
+/*
+ * 单独编译的模块，地址从 0 起算：relocs 记下所有模块内地址，链接时加上模块的起始位置，
+ * calls 在链接时解析到被导入模块的导出函数。字面量（包括浮点）都是指令的立即数，
+ * 字节码不引用常量池，模块也就没有常量段。
+ */
+struct ModuleCode {
+    std::vector<runtime::Op> ops;
+    std::vector<std::pair<size_t, size_t>> relocs;      // op 下标, 地址操作数偏移
+    std::vector<ExternalCall> calls;
+    std::vector<FunctionEntry> exports;                 // 顶层函数，addr 相对模块起点
+};
+
+// 降低为可重定位的模块；with_top 为 false 时不输出顶层代码，被导入的模块只提供函数
+LMC_API bool lower_module(const IRModule& mod, ModuleCode& out, bool with_top);
+
+/*
+ * 把各模块依次接到 ops 末尾，modules[0] 在最前。imports[i][k] 是模块 i 的第 k 条 import
+ * 对应的模块下标，外部调用在该模块的导出表里按名字和参数个数解析。
+ * 解析不到时返回 false 并写入 error，此时 ops 的内容不可用。
+ */
+LMC_API bool link(std::span<const ModuleCode* const> modules, std::span<const std::vector<size_t>> imports,
+                  std::vector<runtime::Op>& ops, std::string& error);
+
+}
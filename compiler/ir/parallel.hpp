@@ -0,0 +1,49 @@
+//
+// Fork-join helper for independent per-function compiler work
+//
+
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+namespace lmx::ir {
+
+// 编译用的线程数：默认取硬件线程数，环境变量 LMX_COMPILE_THREADS 可以覆盖（1 即单线程）
+inline unsigned compile_threads() {
+    static const unsigned threads = [] {
+        if (const char* env = std::getenv("LMX_COMPILE_THREADS"); env && *env) {
+            if (const auto n = std::strtoul(env, nullptr, 10); n > 0) return static_cast<unsigned>(n);
+        }
+        return std::max(1u, std::thread::hardware_concurrency());
+    }();
+    return threads;
+}
+
+/*
+ * 在最多 threads 个线程上对 [0, n) 的每个下标调用 f，下标按顺序动态领取，
+ * 函数大小悬殊时也能均衡。f 只能修改自己下标对应的数据。
+ * 每个线程分不到 MIN_PER_THREAD 个任务时少开线程，任务很少时直接在当前线程顺序执行。
+ */
+template<class F>
+void parallel_for(const size_t n, const unsigned threads, F&& f) {
+    constexpr size_t MIN_PER_THREAD = 16;
+    const auto count = std::min<size_t>(threads, n / MIN_PER_THREAD);
+    if (count <= 1) {
+        for (size_t i = 0; i < n; i++) f(i);
+        return;
+    }
+    std::atomic<size_t> next{0};
+    auto worker = [&] {
+        for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < n;) f(i);
+    };
+    std::vector<std::jthread> pool;
+    pool.reserve(count - 1);
+    for (size_t t = 1; t < count; t++) pool.emplace_back(worker);
+    worker();
+}
+
+}
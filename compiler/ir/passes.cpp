@@ -0,0 +1,429 @@
+//
+// SSA optimization passes
+//
+
+#include "passes.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+
+#include "parallel.hpp"
+
+namespace lmx::ir {
+
+bool remove_unreachable(IRFunction& fn) {
+    const auto rpo = reverse_post_order(fn);
+    if (rpo.size() == fn.blocks.size()) return false;
+
+    std::vector<bool> reachable(fn.blocks.size(), false);
+    for (const auto b : rpo) reachable[b] = true;
+    std::vector<BlockId> remap(fn.blocks.size(), NO_BLOCK);
+    BlockId next = 0;
+    for (BlockId b = 0; b < fn.blocks.size(); b++)
+        if (reachable[b]) remap[b] = next++;
+
+    std::vector<BasicBlock> blocks;
+    blocks.reserve(next);
+    for (auto& bb : fn.blocks) {
+        if (!reachable[bb.id]) continue;
+        std::vector<BlockId> preds;
+        std::vector<size_t> keep;
+        for (size_t i = 0; i < bb.preds.size(); i++) {
+            if (!reachable[bb.preds[i]]) continue;
+            keep.push_back(i);
+            preds.push_back(remap[bb.preds[i]]);
+        }
+        for (auto& phi : bb.phis) {
+            std::vector<VReg> args;
+            args.reserve(keep.size());
+            for (const auto i : keep) args.push_back(phi.args[i]);
+            phi.args = std::move(args);
+        }
+        bb.preds = std::move(preds);
+        bb.id = remap[bb.id];
+        if (bb.terminated()) {
+            for (auto& t : bb.insts.back().target)
+                if (t != NO_BLOCK) t = remap[t];
+        }
+        blocks.push_back(std::move(bb));
+    }
+    fn.blocks = std::move(blocks);
+    return true;
+}
+
+bool merge_blocks(IRFunction& fn) {
+    bool changed = false;
+    for (const auto b : reverse_post_order(fn)) {
+        // 已被并入前驱的块不再出现在 CFG 中
+        if (b != 0 && fn.blocks[b].preds.empty()) continue;
+        while (true) {
+            auto& bb = fn.blocks[b];
+            const auto& term = bb.insts.back();
+            if (term.op != IROp::Jmp) break;
+            const auto s = term.target[0];
+            if (s == b || s == 0 || fn.blocks[s].preds.size() != 1) break;
+
+            auto& succ = fn.blocks[s];
+            bb.insts.pop_back();
+            // 单前驱块的 phi 等价于复制
+            for (auto& phi : succ.phis) {
+                phi.op = IROp::Copy;
+                bb.insts.push_back(std::move(phi));
+            }
+            for (auto& inst : succ.insts) bb.insts.push_back(std::move(inst));
+            succ.phis.clear();
+            succ.insts.clear();
+            succ.preds.clear();
+            for (const auto t : bb.succs()) std::ranges::replace(fn.blocks[t].preds, s, b);
+            changed = true;
+        }
+    }
+    if (changed) remove_unreachable(fn);
+    return changed;
+}
+
+bool propagate_copies(IRFunction& fn) {
+    std::vector<VReg> repl(fn.vreg_count, NO_VREG);
+    auto find = [&](VReg v) {
+        while (repl[v] != NO_VREG) v = repl[v];
+        return v;
+    };
+
+    bool changed_any = false;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto& bb : fn.blocks) {
+            std::erase_if(bb.phis, [&](const IRInst& phi) {
+                // 除自引用外只有一个不同的来源 => 平凡 phi
+                VReg same = NO_VREG;
+                for (auto a : phi.args) {
+                    a = find(a);
+                    if (a == same || a == phi.dst) continue;
+                    if (same != NO_VREG) return false;
+                    same = a;
+                }
+                if (same == NO_VREG) return false;
+                repl[phi.dst] = same;
+                return changed = true;
+            });
+            std::erase_if(bb.insts, [&](const IRInst& inst) {
+                if (inst.op != IROp::Copy) return false;
+                repl[inst.dst] = find(inst.args[0]);
+                return changed = true;
+            });
+        }
+        changed_any |= changed;
+    }
+    if (!changed_any) return false;
+
+    for (auto& bb : fn.blocks) {
+        for (auto& phi : bb.phis)
+            for (auto& a : phi.args) a = find(a);
+        for (auto& inst : bb.insts)
+            for (auto& a : inst.args) a = find(a);
+    }
+    return true;
+}
+
+namespace {
+
+struct ExprKey {
+    IROp op;
+    int64_t imm;
+    std::vector<VReg> args;
+
+    bool operator==(const ExprKey&) const = default;
+};
+
+struct ExprKeyHash {
+    size_t operator()(const ExprKey& k) const {
+        size_t h = static_cast<size_t>(k.op) * 0x9e3779b97f4a7c15ULL ^ static_cast<size_t>(k.imm);
+        for (const auto a : k.args) h = (h ^ a) * 0x100000001b3ULL;
+        return h;
+    }
+};
+
+bool is_commutative(const IROp op) {
+    switch (op) {
+    case IROp::Add: case IROp::Mul: case IROp::CmpEQ: case IROp::CmpNE:
+    case IROp::FAdd: case IROp::FMul: case IROp::FCmpEQ: case IROp::FCmpNE:
+    case IROp::DAdd: case IROp::DMul:
+        return true;
+    default:
+        return false;
+    }
+}
+
+std::vector<std::vector<BlockId>> dom_children(const IRFunction& fn, const std::vector<BlockId>& rpo,
+                                               const std::vector<BlockId>& idom) {
+    std::vector<std::vector<BlockId>> children(fn.blocks.size());
+    for (const auto b : rpo)
+        if (idom[b] != b) children[idom[b]].push_back(b);
+    return children;
+}
+
+struct Loop {
+    BlockId header;
+    std::vector<bool> body;
+    size_t size{0};
+};
+
+std::vector<Loop> find_loops(const IRFunction& fn, const std::vector<BlockId>& idom) {
+    std::vector<Loop> loops;
+    std::unordered_map<BlockId, size_t> by_header;
+    for (const auto& bb : fn.blocks) {
+        if (idom[bb.id] == NO_BLOCK) continue;
+        for (const auto h : bb.succs()) {
+            if (!dominates(idom, h, bb.id)) continue;
+            // 回边 bb -> h
+            auto [it, inserted] = by_header.try_emplace(h, loops.size());
+            if (inserted) {
+                loops.push_back(Loop{h, std::vector<bool>(fn.blocks.size(), false)});
+                loops.back().body[h] = true;
+                loops.back().size = 1;
+            }
+            auto& loop = loops[it->second];
+            std::vector<BlockId> work{bb.id};
+            while (!work.empty()) {
+                const auto b = work.back();
+                work.pop_back();
+                if (loop.body[b]) continue;
+                loop.body[b] = true;
+                loop.size++;
+                for (const auto p : fn.blocks[b].preds)
+                    if (idom[p] != NO_BLOCK) work.push_back(p);
+            }
+        }
+    }
+    return loops;
+}
+
+void redirect(BasicBlock& bb, const BlockId from, const BlockId to) {
+    for (auto& t : bb.insts.back().target)
+        if (t == from) t = to;
+}
+
+// 为循环头创建唯一的前置块，把来自循环外的边汇聚到一起
+BlockId create_preheader(IRFunction& fn, const BlockId header, const std::vector<bool>& body) {
+    const auto ph = fn.new_block();
+    auto& h = fn.blocks[header];
+    std::vector<size_t> outside, inside;
+    for (size_t i = 0; i < h.preds.size(); i++) (body[h.preds[i]] ? inside : outside).push_back(i);
+
+    auto& pre = fn.blocks[ph];
+    for (const auto i : outside) pre.preds.push_back(h.preds[i]);
+    for (auto& phi : h.phis) {
+        VReg v;
+        if (outside.size() == 1) {
+            v = phi.args[outside[0]];
+        } else {
+            IRInst split{IROp::Phi};
+            v = split.dst = fn.new_vreg();
+            for (const auto i : outside) split.args.push_back(phi.args[i]);
+            pre.phis.push_back(std::move(split));
+        }
+        std::vector<VReg> args;
+        for (const auto i : inside) args.push_back(phi.args[i]);
+        args.push_back(v);
+        phi.args = std::move(args);
+    }
+    std::vector<BlockId> preds;
+    for (const auto i : inside) preds.push_back(h.preds[i]);
+    preds.push_back(ph);
+
+    for (const auto p : pre.preds) redirect(fn.blocks[p], header, ph);
+    h.preds = std::move(preds);
+    IRInst jmp{IROp::Jmp};
+    jmp.target[0] = header;
+    pre.insts.push_back(std::move(jmp));
+    return ph;
+}
+
+BlockId find_preheader(const IRFunction& fn, const Loop& loop) {
+    BlockId outside = NO_BLOCK;
+    for (const auto p : fn.blocks[loop.header].preds) {
+        if (loop.body[p]) continue;
+        if (outside != NO_BLOCK) return NO_BLOCK;
+        outside = p;
+    }
+    if (outside == NO_BLOCK || fn.blocks[outside].succs().size() != 1) return NO_BLOCK;
+    return outside;
+}
+
+} // namespace
+
+bool eliminate_common_subexpressions(IRFunction& fn) {
+    const auto rpo = reverse_post_order(fn);
+    const auto idom = dominators(fn, rpo);
+    const auto children = dom_children(fn, rpo, idom);
+
+    bool changed = false;
+    std::unordered_map<ExprKey, VReg, ExprKeyHash> available;
+    // 沿支配树先序遍历，离开子树时撤销该块加入的表达式
+    std::vector<std::pair<BlockId, std::vector<ExprKey>>> stack;
+    std::vector<std::pair<BlockId, size_t>> walk{{0, 0}};
+    stack.emplace_back(0, std::vector<ExprKey>{});
+    auto visit = [&](const BlockId b, std::vector<ExprKey>& added) {
+        for (auto& inst : fn.blocks[b].insts) {
+            if (!inst.is_pure() || inst.op == IROp::Copy) continue;
+            ExprKey key{inst.op, inst.imm, inst.args};
+            if (is_commutative(inst.op)) std::sort(key.args.begin(), key.args.end());
+            if (const auto it = available.find(key); it != available.end()) {
+                inst.op = IROp::Copy;
+                inst.args = {it->second};
+                inst.imm = 0;
+                changed = true;
+            } else {
+                available.emplace(key, inst.dst);
+                added.push_back(std::move(key));
+            }
+        }
+    };
+    visit(0, stack.back().second);
+    while (!walk.empty()) {
+        auto& [b, i] = walk.back();
+        if (i < children[b].size()) {
+            const auto c = children[b][i++];
+            stack.emplace_back(c, std::vector<ExprKey>{});
+            visit(c, stack.back().second);
+            walk.emplace_back(c, 0);
+        } else {
+            for (const auto& key : stack.back().second) available.erase(key);
+            stack.pop_back();
+            walk.pop_back();
+        }
+    }
+    return changed;
+}
+
+bool hoist_loop_invariants(IRFunction& fn) {
+    bool changed = false;
+    // 先保证每个循环都有专用前置块，CFG 变化后重新分析
+    while (true) {
+        const auto rpo = reverse_post_order(fn);
+        const auto idom = dominators(fn, rpo);
+        bool created = false;
+        for (const auto& loop : find_loops(fn, idom)) {
+            if (loop.header == 0 || find_preheader(fn, loop) != NO_BLOCK) continue;
+            create_preheader(fn, loop.header, loop.body);
+            created = changed = true;
+            break;
+        }
+        if (!created) break;
+    }
+
+    const auto rpo = reverse_post_order(fn);
+    const auto idom = dominators(fn, rpo);
+    auto loops = find_loops(fn, idom);
+    if (loops.empty()) return changed;
+    // 内层循环先处理，外提的指令还可以继续外提到外层
+    std::sort(loops.begin(), loops.end(), [](const Loop& a, const Loop& b) { return a.size < b.size; });
+
+    std::vector<BlockId> def_block(fn.vreg_count, NO_BLOCK);
+    for (const auto& bb : fn.blocks) {
+        for (const auto& phi : bb.phis) def_block[phi.dst] = bb.id;
+        for (const auto& inst : bb.insts)
+            if (inst.dst != NO_VREG) def_block[inst.dst] = bb.id;
+    }
+
+    for (const auto& loop : loops) {
+        const auto ph = find_preheader(fn, loop);
+        if (ph == NO_BLOCK) continue;
+        auto invariant = [&](const IRInst& inst) {
+            if (!inst.is_pure() || inst.may_trap()) return false;
+            return std::ranges::all_of(inst.args, [&](const VReg a) {
+                return def_block[a] == NO_BLOCK || !loop.body[def_block[a]];
+            });
+        };
+        for (const auto b : rpo) {
+            if (!loop.body[b]) continue;
+            auto& insts = fn.blocks[b].insts;
+            std::vector<IRInst> kept;
+            kept.reserve(insts.size());
+            for (auto& inst : insts) {
+                if (!invariant(inst)) {
+                    kept.push_back(std::move(inst));
+                    continue;
+                }
+                auto& dest = fn.blocks[ph].insts;
+                def_block[inst.dst] = ph;
+                dest.insert(dest.end() - 1, std::move(inst));
+                changed = true;
+            }
+            insts = std::move(kept);
+        }
+    }
+    return changed;
+}
+
+bool eliminate_dead_code(IRFunction& fn) {
+    bool changed = remove_unreachable(fn);
+
+    std::vector<const IRInst*> def(fn.vreg_count, nullptr);
+    std::vector<VReg> work;
+    for (const auto& bb : fn.blocks) {
+        for (const auto& phi : bb.phis) def[phi.dst] = &phi;
+        for (const auto& inst : bb.insts) {
+            if (inst.dst != NO_VREG) def[inst.dst] = &inst;
+            // 终结指令、调用和 map 操作有副作用或可能报错，作为根
+            if (!inst.is_pure())
+                work.insert(work.end(), inst.args.begin(), inst.args.end());
+        }
+    }
+    // 除数不是非零常量的除法可能报除零错误，结果没人用也要保留
+    for (const auto& bb : fn.blocks) {
+        for (const auto& inst : bb.insts) {
+            if (!inst.may_trap()) continue;
+            const auto* divisor = def[inst.args[1]];
+            if (!divisor || divisor->op != IROp::Const || divisor->imm == 0) work.push_back(inst.dst);
+        }
+    }
+    std::vector<bool> live(fn.vreg_count, false);
+    while (!work.empty()) {
+        const auto v = work.back();
+        work.pop_back();
+        if (live[v]) continue;
+        live[v] = true;
+        if (def[v]) work.insert(work.end(), def[v]->args.begin(), def[v]->args.end());
+    }
+
+    for (auto& bb : fn.blocks) {
+        const auto before = bb.phis.size() + bb.insts.size();
+        std::erase_if(bb.phis, [&](const IRInst& phi) { return !live[phi.dst]; });
+        std::erase_if(bb.insts, [&](const IRInst& inst) {
+            return inst.dst != NO_VREG && !live[inst.dst] && (inst.is_pure() || inst.op == IROp::Param);
+        });
+        changed |= bb.phis.size() + bb.insts.size() != before;
+    }
+    return changed;
+}
+
+static void optimize_function(IRFunction& fn) {
+    remove_unreachable(fn);
+    for (int round = 0; round < 4; round++) {
+        bool changed = propagate_copies(fn);
+        changed |= eliminate_common_subexpressions(fn);
+        changed |= propagate_copies(fn);
+        changed |= hoist_loop_invariants(fn);
+        changed |= eliminate_dead_code(fn);
+        changed |= merge_blocks(fn);
+        if (!changed) break;
+    }
+}
+
+void optimize(IRModule& mod, const OptimizeOptions& options) {
+    // 函数之间互不影响，分给多个线程
+    auto optimize_all = [&mod] {
+        parallel_for(mod.funcs.size(), compile_threads(), [&mod](const size_t i) {
+            if (!mod.funcs[i].external()) optimize_function(mod.funcs[i]);
+        });
+    };
+    // 先简化各函数，内联时按化简后的大小估算
+    optimize_all();
+    if (!inline_calls(mod)) return;
+    if (!options.keep_functions) remove_unused_functions(mod);
+    optimize_all();
+}
+
+} // namespace lmx::ir
@@ -0,0 +1,43 @@
+//
+// SSA optimization passes
+//
+
+#pragma once
+#include <cstddef>
+
+#include "../../include/lmx_export.hpp"
+#include "ir.hpp"
+
+namespace lmx::ir {
+
+// 删除不可达块并重新编号，同时移除对应的 phi 操作数
+LMC_API bool remove_unreachable(IRFunction& fn);
+// 把唯一后继且只有一个前驱的块并入当前块
+LMC_API bool merge_blocks(IRFunction& fn);
+// 复制传播：消除 copy 与平凡 phi
+LMC_API bool propagate_copies(IRFunction& fn);
+// 基于支配树的公共子表达式消除
+LMC_API bool eliminate_common_subexpressions(IRFunction& fn);
+// 循环不变量外提到循环前置块
+LMC_API bool hoist_loop_invariants(IRFunction& fn);
+// 死代码消除
+LMC_API bool eliminate_dead_code(IRFunction& fn);
+
+struct InlineOptions {
+    size_t max_callee_size{24};     // 被调函数体的指令数上限
+    size_t max_caller_size{2048};   // 展开后调用者的指令数上限
+    size_t max_depth{3};            // 被展开代码中的调用继续展开的层数
+};
+
+// 把小的非递归函数体展开到调用点：参数变为复制，return 变为跳到续接块
+LMC_API bool inline_calls(IRModule& mod, const InlineOptions& options = {});
+// 删除顶层代码不再能调用到的函数，并重新编号 Call
+LMC_API bool remove_unused_functions(IRModule& mod);
+
+struct OptimizeOptions {
+    bool keep_functions{false};     // 保留顶层代码调用不到的函数，宿主可能按名字调用它们
+};
+
+LMC_API void optimize(IRModule& mod, const OptimizeOptions& options = {});
+
+}
@@ -0,0 +1,212 @@
+//
+// Liveness analysis and linear-scan register allocation over SSA
+//
+
+#include "regalloc.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <bitset>
+#include <queue>
+
+#include "../generator/generator.hpp"
+
+namespace lmx::ir {
+
+namespace {
+
+class VRegSet {
+    std::vector<uint64_t> words;
+public:
+    explicit VRegSet(const size_t n = 0): words((n + 63) / 64, 0) {}
+    void set(const VReg v) { words[v / 64] |= 1ULL << (v % 64); }
+    void reset(const VReg v) { words[v / 64] &= ~(1ULL << (v % 64)); }
+    [[nodiscard]] bool test(const VReg v) const { return words[v / 64] >> (v % 64) & 1; }
+    bool operator==(const VRegSet&) const = default;
+
+    VRegSet& operator|=(const VRegSet& o) {
+        for (size_t i = 0; i < words.size(); i++) words[i] |= o.words[i];
+        return *this;
+    }
+    // this = a | (b & ~c)
+    void assign_union_minus(const VRegSet& a, const VRegSet& b, const VRegSet& c) {
+        for (size_t i = 0; i < words.size(); i++) words[i] = a.words[i] | (b.words[i] & ~c.words[i]);
+    }
+    template<class F>
+    void for_each(F&& f) const {
+        for (size_t i = 0; i < words.size(); i++) {
+            for (auto w = words[i]; w; w &= w - 1)
+                f(static_cast<VReg>(i * 64 + std::countr_zero(w)));
+        }
+    }
+};
+
+} // namespace
+
+std::vector<LiveInterval> build_intervals(const IRFunction& fn, const std::vector<BlockId>& layout,
+                                          std::vector<std::pair<const IRInst*, size_t>>* calls) {
+    const auto nb = fn.blocks.size();
+    const auto nv = fn.vreg_count;
+
+    // 每条指令占一个偶数位置，块起点单独占一个位置给 phi
+    std::vector<size_t> bstart(nb, 0), bend(nb, 0);
+    size_t pos = 0;
+    for (const auto b : layout) {
+        bstart[b] = pos;
+        pos += 2;
+        bend[b] = bstart[b];
+        for (size_t i = 0; i < fn.blocks[b].insts.size(); i++) {
+            bend[b] = pos;
+            pos += 2;
+        }
+    }
+
+    std::vector<VRegSet> gen(nb, VRegSet(nv)), kill(nb, VRegSet(nv));
+    std::vector<bool> used(nv, false);
+    for (const auto b : layout) {
+        const auto& bb = fn.blocks[b];
+        for (const auto& phi : bb.phis) {
+            kill[b].set(phi.dst);
+            for (const auto a : phi.args) used[a] = true;
+        }
+        for (const auto& inst : bb.insts) {
+            for (const auto a : inst.args) {
+                used[a] = true;
+                if (!kill[b].test(a)) gen[b].set(a);
+            }
+            if (inst.dst != NO_VREG) kill[b].set(inst.dst);
+            // DCE 留下的除法即使结果没人用也要执行，照样给它分配寄存器
+            if (inst.may_trap()) used[inst.dst] = true;
+        }
+    }
+
+    // phi 的操作数视为在对应前驱的末尾被使用
+    std::vector<VRegSet> live_in(nb, VRegSet(nv)), live_out(nb, VRegSet(nv));
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto it = layout.rbegin(); it != layout.rend(); ++it) {
+            const auto b = *it;
+            VRegSet out(nv);
+            for (const auto s : fn.blocks[b].succs()) {
+                out |= live_in[s];
+                const auto& succ = fn.blocks[s];
+                const auto k = std::ranges::find(succ.preds, b) - succ.preds.begin();
+                for (const auto& phi : succ.phis) out.set(phi.args[k]);
+            }
+            VRegSet in(nv);
+            in.assign_union_minus(gen[b], out, kill[b]);
+            if (!(in == live_in[b]) || !(out == live_out[b])) {
+                live_in[b] = std::move(in);
+                live_out[b] = std::move(out);
+                changed = true;
+            }
+        }
+    }
+
+    std::vector<size_t> lo(nv, SIZE_MAX), hi(nv, 0);
+    auto extend = [&](const VReg v, const size_t p) {
+        lo[v] = std::min(lo[v], p);
+        hi[v] = std::max(hi[v], p);
+    };
+    for (const auto b : layout) {
+        const auto& bb = fn.blocks[b];
+        live_in[b].for_each([&](const VReg v) { extend(v, bstart[b]); });
+        live_out[b].for_each([&](const VReg v) { extend(v, bend[b]); });
+        for (const auto& phi : bb.phis) extend(phi.dst, bstart[b]);
+        auto p = bstart[b];
+        for (const auto& inst : bb.insts) {
+            p += 2;
+            for (const auto a : inst.args) extend(a, p);
+            if (inst.dst != NO_VREG) extend(inst.dst, p);
+            if (calls && inst.op == IROp::Call) calls->emplace_back(&inst, p);
+        }
+    }
+
+    std::vector<LiveInterval> intervals;
+    for (VReg v = 0; v < nv; v++) {
+        // 只定义不使用的值不占寄存器
+        if (lo[v] != SIZE_MAX && used[v]) intervals.push_back({v, lo[v], hi[v]});
+    }
+    return intervals;
+}
+
+bool allocate_registers(const IRFunction& fn, const std::vector<BlockId>& layout,
+                        const uint8_t reg_limit, RegAllocation& out) {
+    std::vector<std::pair<const IRInst*, size_t>> calls;
+    auto intervals = build_intervals(fn, layout, &calls);
+    std::ranges::sort(intervals, [](const LiveInterval& a, const LiveInterval& b) {
+        return a.start != b.start ? a.start < b.start : a.end < b.end;
+    });
+
+    std::vector<std::vector<VReg>> hints(fn.vreg_count);
+    std::vector<VReg> param_of(fn.vreg_count, NO_VREG);
+    for (const auto& bb : fn.blocks) {
+        for (const auto& phi : bb.phis) {
+            for (const auto a : phi.args) {
+                hints[phi.dst].push_back(a);
+                hints[a].push_back(phi.dst);
+            }
+        }
+        for (const auto& inst : bb.insts) {
+            if (inst.op == IROp::Param) param_of[inst.dst] = static_cast<VReg>(inst.imm);
+            if (inst.op != IROp::Copy) continue;
+            hints[inst.dst].push_back(inst.args[0]);
+            hints[inst.args[0]].push_back(inst.dst);
+        }
+    }
+
+    const bool leaf = calls.empty();
+    std::vector<bool> prefer_r0(fn.vreg_count, false);
+    if (leaf) {
+        for (const auto& bb : fn.blocks)
+            for (const auto& inst : bb.insts)
+                if ((inst.op == IROp::Ret || inst.op == IROp::Halt) && !inst.args.empty())
+                    prefer_r0[inst.args[0]] = true;
+    }
+
+    out.reg.assign(fn.vreg_count, NO_REG);
+    std::bitset<256> busy;
+    if (!leaf) busy.set(0);
+    using Active = std::pair<size_t, uint8_t>;     // end, reg
+    std::priority_queue<Active, std::vector<Active>, std::greater<>> active;
+    for (const auto& iv : intervals) {
+        // 在同一位置结束的区间先释放，结果可以复用操作数的寄存器
+        while (!active.empty() && active.top().first <= iv.start) {
+            busy.reset(active.top().second);
+            active.pop();
+        }
+        if (leaf && param_of[iv.vreg] != NO_VREG) {
+            // 传参寄存器不在分配池中，不需要登记占用
+            out.reg[iv.vreg] = static_cast<uint8_t>(REG_COUNT - 1 - param_of[iv.vreg]);
+            continue;
+        }
+        uint8_t r = NO_REG;
+        if (prefer_r0[iv.vreg] && !busy.test(0)) r = 0;
+        for (const auto h : hints[iv.vreg]) {
+            if (r != NO_REG) break;
+            if (out.reg[h] != NO_REG && out.reg[h] < reg_limit && !busy.test(out.reg[h])) r = out.reg[h];
+        }
+        for (uint8_t i = 1; r == NO_REG && i < reg_limit; i++)
+            if (!busy.test(i)) r = i;
+        if (r == NO_REG) return false;
+        busy.set(r);
+        out.reg[iv.vreg] = r;
+        out.regs_used = std::max<size_t>(out.regs_used, r);
+        active.emplace(iv.end, r);
+    }
+
+    // 扫描每个调用点，收集跨越它的区间
+    size_t next = 0;
+    std::vector<const LiveInterval*> live;
+    for (const auto& [call, p] : calls) {
+        while (next < intervals.size() && intervals[next].start < p) live.push_back(&intervals[next++]);
+        std::erase_if(live, [p](const LiveInterval* iv) { return iv->end <= p; });
+        auto& saves = out.call_saves[call];
+        for (const auto* iv : live) saves.push_back(out.reg[iv->vreg]);
+        out.frame_size = std::max<uint16_t>(out.frame_size, saves.size());
+    }
+    return true;
+}
+
+} // namespace lmx::ir
@@ -0,0 +1,45 @@
+//
+// Liveness analysis and linear-scan register allocation over SSA
+//
+
+#pragma once
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "../../include/lmx_export.hpp"
+#include "ir.hpp"
+
+namespace lmx::ir {
+
+struct LiveInterval {
+    VReg vreg;
+    size_t start, end;      // 闭区间，按线性化后的指令位置编号
+};
+
+constexpr uint8_t NO_REG = 255;
+
+struct RegAllocation {
+    std::vector<uint8_t> reg;                       // vreg -> 物理寄存器，NO_REG 表示未分配
+    // 跨越调用仍然存活的寄存器，由调用者在 FCALL 前后存取帧内存
+    std::unordered_map<const IRInst*, std::vector<uint8_t>> call_saves;
+    uint16_t frame_size{0};
+    size_t regs_used{0};
+};
+
+/*
+ * 按 layout（块的线性顺序）编号指令，迭代求解 live-in/live-out，
+ * 为每个 vreg 建立覆盖其全部活跃位置的区间，再做 Poletto & Sarkar 式线性扫描。
+ * 区间在同一位置结束和开始时可以共用寄存器，因此 `d = add a, b` 可以直接写回 a。
+ * phi 的目标和操作数互相作为提示，尽量分到同一寄存器以省掉边上的复制。
+ * 可分配寄存器为 [1, reg_limit)，不够时返回 false。
+ * 叶子函数中没有调用会破坏参数寄存器和 r0：参数直接留在传参寄存器里，
+ * 返回值优先分配到 r0。
+ */
+LMC_API bool allocate_registers(const IRFunction& fn, const std::vector<BlockId>& layout,
+                                uint8_t reg_limit, RegAllocation& out);
+
+LMC_API std::vector<LiveInterval> build_intervals(const IRFunction& fn, const std::vector<BlockId>& layout,
+                                                  std::vector<std::pair<const IRInst*, size_t>>* calls = nullptr);
+
+}
@@ -4,17 +4,152 @@
 
 #include "lexer.hpp"
 
-#include <unordered_map>
+#include <array>
+#include <bit>
+#include <charconv>
+#include <cstring>
 #include <iostream>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define LMX_LEXER_SIMD 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define LMX_LEXER_SIMD 1
+#endif
+
 namespace lmx {
 
+namespace {
+
+enum CharClass : uint8_t { SPACE = 1, DIGIT = 2, ALPHA = 4, NEWLINE = 8 };
+
+// 与 C locale 下的 isspace/isdigit/isalpha 一致
+constexpr std::array<uint8_t, 256> CHAR_CLASS = [] {
+    std::array<uint8_t, 256> t{};
+    for (int c = '0'; c <= '9'; c++) t[c] = DIGIT;
+    for (int c = 'a'; c <= 'z'; c++) t[c] = ALPHA;
+    for (int c = 'A'; c <= 'Z'; c++) t[c] = ALPHA;
+    for (const char c : {' ', '\t', '\r', '\v', '\f'}) t[static_cast<unsigned char>(c)] = SPACE;
+    t['\n'] = SPACE | NEWLINE;
+    return t;
+}();
+
+inline bool is(const char c, const uint8_t cls) {
+    return CHAR_CLASS[static_cast<unsigned char>(c)] & cls;
+}
+
+#ifdef LMX_LEXER_SIMD
+/*
+ * 一次判断一整块字节的类别，得到每字节一位的掩码，countr_one 即为连续同类字节数。
+ * 只用有符号字节比较：>= 0x80 的字节是负数，不会落进任何 ASCII 区间。
+ */
+#if defined(__AVX2__)
+constexpr size_t LANES = 32;
+using Chunk = __m256i;
+inline Chunk load(const char* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+inline Chunk splat(const char c) { return _mm256_set1_epi8(c); }
+inline Chunk eq(const Chunk a, const Chunk b) { return _mm256_cmpeq_epi8(a, b); }
+inline Chunk gt(const Chunk a, const Chunk b) { return _mm256_cmpgt_epi8(a, b); }
+inline Chunk both(const Chunk a, const Chunk b) { return _mm256_and_si256(a, b); }
+inline Chunk either(const Chunk a, const Chunk b) { return _mm256_or_si256(a, b); }
+inline uint32_t bits(const Chunk v) { return static_cast<uint32_t>(_mm256_movemask_epi8(v)); }
+#else
+constexpr size_t LANES = 16;
+using Chunk = __m128i;
+inline Chunk load(const char* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+inline Chunk splat(const char c) { return _mm_set1_epi8(c); }
+inline Chunk eq(const Chunk a, const Chunk b) { return _mm_cmpeq_epi8(a, b); }
+inline Chunk gt(const Chunk a, const Chunk b) { return _mm_cmpgt_epi8(a, b); }
+inline Chunk both(const Chunk a, const Chunk b) { return _mm_and_si128(a, b); }
+inline Chunk either(const Chunk a, const Chunk b) { return _mm_or_si128(a, b); }
+inline uint32_t bits(const Chunk v) { return static_cast<uint32_t>(_mm_movemask_epi8(v)); }
+#endif
+
+inline Chunk in_range(const Chunk v, const char lo, const char hi) {
+    return both(gt(v, splat(static_cast<char>(lo - 1))), gt(splat(static_cast<char>(hi + 1)), v));
+}
+inline uint32_t digit_mask(const Chunk v) { return bits(in_range(v, '0', '9')); }
+inline uint32_t alnum_mask(const Chunk v) {
+    // | 0x20 把大写折成小写，'@' '[' 之类折过去也不在 a-z 内
+    return bits(either(in_range(v, '0', '9'), in_range(either(v, splat(0x20)), 'a', 'z')));
+}
+inline uint32_t space_mask(const Chunk v) { return bits(either(eq(v, splat(' ')), in_range(v, '\t', '\r'))); }
+inline uint32_t newline_mask(const Chunk v) { return bits(eq(v, splat('\n'))); }
+#endif
+
+// [p, end) 开头连续属于 cls 的字节数
+template<uint8_t cls>
+size_t scan_run(const char* const p, const char* const end) {
+    auto q = p;
+#ifdef LMX_LEXER_SIMD
+    while (q + LANES <= end) {
+        const auto v = load(q);
+        const auto n = static_cast<size_t>(std::countr_one(cls == DIGIT ? digit_mask(v) : alnum_mask(v)));
+        q += n;
+        if (n < LANES) return q - p;
+    }
+#endif
+    while (q < end && is(*q, cls)) q++;
+    return q - p;
+}
+
+/*
+ * 关键字的编译期完美哈希：首字符、末字符和长度组合后落在 16 个槽里互不冲突，
+ * 查找只需一次取表和一次比较。
+ */
+struct Keyword {
+    std::string_view text;
+    TokenType type;
+};
+
+constexpr Keyword KEYWORDS[] = {
+    {"func", TokenType::KW_FUNC},
+    {"return", TokenType::KW_RETURN},
+    {"if", TokenType::KW_IF},
+    {"else", TokenType::KW_ELSE},
+    {"let", TokenType::KW_LET},
+    {"while", TokenType::KW_WHILE},
+    {"for", TokenType::KW_FOR},
+    {"in", TokenType::KW_IN},
+    {"import", TokenType::KW_IMPORT},
+};
+constexpr size_t MAX_KEYWORD_LEN = 6;
+
+constexpr size_t keyword_hash(const std::string_view s) {
+    return (static_cast<unsigned char>(s.front()) * 4 + static_cast<unsigned char>(s.back()) + s.size() * 2) & 15;
+}
+
+constexpr std::array<int8_t, 16> KEYWORD_SLOTS = [] {
+    std::array<int8_t, 16> t{};
+    t.fill(-1);
+    for (size_t i = 0; i < std::size(KEYWORDS); i++) t[keyword_hash(KEYWORDS[i].text)] = static_cast<int8_t>(i);
+    return t;
+}();
+
+static_assert([] {
+    for (size_t i = 0; i < std::size(KEYWORDS); i++) {
+        if (KEYWORD_SLOTS[keyword_hash(KEYWORDS[i].text)] != static_cast<int8_t>(i)) return false;
+        if (KEYWORDS[i].text.size() > MAX_KEYWORD_LEN) return false;
+    }
+    return true;
+}(), "keyword hash has collisions, adjust keyword_hash");
+
+inline TokenType classify_word(const std::string_view word) {
+    if (word.size() < 2 || word.size() > MAX_KEYWORD_LEN) return TokenType::IDENTIFIER;
+    const auto slot = KEYWORD_SLOTS[keyword_hash(word)];
+    return slot >= 0 && KEYWORDS[slot].text == word ? KEYWORDS[slot].type : TokenType::IDENTIFIER;
+}
+
+} // namespace
+
 std::ostream& operator<<(std::ostream& os, const Token& t) {
     os << "Token(";
     switch (t.type) {
     case TokenType::END_OF_FILE: os << "END_OF_FILE"; break;
     case TokenType::IDENTIFIER: os << "IDENTIFIER"; break;
     case TokenType::NUM_LITERAL: os << "INT_LITERAL"; break;
+    case TokenType::FLOAT_LITERAL: os << "FLOAT_LITERAL"; break;
     case TokenType::STRING_LITERAL: os << "STRING_LITERAL"; break;
     case TokenType::COMMA: os << "COMMA"; break;
     case TokenType::TRUE_LITERAL: os << "TRUE_LITERAL"; break;
@@ -31,6 +166,7 @@ std::ostream& operator<<(std::ostream& os, const Token& t) {
     case TokenType::LT: os << "LT"; break;
     case TokenType::COLON: os << "COLON"; break;
     case TokenType::COL_COLON: os << "COL_COLON"; break;
+    case TokenType::DOT_DOT: os << "DOT_DOT"; break;
     case TokenType::OPER_POW: os << "OPER_POW"; break;
     case TokenType::ASSIGN: os << "ASSIGN"; break;
     case TokenType::NOT: os << "NOT"; break;
@@ -45,180 +181,152 @@ std::ostream& operator<<(std::ostream& os, const Token& t) {
     case TokenType::UNKNOWN: os << "UNKNOWN"; break;
     case TokenType::KW_FUNC: os << "KEYWORD_FUNC"; break;
     case TokenType::KW_RETURN: os << "KEYWORD_RETURN"; break;
+    case TokenType::KW_WHILE: os << "KEYWORD_WHILE"; break;
+    case TokenType::KW_FOR: os << "KEYWORD_FOR"; break;
+    case TokenType::KW_IN: os << "KEYWORD_IN"; break;
+    case TokenType::KW_IMPORT: os << "KEYWORD_IMPORT"; break;
     default: os << "UNKNOWN";
     }
-    os << ", " << t.text << ", " << t.line << ", " << t.col << ')';
+    os << ", ";
+    if (t.type == TokenType::NUM_LITERAL) os << t.value;
+    else os << t.text();
+    os << ", " << t.line << ", " << t.col << ')';
     return os;
 }
 
-void Lexer::advance() {
-    pos++;
-    if (src[pos] == '\n') {
-        line++;
-        col = 1;
-    } else col++;
-}
-
-Token Lexer::next() {
-    while (isspace(src[pos])) {
-        advance();
-    }
-    if (pos >= src.size()) return {TokenType::END_OF_FILE,"", line, col};
-
-    switch (src[pos]) {
-        case '+': {
-            advance();
-            return {TokenType::OPER_PLUS, "+", line, col};
-        }
-        case '-': {
-            advance();
-            return {TokenType::OPER_MINUS, "-", line, col};
-        }
-        case '*': {
-            advance();
-            return {TokenType::OPER_MUL, "*", line, col};
-        }
-        case '/': {
-            advance();
-            return {TokenType::OPER_DIV, "/", line, col};
-        }
-        case '%': {
-            advance();
-            return {TokenType::OPER_MOD, "%", line, col};
-        }
-        case '=': {
-            advance();
-            if (src[pos] == '=') {
-                advance();
-                return {TokenType::EQ, "==", line, col};
-            }
-            return {TokenType::ASSIGN, "=", line, col};
-        }
-        case '>': {
-            advance();
-            if (src[pos] == '=') {
-                advance();
-                return {TokenType::GE, ">=", line, col};
-            }
-            return {TokenType::GT, ">", line, col};
-        }
-        case '<': {
-            advance();
-            if (src[pos] == '=') {
-                advance();
-                return {TokenType::LE, "<=", line, col};
+void Lexer::skip_blank() {
+    const char* const base = src.data();
+    const char* const end = base + src.size();
+    auto p = base + pos;
+    while (p < end) {
+#ifdef LMX_LEXER_SIMD
+        while (p + LANES <= end) {
+            const auto v = load(p);
+            const auto run = static_cast<size_t>(std::countr_one(space_mask(v)));
+            // 只统计空白段内的换行
+            const auto nl = newline_mask(v) & (run >= 32 ? ~0u : (1u << run) - 1);
+            if (nl) {
+                line += std::popcount(nl);
+                line_start = p - base + (31 - std::countl_zero(nl)) + 1;
             }
-            return {TokenType::LT, "<", line, col};
+            p += run;
+            if (run < LANES) break;
         }
-        case ':': {
-            advance();
-            if (src[pos] == ':') {
-                advance();
-                return {TokenType::COL_COLON, "::", line, col};
+#endif
+        while (p < end && is(*p, SPACE)) {
+            if (*p == '\n') {
+                line++;
+                line_start = p - base + 1;
             }
-            return {TokenType::COLON, ":", line, col};
-        }
-        case '^': {
-            advance();
-            return {TokenType::OPER_POW, "^", line, col};
+            p++;
         }
-        case '#': {
-            while (src[pos] != '\n')
-                advance();
-            advance();
+        if (p < end && *p == '#') {
+            const auto nl = static_cast<const char*>(memchr(p, '\n', end - p));
+            p = nl ? nl : end;
+            continue;
         }
-        case '"': {
-            advance();
-            std::string str;
-            while (src[pos] != '"') {
-                str += src[pos];
-                advance();
-            }
-            advance();
+        break;
+    }
+    pos = p - base;
+}
 
-            return {TokenType::STRING_LITERAL, str, line, col - str.size()};
-        }
-        case '(': {
-            advance();
-            return {TokenType::LPAREN, "(", line, col};
-        }
-        case ')': {
-            advance();
-            return {TokenType::RPAREN, ")", line, col};
-        }
-        case '{': {
-            advance();
-            return {TokenType::LBRACE, "{", line, col};
-        }
-        case '}': {
-            advance();
-            return {TokenType::RBRACE, "}", line, col};
-        }
-        case '[': {
-            advance();
-            return {TokenType::LBRACK, "[", line, col};
-        }
-        case ']': {
-            advance();
-            return {TokenType::RBRACK, "]", line, col};
-        }
-        case ',': {
-            advance();
-            return {TokenType::COMMA, ", ", line, col};
-        }
-        case '!': {
-            advance();
-            if (src[pos] == '=') {
-                advance();
-                return {TokenType::NE, "!=", line, col};
+// 调用前已跳过空白
+Token Lexer::next() {
+    const auto begin = pos;
+    const auto l = static_cast<uint32_t>(line);
+    const auto c = col();
+    auto make = [&](const TokenType type, const size_t len) {
+        pos = begin + len;
+        return Token{type, src.data() + begin, static_cast<uint32_t>(len), l, c};
+    };
+    if (pos >= src.size()) return make(TokenType::END_OF_FILE, 0);
+
+    switch (src[pos]) {
+        case '+': return make(TokenType::OPER_PLUS, 1);
+        case '-': return make(TokenType::OPER_MINUS, 1);
+        case '*': return make(TokenType::OPER_MUL, 1);
+        case '/': return make(TokenType::OPER_DIV, 1);
+        case '%': return make(TokenType::OPER_MOD, 1);
+        case '^': return make(TokenType::OPER_POW, 1);
+        case '(': return make(TokenType::LPAREN, 1);
+        case ')': return make(TokenType::RPAREN, 1);
+        case '{': return make(TokenType::LBRACE, 1);
+        case '}': return make(TokenType::RBRACE, 1);
+        case '[': return make(TokenType::LBRACK, 1);
+        case ']': return make(TokenType::RBRACK, 1);
+        case ',': return make(TokenType::COMMA, 1);
+        case '=': return peek(1) == '=' ? make(TokenType::EQ, 2) : make(TokenType::ASSIGN, 1);
+        case '>': return peek(1) == '=' ? make(TokenType::GE, 2) : make(TokenType::GT, 1);
+        case '<': return peek(1) == '=' ? make(TokenType::LE, 2) : make(TokenType::LT, 1);
+        case '!': return peek(1) == '=' ? make(TokenType::NE, 2) : make(TokenType::NOT, 1);
+        case ':': return peek(1) == ':' ? make(TokenType::COL_COLON, 2) : make(TokenType::COLON, 1);
+        case '.': return peek(1) == '.' ? make(TokenType::DOT_DOT, 2) : make(TokenType::UNKNOWN, 1);
+        case '"': {
+            // 文本不含引号
+            auto end = src.find('"', begin + 1);
+            if (end == std::string_view::npos) end = src.size();
+            for (auto i = begin + 1; i < end; i++) {
+                if (src[i] != '\n') continue;
+                line++;
+                line_start = i + 1;
             }
-            return {TokenType::NOT, "!", line, col};
+            pos = std::min(end + 1, src.size());
+            return Token{TokenType::STRING_LITERAL, src.data() + begin + 1, static_cast<uint32_t>(end - begin - 1), l, c};
         }
         default: {
-            if (isdigit(src[pos])) {
-                std::string num;
-                while (isdigit(src[pos])) {
-                    num += src[pos];
-                    advance();
+            const char* const limit = src.data() + src.size();
+            if (is(src[pos], DIGIT)) {
+                auto end = begin + scan_run<DIGIT>(src.data() + begin, limit);
+                // 小数点后紧跟数字才是浮点字面量，0..n 里的 .. 仍然是区间
+                if (peek(end - pos) == '.' && is(peek(end - pos + 1), DIGIT)) {
+                    end += 1 + scan_run<DIGIT>(src.data() + end + 1, limit);
+                    double fvalue = 0;
+                    const auto [ptr, ec] = std::from_chars(src.data() + begin, src.data() + end, fvalue);
+                    if (ec != std::errc()) return make(TokenType::UNKNOWN, end - begin);
+                    pos = end;
+                    return Token{fvalue, static_cast<uint32_t>(end - begin), l, c};
                 }
-                return {TokenType::NUM_LITERAL, num, line, col - num.size()};
+                int64_t value = 0;
+                const auto [ptr, ec] = std::from_chars(src.data() + begin, src.data() + end, value);
+                // 超出 int64 范围的字面量交给语法分析报错
+                if (ec != std::errc()) return make(TokenType::UNKNOWN, end - begin);
+                pos = end;
+                return Token{value, static_cast<uint32_t>(end - begin), l, c};
             }
-            if (isalpha(src[pos])) {
-                std::string id;
-                while (isalnum(src[pos])) {
-                    id += src[pos];
-                    advance();
-                }
-                static const std::unordered_map<std::string, TokenType> keywords = {
-                    {"func", TokenType::KW_FUNC},
-                    {"return", TokenType::KW_RETURN},
-                    {"if", TokenType::KW_IF},
-                    {"else", TokenType::KW_ELSE},
-                    {"let", TokenType::KW_LET}
-                };
-                if (const auto it = keywords.find(id); it != keywords.end()) {
-                    return {it->second, id, line, col - id.size()};
-                }
-                return {TokenType::IDENTIFIER, id, line, col - id.size()};
+            if (is(src[pos], ALPHA)) {
+                const auto len = scan_run<ALPHA | DIGIT>(src.data() + begin, limit);
+                return make(classify_word(src.substr(begin, len)), len);
             }
         }
     }
-    advance();
-    return {TokenType::UNKNOWN, "", line, col};
+    return make(TokenType::UNKNOWN, 1);
 }
 
-std::vector<Token> Lexer::tokenize(std::string& new_src) {
-    src = new_src;
+void Lexer::tokenize(std::vector<Token>& tokens) {
     pos = 0;
     line = 1;
-    col = 1;
-    std::vector<Token> tokens;
-    while (pos < src.size()) {
+    line_start = 0;
+    tokens.clear();
+    // 平均每个 token 约 4 个字符，预留空间避免反复扩容
+    tokens.reserve(src.size() / 4 + 1);
+    while (true) {
+        skip_blank();
+        if (pos >= src.size()) break;
         tokens.push_back(next());
     }
     // Add EOF token at the end
-    tokens.push_back({TokenType::END_OF_FILE, "", line, col});
+    tokens.push_back(next());
+}
+
+std::vector<Token> Lexer::tokenize() {
+    std::vector<Token> tokens;
+    tokenize(tokens);
     return tokens;
 }
 
+std::vector<Token> Lexer::tokenize(const std::string_view new_src) {
+    src = new_src;
+    return tokenize();
+}
+
 }
@@ -3,46 +3,86 @@
 //
 
 #pragma once
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "../include/lmx_export.hpp"
 
 namespace lmx {
-enum class LMC_API TokenType {
+enum class LMC_API TokenType : uint8_t {
     END_OF_FILE,
     OPER_PLUS, OPER_MINUS, OPER_MUL, OPER_DIV, OPER_MOD, OPER_POW,
 
-    ASSIGN, COLON, COL_COLON, COMMA, NOT,
+    ASSIGN, COLON, COL_COLON, COMMA, NOT, DOT_DOT,
 
     LPAREN, RPAREN, LBRACK, RBRACK, LBRACE, RBRACE,
 
     EQ, NE, LT, GT, LE, GE,
 
-    NUM_LITERAL, STRING_LITERAL, TRUE_LITERAL, FALSE_LITERAL, IDENTIFIER,
+    NUM_LITERAL, FLOAT_LITERAL, STRING_LITERAL, TRUE_LITERAL, FALSE_LITERAL, IDENTIFIER,
 
     KW_FUNC, KW_RETURN,
-    UNKNOWN, KW_IF, KW_ELSE, KW_LET
+    UNKNOWN, KW_IF, KW_ELSE, KW_LET,
+    KW_WHILE, KW_FOR, KW_IN, KW_IMPORT
 };
 
+/*
+ * token 不持有文本，只记录它在源码中的位置，源码必须比 token 活得久。
+ * 数字在词法阶段就解析好，与文本指针共用存储。
+ */
 struct LMC_API Token {
     TokenType type;
-    std::string text;
-    size_t line, col;
+    uint32_t line, col;
+    uint32_t length;
+    union {
+        const char* start;      // 非数字：指向源码
+        int64_t value;          // NUM_LITERAL 的值
+        double fvalue;          // FLOAT_LITERAL 的值
+    };
+
+    Token(const TokenType type, const char* start, const uint32_t length, const uint32_t line, const uint32_t col)
+        : type(type), line(line), col(col), length(length), start(start) {}
+    Token(const int64_t value, const uint32_t length, const uint32_t line, const uint32_t col)
+        : type(TokenType::NUM_LITERAL), line(line), col(col), length(length), value(value) {}
+    Token(const double fvalue, const uint32_t length, const uint32_t line, const uint32_t col)
+        : type(TokenType::FLOAT_LITERAL), line(line), col(col), length(length), fvalue(fvalue) {}
+
+    [[nodiscard]] std::string_view text() const {
+        return type == TokenType::NUM_LITERAL || type == TokenType::FLOAT_LITERAL ? std::string_view{}
+                                                                                  : std::string_view{start, length};
+    }
 
     friend std::ostream& operator<<(std::ostream& os, const Token& t);
 };
+static_assert(sizeof(Token) <= 24);
 
 class LMC_API Lexer {
-    size_t pos{0}, line{1}, col{1};
+    std::string_view src;
+    size_t pos{0}, line{1}, line_start{0};
 
-    void advance();
-    std::string& src;
+    [[nodiscard]] char peek(size_t ahead = 0) const {
+        return pos + ahead < src.size() ? src[pos + ahead] : '\0';
+    }
+    [[nodiscard]] uint32_t col() const { return static_cast<uint32_t>(pos - line_start + 1); }
+    void skip_blank();
 
     Token next();
 public:
-    explicit Lexer(std::string& src): src(src) {};
-    std::vector<Token> tokenize(std::string& src);
+    explicit Lexer(const std::string_view src): src(src) {}
+    std::vector<Token> tokenize();
+    // 复用调用者的缓冲区，反复切分时不再重新分配
+    void tokenize(std::vector<Token>& tokens);
+    // 按需取下一个 token，源码结束后一直返回 END_OF_FILE
+    Token next_token() {
+        skip_blank();
+        return next();
+    }
+    // 已经切分到的源码位置
+    [[nodiscard]] size_t offset() const { return pos; }
+    // 兼容旧接口：换一份源码重新切分
+    std::vector<Token> tokenize(std::string_view new_src);
 };
 
-}
\ No newline at end of file
+}
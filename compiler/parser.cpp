@@ -5,14 +5,60 @@
 #include "parser.hpp"
 
 #include <stack>
+#include <string>
+#include <string_view>
 
 #include "../include/opcode.hpp"
 
 namespace lmx {
 
+namespace {
+
+struct BuiltinFunc {
+    std::string_view name;
+    Builtin builtin;
+    size_t arity;
+};
+
+// 写成函数调用的内置函数，不能再定义同名函数；m[k] 和 m[k] = v 由 factor() 和 parse() 另行识别
+constexpr BuiltinFunc BUILTIN_FUNCS[] = {
+    {"map", Builtin::MapNew, 0},
+    {"del", Builtin::MapDel, 2},
+    {"len", Builtin::MapLen, 1},
+};
+
+const BuiltinFunc* find_builtin(const std::string_view name) {
+    for (const auto& b : BUILTIN_FUNCS)
+        if (b.name == name) return &b;
+    return nullptr;
+}
+
+} // namespace
+
+Parser::Parser(Lexer& lexer): tokens(window), lexer(&lexer) {
+    fill();
+}
+
+// 保证当前 token 之后至少还有一个可供 peek_match 查看，已消费的 token 丢弃
+void Parser::fill() {
+    if (!lexer || lexer_done || pos + 2 <= window.size()) return;
+    window.erase(window.begin(), window.begin() + static_cast<ptrdiff_t>(pos));
+    pos = 0;
+    // 成批取，摊薄每次整理窗口的开销
+    constexpr size_t BATCH = 256;
+    while (window.size() < BATCH) {
+        window.push_back(lexer->next_token());
+        if (window.back().type == TokenType::END_OF_FILE) {
+            lexer_done = true;
+            break;
+        }
+    }
+}
+
 void Parser::advance() {
     if (pos < tokens.size()) {
         pos++;
+        fill();
     }
 }
 
@@ -23,6 +69,13 @@ Token& Parser::cur() const {
     return tokens[pos];
 }
 
+template<class T>
+std::span<const T> Parser::take(std::vector<T>& stack, const size_t mark) {
+    const auto items = arena.copy(std::span<const T>(stack).subspan(mark));
+    stack.resize(mark);
+    return items;
+}
+
 bool Parser::match(TokenType t) const {
     return cur().type == t;
 }
@@ -43,70 +96,97 @@ void Parser::error(const std::string& msg) {
     has_err = true;
     std::cerr << "Error: " << msg << " at " << cur().line << ":" << cur().col << std::endl;
 }
-std::shared_ptr<BlockStmtNode> Parser::parse_block() {
+BlockStmtNode* Parser::parse_block() {
     if (!match(TokenType::LBRACE)) error("expected '{'");
-    std::vector<std::shared_ptr<ASTNode>> stmts;
+    const auto mark = node_stack.size();
     while (!match(TokenType::RBRACE) && !is_eof()) {
-        if (const auto stmt = parse()) stmts.push_back(stmt);
+        if (const auto stmt = parse()) node_stack.push_back(stmt);
     }
     if (!match(TokenType::RBRACE)) error("expected '}'");
     advance();
-    return std::make_shared<BlockStmtNode>(stmts);
+    return arena.make<BlockStmtNode>(take(node_stack, mark));
 }
-std::shared_ptr<ExprNode> Parser::parse_expr() {
-    std::shared_ptr<ExprNode> node = expr();
-    if (match(TokenType::EQ) || match(TokenType::LT) || match(TokenType::GT) ||
+ExprNode* Parser::parse_expr() {
+    ExprNode* node = expr();
+    if (match(TokenType::EQ) || match(TokenType::NE) || match(TokenType::LT) || match(TokenType::GT) ||
         match(TokenType::LE) || match(TokenType::GE)) {
-        auto op = cur().text;
+        auto op = cur().text();
         advance();
-        node = std::make_shared<BinaryNode>(node, parse_expr(), op);
+        node = arena.make<BinaryNode>(node, parse_expr(), op);
     }
     return node;
 }
-std::shared_ptr<ASTNode> Parser::parse_if() {
+ASTNode* Parser::parse_if() {
     if (!match(TokenType::LPAREN)) error("expected '('");
     advance();
-    std::shared_ptr<ExprNode> condition = parse_expr();
+    ExprNode* condition = parse_expr();
     if (!match(TokenType::RPAREN)) error("expected ')'");
 
     advance();
-    std::shared_ptr<BlockStmtNode> then_block = parse_block();
-    std::shared_ptr<BlockStmtNode> else_block = nullptr;
+    BlockStmtNode* then_block = parse_block();
+    BlockStmtNode* else_block = nullptr;
     if (match(TokenType::KW_ELSE)) {
         advance();
         if (match(TokenType::KW_IF)) {
             advance();
-            else_block = std::make_shared<BlockStmtNode>(std::vector<std::shared_ptr<ASTNode>>{});
-            else_block->children.push_back(parse_if());
+            ASTNode* const inner = parse_if();
+            else_block = arena.make<BlockStmtNode>(arena.copy(std::span<ASTNode* const>(&inner, 1)));
         } else {
             else_block = parse_block();
         }
     }
-    return std::make_shared<IfStmtNode>(condition, then_block, else_block);
+    return arena.make<IfStmtNode>(condition, then_block, else_block);
+}
+ASTNode* Parser::parse_while() {
+    if (!match(TokenType::LPAREN)) error("expected '('");
+    advance();
+    ExprNode* condition = parse_expr();
+    if (!match(TokenType::RPAREN)) error("expected ')'");
+    advance();
+    return arena.make<WhileStmtNode>(condition, parse_block());
+}
+ASTNode* Parser::parse_for() {
+    if (!match(TokenType::LPAREN)) error("expected '('");
+    advance();
+    if (!match(TokenType::IDENTIFIER)) error("expected identifier");
+    auto var = cur().text();
+    advance();
+    if (!match(TokenType::KW_IN)) error("expected 'in'");
+    advance();
+    auto start = expr();
+    if (!match(TokenType::DOT_DOT)) error("expected '..'");
+    advance();
+    auto end = expr();
+    if (!match(TokenType::RPAREN)) error("expected ')'");
+    advance();
+    return arena.make<ForStmtNode>(var, start, end, parse_block());
 }
-std::shared_ptr<ASTNode> Parser::parse() {
+ASTNode* Parser::parse() {
     static bool in_func = false;
-    std::shared_ptr<ASTNode> node;
+    ASTNode* node = nullptr;
     switch (cur().type) {
     case TokenType::KW_LET: {
         advance();
         if (!match(TokenType::IDENTIFIER)) error("expected identifier");
-        auto name = cur().text;
+        auto name = cur().text();
         advance();
         if (!match(TokenType::ASSIGN)) error("expected assignment");
         advance();
-        node = std::make_shared<VarDeclNode>(name, expr(), false);
+        node = arena.make<VarDeclNode>(name, expr(), false);
         break;
     }
     case TokenType::KW_FUNC: {
         advance();
+        // 嵌套函数结束后仍在外层函数里
+        const bool outer_in_func = in_func;
         in_func = true;
         if (!match(TokenType::IDENTIFIER)) {
             advance();
             error("expected identifier");
             break;
         }
-        auto name = cur().text;
+        auto name = cur().text();
+        if (find_builtin(name)) error("`" + std::string(name) + "` is a builtin function");
         advance();
         if (!match(TokenType::LPAREN)) {
             advance();
@@ -114,10 +194,10 @@ std::shared_ptr<ASTNode> Parser::parse() {
             break;
         }
         advance();
-        std::vector<std::string> params;
+        const auto mark = name_stack.size();
         while (true) {
             if (match(TokenType::IDENTIFIER)) {
-                params.push_back(cur().text);
+                name_stack.push_back(cur().text());
                 advance();
             } else if (match(TokenType::RPAREN)) {
                 advance();
@@ -130,8 +210,9 @@ std::shared_ptr<ASTNode> Parser::parse() {
                 break;
             }
         }
-        node = std::make_shared<FuncDeclNode>(name, params, parse_block());
-        in_func = false;
+        const auto params = take(name_stack, mark);
+        node = arena.make<FuncDeclNode>(name, params, parse_block());
+        in_func = outer_in_func;
         break;
     }
     case TokenType::KW_RETURN: {
@@ -140,80 +221,128 @@ std::shared_ptr<ASTNode> Parser::parse() {
         if (!in_func) {
             error("expected 'return'");
         }
-        node = std::make_shared<ReturnStmtNode>(e);
+        node = arena.make<ReturnStmtNode>(e);
         break;
     }
     case TokenType::KW_IF: {
         advance();
         node = parse_if();
+        break;
+    }
+    case TokenType::KW_WHILE: {
+        advance();
+        node = parse_while();
+        break;
+    }
+    case TokenType::KW_FOR: {
+        advance();
+        node = parse_for();
+        break;
+    }
+    case TokenType::KW_IMPORT: {
+        advance();
+        if (!match(TokenType::STRING_LITERAL)) {
+            error("expected module path string after 'import'");
+            node = nullptr;
+            break;
+        }
+        node = arena.make<ImportNode>(cur().text());
         advance();
         break;
     }
     default: {
         if (match(TokenType::IDENTIFIER) && peek_match(TokenType::ASSIGN)) {
-            auto name = cur().text;
+            auto name = cur().text();
             advance();
             advance();
-            node = std::make_shared<VarDeclNode>(name, expr());
-        } else node = expr();
+            node = arena.make<VarDeclNode>(name, expr());
+        } else {
+            node = expr();
+            // m[k] = v：取值的 m[k] 改成写入
+            if (match(TokenType::ASSIGN)) {
+                const auto target = node && node->kind == FuncCallExpr ? static_cast<FuncCallExprNode*>(node) : nullptr;
+                if (!target || target->builtin != Builtin::MapGet) error("cannot assign to this expression");
+                advance();
+                const auto value = expr();
+                if (target) {
+                    const auto mark = expr_stack.size();
+                    expr_stack.insert(expr_stack.end(), target->args.begin(), target->args.end());
+                    expr_stack.push_back(value);
+                    node = arena.make<FuncCallExprNode>("[]=", take(expr_stack, mark), Builtin::MapSet);
+                }
+            }
+        }
         break;
     }
     }
     return node;
 }
-std::shared_ptr<ASTNode> Parser::parse_funcdecl() {
+ASTNode* Parser::parse_funcdecl() {
     if (!match(TokenType::IDENTIFIER)) error("expected identifier");
-    auto name = cur().text;
+    auto name = cur().text();
     advance();
     if (!match(TokenType::LPAREN)) error("expected '('");
     advance();
-    std::vector<std::string> params;
+    const auto mark = name_stack.size();
     while (true) {
         if (!match(TokenType::IDENTIFIER)) {
             error("expected identifier");
+            name_stack.resize(mark);
             return nullptr;
         }
-        params.push_back(cur().text);
+        name_stack.push_back(cur().text());
         advance();
         if (match(TokenType::RPAREN)) break;
         if (!match(TokenType::COMMA)) {
             error("expected ','");
+            name_stack.resize(mark);
             return nullptr;
         }
     }
     advance();
-    return std::make_shared<FuncDeclNode>(name, params, parse_block());
+    const auto params = take(name_stack, mark);
+    return arena.make<FuncDeclNode>(name, params, parse_block());
 }
 
-std::shared_ptr<ExprNode> Parser::expr() {
+ExprNode* Parser::expr() {
     auto node = term();
     while (match(TokenType::OPER_PLUS) || match(TokenType::OPER_MINUS)) {
-        auto op = cur().text;
+        auto op = cur().text();
         advance();
-        node = std::make_shared<BinaryNode>(node, term(), op);
+        node = arena.make<BinaryNode>(node, term(), op);
     }
     return node;
 }
-std::shared_ptr<ExprNode> Parser::term() {
+ExprNode* Parser::term() {
     auto node = factor();
     while (match(TokenType::OPER_MUL) || match(TokenType::OPER_DIV) || match(TokenType::OPER_MOD) || match(TokenType::OPER_POW)) {
-        auto op = cur().text;
+        auto op = cur().text();
         advance();
-        node = std::make_shared<BinaryNode>(node, factor(), op);
+        node = arena.make<BinaryNode>(node, factor(), op);
     }
     return node;
 }
-std::shared_ptr<ProgramASTNode> Parser::parse_program() {
-    std::vector<std::shared_ptr<ASTNode>> stmts;
+ProgramASTNode* Parser::parse_program() {
+    const auto mark = node_stack.size();
     while (!match(TokenType::RBRACE) && !is_eof()) {
-        if (const auto stmt = parse()) stmts.push_back(stmt);
+        if (const auto stmt = parse()) node_stack.push_back(stmt);
     }
-    return std::make_shared<ProgramASTNode>(stmts);
+    return arena.make<ProgramASTNode>(take(node_stack, mark));
 }
-std::shared_ptr<ExprNode> Parser::factor() {
-    std::shared_ptr<ExprNode> fact = nullptr;
+ASTNode* Parser::next_statement() {
+    arena.reset();
+    while (!match(TokenType::RBRACE) && !is_eof()) {
+        if (const auto stmt = parse()) return stmt;
+    }
+    return nullptr;
+}
+ExprNode* Parser::factor() {
+    ExprNode* fact = nullptr;
     if (match(TokenType::NUM_LITERAL)) {
-        fact = std::make_shared<NumberNode>(cur().text);
+        fact = arena.make<NumberNode>(cur().value);
+        advance();
+    } else if (match(TokenType::FLOAT_LITERAL)) {
+        fact = arena.make<FloatNode>(cur().fvalue);
         advance();
     } else if (match(TokenType::LPAREN)) {
         advance();
@@ -224,22 +353,22 @@ std::shared_ptr<ExprNode> Parser::factor() {
             error("Missing closing ')'");
         }
     } else if (match(TokenType::OPER_MINUS) || match(TokenType::OPER_PLUS)) {
-        auto op = cur().text;
+        auto op = cur().text();
         advance();
-        fact = std::make_shared<UnaryNode>(op, expr());
+        fact = arena.make<UnaryNode>(op, expr());
     } else if (match(TokenType::IDENTIFIER)) {
-        auto name = cur().text;
+        auto name = cur().text();
         advance();
-        if (!match(TokenType::LPAREN)) fact = make_shared<VarRefNode>(name);
+        if (!match(TokenType::LPAREN)) fact = arena.make<VarRefNode>(name);
         else {
             advance();
-            std::vector<std::shared_ptr<ExprNode>> args;
+            const auto mark = expr_stack.size();
             while (true) {
                 if (match(TokenType::RPAREN)) {
                     advance();
                     break;
                 }
-                args.push_back(expr());
+                expr_stack.push_back(expr());
                 if (match(TokenType::COMMA)) advance();
                 else if (match(TokenType::RPAREN)) {
                     advance();
@@ -251,26 +380,47 @@ std::shared_ptr<ExprNode> Parser::factor() {
                     break;
                 }
             }
-            fact = std::make_shared<FuncCallExprNode>(name, args);
+            const auto args = take(expr_stack, mark);
+            auto builtin = Builtin::None;
+            if (const auto b = find_builtin(name)) {
+                if (args.size() != b->arity)
+                    error("`" + std::string(name) + "` takes " + std::to_string(b->arity) + " argument(s), got " +
+                          std::to_string(args.size()));
+                builtin = b->builtin;
+            }
+            fact = arena.make<FuncCallExprNode>(name, args, builtin);
+        }
+        // m[k]：按键取值，可以连写
+        while (match(TokenType::LBRACK)) {
+            advance();
+            const auto mark = expr_stack.size();
+            expr_stack.push_back(fact);
+            expr_stack.push_back(expr());
+            if (match(TokenType::RBRACK)) advance();
+            else error("Missing closing ']'");
+            fact = arena.make<FuncCallExprNode>("[]", take(expr_stack, mark), Builtin::MapGet);
         }
 
     } else {
+        // 词法阶段解析失败的数字（超出 int64）
+        if (match(TokenType::UNKNOWN) && isdigit(static_cast<unsigned char>(cur().text()[0])))
+            error("number literal out of range");
         advance();
     }
     return fact;
 }
 
-std::shared_ptr<ExprNode> Parser::rpn_expr() {
+ExprNode* Parser::rpn_expr() {
 
     std::vector<RPNExprNode::RPNToken> tokens;/*
     while (!is_eof() && !match(TokenType::END_OF_FILE)) {
         tokens.push_back({RPNExprNode::Number, cur().text});
         advance();
     }*/
-    return std::make_shared<RPNExprNode>(tokens);
+    return arena.make<RPNExprNode>(arena.copy(std::span<const RPNExprNode::RPNToken>(tokens)));
 
 }
-std::shared_ptr<ExprNode> Parser::rpn_term() {
+ExprNode* Parser::rpn_term() {
     std::vector<RPNExprNode::RPNToken> tokens;/*
     std::stack<std::string> ops;
     std::stack<std::string> nums;
@@ -295,7 +445,7 @@ std::shared_ptr<ExprNode> Parser::rpn_term() {
             ops.pop();
         }
     }*/
-    return std::make_shared<RPNExprNode>(tokens);
+    return arena.make<RPNExprNode>(arena.copy(std::span<const RPNExprNode::RPNToken>(tokens)));
 }
 
 bool Parser::peek_match(TokenType type) {
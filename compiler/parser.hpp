@@ -4,11 +4,13 @@
 
 #pragma once
 #include <iostream>
-#include <memory>
+#include <span>
+#include <vector>
 
 #include "../include/lmx_export.hpp"
 #include "lexer.hpp"
 #include "ast.hpp"
+#include "arena.hpp"
 
 namespace lmx {
 
@@ -16,20 +18,33 @@ class LMC_API Parser {
     bool has_err{false};
     std::vector<Token>& tokens;
     size_t pos{0};
+    // 流式解析时 tokens 指向 window，只缓存少量从 lexer 取来的 token
+    Lexer* lexer{nullptr};
+    std::vector<Token> window;
+    bool lexer_done{false};
+    void fill();
+    // 节点都分配在这里，AST 的生命周期与 Parser 相同
+    Arena arena;
+    // 列表元素先压栈，列表结束后整体复制进 arena，嵌套列表共用同一个栈
+    std::vector<ASTNode*> node_stack;
+    std::vector<ExprNode*> expr_stack;
+    std::vector<std::string_view> name_stack;
+    template<class T>
+    std::span<const T> take(std::vector<T>& stack, size_t mark);
     void advance();
     [[nodiscard]] Token& cur() const;
     [[nodiscard]] bool match(TokenType t) const;
     [[nodiscard]] bool is_eof() const;
-    std::shared_ptr<ExprNode> expr();
-    std::shared_ptr<ExprNode> term();
+    ExprNode* expr();
+    ExprNode* term();
 
 
 
-    std::shared_ptr<ExprNode> factor();
+    ExprNode* factor();
 
-    std::shared_ptr<ExprNode> rpn_expr();
+    ExprNode* rpn_expr();
 
-    std::shared_ptr<ExprNode> rpn_term();
+    ExprNode* rpn_term();
 
     bool peek_match(TokenType type);
 
@@ -37,20 +52,29 @@ class LMC_API Parser {
 
     void error(const std::string& msg);
 
-    std::shared_ptr<BlockStmtNode> parse_block();
+    BlockStmtNode* parse_block();
 
-    std::shared_ptr<ASTNode> parse_if();
-    std::shared_ptr<ExprNode> parse_expr();
-    std::shared_ptr<ASTNode> parse_funcdecl();
+    ASTNode* parse_if();
+    ASTNode* parse_while();
+    ASTNode* parse_for();
+    ExprNode* parse_expr();
+    ASTNode* parse_funcdecl();
 
 public:
     explicit Parser(std::vector<Token>& tokens): tokens(tokens) {}
+    // 流式解析：token 按需从 lexer 取，配合 next_statement() 逐条处理顶层语句
+    explicit Parser(Lexer& lexer);
+    Parser(const Parser&) = delete;
+    Parser& operator=(const Parser&) = delete;
 
-    std::shared_ptr<ASTNode> parse();
+    ASTNode* parse();
 
 
-    std::shared_ptr<ProgramASTNode> parse_program();
+    ProgramASTNode* parse_program();
+    // 解析下一条顶层语句，上一条语句的 AST 随之释放；没有更多语句时返回 nullptr
+    ASTNode* next_statement();
     [[nodiscard]] bool error() const {return has_err;}
+    [[nodiscard]] size_t arena_bytes() const { return arena.bytes_reserved(); }
 };
 
-} // lmx
\ No newline at end of file
+} // lmx
\ No newline at end of file
@@ -0,0 +1,267 @@
+//
+// Static types of values and their inference over the AST
+//
+
+#include "types.hpp"
+
+#include <algorithm>
+#include <array>
+#include <iostream>
+
+#include "ast.hpp"
+
+namespace lmx {
+
+namespace {
+
+// 调用不知道签名的函数时实参都按 Dynamic 传
+constexpr auto DYNAMIC_PARAMS = [] {
+    std::array<Type, 256> params{};
+    params.fill(Type::Dynamic);
+    return params;
+}();
+
+bool is_expr(const ASTKind kind) {
+    switch (kind) {
+    case Binary: case Unary: case NumLiteral: case FloatLiteral: case RPNExpr: case VarRef: case FuncCallExpr:
+        return true;
+    default:
+        return false;
+    }
+}
+
+} // namespace
+
+const char* type_name(const Type t) {
+    switch (t) {
+    case Type::Unknown: return "unknown";
+    case Type::Int: return "int";
+    case Type::Dynamic: return "dynamic";
+    case Type::Float: return "float";
+    }
+    return "?";
+}
+
+Type value_type(const ASTNode* node) {
+    if (!node) return Type::Int;
+    if (node->kind == ASTKind::ExprStmt) return value_type(static_cast<const struct ExprStmt*>(node)->hs);
+    if (node->kind == ASTKind::VarDecl) return concrete(static_cast<const VarDeclNode*>(node)->type);
+    if (is_expr(node->kind)) return concrete(static_cast<const ExprNode*>(node)->type);
+    return Type::Int;
+}
+
+Type TypeInfer::global(const std::string_view name) const {
+    const auto it = globals.find(name);
+    return it == globals.end() ? Type::Unknown : it->second;
+}
+
+Type& TypeInfer::var(const std::string_view name) {
+    if (cur) return cur->vars[name];
+    const auto [it, inserted] = top_vars.try_emplace(name, Type::Unknown);
+    if (inserted) it->second = global(name);
+    return it->second;
+}
+
+void TypeInfer::widen(Type& slot, const Type t) {
+    if (join(slot, t) == slot) return;
+    slot = join(slot, t);
+    changed = true;
+}
+
+void TypeInfer::assign(const std::string_view name, const Type t) {
+    widen(var(name), t);
+}
+
+void TypeInfer::error(const std::string& msg) {
+    if (!report) return;
+    std::cerr << "Generate Error: " << msg << std::endl;
+    failed = true;
+}
+
+// 函数名在所在的块里提前可见，块里可以调用后面才定义的函数
+void TypeInfer::declare(const std::span<ASTNode* const> stmts) {
+    for (const auto node : stmts) {
+        if (!node || node->kind != ASTKind::FuncDecl) continue;
+        const auto decl = static_cast<const FuncDeclNode*>(node);
+        scopes.back().try_emplace(decl->name, decl);
+        const auto [it, inserted] = funcs.try_emplace(decl);
+        if (!inserted) continue;
+        it->second.top_level = scopes.size() == 1;
+        it->second.sig.params.assign(decl->args.size(), it->second.top_level ? Type::Dynamic : Type::Unknown);
+    }
+}
+
+Type TypeInfer::ret_of(const Func& f) {
+    return f.top_level && f.sig.ret == Type::Float ? Type::Dynamic : f.sig.ret;
+}
+
+void TypeInfer::block(BlockStmtNode* node) {
+    declare(node->children);
+    for (const auto child : node->children) stmt(child);
+}
+
+void TypeInfer::func(FuncDeclNode* node) {
+    if (!funcs.contains(node)) {
+        ASTNode* const decl = node;
+        declare(std::span<ASTNode* const>(&decl, 1));
+    }
+    auto& f = funcs.at(node);
+    auto* const outer = cur;
+    cur = &f;
+    for (size_t i = 0; i < node->args.size(); i++) widen(f.vars[node->args[i]], f.sig.params[i]);
+    scopes.emplace_back();
+    block(node->body);
+    scopes.pop_back();
+    cur = outer;
+    node->ret = concrete(ret_of(f));
+    node->params = f.sig.params;
+}
+
+void TypeInfer::stmt(ASTNode* node) {
+    if (!node) return;
+    switch (node->kind) {
+    case ASTKind::ExprStmt: expr(static_cast<struct ExprStmt*>(node)->hs); break;
+    case ASTKind::BlockStmt: block(static_cast<BlockStmtNode*>(node)); break;
+    case ASTKind::IfStmt: {
+        const auto n = static_cast<IfStmtNode*>(node);
+        expr(n->condition);
+        block(n->thenBlock);
+        if (n->elseBlock) block(n->elseBlock);
+        break;
+    }
+    case ASTKind::WhileStmt: {
+        const auto n = static_cast<WhileStmtNode*>(node);
+        expr(n->condition);
+        block(n->body);
+        break;
+    }
+    case ASTKind::ForStmt: {
+        // 循环变量每轮加一，只能是整数或 Dynamic
+        const auto n = static_cast<ForStmtNode*>(node);
+        assign(n->var, join(expr(n->start), Type::Int));
+        const auto end = expr(n->end);
+        block(n->body);
+        n->type = concrete(var(n->var));
+        if (n->type == Type::Float) error("the loop variable `" + std::string(n->var) + "` cannot be a float");
+        if (end == Type::Float) error("the loop bound of `" + std::string(n->var) + "` cannot be a float");
+        break;
+    }
+    case ASTKind::VarDecl: {
+        const auto n = static_cast<VarDeclNode*>(node);
+        assign(n->name, expr(n->value));
+        n->type = concrete(var(n->name));
+        break;
+    }
+    case ASTKind::Return: {
+        const auto n = static_cast<ReturnStmtNode*>(node);
+        const auto t = expr(n->expr);
+        if (cur) {
+            widen(cur->sig.ret, t);
+            n->type = concrete(ret_of(*cur));
+        } else {
+            n->type = concrete(t);
+        }
+        break;
+    }
+    case ASTKind::FuncDecl: func(static_cast<FuncDeclNode*>(node)); break;
+    default:
+        if (is_expr(node->kind)) expr(static_cast<ExprNode*>(node));
+        break;
+    }
+}
+
+Type TypeInfer::expr(ExprNode* node) {
+    auto t = Type::Int;
+    switch (node->kind) {
+    case ASTKind::FloatLiteral: t = Type::Float; break;
+    case ASTKind::VarRef: t = var(static_cast<VarRefNode*>(node)->name); break;
+    case ASTKind::Binary: {
+        const auto n = static_cast<BinaryNode*>(node);
+        const auto l = expr(static_cast<ExprNode*>(n->left));
+        const auto r = expr(static_cast<ExprNode*>(n->right));
+        switch (n->op[0]) {
+        case '+': case '-': case '*': case '/': case '%': t = join(join(l, r), Type::Int); break;
+        case '^': t = Type::Float; break;
+        default: break;     // 比较的结果是整数
+        }
+        break;
+    }
+    case ASTKind::Unary:
+        t = join(expr(static_cast<ExprNode*>(static_cast<UnaryNode*>(node)->operand)), Type::Int);
+        break;
+    case ASTKind::FuncCallExpr: {
+        const auto n = static_cast<FuncCallExprNode*>(node);
+        std::vector<Type> args;
+        args.reserve(n->args.size());
+        for (const auto arg : n->args) args.push_back(expr(arg));
+        t = call(n, args);
+        break;
+    }
+    default: break;
+    }
+    node->type = t;
+    return t;
+}
+
+Type TypeInfer::call(FuncCallExprNode* node, const std::span<const Type> args) {
+    if (node->builtin != Builtin::None) {
+        node->params = {};
+        if (std::ranges::find(args, Type::Float) != args.end())
+            error("map operands must be integers, got a float in `" + std::string(node->name) + "`");
+        return Type::Int;
+    }
+    for (auto it = scopes.rbegin(); it != scopes.rend(); ++it) {
+        const auto found = it->find(node->name);
+        if (found == it->end()) continue;
+        auto& callee = funcs.at(found->second);
+        if (!callee.top_level) {
+            for (size_t i = 0; i < std::min(args.size(), callee.sig.params.size()); i++) widen(callee.sig.params[i], args[i]);
+        }
+        node->params = callee.sig.params;
+        return ret_of(callee);
+    }
+    if (const auto it = global_funcs.find(node->name); it != global_funcs.end()) {
+        node->params = it->second.params;
+        return it->second.ret;
+    }
+    // 后面才定义、从别的模块导入或者根本不存在的函数，签名未知
+    node->params = std::span<const Type>(DYNAMIC_PARAMS).first(std::min(args.size(), DYNAMIC_PARAMS.size()));
+    return Type::Dynamic;
+}
+
+bool TypeInfer::infer(ASTNode* stmt) {
+    funcs.clear();
+    top_vars.clear();
+    widened_vars.clear();
+    failed = false;
+    if (!stmt) return true;
+    scopes.assign(1, {});
+    declare(std::span<ASTNode* const>(&stmt, 1));
+    // 类型只会变宽，链的高度有限，一定会停下
+    do {
+        changed = false;
+        this->stmt(stmt);
+    } while (changed);
+    report = true;
+    this->stmt(stmt);
+    report = false;
+    scopes.clear();
+    cur = nullptr;
+    if (failed) return false;
+
+    for (const auto& [name, t] : top_vars) {
+        if (t == Type::Unknown) continue;
+        const auto [it, inserted] = globals.try_emplace(std::string(name), t);
+        if (inserted) continue;
+        if (t == Type::Float && it->second != Type::Float && it->second != Type::Unknown) widened_vars.emplace_back(name);
+        it->second = t;
+    }
+    if (stmt->kind == ASTKind::FuncDecl) {
+        const auto decl = static_cast<const FuncDeclNode*>(stmt);
+        const auto& f = funcs.at(decl);
+        global_funcs[std::string(decl->name)] = {concrete(ret_of(f)), f.sig.params};
+    }
+    return true;
+}
+
+}
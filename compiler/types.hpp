@@ -0,0 +1,101 @@
+//
+// Static types of values and their inference over the AST
+//
+
+#pragma once
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "../include/lmx_export.hpp"
+
+namespace lmx {
+
+struct ASTNode;
+struct ExprNode;
+struct BlockStmtNode;
+struct FuncDeclNode;
+struct FuncCallExprNode;
+
+/*
+ * 值的静态类型，按 Unknown < Int < Dynamic < Float 排成一条链，汇合取较大者：
+ * 整数和浮点都可能出现的位置按浮点算，整数在写入时转换；推导不出来的位置（顶层函数的参数、
+ * 调用不知道签名的函数）是 Dynamic，运行时靠寄存器标记区分整数和浮点。
+ * Unknown 只在推导过程中出现，推导结束后仍是 Unknown 的位置（没有赋过值的变量、
+ * 从不返回值的函数）按 Int 处理。
+ */
+enum class Type : uint8_t { Unknown, Int, Dynamic, Float };
+
+constexpr Type join(const Type a, const Type b) { return a < b ? b : a; }
+constexpr Type concrete(const Type t) { return t == Type::Unknown ? Type::Int : t; }
+LMC_API const char* type_name(Type t);
+// 表达式的类型；变量声明为变量的类型；其他语句为 Int
+LMC_API Type value_type(const ASTNode* node);
+
+/*
+ * 逐条推导顶层语句，结果直接写进语句的节点里，生成代码时按节点上的类型选择指令。
+ * 每条语句迭代到不动点：函数内的变量不区分位置，类型是它所有赋值的汇合；
+ * 嵌套函数只能在外层函数里调用，参数类型是所有调用点实参的汇合；
+ * 顶层函数可能被后面的语句、别的模块或宿主调用，参数按 Dynamic，返回浮点时也按 Dynamic 交出。
+ * 顶层变量跨语句保留类型，后面的语句把它拓宽成浮点时记在 widened() 里，
+ * 调用方在这条语句的代码前把变量就地转换。
+ */
+class LMC_API TypeInfer {
+public:
+    struct Sig {
+        Type ret{Type::Unknown};
+        std::vector<Type> params;
+    };
+
+    // 类型错误时报错并返回 false，节点上的类型不可用
+    bool infer(ASTNode* stmt);
+    // 上一次 infer() 的语句里从整数或 Dynamic 拓宽成浮点的顶层变量
+    [[nodiscard]] std::span<const std::string> widened() const { return widened_vars; }
+    // 顶层变量的类型，没有赋过值时为 Unknown
+    [[nodiscard]] Type global(std::string_view name) const;
+
+private:
+    struct Hash {
+        using is_transparent = void;
+        size_t operator()(const std::string_view s) const { return std::hash<std::string_view>{}(s); }
+    };
+    using Names = std::unordered_map<std::string, Type, Hash, std::equal_to<>>;
+
+    // 这条语句里定义的函数
+    struct Func {
+        Sig sig;
+        bool top_level;
+        std::unordered_map<std::string_view, Type> vars;
+    };
+
+    Names globals;
+    std::unordered_map<std::string, Sig, Hash, std::equal_to<>> global_funcs;   // 之前的语句定义的顶层函数
+    std::vector<std::string> widened_vars;
+
+    // 以下只在一次 infer() 内有效；funcs 的内容一直留到下一次 infer()，节点上的参数类型指向这里
+    std::unordered_map<const FuncDeclNode*, Func> funcs;
+    std::unordered_map<std::string_view, Type> top_vars;
+    std::vector<std::unordered_map<std::string_view, const FuncDeclNode*>> scopes;
+    Func* cur{nullptr};     // 正在推导的函数，顶层代码为空
+    bool changed{false};
+    bool report{false};     // 到达不动点后的最后一遍，检查并报告类型错误
+    bool failed{false};
+
+    Type& var(std::string_view name);
+    void assign(std::string_view name, Type t);
+    void widen(Type& slot, Type t);
+    void error(const std::string& msg);
+
+    void declare(std::span<ASTNode* const> stmts);
+    [[nodiscard]] static Type ret_of(const Func& f);
+    void stmt(ASTNode* node);
+    void block(BlockStmtNode* node);
+    void func(FuncDeclNode* node);
+    Type expr(ExprNode* node);
+    Type call(FuncCallExprNode* node, std::span<const Type> args);
+};
+
+}
@@ -0,0 +1,333 @@
+//
+// C embedding API on top of the IR compiler and VirtualCore
+//
+
+#include "../include/lmx.h"
+
+#include <bit>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "../compiler/ast.hpp"
+#include "../compiler/lexer.hpp"
+#include "../compiler/parser.hpp"
+#include "../compiler/generator/generator.hpp"
+#include "../compiler/ir/builder.hpp"
+#include "../compiler/ir/lower.hpp"
+#include "../compiler/ir/passes.hpp"
+#include "../runtime/batch.hpp"
+#include "../runtime/vm.hpp"
+
+struct lmx_program {
+    std::vector<lmx::runtime::Op> ops;
+    std::vector<lmx::ir::FunctionEntry> funcs;
+    std::unordered_map<std::string, lmx_function> by_name;
+    size_t return_pc{0};    // 宿主调用返回到的 HALT
+    // 从快照载入时持有映射，程序和初始状态都在里面，ops 为空
+    std::unique_ptr<lmx::runtime::Snapshot> image;
+};
+
+struct lmx_vm {
+    const lmx_program* program;
+    lmx::runtime::VirtualCore core;
+    std::vector<int64_t> args;
+    std::vector<uint8_t> arg_float;     // 交给 Dynamic 参数的浮点要带上标记
+    std::unique_ptr<lmx::runtime::BatchCore> batch;    // 第一次 lmx_call_batch 时创建
+};
+
+namespace {
+
+thread_local std::string last_error;
+
+lmx_status fail(const lmx_status status, std::string msg) {
+    last_error = std::move(msg);
+    return status;
+}
+
+// 推导为浮点的返回值不带标记，按返回类型读取；Dynamic 的返回值看寄存器的标记
+lmx_status result_of(const lmx::runtime::VirtualCore& core, const lmx::Type ret, lmx_value* result) {
+    if (!result) return LMX_OK;
+    if (ret == lmx::Type::Float || core.register_is_float(0)) {
+        *result = lmx_float(core.look_float(0));
+        return LMX_OK;
+    }
+    if (core.register_is_big(0)) return fail(LMX_ERROR_RUNTIME, "result " + core.register_string(0) + " does not fit in 64 bits");
+    *result = lmx_int(core.look_register(0));
+    return LMX_OK;
+}
+
+void put_u64(std::vector<std::byte>& out, const uint64_t v) {
+    const auto p = reinterpret_cast<const std::byte*>(&v);
+    out.insert(out.end(), p, p + sizeof(v));
+}
+
+bool get_u64(std::span<const std::byte>& in, uint64_t& v) {
+    if (in.size() < sizeof(v)) return false;
+    std::memcpy(&v, in.data(), sizeof(v));
+    in = in.subspan(sizeof(v));
+    return true;
+}
+
+// 快照附带的函数表：return_pc、函数个数，之后每个函数依次是地址、参数个数、返回类型、
+// 各参数的类型、名字长度和名字
+std::vector<std::byte> encode_functions(const lmx_program& program) {
+    std::vector<std::byte> out;
+    put_u64(out, program.return_pc);
+    put_u64(out, program.funcs.size());
+    for (const auto& fn : program.funcs) {
+        put_u64(out, fn.addr);
+        put_u64(out, fn.param_count);
+        put_u64(out, static_cast<uint64_t>(fn.ret));
+        for (const auto t : fn.params) put_u64(out, static_cast<uint64_t>(t));
+        put_u64(out, fn.name.size());
+        const auto p = reinterpret_cast<const std::byte*>(fn.name.data());
+        out.insert(out.end(), p, p + fn.name.size());
+    }
+    return out;
+}
+
+bool decode_functions(std::span<const std::byte> in, const size_t op_count, lmx_program& program) {
+    uint64_t count;
+    if (!get_u64(in, program.return_pc) || program.return_pc >= op_count || !get_u64(in, count)) return false;
+    for (uint64_t i = 0; i < count; i++) {
+        lmx::ir::FunctionEntry fn;
+        uint64_t len, ret;
+        if (!get_u64(in, fn.addr) || !get_u64(in, fn.param_count) || !get_u64(in, ret) || fn.param_count > in.size())
+            return false;
+        fn.ret = static_cast<lmx::Type>(ret);
+        for (size_t k = 0; k < fn.param_count; k++) {
+            uint64_t t;
+            if (!get_u64(in, t) || t > static_cast<uint64_t>(lmx::Type::Float)) return false;
+            fn.params.push_back(static_cast<lmx::Type>(t));
+        }
+        if (ret > static_cast<uint64_t>(lmx::Type::Float) || !get_u64(in, len) || len > in.size()) return false;
+        if (fn.addr >= op_count) return false;
+        fn.name.assign(reinterpret_cast<const char*>(in.data()), len);
+        in = in.subspan(len);
+        program.by_name.emplace(fn.name, static_cast<lmx_function>(program.funcs.size()));
+        program.funcs.push_back(std::move(fn));
+    }
+    return true;
+}
+
+bool has_value(const lmx::ASTKind kind) {
+    switch (kind) {
+    case lmx::Binary: case lmx::Unary: case lmx::NumLiteral: case lmx::FloatLiteral: case lmx::RPNExpr:
+    case lmx::VarRef: case lmx::FuncCallExpr: case lmx::ExprStmt: case lmx::VarDecl:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/*
+ * IR 降低时寄存器不够（比如局部变量特别多的函数）改用 AST 直接生成字节码，和 lm 的回退相同。
+ * 直接生成的函数同样按调用约定传参和返回；顶层表达式的值逐条写进 r0，程序结果与 IR 路径一致。
+ */
+bool compile_direct(const std::string_view source, lmx_program& program) {
+    lmx::Generator gener;
+    lmx::Lexer lexer(source);
+    lmx::Parser parser(lexer);
+    while (const auto stmt = parser.next_statement()) {
+        if (parser.error() || !gener.infer(stmt)) return false;
+        const auto reg = stmt->gen(gener);
+        if (gener.has_error()) return false;
+        if (stmt->kind == lmx::ASTKind::FuncDecl) {
+            // 节点上的参数类型只在下一条语句推导之前有效，现在就复制
+            const auto decl = static_cast<const lmx::FuncDeclNode*>(stmt);
+            const auto func = gener.find_func(decl->name);
+            program.funcs.push_back({std::string(decl->name), func->addr, func->arg_count, decl->ret,
+                                     {decl->params.begin(), decl->params.end()}});
+        } else if (has_value(stmt->kind) && reg < REG_COUNT) {
+            lmx::runtime::Op mov(lmx::runtime::Opcode::MOV_RR);
+            mov.operands[1] = static_cast<uint8_t>(reg);
+            gener.ops.push_back(mov);
+            if (lmx::value_type(stmt) == lmx::Type::Float) gener.ops.emplace_back(lmx::runtime::Opcode::BOX_FLOAT);
+        }
+        gener.regs.free(reg);
+    }
+    if (parser.error()) return false;
+    program.ops = std::move(gener.ops);
+    return true;
+}
+
+} // namespace
+
+extern "C" {
+
+lmx_status lmx_compile(const char* source, const size_t length, lmx_program** out) {
+    *out = nullptr;
+    auto program = std::make_unique<lmx_program>();
+    {
+        lmx::ir::IRModule mod;
+        lmx::Lexer lexer(std::string_view(source, length));
+        lmx::Parser parser(lexer);
+        lmx::ir::IRBuilder builder(mod);
+        builder.begin();
+        while (const auto stmt = parser.next_statement()) {
+            if (parser.error()) break;
+            builder.add(stmt);
+        }
+        if (!builder.finish() || parser.error()) return fail(LMX_ERROR_COMPILE, "compile error (details on stderr)");
+        // 宿主可能调用任何函数，顶层没有用到的也要保留
+        lmx::ir::optimize(mod, {.keep_functions = true});
+        if (!lmx::ir::lower(mod, program->ops, program->funcs)) {
+            program->ops.clear();
+            program->funcs.clear();
+            if (!compile_direct(std::string_view(source, length), *program))
+                return fail(LMX_ERROR_COMPILE, "compile error (details on stderr)");
+        }
+    }
+    program->ops.emplace_back(lmx::runtime::Opcode::HALT);
+    program->return_pc = program->ops.size() - 1;
+    for (size_t i = 0; i < program->funcs.size(); i++)
+        program->by_name.emplace(program->funcs[i].name, static_cast<lmx_function>(i));
+    *out = program.release();
+    return LMX_OK;
+}
+
+void lmx_program_free(lmx_program* program) {
+    delete program;
+}
+
+lmx_function lmx_find_function(const lmx_program* program, const char* name) {
+    const auto it = program->by_name.find(name);
+    return it == program->by_name.end() ? LMX_NO_FUNCTION : it->second;
+}
+
+int lmx_function_arity(const lmx_program* program, const lmx_function function) {
+    if (function < 0 || static_cast<size_t>(function) >= program->funcs.size()) return -1;
+    return static_cast<int>(program->funcs[function].param_count);
+}
+
+lmx_vm* lmx_vm_new(const lmx_program* program) {
+    auto vm = new lmx_vm{program, {}, {}, {}, {}};
+    lmx_vm_reset(vm);
+    return vm;
+}
+
+void lmx_vm_free(lmx_vm* vm) {
+    delete vm;
+}
+
+void lmx_vm_reset(lmx_vm* vm) {
+    const auto program = vm->program;
+    if (program->image) {
+        vm->core.restore(*program->image);
+        return;
+    }
+    // VM 不会改写程序，多个 VM 可以共享同一份字节码
+    if (vm->core.get_program() != &program->ops)
+        vm->core.set_program(const_cast<std::vector<lmx::runtime::Op>*>(&program->ops));
+    vm->core.reset_state();
+}
+
+lmx_status lmx_run(lmx_vm* vm, lmx_value* result) {
+    vm->core.reset_state();
+    if (vm->core.run() != 0) return fail(LMX_ERROR_RUNTIME, "execution failed");
+    // 顶层代码的结果按 Dynamic 交出
+    return result_of(vm->core, lmx::Type::Dynamic, result);
+}
+
+lmx_status lmx_call(lmx_vm* vm, const lmx_function function, const lmx_value* args, const size_t argc,
+                    lmx_value* result) {
+    const auto& funcs = vm->program->funcs;
+    if (function < 0 || static_cast<size_t>(function) >= funcs.size())
+        return fail(LMX_ERROR_FUNCTION, "invalid function handle");
+    const auto& fn = funcs[function];
+    if (argc != fn.param_count) {
+        return fail(LMX_ERROR_ARGUMENTS, "`" + fn.name + "` takes " + std::to_string(fn.param_count) +
+                    " arguments, got " + std::to_string(argc));
+    }
+    vm->args.resize(argc);
+    vm->arg_float.assign(argc, 0);
+    for (size_t i = 0; i < argc; i++) {
+        const auto param = i < fn.params.size() ? fn.params[i] : lmx::Type::Dynamic;
+        switch (args[i].type) {
+        case LMX_TYPE_INT:
+        case LMX_TYPE_BOOL: {
+            const int64_t v = args[i].type == LMX_TYPE_INT ? args[i].as.i : args[i].as.b != 0;
+            vm->args[i] = param == lmx::Type::Float ? std::bit_cast<int64_t>(static_cast<double>(v)) : v;
+            break;
+        }
+        case LMX_TYPE_FLOAT:
+            if (param == lmx::Type::Int)
+                return fail(LMX_ERROR_ARGUMENTS, "argument " + std::to_string(i) + " of `" + fn.name + "` must be an integer");
+            vm->args[i] = std::bit_cast<int64_t>(args[i].as.f);
+            vm->arg_float[i] = param == lmx::Type::Dynamic;
+            break;
+        default: return fail(LMX_ERROR_ARGUMENTS, "argument " + std::to_string(i) + " has an unknown type");
+        }
+    }
+    if (vm->core.call(fn.addr, vm->args, vm->arg_float, vm->program->return_pc) != 0)
+        return fail(LMX_ERROR_RUNTIME, "execution failed");
+    return result_of(vm->core, fn.ret, result);
+}
+
+lmx_status lmx_call_batch(lmx_vm* vm, const lmx_function function, const int64_t* const* columns, const size_t argc,
+                          const size_t rows, int64_t* results) {
+    const auto& funcs = vm->program->funcs;
+    if (function < 0 || static_cast<size_t>(function) >= funcs.size())
+        return fail(LMX_ERROR_FUNCTION, "invalid function handle");
+    const auto& fn = funcs[function];
+    if (argc != fn.param_count) {
+        return fail(LMX_ERROR_ARGUMENTS, "`" + fn.name + "` takes " + std::to_string(fn.param_count) +
+                    " arguments, got " + std::to_string(argc));
+    }
+    // 列都是整数，浮点参数和浮点返回值走不了批量路径
+    if (fn.ret == lmx::Type::Float || std::ranges::find(fn.params, lmx::Type::Float) != fn.params.end())
+        return fail(LMX_ERROR_ARGUMENTS, "`" + fn.name + "` takes or returns floats, call it with lmx_call");
+    if (!vm->batch) {
+        const auto pool = vm->core.get_const_pool();
+        vm->batch = std::make_unique<lmx::runtime::BatchCore>(vm->core.get_program(), pool.data(), pool.size());
+    }
+    std::vector<size_t> fallback;
+    std::string error;
+    if (!vm->batch->run(fn.addr, vm->program->return_pc, {columns, argc}, rows, results, fallback, error))
+        return fail(LMX_ERROR_RUNTIME, error);
+    // 中途溢出（标量 VM 会转成大整数）、出现浮点或用到 map 的行交给标量 VM 逐行重算
+    vm->args.resize(argc);
+    for (const auto row : fallback) {
+        for (size_t i = 0; i < argc; i++) vm->args[i] = columns[i][row];
+        if (vm->core.call(fn.addr, vm->args, vm->program->return_pc) != 0)
+            return fail(LMX_ERROR_RUNTIME, "execution failed in row " + std::to_string(row));
+        lmx_value result;
+        if (const auto status = result_of(vm->core, fn.ret, &result); status != LMX_OK) return status;
+        if (result.type == LMX_TYPE_FLOAT) return fail(LMX_ERROR_RUNTIME, "row " + std::to_string(row) + " returned a float");
+        results[row] = result.as.i;
+    }
+    return LMX_OK;
+}
+
+lmx_status lmx_vm_save(const lmx_vm* vm, const char* path) {
+    std::string error;
+    if (!vm->core.save_snapshot(path, encode_functions(*vm->program), error)) return fail(LMX_ERROR_SNAPSHOT, error);
+    return LMX_OK;
+}
+
+lmx_status lmx_vm_load(const char* path, lmx_program** program, lmx_vm** vm) {
+    *program = nullptr;
+    *vm = nullptr;
+    std::string error;
+    auto image = lmx::runtime::Snapshot::open(path, error);
+    if (!image) return fail(LMX_ERROR_SNAPSHOT, error);
+    auto loaded = std::make_unique<lmx_program>();
+    if (!decode_functions(image->extra(), image->program().size(), *loaded) ||
+        image->program()[loaded->return_pc].op != lmx::runtime::Opcode::HALT)
+        return fail(LMX_ERROR_SNAPSHOT, std::string(path) + " has no usable function table");
+    loaded->image = std::move(image);
+    *program = loaded.release();
+    *vm = lmx_vm_new(*program);
+    return LMX_OK;
+}
+
+const char* lmx_last_error(void) {
+    return last_error.c_str();
+}
+
+}
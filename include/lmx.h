@@ -0,0 +1,129 @@
+/*
+ * Lamina embedding API
+ *
+ * 编译一次、按名字取函数句柄、直接调用。典型用法：
+ *
+ *     lmx_program* prog;
+ *     if (lmx_compile(src, len, &prog) != LMX_OK) puts(lmx_last_error());
+ *     lmx_vm* vm = lmx_vm_new(prog);              // 每个线程一个 VM，程序可以共享
+ *     lmx_function add = lmx_find_function(prog, "add");
+ *     lmx_value args[2] = {lmx_int(1), lmx_int(2)}, ret;
+ *     lmx_call(vm, add, args, 2, &ret);
+ *     lmx_vm_free(vm);
+ *     lmx_program_free(prog);
+ *
+ * 调用不执行顶层代码，也不改写程序；每次调用前调用栈自动清空，不需要手动重置。
+ */
+
+#ifndef LMX_H
+#define LMX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32) && defined(LMX_DLL)
+    #ifdef LMX_EMBED_BUILD
+        #define LMX_API __declspec(dllexport)
+    #else
+        #define LMX_API __declspec(dllimport)
+    #endif
+#else
+    #define LMX_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct lmx_program lmx_program;    /* 编译结果，只读，可被多个 VM 共享 */
+typedef struct lmx_vm lmx_vm;              /* 执行状态，不能跨线程同时使用 */
+typedef int32_t lmx_function;              /* 函数句柄，在所属程序内有效，找不到时为 LMX_NO_FUNCTION */
+
+#define LMX_NO_FUNCTION ((lmx_function)-1)
+
+typedef enum lmx_status {
+    LMX_OK = 0,
+    LMX_ERROR_COMPILE,      /* 语法或代码生成错误 */
+    LMX_ERROR_FUNCTION,     /* 句柄无效 */
+    LMX_ERROR_ARGUMENTS,    /* 参数个数或类型不符 */
+    LMX_ERROR_RUNTIME,      /* 校验失败或执行出错 */
+    LMX_ERROR_SNAPSHOT,     /* 快照无法写出，或文件不是可用的快照 */
+} lmx_status;
+
+typedef enum lmx_type {
+    LMX_TYPE_INT,
+    LMX_TYPE_FLOAT,
+    LMX_TYPE_BOOL,
+} lmx_type;
+
+typedef struct lmx_value {
+    lmx_type type;
+    union {
+        int64_t i;
+        double f;
+        int b;
+    } as;
+} lmx_value;
+
+static inline lmx_value lmx_int(const int64_t i) {
+    lmx_value v;
+    v.type = LMX_TYPE_INT;
+    v.as.i = i;
+    return v;
+}
+
+static inline lmx_value lmx_float(const double f) {
+    lmx_value v;
+    v.type = LMX_TYPE_FLOAT;
+    v.as.f = f;
+    return v;
+}
+
+/* 编译源码；失败时 *out 为 NULL，原因见 lmx_last_error() */
+LMX_API lmx_status lmx_compile(const char* source, size_t length, lmx_program** out);
+LMX_API void lmx_program_free(lmx_program* program);
+
+LMX_API lmx_function lmx_find_function(const lmx_program* program, const char* name);
+/* 函数的参数个数，句柄无效时为 -1 */
+LMX_API int lmx_function_arity(const lmx_program* program, lmx_function function);
+
+/* VM 持有 program 的引用，program 要比 VM 活得久 */
+LMX_API lmx_vm* lmx_vm_new(const lmx_program* program);
+LMX_API void lmx_vm_free(lmx_vm* vm);
+/* 清空寄存器和调用栈，下次 lmx_run 从头执行顶层代码；从快照载入的程序回到快照时的状态 */
+LMX_API void lmx_vm_reset(lmx_vm* vm);
+
+/* 执行顶层代码，result 可以为 NULL */
+LMX_API lmx_status lmx_run(lmx_vm* vm, lmx_value* result);
+/*
+ * 直接调用函数，参数个数必须与定义一致；result 可以为 NULL。返回值超出 64 位时为 LMX_ERROR_RUNTIME。
+ * 整数参数传给浮点参数时自动转换；浮点参数传给只接受整数的参数（嵌套函数推导出的类型）时为 LMX_ERROR_ARGUMENTS。
+ * 返回值按实际类型给出整数或浮点。
+ */
+LMX_API lmx_status lmx_call(lmx_vm* vm, lmx_function function, const lmx_value* args, size_t argc, lmx_value* result);
+
+/*
+ * 对 rows 行输入各调用一次函数：第 i 个参数取自 columns[i][row]，返回值写入 results[row]。
+ * 多行装进向量寄存器一起执行，一次分派处理一批，结果与逐行 lmx_call 相同；
+ * 有一行返回值超出 64 位、是浮点或出错时返回 LMX_ERROR_RUNTIME，results 的内容不可用。
+ * 参数或返回值推导为浮点的函数只能用 lmx_call，返回 LMX_ERROR_ARGUMENTS。
+ */
+LMX_API lmx_status lmx_call_batch(lmx_vm* vm, lmx_function function, const int64_t* const* columns, size_t argc,
+                                  size_t rows, int64_t* results);
+
+/*
+ * 快照：初始化（lmx_run 或若干次 lmx_call）之后把 VM 的状态连同程序写入文件，
+ * 新进程用 lmx_vm_load 映射文件得到程序和 VM，直接从保存时的状态开始调用，不再重跑初始化。
+ * 之后对该程序调用 lmx_vm_new 得到的 VM 也都从快照状态开始。
+ */
+LMX_API lmx_status lmx_vm_save(const lmx_vm* vm, const char* path);
+LMX_API lmx_status lmx_vm_load(const char* path, lmx_program** program, lmx_vm** vm);
+
+/* 当前线程上一次失败的说明 */
+LMX_API const char* lmx_last_error(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -10,23 +10,52 @@ namespace lmx::runtime {
 enum class OpPrefix {
     Integer, Float
 };
+// M 操作数的基址寄存器取这个值时表示当前调用帧，偏移按无符号槽位解释
+constexpr uint8_t FRAME_BASE = 255;
+// DEBUG_LOG 的负载寄存器取这个值时表示只输出字符串
+constexpr uint8_t LOG_NO_PAYLOAD = 255;
+// 字节码格式的版本，增删操作码、改变操作数布局或指令语义时加一；编译缓存的 key 里带着它
+constexpr uint32_t BYTECODE_FORMAT = 6;
+
 enum class Opcode {
     /*
          * R = 寄存器 1
          * I = 立即数 8
-         * M = 内存偏移 （1字节寄存器 + 1字节偏移）
+         * M = 内存偏移 （1字节寄存器 + 2字节偏移），偏移按两字节对齐存放
          * C = 常量池偏移 8
          */
-    MOV_RI, MOV_RM, MOV_RR, MOV_RC, //op dst(1), src
-    MOV_MI, MOV_MM, MOV_MR, MOV_MC, //op dst(2), src
-    ADD, SUB, MUL, DIV, MOD, POW,   //op dst(1), src1(1), src2(1)
+    MOV_RI, MOV_RM, MOV_RR, MOV_RC, //op dst(1), src  MOV_RM: dst(1), base(1), offset(2)
+    MOV_MI, MOV_MM, MOV_MR, MOV_MC, //op dst(4), src  dst 为 base(1), 空(1), offset(2)，MOV_MM 的 src 也是这样
+    ADD, SUB, MUL, DIV, MOD, POW,   //op dst(1), src1(1), src2(1)  POW 的操作数和结果是浮点
     HALT,
-    FCALL,  //op mem(8)
-    FRET, DEBUG_LOG,
-    BLT, BLE, BGT, BGE, BEQ, BNE, JMP,
+    FCALL,  //op mem(8), frame size(2)
+    FRET, DEBUG_LOG,    //DEBUG_LOG str(8), payload reg(1)
+    BLT, BLE, BGT, BGE, BEQ, BNE,   //op src1(1), src2(1), mem(8)
+    JMP,
     CMP_GE, CMP_LT, CMP_LE, CMP_GT, CMP_EQ, CMP_NE,
     IF_TRUE,
     IF_FALSE,
+    LOOP_LT,    //op counter(1), limit(1), mem(8)  ++counter < limit 时跳转
+    MAP_NEW,    //op dst(1)  新建空表，dst 为句柄
+    MAP_GET,    //op dst(1), map(1), key(1)  键不存在时为 0
+    MAP_SET,    //op map(1), key(1), value(1)
+    MAP_DEL,    //op dst(1), map(1), key(1)  键存在并删除时为 1，否则为 0
+    MAP_LEN,    //op dst(1), map(1)
+    /*
+     * 按静态类型分开的指令：整数指令（ADD 等）的操作数已知是整数，浮点指令的操作数已知是浮点，
+     * 都不看运行时标记；只有类型推导不出来（动态类型）的地方才用 D 开头的通用指令。
+     * 比较和条件跳转在标记模式下本来就按标记比较，整数和动态类型共用一套。
+     */
+    FADD, FSUB, FMUL, FDIV, FMOD,   //op dst(1), src1(1), src2(1)
+    FCMP_GE, FCMP_LT, FCMP_LE, FCMP_GT, FCMP_EQ, FCMP_NE,
+    TO_FLOAT,   //op dst(1), src(1)  整数或动态类型的值转成浮点
+    BOX_FLOAT,  //op reg(1)  寄存器里的浮点交给动态类型的位置，打上浮点标记（必要时切到标记模式）
+    DADD, DSUB, DMUL, DDIV, DMOD,   //op dst(1), src1(1), src2(1)  有浮点标记的操作数时按浮点算，否则同整数指令
+    /*
+     * 快速化指令：只出现在 VirtualCore 私有的程序副本里，由执行时原地改写得到，编译器不会生成，
+     * 校验器拒绝含有它们的程序。操作数与被改写的指令相同。
+     */
+    DADD_F, DSUB_F, DMUL_F, DDIV_F, DMOD_F, // 两个操作数都带浮点标记的 D 开头指令，不再是时改回原指令
 };
 
 struct Op {
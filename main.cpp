@@ -3,8 +3,16 @@
 #include <string>
 
 int main(int argc, char* argv[]) {
-    if (argc < 2)
+    RunOptions opts;
+    std::string filename;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--dump-ir") opts.dump_ir = true;
+        else if (arg == "-O0") opts.optimize = false;
+        else if (arg == "--no-cache") opts.use_cache = false;
+        else filename = arg;
+    }
+    if (filename.empty())
         return run_repl();
-    std::string filename = argv[1];
-    return file_run(filename);
-}
\ No newline at end of file
+    return file_run(filename, opts);
+}
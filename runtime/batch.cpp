@@ -0,0 +1,513 @@
+#include "batch.hpp"
+#include "verifier.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+// 批量循环按指令集各编一份，加载时按 CPU 选用：AVX-512 下一个寄存器的 8 条车道是一条指令，AVX2 下两条
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && defined(__linux__)
+#define LMX_BATCH_TARGETS __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define LMX_BATCH_TARGETS
+#endif
+
+namespace lmx::runtime {
+
+namespace {
+
+constexpr size_t L = BATCH_LANES;
+constexpr size_t DEAD = std::numeric_limits<size_t>::max();
+
+/*
+ * 一个寄存器的全部车道。GCC/Clang 用向量扩展，运算直接生成向量指令；比较结果是每车道 -1 / 0 的掩码。
+ * 别的编译器退回逐车道循环，语义相同。
+ */
+#if defined(__GNUC__) || defined(__clang__)
+// 按值传递向量的调用约定随指令集而变，默认目标编出的函数不能被 AVX-512 版本调用，
+// 所以这些辅助函数一律强制内联（不优化的构建也一样），也就不用理会 -Wpsabi
+#define LMX_LANE_FN [[gnu::always_inline]] inline
+#if !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+using Vec = int64_t __attribute__((vector_size(sizeof(Lanes))));
+using UVec = uint64_t __attribute__((vector_size(sizeof(Lanes))));
+
+LMX_LANE_FN Vec wrap_add(const Vec a, const Vec b) { return reinterpret_cast<Vec>(reinterpret_cast<UVec>(a) + reinterpret_cast<UVec>(b)); }
+LMX_LANE_FN Vec wrap_sub(const Vec a, const Vec b) { return reinterpret_cast<Vec>(reinterpret_cast<UVec>(a) - reinterpret_cast<UVec>(b)); }
+#else
+#define LMX_LANE_FN inline
+struct Vec {
+    int64_t v[L];
+    int64_t& operator[](const size_t l) { return v[l]; }
+    int64_t operator[](const size_t l) const { return v[l]; }
+};
+
+#define LMX_VEC_OP(OP, EXPR) \
+    inline Vec operator OP(const Vec& a, const Vec& b) { \
+        Vec r; \
+        for (size_t l = 0; l < L; l++) r.v[l] = (EXPR); \
+        return r; \
+    }
+LMX_VEC_OP(&, a.v[l] & b.v[l])
+LMX_VEC_OP(|, a.v[l] | b.v[l])
+LMX_VEC_OP(^, a.v[l] ^ b.v[l])
+LMX_VEC_OP(<, -static_cast<int64_t>(a.v[l] < b.v[l]))
+LMX_VEC_OP(<=, -static_cast<int64_t>(a.v[l] <= b.v[l]))
+LMX_VEC_OP(>, -static_cast<int64_t>(a.v[l] > b.v[l]))
+LMX_VEC_OP(>=, -static_cast<int64_t>(a.v[l] >= b.v[l]))
+LMX_VEC_OP(==, -static_cast<int64_t>(a.v[l] == b.v[l]))
+LMX_VEC_OP(!=, -static_cast<int64_t>(a.v[l] != b.v[l]))
+#undef LMX_VEC_OP
+
+inline Vec operator~(const Vec& a) {
+    Vec r;
+    for (size_t l = 0; l < L; l++) r.v[l] = ~a.v[l];
+    return r;
+}
+inline Vec wrap_add(const Vec& a, const Vec& b) {
+    Vec r;
+    for (size_t l = 0; l < L; l++) r.v[l] = static_cast<int64_t>(static_cast<uint64_t>(a.v[l]) + static_cast<uint64_t>(b.v[l]));
+    return r;
+}
+inline Vec wrap_sub(const Vec& a, const Vec& b) {
+    Vec r;
+    for (size_t l = 0; l < L; l++) r.v[l] = static_cast<int64_t>(static_cast<uint64_t>(a.v[l]) - static_cast<uint64_t>(b.v[l]));
+    return r;
+}
+#endif
+
+LMX_LANE_FN Vec load(const Lanes& x) {
+    Vec r;
+    std::memcpy(&r, &x, sizeof(r));
+    return r;
+}
+
+LMX_LANE_FN void store(Lanes& x, const Vec& r) { std::memcpy(&x, &r, sizeof(r)); }
+
+LMX_LANE_FN Vec splat(const int64_t x) {
+    Vec r;
+    for (size_t l = 0; l < L; l++) r[l] = x;
+    return r;
+}
+
+// 掩码里为 -1 的车道取 r，为 0 的保留 d
+LMX_LANE_FN void blend(Lanes& d, const Vec& r, const Vec& m) { store(d, (r & m) | (load(d) & ~m)); }
+
+// 每条车道和自己的那一位比较，比逐个写车道少得多
+LMX_LANE_FN Vec to_mask(const uint64_t bits) {
+    static constexpr Lanes lane_bit{{1, 2, 4, 8, 16, 32, 64, 128}};
+    static_assert(L == 8);
+    return (splat(static_cast<int64_t>(bits)) & load(lane_bit)) != splat(0);
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+// 每车道先收窄成一个字节，再用一次乘法把 8 个字节的最高位收拢到最高字节：逐个取车道要多出十几条指令
+LMX_LANE_FN uint64_t to_bits(const Vec& m) {
+    using Bytes = int8_t __attribute__((vector_size(L)));
+    const auto b = __builtin_convertvector(m, Bytes);
+    uint64_t x;
+    std::memcpy(&x, &b, sizeof(x));
+    return (x & 0x8080808080808080ULL) * 0x0002040810204081ULL >> 56;
+}
+#else
+LMX_LANE_FN uint64_t to_bits(const Vec& m) {
+    uint64_t bits = 0;
+    for (size_t l = 0; l < L; l++) bits |= static_cast<uint64_t>(m[l] & 1) << l;
+    return bits;
+}
+#endif
+
+uint64_t read_u64(const uint8_t* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint16_t read_u16(const uint8_t* p) {
+    uint16_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+} // namespace
+
+BatchCore::BatchCore(const std::vector<Op>* program, const void* const_pool, const size_t const_pool_bytes):
+    program(program), const_pool(const_pool), const_pool_bytes(const_pool_bytes) {}
+
+bool BatchCore::run(const size_t entry, const size_t return_pc, const std::span<const int64_t* const> columns,
+                    const size_t rows, int64_t* results, std::vector<size_t>& fallback, std::string& error) {
+    if (!verified) {
+        const size_t entries[] = {0};
+        const std::span pool(static_cast<const std::byte*>(const_pool), const_pool ? const_pool_bytes : 0);
+        if (!verify(*program, pool, entries, error)) return false;
+        verified = true;
+        frame_window = frame_slots(*program);
+        if (frame.size() < frame_window) frame.resize(frame_window);
+    }
+    if (entry >= program->size() || return_pc >= program->size() || (*program)[return_pc].op != Opcode::HALT) {
+        error = "invalid entry point or return stub";
+        return false;
+    }
+    if (columns.size() > regs.size()) {
+        error = "too many arguments";
+        return false;
+    }
+    for (size_t row0 = 0; row0 < rows; row0 += L) {
+        const auto n = std::min(L, rows - row0);
+        for (size_t i = 0; i < columns.size(); i++) {
+            auto& r = regs[regs.size() - 1 - i];
+            for (size_t l = 0; l < n; l++) r.v[l] = columns[i][row0 + l];
+        }
+        if (!run_lanes(entry, return_pc, (1ULL << n) - 1, row0, results, fallback, error)) return false;
+    }
+    return true;
+}
+
+LMX_BATCH_TARGETS
+bool BatchCore::run_lanes(const size_t entry, const size_t return_pc, const uint64_t live_lanes, const size_t row0,
+                          int64_t* results, std::vector<size_t>& fallback, std::string& error) {
+    const Op* const code = program->data();
+    for (size_t l = 0; l < L; l++) {
+        stacks[l].assign(1, {return_pc, 0});
+        fp[l] = 0;
+    }
+
+    uint64_t live = live_lanes;
+    uint64_t active = live;     // 这一步要执行的车道，都在 at
+    Vec m = to_mask(active);
+    // 其余活着的车道停在各自的 pc[]，其中最小的是 waiting；没有等待的车道时是 DEAD
+    size_t at = entry;
+    size_t waiting = DEAD;
+    // 活着的车道 fp 都相同时帧按整槽读写，否则是 DEAD，逐车道读写
+    size_t shared_fp = 0;
+
+    const auto refresh_fp = [&] {
+        shared_fp = fp[std::countr_zero(live)];
+        for (size_t l = 0; l < L; l++)
+            if ((live >> l & 1) && fp[l] != shared_fp) shared_fp = DEAD;
+    };
+    const auto reschedule = [&] {
+        at = waiting = DEAD;
+        for (size_t l = 0; l < L; l++)
+            if (live >> l & 1) at = std::min(at, pc[l]);
+        active = 0;
+        for (size_t l = 0; l < L; l++) {
+            if (!(live >> l & 1)) continue;
+            if (pc[l] == at) active |= 1ULL << l;
+            else waiting = std::min(waiting, pc[l]);
+        }
+        m = to_mask(active);
+    };
+    const auto finish = [&](const uint64_t lanes) {
+        live &= ~lanes;
+        active &= ~lanes;
+        m = to_mask(active);
+    };
+    // 这些车道的结果需要大整数，交给调用方逐行重算
+    const auto retire = [&](const uint64_t lanes) {
+        for (size_t l = 0; l < L; l++)
+            if (lanes >> l & 1) fallback.push_back(row0 + l);
+        finish(lanes);
+    };
+
+    while (live) {
+        // 这一组车道全部结束或转为标量重算了，换下一组
+        if (!active) reschedule();
+        const auto& [op, o] = code[at];
+        size_t next = at + 1;
+        bool branch = false;
+        uint64_t taken = 0;
+        size_t target = 0;
+
+        switch (op) {
+            using enum Opcode;
+        case MOV_RI: blend(regs[o[0]], splat(static_cast<int64_t>(read_u64(o + 1))), m); break;
+        case MOV_RR: blend(regs[o[0]], load(regs[o[1]]), m); break;
+        case MOV_RC:
+            blend(regs[o[0]], splat(reinterpret_cast<int64_t>(static_cast<const Value*>(const_pool) + read_u64(o + 1))), m);
+            break;
+        case MOV_RM: {
+            const auto slot = read_u16(o + 2);
+            if (shared_fp != DEAD) {
+                blend(regs[o[0]], load(frame[shared_fp + slot]), m);
+            } else {
+                for (size_t l = 0; l < L; l++)
+                    if (active >> l & 1) regs[o[0]].v[l] = frame[fp[l] + slot].v[l];
+            }
+            break;
+        }
+        case MOV_MI: {
+            const auto slot = read_u16(o + 2);
+            if (shared_fp != DEAD) {
+                blend(frame[shared_fp + slot], splat(static_cast<int64_t>(read_u64(o + 4))), m);
+            } else {
+                for (size_t l = 0; l < L; l++)
+                    if (active >> l & 1) frame[fp[l] + slot].v[l] = static_cast<int64_t>(read_u64(o + 4));
+            }
+            break;
+        }
+        case MOV_MM: {
+            const auto dst = read_u16(o + 2), src = read_u16(o + 6);
+            if (shared_fp != DEAD) {
+                blend(frame[shared_fp + dst], load(frame[shared_fp + src]), m);
+            } else {
+                for (size_t l = 0; l < L; l++)
+                    if (active >> l & 1) frame[fp[l] + dst].v[l] = frame[fp[l] + src].v[l];
+            }
+            break;
+        }
+        case MOV_MR: {
+            const auto slot = read_u16(o + 2);
+            if (shared_fp != DEAD) {
+                blend(frame[shared_fp + slot], load(regs[o[4]]), m);
+            } else {
+                for (size_t l = 0; l < L; l++)
+                    if (active >> l & 1) frame[fp[l] + slot].v[l] = regs[o[4]].v[l];
+            }
+            break;
+        }
+        case MOV_MC: {
+            const auto slot = read_u16(o + 2);
+            const auto p = reinterpret_cast<int64_t>(static_cast<const Value*>(const_pool) + read_u64(o + 4));
+            if (shared_fp != DEAD) {
+                blend(frame[shared_fp + slot], splat(p), m);
+            } else {
+                for (size_t l = 0; l < L; l++)
+                    if (active >> l & 1) frame[fp[l] + slot].v[l] = p;
+            }
+            break;
+        }
+        // 批量执行的行都不带标记，通用算术指令就是整数指令
+        case ADD: case SUB: case DADD: case DSUB: {
+            const auto a = load(regs[o[1]]), b = load(regs[o[2]]);
+            Vec r, overflow;
+            // 加法两数同号而结果变号、减法两数异号而结果与被减数异号时溢出
+            if (op == ADD || op == DADD) {
+                r = wrap_add(a, b);
+                overflow = ((a ^ r) & (b ^ r)) < splat(0);
+            } else {
+                r = wrap_sub(a, b);
+                overflow = ((a ^ b) & (a ^ r)) < splat(0);
+            }
+            if (const auto bad = to_bits(overflow) & active) [[unlikely]] retire(bad);
+            blend(regs[o[0]], r, m);
+            break;
+        }
+        case MUL: case DMUL: {
+            // 64 位乘法的溢出检查没有对应的向量指令，逐车道算
+            const auto a = load(regs[o[1]]), b = load(regs[o[2]]);
+            Vec r;
+            uint64_t overflow = 0;
+            for (size_t l = 0; l < L; l++) {
+                int64_t x;
+                overflow |= static_cast<uint64_t>(mul_overflow(a[l], b[l], &x)) << l;
+                r[l] = x;
+            }
+            if (overflow & active) [[unlikely]] retire(overflow & active);
+            blend(regs[o[0]], r, m);
+            break;
+        }
+        case DIV: case MOD: case DDIV: case DMOD: {
+            // 没有整数向量除法，逐车道算
+            for (size_t l = 0; l < L; l++) {
+                if (!(active >> l & 1)) continue;
+                const auto a = regs[o[1]].v[l], b = regs[o[2]].v[l];
+                if (b == 0) {
+                    error = "integer division by zero in row " + std::to_string(row0 + l);
+                    return false;
+                }
+                if (b == -1 && a == std::numeric_limits<int64_t>::min()) {
+                    retire(1ULL << l);
+                    continue;
+                }
+                regs[o[0]].v[l] = op == DIV || op == DDIV ? a / b : a % b;
+            }
+            break;
+        }
+        case POW:
+            for (size_t l = 0; l < L; l++) {
+                if (!(active >> l & 1)) continue;
+                const auto x = std::bit_cast<double>(regs[o[1]].v[l]);
+                const auto y = std::bit_cast<double>(regs[o[2]].v[l]);
+                regs[o[0]].v[l] = std::bit_cast<int64_t>(std::pow(x, y));
+            }
+            break;
+        case FADD: case FSUB: case FMUL: case FDIV: case FMOD:
+            for (size_t l = 0; l < L; l++) {
+                if (!(active >> l & 1)) continue;
+                const auto x = std::bit_cast<double>(regs[o[1]].v[l]);
+                const auto y = std::bit_cast<double>(regs[o[2]].v[l]);
+                double r;
+                switch (op) {
+                case FADD: r = x + y; break;
+                case FSUB: r = x - y; break;
+                case FMUL: r = x * y; break;
+                case FDIV: r = x / y; break;
+                default: r = std::fmod(x, y); break;
+                }
+                regs[o[0]].v[l] = std::bit_cast<int64_t>(r);
+            }
+            break;
+        case FCMP_GE: case FCMP_LT: case FCMP_LE: case FCMP_GT: case FCMP_EQ: case FCMP_NE:
+            for (size_t l = 0; l < L; l++) {
+                if (!(active >> l & 1)) continue;
+                const auto x = std::bit_cast<double>(regs[o[1]].v[l]);
+                const auto y = std::bit_cast<double>(regs[o[2]].v[l]);
+                bool r;
+                switch (op) {
+                case FCMP_GE: r = x >= y; break;
+                case FCMP_LT: r = x < y; break;
+                case FCMP_LE: r = x <= y; break;
+                case FCMP_GT: r = x > y; break;
+                case FCMP_EQ: r = x == y; break;
+                default: r = x != y; break;
+                }
+                regs[o[0]].v[l] = r;
+            }
+            break;
+        case TO_FLOAT:
+            for (size_t l = 0; l < L; l++)
+                if (active >> l & 1) regs[o[0]].v[l] = std::bit_cast<int64_t>(static_cast<double>(regs[o[1]].v[l]));
+            break;
+        case CMP_GE: case CMP_LT: case CMP_LE: case CMP_GT: case CMP_EQ: case CMP_NE: {
+            const auto a = load(regs[o[1]]), b = load(regs[o[2]]);
+            Vec r;
+            switch (op) {
+            case CMP_GE: r = a >= b; break;
+            case CMP_LT: r = a < b; break;
+            case CMP_LE: r = a <= b; break;
+            case CMP_GT: r = a > b; break;
+            case CMP_EQ: r = a == b; break;
+            default: r = a != b; break;
+            }
+            // 掩码的 -1 换成 1
+            blend(regs[o[0]], r & splat(1), m);
+            break;
+        }
+        // 标量 VM 按 .b 取条件，也就是只看最低字节
+        case IF_TRUE: case IF_FALSE: {
+            const auto set = to_bits((load(regs[o[0]]) & splat(0xFF)) != splat(0));
+            taken = op == IF_TRUE ? set : ~set;
+            target = read_u64(o + 1);
+            branch = true;
+            break;
+        }
+        case BLT: case BLE: case BGT: case BGE: case BEQ: case BNE: {
+            const auto a = load(regs[o[0]]), b = load(regs[o[1]]);
+            switch (op) {
+            case BLT: taken = to_bits(a < b); break;
+            case BLE: taken = to_bits(a <= b); break;
+            case BGT: taken = to_bits(a > b); break;
+            case BGE: taken = to_bits(a >= b); break;
+            case BEQ: taken = to_bits(a == b); break;
+            default: taken = to_bits(a != b); break;
+            }
+            target = read_u64(o + 2);
+            branch = true;
+            break;
+        }
+        case LOOP_LT: {
+            // 掩码是 -1，减掉它就是只给执行的车道加一
+            const auto c = wrap_sub(load(regs[o[0]]), m);
+            store(regs[o[0]], c);
+            taken = to_bits(c < load(regs[o[1]]));
+            target = read_u64(o + 2);
+            branch = true;
+            break;
+        }
+        case JMP: next = read_u64(o); break;
+        case FCALL: {
+            const auto size = *reinterpret_cast<const uint16_t*>(o + 8);
+            size_t top = 0;
+            for (size_t l = 0; l < L; l++) {
+                if (!(active >> l & 1)) continue;
+                stacks[l].push_back({at + 1, fp[l]});
+                fp[l] += size;
+                top = std::max(top, fp[l]);
+            }
+            if (top + frame_window > frame.size()) frame.resize(std::max(frame.size() * 2, top + frame_window));
+            if (active != live) refresh_fp();
+            else if (shared_fp != DEAD) shared_fp += size;
+            next = read_u64(o);
+            break;
+        }
+        case FRET: {
+            // 递归深度不同的车道会返回到不同的地方
+            size_t first = DEAD;
+            bool same = true;
+            for (size_t l = 0; l < L; l++) {
+                if (!(active >> l & 1)) continue;
+                pc[l] = stacks[l].back().ret_addr;
+                fp[l] = stacks[l].back().fp;
+                stacks[l].pop_back();
+                if (first == DEAD) first = pc[l];
+                same = same && pc[l] == first;
+            }
+            refresh_fp();
+            if (!same) {
+                reschedule();
+                continue;
+            }
+            next = first;
+            break;
+        }
+        case HALT:
+            for (size_t l = 0; l < L; l++)
+                if (active >> l & 1) results[row0 + l] = regs[0].v[l];
+            finish(active);
+            if (live) {
+                refresh_fp();
+                reschedule();
+            }
+            continue;
+        case MAP_NEW: case MAP_GET: case MAP_SET: case MAP_DEL: case MAP_LEN:
+            // 表是 VirtualCore 里的状态，用到表的行整行交给标量 VM 重算
+            retire(active);
+            break;
+        case BOX_FLOAT:
+            // 动态类型的浮点要靠标量 VM 的标记，同样整行重算
+            retire(active);
+            break;
+        case DADD_F: case DSUB_F: case DMUL_F: case DDIV_F: case DMOD_F:
+            // 快速化指令只在 VirtualCore 的私有副本里，校验过的程序中没有
+            break;
+        case DEBUG_LOG: {
+            const char* str = static_cast<const char*>(const_pool) + read_u64(o);
+            for (size_t l = 0; l < L; l++) {
+                if (!(active >> l & 1)) continue;
+                if (o[8] == LOG_NO_PAYLOAD) std::fprintf(stderr, "[LogInfo row %zu]: %s\n", row0 + l, str);
+                else std::fprintf(stderr, "[LogInfo row %zu]: %s %lld\n", row0 + l, str, static_cast<long long>(regs[o[8]].v[l]));
+            }
+            break;
+        }
+        }
+
+        if (branch) {
+            taken &= active;
+            if (taken == active) {
+                next = target;
+            } else if (taken != 0) {
+                // 车道分开走：各自记下 pc，之后按最小 pc 调度，走到同一处时再合起来
+                for (size_t l = 0; l < L; l++)
+                    if (active >> l & 1) pc[l] = taken >> l & 1 ? target : at + 1;
+                reschedule();
+                continue;
+            }
+        }
+        if (next < waiting) {
+            at = next;
+        } else {
+            // 追上了等待的车道，或者越过了它们：停下来，换 pc 最小的一组
+            for (size_t l = 0; l < L; l++)
+                if (active >> l & 1) pc[l] = next;
+            reschedule();
+        }
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,62 @@
+//
+// Batch execution: one function over many input rows, BATCH_LANES rows in lockstep
+//
+
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "../include/lmx_export.hpp"
+#include "../include/opcode.hpp"
+#include "vm.hpp"
+
+namespace lmx::runtime {
+
+// 每个寄存器同时装 BATCH_LANES 行的值：AVX-512 下正好一个向量，AVX2 下两个
+constexpr size_t BATCH_LANES = 8;
+
+struct alignas(64) Lanes {
+    int64_t v[BATCH_LANES];
+};
+
+/*
+ * 把 BATCH_LANES 行输入装进同一组寄存器，按同一条指令流一起执行，一次分派处理一批。
+ * 每条车道（行）有自己的 pc、调用栈和帧指针；每步执行 pc 最小的那些车道所在的指令，
+ * 其余车道用掩码屏蔽。条件跳转让车道分开后，先走的一组一直执行到追上等待的车道为止，
+ * 在 pc 相同的地方自然汇合；只有分开、汇合和车道结束时才重新找最小 pc。
+ *
+ * 结果放不进 int64 的行（溢出后标量 VM 会转成大整数）和用到 map 的行不在这里算，行号交给调用方，
+ * 由 VirtualCore::call() 逐行重算，语义和逐行调用完全一致。
+ */
+class LMVM_API BatchCore {
+    const std::vector<Op>* program;
+    const void* const_pool;
+    size_t const_pool_bytes;
+    bool verified{false};
+    size_t frame_window{FRAME_SLOTS};   // 一帧要留出的槽位数，见 frame_slots()
+
+    std::array<Lanes, 255> regs{};
+    std::array<size_t, BATCH_LANES> pc{}, fp{};
+    std::array<std::vector<CallFrame>, BATCH_LANES> stacks;
+    // 帧按槽位交错存放：frame[fp + slot].v[l] 是车道 l 的槽位，各车道 fp 相同时整槽一次读写
+    std::vector<Lanes> frame = std::vector<Lanes>(FRAME_SLOTS);
+
+    bool run_lanes(size_t entry, size_t return_pc, uint64_t live_lanes, size_t row0, int64_t* results,
+                   std::vector<size_t>& fallback, std::string& error);
+public:
+    explicit BatchCore(const std::vector<Op>* program, const void* const_pool = nullptr, size_t const_pool_bytes = 0);
+
+    /*
+     * 对 rows 行输入各调用一次 entry 处的函数，第 i 个参数取自 columns[i]，r0 写入 results。
+     * return_pc 和 VirtualCore::call() 一样必须指向一条 HALT。
+     * 需要大整数或用到 map 的行号追加到 fallback，对应的 results 不写；除零等错误返回 false。
+     */
+    bool run(size_t entry, size_t return_pc, std::span<const int64_t* const> columns, size_t rows,
+             int64_t* results, std::vector<size_t>& fallback, std::string& error);
+};
+
+}
@@ -0,0 +1,202 @@
+#include "log_ring.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <cstring>
+
+#ifndef _WIN32
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace lmx::runtime {
+
+namespace {
+
+constexpr size_t BATCH = 64;
+
+struct Piece {
+    const char* data;
+    size_t size;
+};
+
+// 一批日志攒成若干片段一次写出，没有 writev 的平台逐片 fwrite
+void write_pieces(const int fd, const Piece* pieces, const size_t count) {
+#ifndef _WIN32
+    iovec iov[BATCH * 3 + 1];
+    size_t n = 0;
+    for (size_t i = 0; i < count; i++) iov[n++] = {const_cast<char*>(pieces[i].data), pieces[i].size};
+    // 短写时跳过已经写出的部分继续
+    for (iovec* v = iov; n > 0;) {
+        auto written = writev(fd, v, static_cast<int>(n));
+        if (written < 0) return;
+        while (n > 0 && static_cast<size_t>(written) >= v->iov_len) {
+            written -= static_cast<ssize_t>(v->iov_len);
+            v++;
+            n--;
+        }
+        if (n > 0) {
+            v->iov_base = static_cast<char*>(v->iov_base) + written;
+            v->iov_len -= static_cast<size_t>(written);
+        }
+    }
+#else
+    FILE* out = fd == 1 ? stdout : stderr;
+    for (size_t i = 0; i < count; i++) fwrite(pieces[i].data, 1, pieces[i].size, out);
+    fflush(out);
+#endif
+}
+
+} // namespace
+
+LogRing::LogRing(const char* pool, const LogOptions& options):
+    pool(pool),
+    options(options),
+    mask(std::bit_ceil(std::max<size_t>(options.capacity, 2)) - 1),
+    start(std::chrono::steady_clock::now()),
+    start_ticks(ticks()) {
+    slots = std::make_unique_for_overwrite<Event[]>(mask + 1);
+    worker = std::jthread([this] { drain_loop(); });
+}
+
+LogRing::~LogRing() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    cv.notify_one();
+    // jthread 析构时 join，后台线程退出前会写完剩下的日志
+}
+
+// 缓冲区看起来满了：刷新 tail，确实满了再按策略处理；返回 false 表示丢弃这条
+bool LogRing::make_room(const uint64_t h) {
+    tail_cache = tail.load(std::memory_order_acquire);
+    if (h - tail_cache <= mask) return true;
+    if (options.overflow == LogOverflow::Drop) {
+        drop_count.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    while (h - tail_cache > mask) {
+        wake();
+        tail.wait(tail_cache, std::memory_order_acquire);
+        tail_cache = tail.load(std::memory_order_acquire);
+    }
+    return true;
+}
+
+void LogRing::wake() {
+    {
+        std::lock_guard lock(mutex);
+        wake_flag = true;
+    }
+    cv.notify_one();
+}
+
+void LogRing::flush() {
+    const auto h = head.load(std::memory_order_relaxed);
+    if (tail.load(std::memory_order_acquire) == h) return;
+    wake();
+    for (auto t = tail.load(std::memory_order_acquire); t != h; t = tail.load(std::memory_order_acquire)) {
+        tail.wait(t, std::memory_order_acquire);
+    }
+    tail_cache = h;
+}
+
+void LogRing::write_now(const uint64_t offset, const std::string_view payload) {
+    flush();
+    const auto us = static_cast<uint64_t>(static_cast<double>(ticks() - start_ticks) * ns_per_tick()) / 1000;
+    char prefix[48];
+    const auto plen = std::snprintf(prefix, sizeof(prefix), "[LogInfo +%llu.%03llums]: ",
+                                    static_cast<unsigned long long>(us / 1000), static_cast<unsigned long long>(us % 1000));
+    const char* str = pool + offset;
+    const Piece pieces[] = {{prefix, static_cast<size_t>(plen)}, {str, std::strlen(str)}, {" ", 1},
+                            {payload.data(), payload.size()}, {"\n", 1}};
+    write_pieces(options.fd, pieces, std::size(pieces));
+}
+
+double LogRing::ns_per_tick() const {
+    const auto elapsed_ticks = ticks() - start_ticks;
+    const auto elapsed_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    return elapsed_ticks > 0 ? elapsed_ns / static_cast<double>(elapsed_ticks) : 1.0;
+}
+
+// 取出一批日志写出，返回是否取到了东西
+bool LogRing::drain_batch(uint64_t& reported_drops) {
+    const auto t = tail.load(std::memory_order_relaxed);
+    const auto h = head.load(std::memory_order_acquire);
+    const auto drops = drop_count.load(std::memory_order_relaxed);
+    if (t == h && drops == reported_drops) return false;
+
+    const auto count = std::min<uint64_t>(h - t, BATCH);
+    const auto scale = ns_per_tick();
+    // 每条日志三段：带时间戳的前缀、常量池里的字符串、负载和换行
+    char text[BATCH + 1][80];
+    Piece pieces[BATCH * 3 + 1];
+    size_t n = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        const auto& e = slots[(t + i) & mask];
+        char* prefix = text[i];
+        const auto us = static_cast<uint64_t>(static_cast<double>(e.stamp - start_ticks) * scale) / 1000;
+        const auto plen = std::snprintf(prefix, 48, "[LogInfo +%llu.%03llums]: ",
+                                        static_cast<unsigned long long>(us / 1000), static_cast<unsigned long long>(us % 1000));
+        pieces[n++] = {prefix, static_cast<size_t>(plen)};
+        const char* str = pool + e.offset;
+        pieces[n++] = {str, std::strlen(str)};
+        char* suffix = prefix + 48;
+        const auto slen = e.has_payload
+            ? std::snprintf(suffix, 32, " %lld\n", static_cast<long long>(e.payload))
+            : std::snprintf(suffix, 32, "\n");
+        pieces[n++] = {suffix, static_cast<size_t>(slen)};
+    }
+    if (drops != reported_drops) {
+        const auto len = std::snprintf(text[BATCH], sizeof(text[BATCH]), "[LogInfo]: %llu messages dropped\n",
+                                       static_cast<unsigned long long>(drops - reported_drops));
+        pieces[n++] = {text[BATCH], static_cast<size_t>(len)};
+        reported_drops = drops;
+    }
+    write_pieces(options.fd, pieces, n);
+
+    tail.store(t + count, std::memory_order_release);
+    return true;
+}
+
+void LogRing::drain_loop() {
+    uint64_t reported_drops = 0;
+    // 上一次轮询期间没有新日志，下次不再轮询，睡到被叫醒为止
+    bool idle = false;
+    while (true) {
+        // 把现有的日志全部写完再通知等待的生产者，避免每批都来回切换线程
+        if (drain_batch(reported_drops)) {
+            while (drain_batch(reported_drops)) {}
+            tail.notify_all();
+            idle = false;
+            continue;
+        }
+        std::unique_lock lock(mutex);
+        if (stopping) {
+            lock.unlock();
+            // 停止前最后再取一次，生产者在 stopping 之前推入的都要写出
+            while (drain_batch(reported_drops)) {}
+            tail.notify_all();
+            return;
+        }
+        if (!idle) {
+            cv.wait_for(lock, std::chrono::milliseconds(1), [this] { return wake_flag || stopping; });
+            idle = true;
+        } else {
+            sleeping.store(true, std::memory_order_seq_cst);
+            // 设置 sleeping 之前推入的日志，生产者不会来叫醒，睡下之前再看一眼
+            if (head.load(std::memory_order_seq_cst) != tail.load(std::memory_order_relaxed) ||
+                drop_count.load(std::memory_order_relaxed) != reported_drops) {
+                sleeping.store(false, std::memory_order_relaxed);
+                continue;
+            }
+            cv.wait(lock, [this] { return wake_flag || stopping; });
+            sleeping.store(false, std::memory_order_relaxed);
+        }
+        wake_flag = false;
+    }
+}
+
+}
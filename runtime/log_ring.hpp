@@ -0,0 +1,111 @@
+//
+// Asynchronous DEBUG_LOG sink: single-producer ring buffer drained by a background thread
+//
+
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+
+#include "../include/lmx_export.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#endif
+
+namespace lmx::runtime {
+
+// 环形缓冲区满了之后的处理方式
+enum class LogOverflow : uint8_t {
+    Block,  // 等后台线程腾出位置，不丢日志
+    Drop,   // 直接丢弃，记入丢弃计数，之后输出一条汇总
+};
+
+struct LogOptions {
+    size_t capacity{4096};          // 向上取整到 2 的幂
+    LogOverflow overflow{LogOverflow::Block};
+    int fd{2};                      // 输出的文件描述符，默认 stderr
+};
+
+/*
+ * VM 线程是唯一的生产者，后台线程是唯一的消费者，两边只通过 head/tail 两个原子下标同步。
+ * push() 只写一个槽位并发布 head，不加锁、不做系统调用；后台线程按批取出，
+ * 格式化后用一次 writev 写出，字符串直接引用常量池，不做拷贝。
+ * 后台线程写完一批后按毫秒轮询，持续有日志时生产者不用叫醒它；轮询一次没等到新日志就在条件变量上睡下，
+ * 直到生产者推入下一条、缓冲区过半、flush() 或析构，VM 不输出日志时后台线程不会醒来。
+ * VM 在第一次执行 DEBUG_LOG 时才创建 LogRing，从不输出日志的 VM 没有后台线程。
+ */
+class LMVM_API LogRing {
+public:
+    struct Event {
+        uint64_t stamp;     // ticks() 的读数，写出时才换算成时间
+        uint64_t offset;    // 字符串在常量池中的字节偏移
+        int64_t payload;
+        bool has_payload;
+    };
+
+    LogRing(const char* pool, const LogOptions& options);
+    ~LogRing();
+    LogRing(const LogRing&) = delete;
+    LogRing& operator=(const LogRing&) = delete;
+
+    void push(const uint64_t offset, const bool has_payload, const int64_t payload) {
+        const auto h = head.load(std::memory_order_relaxed);
+        if (h - tail_cache >= mask + 1 && !make_room(h)) return;
+        slots[h & mask] = {ticks(), offset, payload, has_payload};
+        // 和后台线程的 sleeping / head 读写构成 Dekker 式配对，两边都用 seq_cst，不会双方都看不到对方
+        head.store(h + 1, std::memory_order_seq_cst);
+        // 过半或后台线程已经睡下时才叫醒它，平时完全不碰锁；exchange 保证睡一次只叫醒一次
+        if (h - tail_cache == (mask + 1) / 2 ||
+            (sleeping.load(std::memory_order_seq_cst) && sleeping.exchange(false, std::memory_order_seq_cst))) wake();
+    }
+
+    // 等缓冲区里已有的日志全部写出
+    void flush();
+    // 负载不是 int64 时（比如大整数）走这里：先写完队列里的，再同步写出这一条，保持顺序
+    void write_now(uint64_t offset, std::string_view payload);
+    [[nodiscard]] uint64_t dropped() const { return drop_count.load(std::memory_order_relaxed); }
+
+private:
+    const char* pool;
+    LogOptions options;
+    std::unique_ptr<Event[]> slots;
+    size_t mask;
+    std::chrono::steady_clock::time_point start;
+    uint64_t start_ticks;
+
+    alignas(64) std::atomic<uint64_t> head{0};
+    uint64_t tail_cache{0};     // 生产者看到的 tail，只在缓冲区看起来满了时刷新
+    std::atomic<uint64_t> drop_count{0};
+    alignas(64) std::atomic<uint64_t> tail{0};
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool wake_flag{false};
+    bool stopping{false};
+    std::atomic<bool> sleeping{false};  // 后台线程没有超时地等在 cv 上，推入日志时要叫醒它
+    std::jthread worker;
+
+    // x86 上直接读时间戳计数器，比 steady_clock 便宜得多；换算比例由后台线程对照 steady_clock 得出
+    static uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+    }
+    [[nodiscard]] double ns_per_tick() const;
+    bool make_room(uint64_t h);
+    void wake();
+    void drain_loop();
+    bool drain_batch(uint64_t& reported_drops);
+};
+
+}
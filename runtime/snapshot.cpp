@@ -0,0 +1,261 @@
+#include "snapshot.hpp"
+#include "verifier.hpp"
+#include "vm.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <system_error>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace lmx::runtime {
+
+namespace {
+
+struct Section {
+    uint64_t offset;
+    uint64_t bytes;
+};
+
+// 文件格式：Header 之后各段按 SECTION_ALIGN 对齐存放，常量池按页对齐，写时复制只影响被改到的页
+struct Header {
+    char magic[4];
+    uint32_t format;
+    uint32_t op_size;
+    uint32_t value_size;
+    uint64_t pc;
+    Section regs, frame, tags, program, pool, extra;
+};
+
+constexpr char MAGIC[4] = {'L', 'M', 'X', 'S'};
+constexpr uint32_t FORMAT = 4;
+constexpr uint64_t SECTION_ALIGN = 64;
+constexpr uint64_t PAGE_ALIGN = 4096;
+
+constexpr uint64_t REG_COUNT = std::tuple_size_v<decltype(LMXState::regs)>;
+constexpr uint64_t REGS_BYTES = REG_COUNT * sizeof(Value);
+// 帧段保存顶层帧，槽位数按程序而定（见 frame_slots()），至少 FRAME_SLOTS；
+// 标记段里寄存器的标记在前，帧的标记在后，每个槽位一个字节
+
+uint64_t align_up(const uint64_t n, const uint64_t a) {
+    return (n + a - 1) / a * a;
+}
+
+bool inside(const Section& s, const uint64_t file_size) {
+    return s.offset <= file_size && s.bytes <= file_size - s.offset;
+}
+
+} // namespace
+
+Snapshot::~Snapshot() {
+#ifndef _WIN32
+    if (mapped) munmap(base, size);
+#endif
+}
+
+std::unique_ptr<Snapshot> Snapshot::open(const std::string& path, std::string& error) {
+    std::unique_ptr<Snapshot> image(new Snapshot);
+#ifndef _WIN32
+    if (const int fd = ::open(path.c_str(), O_RDONLY); fd >= 0) {
+        struct stat st{};
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            // 私有映射：可写，但写入只落在本进程的副本上
+            void* p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                image->base = p;
+                image->size = static_cast<size_t>(st.st_size);
+                image->mapped = true;
+            }
+        }
+        close(fd);
+    }
+#endif
+    if (!image->mapped) {
+        std::error_code ec;
+        const auto file_size = std::filesystem::file_size(path, ec);
+        std::ifstream in(path, std::ios::binary);
+        if (ec || !in) {
+            error = "cannot open " + path;
+            return nullptr;
+        }
+        image->buffer = std::make_unique_for_overwrite<std::byte[]>(file_size);
+        if (!in.read(reinterpret_cast<char*>(image->buffer.get()), static_cast<std::streamsize>(file_size))) {
+            error = "cannot read " + path;
+            return nullptr;
+        }
+        image->base = image->buffer.get();
+        image->size = file_size;
+    }
+
+    Header h{};
+    if (image->size < sizeof(h)) {
+        error = path + " is not a snapshot";
+        return nullptr;
+    }
+    std::memcpy(&h, image->base, sizeof(h));
+    if (std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0) {
+        error = path + " is not a snapshot";
+        return nullptr;
+    }
+    if (h.format != FORMAT || h.op_size != sizeof(Op) || h.value_size != sizeof(Value)) {
+        error = path + " was written by an incompatible VM";
+        return nullptr;
+    }
+    for (const auto& s : {h.regs, h.frame, h.tags, h.program, h.pool, h.extra}) {
+        if (!inside(s, image->size)) {
+            error = path + " is truncated";
+            return nullptr;
+        }
+    }
+    const auto slots = h.frame.bytes / sizeof(Value);
+    if (h.regs.bytes != REGS_BYTES || h.frame.bytes % sizeof(Value) != 0 || slots < FRAME_SLOTS ||
+        h.tags.bytes != REG_COUNT + slots ||
+        h.program.bytes % sizeof(Op) != 0 ||
+        h.pc >= h.program.bytes / sizeof(Op)) {
+        error = path + " is corrupted";
+        return nullptr;
+    }
+
+    auto* bytes = static_cast<std::byte*>(image->base);
+    image->pc = h.pc;
+    image->regs = {bytes + h.regs.offset, h.regs.bytes};
+    image->frame = {bytes + h.frame.offset, h.frame.bytes};
+    image->tags = {bytes + h.tags.offset, h.tags.bytes};
+    image->pool = {bytes + h.pool.offset, h.pool.bytes};
+    image->extra_data = {bytes + h.extra.offset, h.extra.bytes};
+    image->ops.resize(h.program.bytes / sizeof(Op), Op(Opcode::HALT));
+    std::memcpy(image->ops.data(), bytes + h.program.offset, h.program.bytes);
+    return image;
+}
+
+bool VirtualCore::save_snapshot(const std::string& path, const std::span<const std::byte> extra,
+                                std::string& error) const {
+    if (!ste.call_stack.empty()) {
+        error = "cannot snapshot while a call is in progress";
+        return false;
+    }
+    // 大整数在进程内的堆上，快照里存不下；浮点标记和值一起保存
+    if (std::ranges::find(reg_big, TAG_BIG) != reg_big.end() || std::ranges::find(frame_big, TAG_BIG) != frame_big.end()) {
+        error = "cannot snapshot while registers hold integers wider than 64 bits";
+        return false;
+    }
+    // 调用栈为空，顶层帧就是 frames 开头的这些槽位
+    const auto slots = std::min(ste.frames.size(), frame_slots(*ste.program));
+    std::vector<uint8_t> tags(REG_COUNT + slots, 0);
+    if (big_mode) {
+        std::ranges::copy(reg_big, tags.begin());
+        std::copy_n(frame_big.begin(), std::min(slots, frame_big.size()), tags.begin() + reg_big.size());
+    }
+    if (!maps.empty()) {
+        error = "cannot snapshot while maps are alive";
+        return false;
+    }
+    const auto& program = *ste.program;
+    const uint64_t pool_bytes = const_pool_top ? const_pool_bytes : 0;
+    /*
+     * MOV_*C 放进寄存器和帧的是常量池里的地址，载入后常量池换了位置，这些地址就失效了；
+     * 值没有类型标记，分不清这样的地址和恰好落在常量池范围内的整数，只能都不改写。
+     * 程序里没有 MOV_*C 就不会有这样的地址；有的话，只要有值落在常量池范围内就不保存。
+     */
+    const auto loads_pool = std::ranges::any_of(program, [](const Op& op) {
+        return op.op == Opcode::MOV_RC || op.op == Opcode::MOV_MC;
+    });
+    if (loads_pool && pool_bytes > 0) {
+        const auto base = reinterpret_cast<uint64_t>(const_pool_top);
+        const auto in_pool = [&](const Value& v) { return v.u64 >= base && v.u64 < base + pool_bytes; };
+        if (std::ranges::any_of(ste.regs, in_pool) ||
+            std::any_of(ste.frames.begin(), ste.frames.begin() + static_cast<ptrdiff_t>(slots), in_pool)) {
+            error = "cannot snapshot while registers hold constant-pool addresses";
+            return false;
+        }
+    }
+
+    Header h{};
+    std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+    h.format = FORMAT;
+    h.op_size = sizeof(Op);
+    h.value_size = sizeof(Value);
+    h.pc = ste.pc;
+    h.regs = {align_up(sizeof(Header), SECTION_ALIGN), REGS_BYTES};
+    h.frame = {align_up(h.regs.offset + h.regs.bytes, SECTION_ALIGN), slots * sizeof(Value)};
+    h.tags = {align_up(h.frame.offset + h.frame.bytes, SECTION_ALIGN), tags.size()};
+    h.program = {align_up(h.tags.offset + h.tags.bytes, SECTION_ALIGN), program.size() * sizeof(Op)};
+    h.pool = {align_up(h.program.offset + h.program.bytes, PAGE_ALIGN), pool_bytes};
+    h.extra = {align_up(h.pool.offset + h.pool.bytes, SECTION_ALIGN), extra.size()};
+
+    // 和编译缓存一样先写临时文件再 rename，读者不会看到写了一半的快照
+    const std::filesystem::path final_path(path);
+    auto tmp_path = final_path;
+    tmp_path += ".tmp." + std::to_string(std::random_device{}());
+    {
+        std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+        uint64_t written = 0;
+        const auto put = [&](const Section& s, const void* data) {
+            static constexpr char zeros[PAGE_ALIGN]{};
+            out.write(zeros, static_cast<std::streamsize>(s.offset - written));
+            out.write(static_cast<const char*>(data), static_cast<std::streamsize>(s.bytes));
+            written = s.offset + s.bytes;
+        };
+        out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        written = sizeof(h);
+        put(h.regs, ste.regs.data());
+        put(h.frame, ste.frames.data());
+        put(h.tags, tags.data());
+        put(h.program, program.data());
+        put(h.pool, const_pool_top);
+        put(h.extra, extra.data());
+        out.close();
+        if (!out) {
+            std::error_code ec;
+            std::filesystem::remove(tmp_path, ec);
+            error = "cannot write " + path;
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp_path, final_path, ec);
+    if (ec) {
+        std::filesystem::remove(tmp_path, ec);
+        error = "cannot write " + path;
+        return false;
+    }
+    return true;
+}
+
+void VirtualCore::restore(Snapshot& image) {
+    // 日志队列引用着旧常量池里的字符串，先写完
+    flush_log();
+    log.reset();
+    ste.pc = image.pc;
+    std::memcpy(ste.regs.data(), image.regs.data(), image.regs.size());
+    ste.call_stack.clear();
+    ste.fp = 0;
+    maps.clear();
+    ste.frames.assign(image.frame.size() / sizeof(Value), Value());
+    std::memcpy(ste.frames.data(), image.frame.data(), image.frame.size());
+    // 有带浮点标记的值时才需要标记模式。快照里只会有浮点标记，文件里的其他值一律当作没有标记，
+    // 否则 VM 会把整数当成大整数的指针
+    leave_big_mode();
+    const auto tags = reinterpret_cast<const uint8_t*>(image.tags.data());
+    const auto as_float = [](const uint8_t t) -> uint8_t { return t == TAG_FLOAT ? TAG_FLOAT : 0; };
+    if (std::any_of(tags, tags + image.tags.size(), [](const uint8_t t) { return t == TAG_FLOAT; })) {
+        enter_big_mode();
+        std::transform(tags, tags + reg_big.size(), reg_big.begin(), as_float);
+        std::transform(tags + reg_big.size(), tags + image.tags.size(), frame_big.begin(), as_float);
+    }
+    ste.program = &image.ops;
+    const_pool_top = image.pool.empty() ? nullptr : image.pool.data();
+    const_pool_bytes = image.pool.size();
+    // 保存时已经保证没有指向常量池的地址，值原样使用
+    verified = false;
+}
+
+}
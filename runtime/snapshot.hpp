@@ -0,0 +1,54 @@
+//
+// VirtualCore state images: save after initialization, map into a new process and resume
+//
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "../include/lmx_export.hpp"
+#include "../include/opcode.hpp"
+
+namespace lmx::runtime {
+
+/*
+ * 快照文件由 VirtualCore::save_snapshot() 写出，包含寄存器、顶层帧及它们的浮点标记、程序、常量池，
+ * 以及宿主附带的一段任意数据（比如嵌入 API 的函数表）。
+ * 打开时整个文件以 MAP_PRIVATE 映射：常量池原地使用，写入时才按页复制，不影响文件和其他进程；
+ * 程序和帧放在 VirtualCore 的 vector 里，从映射中复制一份，只有几 KB 到几 MB。
+ * 寄存器和帧里的值没有类型，指向常量池的地址无法和整数区分，恢复时也就无法换到新映射上，
+ * 所以保存时不能有这样的地址（见 save_snapshot()），恢复时值原样载入。
+ * 文件来自磁盘，内容不可信：打开时检查各段边界，程序在第一次执行前照常校验。
+ */
+class LMVM_API Snapshot {
+    void* base{nullptr};
+    size_t size{0};
+    bool mapped{false};
+    std::unique_ptr<std::byte[]> buffer;    // 不支持 mmap 的平台整体读入
+
+    Snapshot() = default;
+    friend class VirtualCore;
+
+    // 以下由 open() 从文件头填好
+    std::vector<Op> ops;
+    size_t pc{0};
+    std::span<const std::byte> regs, frame, tags, extra_data;
+    std::span<std::byte> pool;
+
+public:
+    ~Snapshot();
+    Snapshot(const Snapshot&) = delete;
+    Snapshot& operator=(const Snapshot&) = delete;
+
+    // 失败时返回空指针，error 说明原因
+    static std::unique_ptr<Snapshot> open(const std::string& path, std::string& error);
+
+    [[nodiscard]] std::span<const std::byte> extra() const { return extra_data; }
+    [[nodiscard]] std::span<const Op> program() const { return ops; }
+};
+
+}
@@ -0,0 +1,286 @@
+#include "bigint.hpp"
+
+#include <algorithm>
+#include <bit>
+
+namespace lmx::runtime {
+
+namespace {
+
+using Mag = std::vector<uint32_t>;
+using Limbs = std::span<const uint32_t>;
+
+void trim_mag(Mag& m) {
+    while (!m.empty() && m.back() == 0) m.pop_back();
+}
+
+int compare_mag(const Limbs a, const Limbs b) {
+    if (a.size() != b.size()) return a.size() < b.size() ? -1 : 1;
+    for (size_t i = a.size(); i-- > 0;) {
+        if (a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+Mag add_mag(Limbs a, Limbs b) {
+    if (a.size() < b.size()) std::swap(a, b);
+    Mag r(a.size() + 1);
+    uint64_t carry = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        carry += static_cast<uint64_t>(a[i]) + (i < b.size() ? b[i] : 0);
+        r[i] = static_cast<uint32_t>(carry);
+        carry >>= 32;
+    }
+    r[a.size()] = static_cast<uint32_t>(carry);
+    trim_mag(r);
+    return r;
+}
+
+// a -= b，要求 a >= b
+void sub_mag(Mag& a, const Limbs b) {
+    int64_t borrow = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        int64_t t = static_cast<int64_t>(a[i]) - borrow - (i < b.size() ? b[i] : 0);
+        borrow = t < 0;
+        a[i] = static_cast<uint32_t>(t);
+        if (i >= b.size() && !borrow) break;
+    }
+    trim_mag(a);
+}
+
+// acc += x << (32 * shift)
+void add_shifted(Mag& acc, const Limbs x, const size_t shift) {
+    if (acc.size() < shift + x.size() + 1) acc.resize(shift + x.size() + 1);
+    uint64_t carry = 0;
+    size_t i = 0;
+    for (; i < x.size(); i++) {
+        carry += static_cast<uint64_t>(acc[shift + i]) + x[i];
+        acc[shift + i] = static_cast<uint32_t>(carry);
+        carry >>= 32;
+    }
+    for (size_t k = shift + i; carry; k++) {
+        if (k == acc.size()) acc.push_back(0);
+        carry += acc[k];
+        acc[k] = static_cast<uint32_t>(carry);
+        carry >>= 32;
+    }
+}
+
+// out 预先清零，长度至少 a.size() + b.size()
+void mul_school(const Limbs a, const Limbs b, uint32_t* out) {
+    for (size_t i = 0; i < a.size(); i++) {
+        uint64_t carry = 0;
+        for (size_t j = 0; j < b.size(); j++) {
+            carry += static_cast<uint64_t>(a[i]) * b[j] + out[i + j];
+            out[i + j] = static_cast<uint32_t>(carry);
+            carry >>= 32;
+        }
+        out[i + b.size()] = static_cast<uint32_t>(carry);
+    }
+}
+
+Mag mul_mag(Limbs a, Limbs b) {
+    if (a.empty() || b.empty()) return {};
+    if (a.size() < b.size()) std::swap(a, b);
+    Mag out(a.size() + b.size());
+    if (b.size() < BigInt::KARATSUBA_LIMBS) {
+        mul_school(a, b, out.data());
+    } else if (a.size() >= 2 * b.size()) {
+        // 长短悬殊时把长的一边按短边的长度切块，每块与短边做平衡的乘法
+        for (size_t off = 0; off < a.size(); off += b.size()) {
+            add_shifted(out, mul_mag(a.subspan(off, std::min(b.size(), a.size() - off)), b), off);
+        }
+    } else {
+        // (a1·B + a0)(b1·B + b0) = z2·B² + z1·B + z0，z1 = (a0 + a1)(b0 + b1) - z0 - z2
+        const auto m = a.size() / 2;
+        const auto a0 = a.first(m), a1 = a.subspan(m), b0 = b.first(m), b1 = b.subspan(m);
+        const auto z0 = mul_mag(a0, b0);
+        const auto z2 = mul_mag(a1, b1);
+        auto z1 = mul_mag(add_mag(a0, a1), add_mag(b0, b1));
+        sub_mag(z1, z0);
+        sub_mag(z1, z2);
+        add_shifted(out, z0, 0);
+        add_shifted(out, z1, m);
+        add_shifted(out, z2, 2 * m);
+    }
+    trim_mag(out);
+    return out;
+}
+
+uint32_t divmod_small(const Limbs u, const uint32_t d, Mag& q) {
+    q.assign(u.size(), 0);
+    uint64_t rem = 0;
+    for (size_t i = u.size(); i-- > 0;) {
+        const auto cur = rem << 32 | u[i];
+        q[i] = static_cast<uint32_t>(cur / d);
+        rem = cur % d;
+    }
+    trim_mag(q);
+    return static_cast<uint32_t>(rem);
+}
+
+// Knuth 4.3.1 算法 D，v 至少两段
+void divmod_mag(const Limbs u, const Limbs v, Mag& q, Mag& r) {
+    const auto n = v.size(), m = u.size() - n;
+    const int s = std::countl_zero(v.back());
+    // 除数左移到最高位为 1，估商最多偏大 2
+    Mag vn(n), un(u.size() + 1);
+    for (size_t i = n; i-- > 0;)
+        vn[i] = static_cast<uint32_t>(static_cast<uint64_t>(v[i]) << s | (i ? static_cast<uint64_t>(v[i - 1]) >> (32 - s) : 0));
+    un[u.size()] = static_cast<uint32_t>(static_cast<uint64_t>(u.back()) >> (32 - s));
+    for (size_t i = u.size(); i-- > 0;)
+        un[i] = static_cast<uint32_t>(static_cast<uint64_t>(u[i]) << s | (i ? static_cast<uint64_t>(u[i - 1]) >> (32 - s) : 0));
+
+    constexpr uint64_t BASE = 1ULL << 32;
+    q.assign(m + 1, 0);
+    for (size_t j = m + 1; j-- > 0;) {
+        const auto num = static_cast<uint64_t>(un[j + n]) << 32 | un[j + n - 1];
+        auto qhat = num / vn[n - 1];
+        auto rhat = num % vn[n - 1];
+        while (qhat >= BASE || qhat * vn[n - 2] > (rhat << 32 | un[j + n - 2])) {
+            qhat--;
+            rhat += vn[n - 1];
+            if (rhat >= BASE) break;
+        }
+        int64_t k = 0, t;
+        for (size_t i = 0; i < n; i++) {
+            const auto p = qhat * vn[i];
+            t = static_cast<int64_t>(un[i + j]) - k - static_cast<int64_t>(p & 0xFFFFFFFF);
+            un[i + j] = static_cast<uint32_t>(t);
+            k = static_cast<int64_t>(p >> 32) - (t >> 32);
+        }
+        t = static_cast<int64_t>(un[j + n]) - k;
+        un[j + n] = static_cast<uint32_t>(t);
+        q[j] = static_cast<uint32_t>(qhat);
+        if (t < 0) {
+            // 估大了一，加回一个除数
+            q[j]--;
+            uint64_t carry = 0;
+            for (size_t i = 0; i < n; i++) {
+                carry += static_cast<uint64_t>(un[i + j]) + vn[i];
+                un[i + j] = static_cast<uint32_t>(carry);
+                carry >>= 32;
+            }
+            un[j + n] += static_cast<uint32_t>(carry);
+        }
+    }
+    trim_mag(q);
+    r.assign(n, 0);
+    for (size_t i = 0; i < n; i++)
+        r[i] = static_cast<uint32_t>((static_cast<uint64_t>(un[i + 1]) << 32 | un[i]) >> s);
+    trim_mag(r);
+}
+
+} // namespace
+
+BigInt::BigInt(const int64_t v): neg(v < 0) {
+    const auto u = neg ? 0 - static_cast<uint64_t>(v) : static_cast<uint64_t>(v);
+    mag = {static_cast<uint32_t>(u), static_cast<uint32_t>(u >> 32)};
+    trim();
+}
+
+void BigInt::trim() {
+    trim_mag(mag);
+    if (mag.empty()) neg = false;
+}
+
+bool BigInt::to_i64(int64_t& out) const {
+    if (mag.size() > 2) return false;
+    uint64_t u = 0;
+    for (size_t i = mag.size(); i-- > 0;) u = u << 32 | mag[i];
+    if (neg ? u > 1ULL << 63 : u > static_cast<uint64_t>(std::numeric_limits<int64_t>::max())) return false;
+    out = static_cast<int64_t>(neg ? 0 - u : u);
+    return true;
+}
+
+double BigInt::to_double() const {
+    double d = 0;
+    for (size_t i = mag.size(); i-- > 0;) d = d * 4294967296.0 + mag[i];
+    return neg ? -d : d;
+}
+
+std::string BigInt::to_string() const {
+    if (mag.empty()) return "0";
+    // 每次除以 10^9 取出九位十进制
+    std::vector<uint32_t> chunks;
+    Mag cur = mag, next;
+    while (!cur.empty()) {
+        chunks.push_back(divmod_small(cur, 1000000000, next));
+        cur.swap(next);
+    }
+    std::string s = neg ? "-" : "";
+    s += std::to_string(chunks.back());
+    for (size_t i = chunks.size() - 1; i-- > 0;) {
+        const auto part = std::to_string(chunks[i]);
+        s.append(9 - part.size(), '0');
+        s += part;
+    }
+    return s;
+}
+
+int BigInt::compare(const BigInt& o) const {
+    if (neg != o.neg) return neg ? -1 : 1;
+    const int c = compare_mag(mag, o.mag);
+    return neg ? -c : c;
+}
+
+BigInt operator+(const BigInt& a, const BigInt& b) {
+    BigInt r;
+    if (a.neg == b.neg) {
+        r.mag = add_mag(a.mag, b.mag);
+        r.neg = a.neg;
+    } else if (compare_mag(a.mag, b.mag) >= 0) {
+        r.mag = a.mag;
+        sub_mag(r.mag, b.mag);
+        r.neg = a.neg;
+    } else {
+        r.mag = b.mag;
+        sub_mag(r.mag, a.mag);
+        r.neg = b.neg;
+    }
+    r.trim();
+    return r;
+}
+
+BigInt operator-(const BigInt& a, const BigInt& b) {
+    BigInt nb = b;
+    if (!nb.is_zero()) nb.neg = !nb.neg;
+    return a + nb;
+}
+
+BigInt operator*(const BigInt& a, const BigInt& b) {
+    BigInt r;
+    r.mag = mul_mag(a.mag, b.mag);
+    r.neg = a.neg != b.neg;
+    r.trim();
+    return r;
+}
+
+void BigInt::divmod(const BigInt& a, const BigInt& b, BigInt* quot, BigInt* rem) {
+    BigInt q, r;
+    if (compare_mag(a.mag, b.mag) < 0) {
+        r.mag = a.mag;
+    } else if (b.mag.size() == 1) {
+        const auto small = divmod_small(a.mag, b.mag[0], q.mag);
+        if (small) r.mag = {small};
+    } else {
+        divmod_mag(a.mag, b.mag, q.mag, r.mag);
+    }
+    q.neg = a.neg != b.neg;
+    r.neg = a.neg;
+    q.trim();
+    r.trim();
+    if (quot) *quot = std::move(q);
+    if (rem) *rem = std::move(r);
+}
+
+size_t BigHeap::collect(std::vector<const BigInt*>& roots) {
+    std::ranges::sort(roots);
+    std::erase_if(objects, [&](const std::unique_ptr<BigInt>& p) {
+        return !std::ranges::binary_search(roots, static_cast<const BigInt*>(p.get()));
+    });
+    next_collect = std::max<size_t>(1024, objects.size() * 2);
+    return objects.size();
+}
+
+}
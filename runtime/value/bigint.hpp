@@ -0,0 +1,90 @@
+//
+// Arbitrary-precision integers for results that overflow int64
+//
+
+#pragma once
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "../../include/lmx_export.hpp"
+
+namespace lmx::runtime {
+
+// 有溢出检查的 64 位运算，返回 true 表示溢出（此时 *r 的值无意义）
+#if defined(__GNUC__) || defined(__clang__)
+inline bool add_overflow(const int64_t a, const int64_t b, int64_t* r) { return __builtin_add_overflow(a, b, r); }
+inline bool sub_overflow(const int64_t a, const int64_t b, int64_t* r) { return __builtin_sub_overflow(a, b, r); }
+inline bool mul_overflow(const int64_t a, const int64_t b, int64_t* r) { return __builtin_mul_overflow(a, b, r); }
+#else
+inline bool add_overflow(const int64_t a, const int64_t b, int64_t* r) {
+    *r = static_cast<int64_t>(static_cast<uint64_t>(a) + static_cast<uint64_t>(b));
+    return (a >= 0) == (b >= 0) && (*r >= 0) != (a >= 0);
+}
+inline bool sub_overflow(const int64_t a, const int64_t b, int64_t* r) {
+    *r = static_cast<int64_t>(static_cast<uint64_t>(a) - static_cast<uint64_t>(b));
+    return (a >= 0) != (b >= 0) && (*r >= 0) != (a >= 0);
+}
+inline bool mul_overflow(const int64_t a, const int64_t b, int64_t* r) {
+    *r = static_cast<int64_t>(static_cast<uint64_t>(a) * static_cast<uint64_t>(b));
+    if (a == 0 || b == 0) return false;
+    if ((a == -1 && b == std::numeric_limits<int64_t>::min()) || (b == -1 && a == std::numeric_limits<int64_t>::min()))
+        return true;
+    return *r / b != a;
+}
+#endif
+
+/*
+ * 符号加绝对值，绝对值按 32 位分段小端存放，最高段非零，0 没有分段。
+ * 乘法在两边都超过 KARATSUBA_LIMBS 段时用 Karatsuba，否则逐段相乘；除法是 Knuth 的 D 算法。
+ * 除法和取余与 int64 一致：商向零截断，余数与被除数同号。
+ */
+class LMVM_API BigInt {
+    std::vector<uint32_t> mag;
+    bool neg{false};
+
+    void trim();
+public:
+    static constexpr size_t KARATSUBA_LIMBS = 32;
+
+    BigInt() = default;
+    explicit BigInt(int64_t v);
+
+    [[nodiscard]] bool is_zero() const { return mag.empty(); }
+    [[nodiscard]] bool negative() const { return neg; }
+    // 能放进 int64 时写入 out 并返回 true
+    [[nodiscard]] bool to_i64(int64_t& out) const;
+    [[nodiscard]] double to_double() const;
+    [[nodiscard]] std::string to_string() const;
+    [[nodiscard]] int compare(const BigInt& o) const;
+
+    friend BigInt operator+(const BigInt& a, const BigInt& b);
+    friend BigInt operator-(const BigInt& a, const BigInt& b);
+    friend BigInt operator*(const BigInt& a, const BigInt& b);
+    // b 不能为 0
+    static void divmod(const BigInt& a, const BigInt& b, BigInt* quot, BigInt* rem);
+};
+
+/*
+ * VirtualCore 里的大整数都分配在这里，寄存器和帧里只存指针。
+ * 对象个数超过上次回收后存活数的两倍时，由 VM 带着根（打了大整数标记的寄存器和帧）调用 collect()。
+ */
+class LMVM_API BigHeap {
+    std::vector<std::unique_ptr<BigInt>> objects;
+    size_t next_collect{1024};
+public:
+    BigInt* make(BigInt&& v) {
+        objects.push_back(std::make_unique<BigInt>(std::move(v)));
+        return objects.back().get();
+    }
+    [[nodiscard]] bool should_collect() const { return objects.size() >= next_collect; }
+    // roots 可以重复、无序；回收后返回存活的对象数
+    size_t collect(std::vector<const BigInt*>& roots);
+    [[nodiscard]] size_t size() const { return objects.size(); }
+    void clear() { objects.clear(); }
+};
+
+}
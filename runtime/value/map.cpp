@@ -0,0 +1,92 @@
+#include "map.hpp"
+
+namespace lmx::runtime {
+
+namespace {
+
+// 负载上限 7/8
+size_t max_load(const size_t cap) { return cap - cap / 8; }
+
+}
+
+size_t IntMap::find_free(const uint64_t h) const {
+    const auto groups = cap / GROUP - 1;
+    auto g = first_group(h);
+    for (size_t step = 1;; step++) {
+        if (const auto bits = Group(ctrl.get() + g * GROUP).match_free()) return g * GROUP + std::countr_zero(bits);
+        g = (g + step) & groups;
+    }
+}
+
+void IntMap::rehash(const size_t new_cap) {
+    const auto old_ctrl = std::move(ctrl);
+    const auto old_slots = std::move(slots);
+    const auto old_cap = cap;
+    ctrl = std::make_unique_for_overwrite<int8_t[]>(new_cap);
+    std::memset(ctrl.get(), EMPTY, new_cap);
+    slots = std::make_unique_for_overwrite<Slot[]>(new_cap);
+    cap = new_cap;
+    growth_left = max_load(cap) - count;
+    // 新表里没有 DELETED，也不会有重复的键，直接放进探测序列上的第一个空槽
+    for (size_t i = 0; i < old_cap; i++) {
+        if (old_ctrl[i] < 0) continue;
+        const auto h = hash(old_slots[i].key);
+        const auto at = find_free(h);
+        ctrl[at] = h2(h);
+        slots[at] = old_slots[i];
+    }
+}
+
+size_t IntMap::prepare_insert(const uint64_t h) {
+    if (cap == 0) rehash(GROUP);
+    auto at = find_free(h);
+    if (growth_left == 0 && ctrl[at] == EMPTY) {
+        // 一半以上的余量被 DELETED 占着时原大小重建就够了
+        rehash(count < max_load(cap) / 2 ? cap : cap * 2);
+        at = find_free(h);
+    }
+    return at;
+}
+
+bool IntMap::set(const int64_t key, const int64_t value) {
+    if (const auto slot = find(key)) {
+        slot->value = value;
+        return false;
+    }
+    const auto h = hash(key);
+    const auto at = prepare_insert(h);
+    if (ctrl[at] == EMPTY) growth_left--;
+    ctrl[at] = h2(h);
+    slots[at] = {key, value};
+    count++;
+    return true;
+}
+
+bool IntMap::erase(const int64_t key) {
+    const auto slot = find(key);
+    if (!slot) return false;
+    const auto at = static_cast<size_t>(slot - slots.get());
+    // 组里本来就有 EMPTY 时探测不会越过这一组，置回 EMPTY 不会截断别的键的探测序列
+    if (Group(ctrl.get() + at / GROUP * GROUP).match_empty()) {
+        ctrl[at] = EMPTY;
+        growth_left++;
+    } else {
+        ctrl[at] = DELETED;
+    }
+    count--;
+    return true;
+}
+
+void IntMap::reserve(const size_t n) {
+    auto want = cap ? cap : GROUP;
+    while (max_load(want) < n) want *= 2;
+    if (want != cap) rehash(want);
+}
+
+void IntMap::clear() {
+    if (cap) std::memset(ctrl.get(), EMPTY, cap);
+    count = 0;
+    growth_left = max_load(cap);
+}
+
+}
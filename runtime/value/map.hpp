@@ -0,0 +1,153 @@
+//
+// Open-addressing hash map from int64 to int64, probed a control-byte group at a time
+//
+
+#pragma once
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LMX_MAP_SSE2 1
+#else
+#define LMX_MAP_SSE2 0
+#endif
+
+#include "../../include/lmx_export.hpp"
+
+namespace lmx::runtime {
+
+/*
+ * SwissTable 式的开放寻址表：每个槽位对应一个控制字节，空槽为 EMPTY、删除后为 DELETED，
+ * 占用时存键哈希的低 7 位（h2）。控制字节按 GROUP 个一组对齐存放，查找时用一条 SIMD 比较
+ * 同时筛出一组里 h2 相同的槽位，再逐个比较键；哪一组里还有 EMPTY 就说明键不在表里。
+ * 高位哈希（h1）选起始组，组间按三角数步长探测，组数是 2 的幂时能走遍所有组。
+ *
+ * 键和值都直接存在槽位里，整数键的哈希每次现算（一次乘法），不需要缓存。
+ * 负载超过 7/8 时扩容；删除时所在组还有 EMPTY 就直接置回 EMPTY，否则留下 DELETED，
+ * DELETED 占满可用空间时按原大小重建。
+ */
+class LMVM_API IntMap {
+public:
+    static constexpr size_t GROUP = 16;
+
+    struct Slot {
+        int64_t key;
+        int64_t value;
+    };
+
+private:
+    static constexpr int8_t EMPTY = -128;
+    static constexpr int8_t DELETED = -2;
+
+    std::unique_ptr<int8_t[]> ctrl;
+    std::unique_ptr<Slot[]> slots;
+    size_t cap{0};          // 槽位数，0 或 GROUP 的 2 的幂倍
+    size_t count{0};
+    size_t growth_left{0};  // 还能填进多少个 EMPTY 槽位而不超过负载上限
+
+    // 一组控制字节，match 系列返回第 i 位对应组内第 i 个槽位的掩码
+    struct Group {
+#if LMX_MAP_SSE2
+        __m128i ctrl;
+        explicit Group(const int8_t* p): ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))) {}
+        [[nodiscard]] uint32_t match(const int8_t h2) const {
+            return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(h2))));
+        }
+        [[nodiscard]] uint32_t match_empty() const {
+            return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(EMPTY))));
+        }
+        // EMPTY 和 DELETED 的最高位为 1，占用的槽位最高位为 0
+        [[nodiscard]] uint32_t match_free() const { return static_cast<uint32_t>(_mm_movemask_epi8(ctrl)); }
+#else
+        // 没有 SSE2 时按两个 64 位字做 SWAR，结果与 SIMD 版逐位相同（按小端字节序）
+        uint64_t lo, hi;
+        static constexpr uint64_t LSB = 0x0101010101010101ULL;
+        static constexpr uint64_t MSB = 0x8080808080808080ULL;
+        explicit Group(const int8_t* p) {
+            std::memcpy(&lo, p, 8);
+            std::memcpy(&hi, p + 8, 8);
+        }
+        // 每个字节的最高位收拢成 8 位掩码
+        static uint32_t gather(const uint64_t msb) { return static_cast<uint32_t>(((msb >> 7) * 0x0102040810204080ULL) >> 56); }
+        // 值为 0 的字节置 0x80，没有误报
+        static uint64_t zero_bytes(const uint64_t x) { return ~(((x & ~MSB) + ~MSB) | x | ~MSB); }
+        [[nodiscard]] uint32_t match(const int8_t h2) const {
+            const auto pattern = LSB * static_cast<uint8_t>(h2);
+            return gather(zero_bytes(lo ^ pattern)) | gather(zero_bytes(hi ^ pattern)) << 8;
+        }
+        // 最高位为 1 且次低位为 0 的只有 EMPTY
+        [[nodiscard]] uint32_t match_empty() const {
+            return gather(lo & ~(lo << 6) & MSB) | gather(hi & ~(hi << 6) & MSB) << 8;
+        }
+        [[nodiscard]] uint32_t match_free() const { return gather(lo & MSB) | gather(hi & MSB) << 8; }
+#endif
+    };
+
+    static uint64_t hash(const int64_t key) {
+        // 乘以黄金比例常数后高低位折叠，相邻整数也能散开到不同的组和 h2
+        const auto h = static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ULL;
+        return h ^ h >> 32;
+    }
+    static int8_t h2(const uint64_t h) { return static_cast<int8_t>(h & 0x7F); }
+    [[nodiscard]] size_t first_group(const uint64_t h) const { return (h >> 7) & (cap / GROUP - 1); }
+
+    void rehash(size_t new_cap);
+    // 哈希为 h 的键的探测序列上第一个 EMPTY 或 DELETED 槽位，表不能为空
+    [[nodiscard]] size_t find_free(uint64_t h) const;
+    // 同上，没有余量时先扩容或重建
+    size_t prepare_insert(uint64_t h);
+
+public:
+    IntMap() = default;
+    IntMap(const IntMap&) = delete;
+    IntMap& operator=(const IntMap&) = delete;
+
+    [[nodiscard]] const Slot* find(const int64_t key) const {
+        if (cap == 0) return nullptr;
+        const auto h = hash(key);
+        const auto groups = cap / GROUP - 1;
+        auto g = first_group(h);
+        for (size_t step = 1;; step++) {
+            const Group group(ctrl.get() + g * GROUP);
+            for (auto bits = group.match(h2(h)); bits; bits &= bits - 1) {
+                const auto& slot = slots[g * GROUP + std::countr_zero(bits)];
+                if (slot.key == key) [[likely]] return &slot;
+            }
+            if (group.match_empty()) return nullptr;
+            g = (g + step) & groups;
+        }
+    }
+    [[nodiscard]] Slot* find(const int64_t key) {
+        return const_cast<Slot*>(std::as_const(*this).find(key));
+    }
+    [[nodiscard]] bool contains(const int64_t key) const { return find(key) != nullptr; }
+    // 键不存在时返回 missing
+    [[nodiscard]] int64_t get(const int64_t key, const int64_t missing = 0) const {
+        const auto slot = find(key);
+        return slot ? slot->value : missing;
+    }
+    // 插入或覆盖，返回 true 表示新插入
+    bool set(int64_t key, int64_t value);
+    // 返回 true 表示键存在并已删除
+    bool erase(int64_t key);
+    // 预留至少能放下 n 个键而不扩容的空间
+    void reserve(size_t n);
+    void clear();
+
+    [[nodiscard]] size_t size() const { return count; }
+    [[nodiscard]] bool empty() const { return count == 0; }
+    [[nodiscard]] size_t capacity() const { return cap; }
+
+    // 按槽位顺序遍历所有键值对，顺序与插入顺序无关
+    template <class F>
+    void for_each(F&& f) const {
+        for (size_t i = 0; i < cap; i++)
+            if (ctrl[i] >= 0) f(slots[i].key, slots[i].value);
+    }
+};
+
+}
@@ -4,6 +4,8 @@
 
 #include "value.hpp"
 
+#include <charconv>
+
 namespace lmx::runtime {
 
 Value::Value() : null(nullptr) {
@@ -22,4 +24,13 @@ T &Value::get() {
     return *reinterpret_cast<T*>(this);
 }
 
+std::string float_string(const double v) {
+    char buf[32];
+    const auto end = std::to_chars(buf, buf + sizeof(buf), v).ptr;
+    std::string out(buf, end);
+    // inf 和 nan 原样输出
+    if (out.find_first_of(".eni") == std::string::npos) out += ".0";
+    return out;
+}
+
 } // namespace lmx::runtime
\ No newline at end of file
@@ -33,4 +33,7 @@ union LMVM_API Value {
     Value &operator=(void* new_ptr);
 };
 
+// 浮点的最短往返十进制形式，整数值补上 .0，与整数区分开
+LMVM_API std::string float_string(double v);
+
 }
@@ -0,0 +1,161 @@
+#include "verifier.hpp"
+#include "vm.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace lmx::runtime {
+
+namespace {
+
+constexpr size_t REG_COUNT = std::tuple_size_v<decltype(LMXState::regs)>;
+
+uint64_t read_u64(const uint8_t* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint16_t read_u16(const uint8_t* p) {
+    uint16_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+class Verifier {
+    std::span<const Op> program;
+    std::span<const std::byte> pool;
+    std::string& error;
+
+    bool fail(const size_t pc, const std::string& msg) {
+        error = "at " + std::to_string(pc) + ": " + msg;
+        return false;
+    }
+    bool reg(const size_t pc, const uint8_t r) {
+        return r < REG_COUNT || fail(pc, "register r" + std::to_string(r) + " out of range");
+    }
+    bool mem(const size_t pc, const uint8_t base) {
+        return base == FRAME_BASE || fail(pc, "memory operand must be frame-relative");
+    }
+    bool target(const size_t pc, const uint8_t* p) {
+        const auto t = read_u64(p);
+        return t < program.size() || fail(pc, "jump target " + std::to_string(t) + " out of range");
+    }
+    bool constant(const size_t pc, const uint8_t* p) {
+        const auto index = read_u64(p);
+        return index < pool.size() / sizeof(Value) || fail(pc, "constant " + std::to_string(index) + " out of range");
+    }
+    bool string(const size_t pc, const uint8_t* p) {
+        const auto offset = read_u64(p);
+        if (offset >= pool.size()) return fail(pc, "string offset " + std::to_string(offset) + " out of range");
+        const auto rest = pool.subspan(offset);
+        if (std::memchr(rest.data(), 0, rest.size()) == nullptr) return fail(pc, "unterminated string constant");
+        return true;
+    }
+
+    bool operands(const size_t pc) {
+        const auto& [op, o] = program[pc];
+        switch (op) {
+            using enum Opcode;
+        case MOV_RI: return reg(pc, o[0]);
+        case MOV_RM: return reg(pc, o[0]) && mem(pc, o[1]);
+        case MOV_RR: return reg(pc, o[0]) && reg(pc, o[1]);
+        case MOV_RC: return reg(pc, o[0]) && constant(pc, o + 1);
+        case MOV_MI: return mem(pc, o[0]);
+        case MOV_MM: return mem(pc, o[0]) && mem(pc, o[4]);
+        case MOV_MR: return mem(pc, o[0]) && reg(pc, o[4]);
+        case MOV_MC: return mem(pc, o[0]) && constant(pc, o + 4);
+        case ADD: case SUB: case MUL: case DIV: case MOD: case POW:
+        case CMP_GE: case CMP_LT: case CMP_LE: case CMP_GT: case CMP_EQ: case CMP_NE:
+        case FADD: case FSUB: case FMUL: case FDIV: case FMOD:
+        case FCMP_GE: case FCMP_LT: case FCMP_LE: case FCMP_GT: case FCMP_EQ: case FCMP_NE:
+        case DADD: case DSUB: case DMUL: case DDIV: case DMOD:
+            return reg(pc, o[0]) && reg(pc, o[1]) && reg(pc, o[2]);
+        case TO_FLOAT: return reg(pc, o[0]) && reg(pc, o[1]);
+        case BOX_FLOAT: return reg(pc, o[0]);
+        case HALT: case FRET: return true;
+        case FCALL: case JMP: return target(pc, o);
+        case DEBUG_LOG: return string(pc, o) && (o[8] == LOG_NO_PAYLOAD || reg(pc, o[8]));
+        case IF_TRUE: case IF_FALSE: return reg(pc, o[0]) && target(pc, o + 1);
+        case BLT: case BLE: case BGT: case BGE: case BEQ: case BNE: case LOOP_LT:
+            return reg(pc, o[0]) && reg(pc, o[1]) && target(pc, o + 2);
+        case MAP_NEW: return reg(pc, o[0]);
+        case MAP_LEN: return reg(pc, o[0]) && reg(pc, o[1]);
+        case MAP_GET: case MAP_SET: case MAP_DEL: return reg(pc, o[0]) && reg(pc, o[1]) && reg(pc, o[2]);
+        case DADD_F: case DSUB_F: case DMUL_F: case DDIV_F: case DMOD_F:
+            return fail(pc, "quickened opcode " + std::to_string(static_cast<int>(op)) + " in a program");
+        }
+        return fail(pc, "invalid opcode " + std::to_string(static_cast<int>(op)));
+    }
+
+    // 从 entries 出发遍历调用栈为空时能执行到的代码，FCALL 视为返回到下一条
+    bool top_level(std::span<const size_t> entries) {
+        std::vector<bool> seen(program.size());
+        std::vector<size_t> work(entries.begin(), entries.end());
+        while (!work.empty()) {
+            const auto pc = work.back();
+            work.pop_back();
+            if (seen[pc]) continue;
+            seen[pc] = true;
+            const auto& [op, o] = program[pc];
+            switch (op) {
+                using enum Opcode;
+            case HALT: break;
+            case FRET: return fail(pc, "FRET reachable with an empty call stack");
+            case JMP: work.push_back(read_u64(o)); break;
+            case IF_TRUE: case IF_FALSE:
+                work.push_back(read_u64(o + 1));
+                work.push_back(pc + 1);
+                break;
+            case BLT: case BLE: case BGT: case BGE: case BEQ: case BNE: case LOOP_LT:
+                work.push_back(read_u64(o + 2));
+                work.push_back(pc + 1);
+                break;
+            default: work.push_back(pc + 1); break;
+            }
+        }
+        return true;
+    }
+
+public:
+    Verifier(const std::span<const Op> program, const std::span<const std::byte> pool, std::string& error):
+        program(program), pool(pool), error(error) {}
+
+    bool run(const std::span<const size_t> entries) {
+        if (program.empty()) return fail(0, "empty program");
+        for (size_t pc = 0; pc < program.size(); pc++) {
+            if (!operands(pc)) return false;
+            const auto op = program[pc].op;
+            const bool ends = op == Opcode::HALT || op == Opcode::FRET || op == Opcode::JMP;
+            if (!ends && pc + 1 == program.size()) return fail(pc, "execution can run past the end of the program");
+        }
+        for (const auto entry : entries) {
+            if (entry >= program.size()) return fail(entry, "entry point out of range");
+        }
+        return top_level(entries);
+    }
+};
+
+} // namespace
+
+size_t frame_slots(const std::span<const Op> program) {
+    size_t slots = FRAME_SLOTS;
+    for (const auto& [op, o] : program) {
+        switch (op) {
+            using enum Opcode;
+        case MOV_RM: slots = std::max<size_t>(slots, read_u16(o + 2) + 1); break;
+        case MOV_MM: slots = std::max<size_t>(slots, std::max(read_u16(o + 2), read_u16(o + 6)) + 1); break;
+        case MOV_MI: case MOV_MR: case MOV_MC: slots = std::max<size_t>(slots, read_u16(o + 2) + 1); break;
+        default: break;
+        }
+    }
+    return slots;
+}
+
+bool verify(const std::span<const Op> program, const std::span<const std::byte> const_pool,
+            const std::span<const size_t> entries, std::string& error) {
+    return Verifier(program, const_pool, error).run(entries);
+}
+
+}
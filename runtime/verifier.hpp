@@ -0,0 +1,31 @@
+//
+// Load-time bytecode verification
+//
+
+#pragma once
+#include <cstddef>
+#include <span>
+#include <string>
+
+#include "../include/lmx_export.hpp"
+#include "../include/opcode.hpp"
+
+namespace lmx::runtime {
+
+/*
+ * 执行前对整段程序检查一遍，通过后 VirtualCore 的分派循环不再做任何检查：
+ *   - 操作码合法，寄存器下标小于寄存器数
+ *   - 内存操作数只能以 FRAME_BASE 为基址（寄存器基址是裸指针，无法静态检查）
+ *   - JMP、IF_TRUE/IF_FALSE、B 系列、LOOP_LT 和 FCALL 的目标在程序范围内
+ *   - MOV_*C 的常量下标、DEBUG_LOG 的字符串都落在常量池里，DEBUG_LOG 的负载寄存器合法
+ *   - 没有指令会顺序执行出程序末尾，即每条路径都以 HALT、FRET 或跳转结束
+ *   - 从 entries 出发、不经过 FCALL 能到达的代码里没有 FRET（调用栈为空时返回）
+ * 失败时返回 false，error 为带指令下标的说明。
+ */
+LMVM_API bool verify(std::span<const Op> program, std::span<const std::byte> const_pool,
+                     std::span<const size_t> entries, std::string& error);
+
+// 一帧要留出的槽位数：程序里 FRAME_BASE 寻址用到的最大偏移加一，至少 FRAME_SLOTS
+LMVM_API size_t frame_slots(std::span<const Op> program);
+
+}
@@ -3,9 +3,141 @@
 //
 
 #include "vm.hpp"
+#include "verifier.hpp"
+#include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <iostream>
+#include <limits>
 #include <ostream>
+#include <string>
+
+#ifndef LMX_VM_STATS
+#define LMX_VM_STATS 1
+#endif
+
+// 计数先记在局部变量里，离开 run() 时才写回 counters
+#if LMX_VM_STATS
+#define VM_STAT(stmt) stmt
+#else
+#define VM_STAT(stmt)
+#endif
+
+// 程序都经过校验，分派时不会遇到非法操作码，告诉编译器省掉 switch 的范围检查
+#if defined(__GNUC__) || defined(__clang__)
+#define VM_UNREACHABLE() __builtin_unreachable()
+#elif defined(_MSC_VER)
+#define VM_UNREACHABLE() __assume(0)
+#else
+#define VM_UNREACHABLE() return -1
+#endif
+
+// 条件跳转：满足条件跳到 target，否则执行下一条
+#define VM_BRANCH(cond, target)                                 \
+    if (cond) {                                                 \
+        VM_STAT(run_stats.branches_taken++);                    \
+        ste.pc = (target);                                      \
+    } else {                                                    \
+        VM_STAT(run_stats.branches_not_taken++);                \
+        ste.pc++;                                               \
+    }
+
+// 大整数模式下维护寄存器和帧槽位的标记，普通模式下不生成任何代码
+#define VM_TAG(stmt) if constexpr (Big) { stmt; }
+
+// 两个寄存器按整数比较；大整数模式下任一边是浮点时按双精度比较，是大整数时按 BigInt 比较
+#define VM_CMP(a, b, rel)                                                                       \
+    (Big && (reg_big[a] | reg_big[b])                                                           \
+         ? ((reg_big[a] | reg_big[b]) & TAG_FLOAT ? float_operand(a) rel float_operand(b)       \
+                                                  : big_compare(a, b) rel 0)                    \
+         : ste.regs[a].i64 rel ste.regs[b].i64)
+
+// 条件为真：普通模式只看最低字节；大整数总是非零，浮点按值判断
+#define VM_TRUTHY(r) \
+    (Big && reg_big[r] ? reg_big[r] == TAG_BIG || ste.regs[r].f64 != 0 : ste.regs[r].b)
+
+// 算术指令：大整数模式下有大整数操作数时整条交给 big_arith()
+#define VM_BIG_OPERANDS(a, b)                                   \
+    if constexpr (Big) {                                        \
+        if (reg_big[a] | reg_big[b]) {                          \
+            if (!big_arith(op, operands)) {                     \
+                VM_STAT(finish());                              \
+                return -1;                                      \
+            }                                                   \
+            ste.pc++;                                           \
+            goto RUN_CONTINUE;                                  \
+        }                                                       \
+    }
+
+// 通用算术指令：大整数模式下有浮点标记的操作数时按双精度计算，否则与对应的整数指令相同；
+// 两边都是浮点时顺便改写成快速化指令 quick
+#define VM_FLOAT_OPERANDS(a, b, quick)                          \
+    if constexpr (Big) {                                        \
+        if ((reg_big[a] | reg_big[b]) & TAG_FLOAT) {            \
+            if ((reg_big[a] & reg_big[b]) == TAG_FLOAT) VM_QUICKEN(quick); \
+            float_arith(op, operands);                          \
+            ste.pc++;                                           \
+            goto RUN_CONTINUE;                                  \
+        }                                                       \
+    }
+
+// 把当前指令改写成快速化指令，这个位置去优化过太多次时不改
+#define VM_QUICKEN(quick)                                       \
+    if (deopt_count[ste.pc] < DEOPT_LIMIT) {                    \
+        code[ste.pc].op = (quick);                              \
+        VM_STAT(run_stats.quickened++);                         \
+    }
+
+// 快速化的浮点指令：两个操作数不再都带浮点标记（包括已经回到普通模式）时改回通用指令 generic 重新执行
+#define VM_FLOAT_GUARD(a, b, generic)                           \
+    if (!Big || (reg_big[a] & reg_big[b]) != TAG_FLOAT) [[unlikely]] { \
+        code[ste.pc].op = (generic);                            \
+        deopt_count[ste.pc]++;                                  \
+        VM_STAT(run_stats.deopts++);                            \
+        goto RUN_CONTINUE;                                      \
+    }
+
+// 整数除数为零：与 big_arith 报同样的错并结束执行
+#define VM_ZERO_DIVISOR(r)                                      \
+    if (ste.regs[r].i64 == 0) [[unlikely]] {                    \
+        fprintf(stderr, "[RuntimeError]: integer division by zero\n"); \
+        VM_STAT(finish());                                      \
+        return -1;                                              \
+    }
+
+// 64 位结果溢出：普通模式切到大整数模式重新执行这一条，大整数模式直接按 BigInt 计算
+#define VM_OVERFLOW()                                           \
+    if constexpr (!Big) {                                       \
+        VM_STAT(finish());                                      \
+        enter_big_mode();                                       \
+        return execute<true>();                                 \
+    } else {                                                    \
+        if (!big_arith(op, operands)) {                         \
+            VM_STAT(finish());                                  \
+            return -1;                                          \
+        }                                                       \
+        ste.pc++;                                               \
+        goto RUN_CONTINUE;                                      \
+    }
+
+// map 指令的句柄操作数，无效时结束执行
+#define VM_MAP_OPERAND(var, r)                                  \
+    IntMap* const var = map_operand<Big>(r);                    \
+    if (!var) [[unlikely]] {                                    \
+        VM_STAT(finish());                                      \
+        return -1;                                              \
+    }
+
+// map 只存 64 位整数，键或值是大整数或浮点时报错
+#define VM_MAP_SCALAR(r, what)                                  \
+    if constexpr (Big) {                                        \
+        if (reg_big[r]) {                                       \
+            fprintf(stderr, "[RuntimeError]: map " what " %s %s\n", register_string(r).c_str(), \
+                    reg_big[r] == TAG_BIG ? "does not fit in 64 bits" : "is not an integer"); \
+            VM_STAT(finish());                                  \
+            return -1;                                          \
+        }                                                       \
+    }
 
 namespace lmx::runtime {
 
@@ -17,107 +149,406 @@ VirtualCore::VirtualCore() : const_pool_top(nullptr), ste() {
 
 VirtualCore::VirtualCore(LMXState ste) : const_pool_top(nullptr), ste(std::move(ste)) {}
 
-VirtualCore::VirtualCore(LMXState ste, void* const_pool_top) : 
+VirtualCore::VirtualCore(LMXState ste, void* const_pool_top, const size_t const_pool_bytes) : 
     const_pool_top(const_pool_top), 
-    ste(std::move(ste)) {
+    ste(std::move(ste)),
+    const_pool_bytes(const_pool_bytes) {
 }
 
 Value *VirtualCore::get_value_from_pool(const size_t offest) const {
     return static_cast<Value*>(const_pool_top) + offest;
 }
 
+Value *VirtualCore::get_value_from_mem(const uint8_t base, const uint16_t offest) {
+    if (base == FRAME_BASE) return &ste.frames[ste.fp + offest];
+    return static_cast<Value*>(ste.regs[base].ptr) + static_cast<int16_t>(offest);
+}
+
+bool VirtualCore::stats_enabled() {
+    return LMX_VM_STATS;
+}
+
+bool VirtualCore::check_program(const std::span<const size_t> entries) {
+    if (verified) return true;
+    std::string error;
+    const std::span pool(static_cast<const std::byte*>(const_pool_top), const_pool_top ? const_pool_bytes : 0);
+    if (!verify(*ste.program, pool, entries, error)) {
+        fprintf(stderr, "[VerifyError]: %s\n", error.c_str());
+        return false;
+    }
+    verified = true;
+    // 顶层代码的帧从 0 开始，这里先留够；调用时 FCALL 再按 frame_window 扩容
+    frame_window = frame_slots(*ste.program);
+    if (ste.frames.size() < frame_window) ste.frames.resize(frame_window);
+    if (big_mode && frame_big.size() < ste.frames.size()) frame_big.resize(ste.frames.size());
+    code = *ste.program;
+    deopt_count.assign(code.size(), 0);
+    return true;
+}
+
 int VirtualCore::run() {
+    const size_t entries[] = {0, ste.pc};
+    if (!check_program(entries)) return -1;
+    const int rc = dispatch();
+    flush_log();
+    return rc;
+}
+
+int VirtualCore::call(const size_t entry, const std::span<const int64_t> args, const size_t return_pc) {
+    return call(entry, args, {}, return_pc);
+}
+
+int VirtualCore::call(const size_t entry, const std::span<const int64_t> args, const std::span<const uint8_t> is_float,
+                      const size_t return_pc) {
+    const size_t entries[] = {0};
+    if (!check_program(entries)) return -1;
+    const auto& program = *ste.program;
+    if (entry >= program.size() || return_pc >= program.size() || program[return_pc].op != Opcode::HALT ||
+        args.size() > ste.regs.size()) return -1;
+
+    ste.call_stack.clear();
+    ste.call_stack.push_back({return_pc, 0});
+    ste.fp = 0;
+    // 带标记的浮点参数只能在大整数模式下传
+    if (!big_mode && std::ranges::any_of(is_float, [](const uint8_t f) { return f != 0; })) enter_big_mode();
+    for (size_t i = 0; i < args.size(); i++) {
+        ste.regs[ste.regs.size() - 1 - i].i64 = args[i];
+        reg_big[ste.regs.size() - 1 - i] = i < is_float.size() && is_float[i] ? TAG_FLOAT : 0;
+    }
+    ste.pc = entry;
+    const auto map_mark = maps.size();
+    const int rc = dispatch();
+    maps.erase(maps.begin() + static_cast<ptrdiff_t>(map_mark), maps.end());
+    flush_log();
+    return rc;
+}
+
+void VirtualCore::reset_state() {
+    ste.pc = 0;
+    for (auto& r : ste.regs) r.i64 = 0;
+    ste.call_stack.clear();
+    ste.fp = 0;
+    leave_big_mode();
+    maps.clear();
+}
+
+std::string VirtualCore::register_string(const size_t r, const bool as_float) const {
+    if (register_is_big(r)) return static_cast<const BigInt*>(ste.regs[r].ptr)->to_string();
+    if (as_float || register_is_float(r)) return float_string(ste.regs[r].f64);
+    return std::to_string(ste.regs[r].i64);
+}
+
+std::string VirtualCore::frame_string(const size_t slot, const bool as_float) const {
+    const auto i = ste.fp + slot;
+    const auto tag = big_mode && i < frame_big.size() ? frame_big[i] : 0;
+    if (tag == TAG_BIG) return static_cast<const BigInt*>(ste.frames[i].ptr)->to_string();
+    if (as_float || tag == TAG_FLOAT) return float_string(ste.frames[i].f64);
+    return std::to_string(ste.frames[i].i64);
+}
+
+void VirtualCore::enter_big_mode() {
+    big_mode = true;
+    reg_big.fill(0);
+    frame_big.assign(ste.frames.size(), 0);
+}
+
+void VirtualCore::leave_big_mode() {
+    big_mode = false;
+    reg_big.fill(0);
+    frame_big.clear();
+    bigs.clear();
+}
+
+// 根是所有打了大整数标记的寄存器和帧槽位，已经返回的帧里残留的标记也算，宁可多留
+size_t VirtualCore::collect_bigs() {
+    std::vector<const BigInt*> roots;
+    for (size_t i = 0; i < reg_big.size(); i++)
+        if (reg_big[i] == TAG_BIG) roots.push_back(static_cast<const BigInt*>(ste.regs[i].ptr));
+    for (size_t i = 0; i < frame_big.size(); i++)
+        if (frame_big[i] == TAG_BIG) roots.push_back(static_cast<const BigInt*>(ste.frames[i].ptr));
+    return bigs.collect(roots);
+}
+
+BigInt VirtualCore::big_operand(const uint8_t r) const {
+    return reg_big[r] == TAG_BIG ? *static_cast<const BigInt*>(ste.regs[r].ptr) : BigInt(ste.regs[r].i64);
+}
+
+double VirtualCore::float_operand(const uint8_t r) const {
+    switch (reg_big[r]) {
+    case TAG_FLOAT: return ste.regs[r].f64;
+    case TAG_BIG: return static_cast<const BigInt*>(ste.regs[r].ptr)->to_double();
+    default: return static_cast<double>(ste.regs[r].i64);
+    }
+}
+
+int VirtualCore::big_compare(const uint8_t a, const uint8_t b) const {
+    return big_operand(a).compare(big_operand(b));
+}
+
+// 能放回 int64 的结果不留在堆上
+void VirtualCore::set_big_result(const uint8_t r, BigInt&& v) {
+    if (int64_t small; v.to_i64(small)) {
+        ste.regs[r].i64 = small;
+        reg_big[r] = 0;
+        return;
+    }
+    if (bigs.should_collect()) collect_bigs();
+    ste.regs[r].ptr = bigs.make(std::move(v));
+    reg_big[r] = 1;
+}
+
+bool VirtualCore::big_arith(const Opcode op, const uint8_t* operands) {
+    // 整数指令的操作数由类型推导保证是整数，动态类型的浮点误入时报错而不是把它当指针读
+    for (const auto r : {operands[1], operands[2]}) {
+        if (reg_big[r] == TAG_FLOAT) {
+            fprintf(stderr, "[RuntimeError]: %s is not an integer\n", register_string(r).c_str());
+            return false;
+        }
+    }
+    const auto a = big_operand(operands[1]);
+    const auto b = big_operand(operands[2]);
+    BigInt r;
+    switch (op) {
+    case Opcode::ADD: case Opcode::DADD: r = a + b; break;
+    case Opcode::SUB: case Opcode::DSUB: r = a - b; break;
+    case Opcode::MUL: case Opcode::DMUL: r = a * b; break;
+    case Opcode::DIV: case Opcode::DDIV:
+    case Opcode::MOD: case Opcode::DMOD:
+        if (b.is_zero()) {
+            fprintf(stderr, "[RuntimeError]: integer division by zero\n");
+            return false;
+        }
+        BigInt::divmod(a, b, op == Opcode::DIV || op == Opcode::DDIV ? &r : nullptr,
+                       op == Opcode::MOD || op == Opcode::DMOD ? &r : nullptr);
+        break;
+    default: VM_UNREACHABLE();
+    }
+    set_big_result(operands[0], std::move(r));
+    return true;
+}
+
+// 有一边是浮点：另一边的整数或大整数先转成双精度，结果带浮点标记
+void VirtualCore::float_arith(const Opcode op, const uint8_t* operands) {
+    const auto a = float_operand(operands[1]);
+    const auto b = float_operand(operands[2]);
+    double r;
+    switch (op) {
+    case Opcode::DADD: r = a + b; break;
+    case Opcode::DSUB: r = a - b; break;
+    case Opcode::DMUL: r = a * b; break;
+    case Opcode::DDIV: r = a / b; break;
+    case Opcode::DMOD: r = std::fmod(a, b); break;
+    default: VM_UNREACHABLE();
+    }
+    ste.regs[operands[0]].f64 = r;
+    reg_big[operands[0]] = TAG_FLOAT;
+}
+
+template <bool Big>
+IntMap* VirtualCore::map_operand(const uint8_t r) {
+    const auto handle = ste.regs[r].u64;
+    if ((Big && reg_big[r]) || handle == 0 || handle > maps.size()) [[unlikely]] {
+        fprintf(stderr, "[RuntimeError]: %s is not a map\n", register_string(r).c_str());
+        return nullptr;
+    }
+    return maps[handle - 1].get();
+}
+
+LogRing& VirtualCore::start_log() {
+    log = std::make_unique<LogRing>(static_cast<const char*>(const_pool_top), log_options);
+    return *log;
+}
+
+void VirtualCore::set_log_options(const LogOptions& options) {
+    log_options = options;
+    log.reset();
+}
+
+int VirtualCore::dispatch() {
+    return big_mode ? execute<true>() : execute<false>();
+}
+
+template <bool Big>
+int VirtualCore::execute() {
+    // 执行的是私有副本，只有快速化会原地改写其中的指令，数组本身执行期间不会变
+    Op* const code = this->code.data();
+    VM_STAT(VMStats run_stats);
+    VM_STAT(const auto start = std::chrono::steady_clock::now());
+    VM_STAT(const auto finish = [&] {
+        run_stats.elapsed_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count());
+        counters.add(run_stats);
+    });
     RUN_CONTINUE:
-    const Opcode& op = ste.program->operator[](ste.pc).op;
-    const auto& operands = ste.program->operator[](ste.pc).operands;
+    VM_STAT(run_stats.instructions++);
+    const Opcode op = code[ste.pc].op;
+    const auto& operands = code[ste.pc].operands;
     switch (op) {
         using enum Opcode;
     case MOV_RI: {
         ste.regs[operands[0]].i64 = *reinterpret_cast<const int64_t*>(operands + 1);
+        VM_TAG(reg_big[operands[0]] = 0);
         ste.pc++;
         goto RUN_CONTINUE;
     }
     case MOV_RM: {
-        // todo!
+        const auto offset = *reinterpret_cast<const uint16_t*>(operands + 2);
+        ste.regs[operands[0]] = *get_value_from_mem(operands[1], offset);
+        VM_TAG(reg_big[operands[0]] = frame_big[ste.fp + offset]);
         ste.pc++;
         goto RUN_CONTINUE;
     }
     case MOV_RR: {
         ste.regs[operands[0]].i64 = ste.regs[operands[1]].i64;
+        VM_TAG(reg_big[operands[0]] = reg_big[operands[1]]);
         ste.pc++;
         goto RUN_CONTINUE;
     }
     case MOV_RC: {
         ste.regs[operands[0]] = get_value_from_pool(*reinterpret_cast<const uint64_t*>(operands + 1));
+        VM_TAG(reg_big[operands[0]] = 0);
         ste.pc++;
         goto RUN_CONTINUE;
     }
     case MOV_MI: {
-
-        // todo!
+        const auto offset = *reinterpret_cast<const uint16_t*>(operands + 2);
+        get_value_from_mem(operands[0], offset)->i64 = *reinterpret_cast<const int64_t*>(operands + 4);
+        VM_TAG(frame_big[ste.fp + offset] = 0);
         ste.pc++;
         goto RUN_CONTINUE;
     }
     case MOV_MM: {
-        // todo!
+        const auto dst = *reinterpret_cast<const uint16_t*>(operands + 2);
+        const auto src = *reinterpret_cast<const uint16_t*>(operands + 6);
+        *get_value_from_mem(operands[0], dst) = *get_value_from_mem(operands[4], src);
+        VM_TAG(frame_big[ste.fp + dst] = frame_big[ste.fp + src]);
         ste.pc++;
         goto RUN_CONTINUE;
     }
     case MOV_MR: {
-        // todo!
+        const auto offset = *reinterpret_cast<const uint16_t*>(operands + 2);
+        *get_value_from_mem(operands[0], offset) = ste.regs[operands[4]];
+        VM_TAG(frame_big[ste.fp + offset] = reg_big[operands[4]]);
         ste.pc++;
         goto RUN_CONTINUE;
     }
     case MOV_MC: {
-        // todo!
+        const auto offset = *reinterpret_cast<const uint16_t*>(operands + 2);
+        *get_value_from_mem(operands[0], offset) = get_value_from_pool(*reinterpret_cast<const uint64_t*>(operands + 4));
+        VM_TAG(frame_big[ste.fp + offset] = 0);
         ste.pc++;
         goto RUN_CONTINUE;
     }
+    case DADD:
+        VM_FLOAT_OPERANDS(operands[1], operands[2], DADD_F);
+        [[fallthrough]];
     case ADD: {
-        ste.regs[operands[0]].i64 = ste.regs[operands[1]].i64 + ste.regs[operands[2]].i64;
+        VM_BIG_OPERANDS(operands[1], operands[2]);
+        int64_t result;
+        if (add_overflow(ste.regs[operands[1]].i64, ste.regs[operands[2]].i64, &result)) [[unlikely]] { VM_OVERFLOW(); }
+        ste.regs[operands[0]].i64 = result;
+        VM_TAG(reg_big[operands[0]] = 0);
         ste.pc++;
         goto RUN_CONTINUE;
     }
+    case DSUB:
+        VM_FLOAT_OPERANDS(operands[1], operands[2], DSUB_F);
+        [[fallthrough]];
     case SUB: {
-        ste.regs[operands[0]].i64 = ste.regs[operands[1]].i64 - ste.regs[operands[2]].i64;  
+        VM_BIG_OPERANDS(operands[1], operands[2]);
+        int64_t result;
+        if (sub_overflow(ste.regs[operands[1]].i64, ste.regs[operands[2]].i64, &result)) [[unlikely]] { VM_OVERFLOW(); }
+        ste.regs[operands[0]].i64 = result;
+        VM_TAG(reg_big[operands[0]] = 0);
         ste.pc++;
         goto RUN_CONTINUE;
     }
+    case DMUL:
+        VM_FLOAT_OPERANDS(operands[1], operands[2], DMUL_F);
+        [[fallthrough]];
     case MUL: {
-        ste.regs[operands[0]].i64 = ste.regs[operands[1]].i64 * ste.regs[operands[2]].i64;
-        ste.pc++;   
+        VM_BIG_OPERANDS(operands[1], operands[2]);
+        int64_t result;
+        if (mul_overflow(ste.regs[operands[1]].i64, ste.regs[operands[2]].i64, &result)) [[unlikely]] { VM_OVERFLOW(); }
+        ste.regs[operands[0]].i64 = result;
+        VM_TAG(reg_big[operands[0]] = 0);
+        ste.pc++;
         goto RUN_CONTINUE;
     }
+    case DDIV:
+        VM_FLOAT_OPERANDS(operands[1], operands[2], DDIV_F);
+        [[fallthrough]];
     case DIV: {
+        VM_BIG_OPERANDS(operands[1], operands[2]);
+        VM_ZERO_DIVISOR(operands[2]);
+        // INT64_MIN / -1 的结果放不进 64 位
+        if (ste.regs[operands[2]].i64 == -1 && ste.regs[operands[1]].i64 == std::numeric_limits<int64_t>::min()) [[unlikely]] {
+            VM_OVERFLOW();
+        }
         ste.regs[operands[0]].i64 = ste.regs[operands[1]].i64 / ste.regs[operands[2]].i64;
-        ste.pc++;   
+        VM_TAG(reg_big[operands[0]] = 0);
+        ste.pc++;
         goto RUN_CONTINUE;
     }
+    case DMOD:
+        VM_FLOAT_OPERANDS(operands[1], operands[2], DMOD_F);
+        [[fallthrough]];
     case MOD: {
+        VM_BIG_OPERANDS(operands[1], operands[2]);
+        VM_ZERO_DIVISOR(operands[2]);
+        // INT64_MIN / -1 的结果放不进 64 位
+        if (ste.regs[operands[2]].i64 == -1 && ste.regs[operands[1]].i64 == std::numeric_limits<int64_t>::min()) [[unlikely]] {
+            VM_OVERFLOW();
+        }
         ste.regs[operands[0]].i64 = ste.regs[operands[1]].i64 % ste.regs[operands[2]].i64;
-        ste.pc++;   
+        VM_TAG(reg_big[operands[0]] = 0);
+        ste.pc++;
         goto RUN_CONTINUE;
     }
     case POW: {
         ste.regs[operands[0]].f64 = std::pow(ste.regs[operands[1]].f64, ste.regs[operands[2]].f64);
-        ste.pc++;   
+        VM_TAG(reg_big[operands[0]] = 0);
+        ste.pc++;
         goto RUN_CONTINUE;
     }
     case FCALL: {
-        ste.ret_addr_stack.push_back(ste.pc + 1);
+        ste.call_stack.push_back({ste.pc + 1, ste.fp});
+        VM_STAT(run_stats.calls++);
+        VM_STAT(run_stats.max_depth = std::max<uint64_t>(run_stats.max_depth, ste.call_stack.size()));
+        // 被调用者的帧紧接在调用者的帧之后
+        ste.fp += *reinterpret_cast<const uint16_t*>(operands + 8);
+        if (ste.fp + frame_window > ste.frames.size())
+            ste.frames.resize(std::max(ste.frames.size() * 2, ste.fp + frame_window));
+        VM_TAG(if (frame_big.size() < ste.frames.size()) frame_big.resize(ste.frames.size()));
         ste.pc = *reinterpret_cast<const uint64_t*>(operands);
         goto RUN_CONTINUE;
     }
     case FRET: {
-        ste.pc = ste.ret_addr_stack.back();
-        ste.ret_addr_stack.pop_back();
+        VM_STAT(run_stats.returns++);
+        ste.pc = ste.call_stack.back().ret_addr;
+        ste.fp = ste.call_stack.back().fp;
+        ste.call_stack.pop_back();
         goto RUN_CONTINUE;
     }
     case HALT: {
+        // 运行结束时已经没有活着的大整数和带标记的浮点就回到普通模式
+        VM_TAG(if (collect_bigs() == 0 && std::ranges::find(reg_big, TAG_FLOAT) == reg_big.end() &&
+                   std::ranges::find(frame_big, TAG_FLOAT) == frame_big.end()) leave_big_mode());
+        VM_STAT(finish());
         return 0;
     }
     case DEBUG_LOG: {
-        fprintf(stderr,"[LogInfo]: %s\n", static_cast<char *>(const_pool_top) + *reinterpret_cast<const uint64_t*>(operands));
+        // 只把事件放进队列，格式化和写出由后台线程完成
+        const uint8_t payload = operands[8];
+        if constexpr (Big) {
+            if (payload != LOG_NO_PAYLOAD && reg_big[payload]) {
+                (log ? *log : start_log()).write_now(*reinterpret_cast<const uint64_t*>(operands), register_string(payload));
+                ste.pc++;
+                goto RUN_CONTINUE;
+            }
+        }
+        (log ? *log : start_log()).push(*reinterpret_cast<const uint64_t*>(operands), payload != LOG_NO_PAYLOAD,
+                                        payload != LOG_NO_PAYLOAD ? ste.regs[payload].i64 : 0);
         ste.pc++;
         goto RUN_CONTINUE;
     }
@@ -126,47 +557,249 @@ int VirtualCore::run() {
         goto RUN_CONTINUE;
     }
     case CMP_GE: {
-        ste.regs[operands[0]].b = ste.regs[operands[1]].i64 >= ste.regs[operands[2]].i64;
+        ste.regs[operands[0]].b = VM_CMP(operands[1], operands[2], >=);
+        VM_TAG(reg_big[operands[0]] = 0);
         ste.pc++;
         goto RUN_CONTINUE;
     }
     case CMP_LT: {
-        ste.regs[operands[0]].b = ste.regs[operands[1]].i64 <  ste.regs[operands[2]].i64;
+        ste.regs[operands[0]].b = VM_CMP(operands[1], operands[2], <);
+        VM_TAG(reg_big[operands[0]] = 0);
         ste.pc++;
         goto RUN_CONTINUE;
     }
     case CMP_LE: {
-        ste.regs[operands[0]].b = ste.regs[operands[1]].i64 <= ste.regs[operands[2]].i64;
+        ste.regs[operands[0]].b = VM_CMP(operands[1], operands[2], <=);
+        VM_TAG(reg_big[operands[0]] = 0);
         ste.pc++;
         goto RUN_CONTINUE;
     }
     case CMP_GT: {
-        ste.regs[operands[0]].b = ste.regs[operands[1]].i64 >  ste.regs[operands[2]].i64;
+        ste.regs[operands[0]].b = VM_CMP(operands[1], operands[2], >);
+        VM_TAG(reg_big[operands[0]] = 0);
         ste.pc++;
         goto RUN_CONTINUE;
     }
     case CMP_EQ: {
-        ste.regs[operands[0]].b = ste.regs[operands[1]].i64 == ste.regs[operands[2]].i64;
+        ste.regs[operands[0]].b = VM_CMP(operands[1], operands[2], ==);
+        VM_TAG(reg_big[operands[0]] = 0);
         ste.pc++;
         goto RUN_CONTINUE;
     }
     case CMP_NE: {
-        ste.regs[operands[0]].b = ste.regs[operands[1]].i64 != ste.regs[operands[2]].i64;
+        ste.regs[operands[0]].b = VM_CMP(operands[1], operands[2], !=);
+        VM_TAG(reg_big[operands[0]] = 0);
         ste.pc++;
         goto RUN_CONTINUE;
     }
     case IF_TRUE: {
-        if (ste.regs[operands[0]].b) ste.pc = *reinterpret_cast<const uint64_t*>(operands + 1);
-        else ste.pc++;
+        VM_BRANCH(VM_TRUTHY(operands[0]), *reinterpret_cast<const uint64_t*>(operands + 1));
         goto RUN_CONTINUE;
     }
     case IF_FALSE: {
-        if (!ste.regs[operands[0]].b) ste.pc = *reinterpret_cast<const uint64_t*>(operands + 1);
-        else ste.pc++;
+        VM_BRANCH(!VM_TRUTHY(operands[0]), *reinterpret_cast<const uint64_t*>(operands + 1));
+        goto RUN_CONTINUE;
+    }
+    case BLT: {
+        VM_BRANCH(VM_CMP(operands[0], operands[1], <), *reinterpret_cast<const uint64_t*>(operands + 2));
+        goto RUN_CONTINUE;
+    }
+    case BLE: {
+        VM_BRANCH(VM_CMP(operands[0], operands[1], <=), *reinterpret_cast<const uint64_t*>(operands + 2));
+        goto RUN_CONTINUE;
+    }
+    case BGT: {
+        VM_BRANCH(VM_CMP(operands[0], operands[1], >), *reinterpret_cast<const uint64_t*>(operands + 2));
+        goto RUN_CONTINUE;
+    }
+    case BGE: {
+        VM_BRANCH(VM_CMP(operands[0], operands[1], >=), *reinterpret_cast<const uint64_t*>(operands + 2));
+        goto RUN_CONTINUE;
+    }
+    case BEQ: {
+        VM_BRANCH(VM_CMP(operands[0], operands[1], ==), *reinterpret_cast<const uint64_t*>(operands + 2));
+        goto RUN_CONTINUE;
+    }
+    case BNE: {
+        VM_BRANCH(VM_CMP(operands[0], operands[1], !=), *reinterpret_cast<const uint64_t*>(operands + 2));
+        goto RUN_CONTINUE;
+    }
+    case LOOP_LT: {
+        // 计数循环的回边：自增、比较、跳转合为一次分派
+        if constexpr (Big) {
+            if (reg_big[operands[0]] | reg_big[operands[1]]) {
+                // 动态类型的循环变量在循环体里可能被赋成浮点
+                if (reg_big[operands[0]] == TAG_FLOAT) ste.regs[operands[0]].f64 += 1;
+                else set_big_result(operands[0], big_operand(operands[0]) + BigInt(1));
+                VM_BRANCH(VM_CMP(operands[0], operands[1], <), *reinterpret_cast<const uint64_t*>(operands + 2));
+                goto RUN_CONTINUE;
+            }
+        }
+        VM_BRANCH(++ste.regs[operands[0]].i64 < ste.regs[operands[1]].i64, *reinterpret_cast<const uint64_t*>(operands + 2));
+        goto RUN_CONTINUE;
+    }
+    case MAP_NEW: {
+        maps.push_back(std::make_unique<IntMap>());
+        ste.regs[operands[0]].u64 = maps.size();
+        VM_TAG(reg_big[operands[0]] = 0);
+        ste.pc++;
+        goto RUN_CONTINUE;
+    }
+    case MAP_GET: {
+        VM_MAP_OPERAND(map, operands[1]);
+        VM_MAP_SCALAR(operands[2], "key");
+        ste.regs[operands[0]].i64 = map->get(ste.regs[operands[2]].i64);
+        VM_TAG(reg_big[operands[0]] = 0);
+        ste.pc++;
+        goto RUN_CONTINUE;
+    }
+    case MAP_SET: {
+        VM_MAP_OPERAND(map, operands[0]);
+        VM_MAP_SCALAR(operands[1], "key");
+        VM_MAP_SCALAR(operands[2], "value");
+        map->set(ste.regs[operands[1]].i64, ste.regs[operands[2]].i64);
+        ste.pc++;
         goto RUN_CONTINUE;
     }
+    case MAP_DEL: {
+        VM_MAP_OPERAND(map, operands[1]);
+        VM_MAP_SCALAR(operands[2], "key");
+        ste.regs[operands[0]].i64 = map->erase(ste.regs[operands[2]].i64);
+        VM_TAG(reg_big[operands[0]] = 0);
+        ste.pc++;
+        goto RUN_CONTINUE;
+    }
+    case MAP_LEN: {
+        VM_MAP_OPERAND(map, operands[1]);
+        ste.regs[operands[0]].i64 = static_cast<int64_t>(map->size());
+        VM_TAG(reg_big[operands[0]] = 0);
+        ste.pc++;
+        goto RUN_CONTINUE;
+    }
+    // 浮点指令的操作数已知是浮点，结果只用在静态类型是浮点的位置，不需要标记
+    case FADD: {
+        ste.regs[operands[0]].f64 = ste.regs[operands[1]].f64 + ste.regs[operands[2]].f64;
+        VM_TAG(reg_big[operands[0]] = 0);
+        ste.pc++;
+        goto RUN_CONTINUE;
+    }
+    case FSUB: {
+        ste.regs[operands[0]].f64 = ste.regs[operands[1]].f64 - ste.regs[operands[2]].f64;
+        VM_TAG(reg_big[operands[0]] = 0);
+        ste.pc++;
+        goto RUN_CONTINUE;
+    }
+    case FMUL: {
+        ste.regs[operands[0]].f64 = ste.regs[operands[1]].f64 * ste.regs[operands[2]].f64;
+        VM_TAG(reg_big[operands[0]] = 0);
+        ste.pc++;
+        goto RUN_CONTINUE;
+    }
+    case FDIV: {
+        ste.regs[operands[0]].f64 = ste.regs[operands[1]].f64 / ste.regs[operands[2]].f64;
+        VM_TAG(reg_big[operands[0]] = 0);
+        ste.pc++;
+        goto RUN_CONTINUE;
+    }
+    case FMOD: {
+        ste.regs[operands[0]].f64 = std::fmod(ste.regs[operands[1]].f64, ste.regs[operands[2]].f64);
+        VM_TAG(reg_big[operands[0]] = 0);
+        ste.pc++;
+        goto RUN_CONTINUE;
+    }
+    case FCMP_GE: {
+        ste.regs[operands[0]].i64 = ste.regs[operands[1]].f64 >= ste.regs[operands[2]].f64;
+        VM_TAG(reg_big[operands[0]] = 0);
+        ste.pc++;
+        goto RUN_CONTINUE;
+    }
+    case FCMP_LT: {
+        ste.regs[operands[0]].i64 = ste.regs[operands[1]].f64 < ste.regs[operands[2]].f64;
+        VM_TAG(reg_big[operands[0]] = 0);
+        ste.pc++;
+        goto RUN_CONTINUE;
+    }
+    case FCMP_LE: {
+        ste.regs[operands[0]].i64 = ste.regs[operands[1]].f64 <= ste.regs[operands[2]].f64;
+        VM_TAG(reg_big[operands[0]] = 0);
+        ste.pc++;
+        goto RUN_CONTINUE;
+    }
+    case FCMP_GT: {
+        ste.regs[operands[0]].i64 = ste.regs[operands[1]].f64 > ste.regs[operands[2]].f64;
+        VM_TAG(reg_big[operands[0]] = 0);
+        ste.pc++;
+        goto RUN_CONTINUE;
+    }
+    case FCMP_EQ: {
+        ste.regs[operands[0]].i64 = ste.regs[operands[1]].f64 == ste.regs[operands[2]].f64;
+        VM_TAG(reg_big[operands[0]] = 0);
+        ste.pc++;
+        goto RUN_CONTINUE;
+    }
+    case FCMP_NE: {
+        ste.regs[operands[0]].i64 = ste.regs[operands[1]].f64 != ste.regs[operands[2]].f64;
+        VM_TAG(reg_big[operands[0]] = 0);
+        ste.pc++;
+        goto RUN_CONTINUE;
+    }
+    case TO_FLOAT: {
+        if constexpr (Big) ste.regs[operands[0]].f64 = float_operand(operands[1]);
+        else ste.regs[operands[0]].f64 = static_cast<double>(ste.regs[operands[1]].i64);
+        VM_TAG(reg_big[operands[0]] = 0);
+        ste.pc++;
+        goto RUN_CONTINUE;
+    }
+    // 两个操作数都带浮点标记时的 D 开头指令，结果同样带浮点标记
+    case DADD_F: {
+        VM_FLOAT_GUARD(operands[1], operands[2], DADD);
+        ste.regs[operands[0]].f64 = ste.regs[operands[1]].f64 + ste.regs[operands[2]].f64;
+        reg_big[operands[0]] = TAG_FLOAT;
+        ste.pc++;
+        goto RUN_CONTINUE;
+    }
+    case DSUB_F: {
+        VM_FLOAT_GUARD(operands[1], operands[2], DSUB);
+        ste.regs[operands[0]].f64 = ste.regs[operands[1]].f64 - ste.regs[operands[2]].f64;
+        reg_big[operands[0]] = TAG_FLOAT;
+        ste.pc++;
+        goto RUN_CONTINUE;
+    }
+    case DMUL_F: {
+        VM_FLOAT_GUARD(operands[1], operands[2], DMUL);
+        ste.regs[operands[0]].f64 = ste.regs[operands[1]].f64 * ste.regs[operands[2]].f64;
+        reg_big[operands[0]] = TAG_FLOAT;
+        ste.pc++;
+        goto RUN_CONTINUE;
+    }
+    case DDIV_F: {
+        VM_FLOAT_GUARD(operands[1], operands[2], DDIV);
+        ste.regs[operands[0]].f64 = ste.regs[operands[1]].f64 / ste.regs[operands[2]].f64;
+        reg_big[operands[0]] = TAG_FLOAT;
+        ste.pc++;
+        goto RUN_CONTINUE;
+    }
+    case DMOD_F: {
+        VM_FLOAT_GUARD(operands[1], operands[2], DMOD);
+        ste.regs[operands[0]].f64 = std::fmod(ste.regs[operands[1]].f64, ste.regs[operands[2]].f64);
+        reg_big[operands[0]] = TAG_FLOAT;
+        ste.pc++;
+        goto RUN_CONTINUE;
+    }
+    case BOX_FLOAT: {
+        // 普通模式下动态类型的值都是整数，第一个浮点出现时切到大整数模式重新执行这一条
+        if constexpr (!Big) {
+            VM_STAT(finish());
+            enter_big_mode();
+            return execute<true>();
+        } else {
+            reg_big[operands[0]] = TAG_FLOAT;
+            ste.pc++;
+            goto RUN_CONTINUE;
+        }
+    }
     default: {
-        return -1;
+        VM_UNREACHABLE();
     }
     }
 
@@ -2,41 +2,181 @@
 // Created by geguj on 2025/12/27.
 //
 #pragma once
+#include <algorithm>
 #include <array>
 #include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
 #include <utility>
 #include <vector>
 #include "../include/lmx_export.hpp"
 #include "value/value.hpp"
+#include "value/bigint.hpp"
+#include "value/map.hpp"
 #include "../include/opcode.hpp"
+#include "log_ring.hpp"
+#include "snapshot.hpp"
 
 namespace lmx::runtime {
 
+// 一帧至少留出的槽位数；程序用到更大的槽位偏移时按 frame_slots() 多留
+constexpr size_t FRAME_SLOTS = 256;
+
+// 执行计数，随 run() 累加；构建时关闭 LMX_VM_STATS 则不统计，各项保持为 0
+struct VMStats {
+    uint64_t instructions{0};       // 分派的指令条数
+    uint64_t calls{0};              // 执行的 FCALL 次数
+    uint64_t returns{0};            // 执行的 FRET 次数
+    uint64_t max_depth{0};          // 调用栈达到过的最大深度
+    uint64_t branches_taken{0};     // 条件跳转（IF_*、B*、LOOP_LT）跳走的次数
+    uint64_t branches_not_taken{0}; // 条件跳转顺序执行下去的次数
+    uint64_t elapsed_ns{0};         // run() 内花费的时间
+    uint64_t quickened{0};          // 原地改写成快速化指令的次数
+    uint64_t deopts{0};             // 快速化指令的前提不再成立、改回原指令的次数
+
+    void add(const VMStats& o) {
+        instructions += o.instructions;
+        calls += o.calls;
+        returns += o.returns;
+        max_depth = std::max(max_depth, o.max_depth);
+        branches_taken += o.branches_taken;
+        branches_not_taken += o.branches_not_taken;
+        elapsed_ns += o.elapsed_ns;
+        quickened += o.quickened;
+        deopts += o.deopts;
+    }
+};
+
+struct CallFrame {
+    size_t ret_addr;
+    size_t fp;
+};
+
 struct LMVM_API LMXState {
     size_t pc{0};
     std::array<Value, 255> regs{};
 
-    std::vector<size_t> ret_addr_stack;
+    std::vector<CallFrame> call_stack;
+    // 调用帧内存，当前帧从 fp 开始，供 FRAME_BASE 寻址的 MOV_*M / MOV_M* 使用
+    std::vector<Value> frames = std::vector<Value>(FRAME_SLOTS);
+    size_t fp{0};
     //void* const_pool_top;
     std::vector<Op>* program;
 };
 class LMVM_API VirtualCore {
     void* const_pool_top;
     LMXState ste;
+    VMStats counters;
+
+    size_t const_pool_bytes{0};
+    // 当前程序是否已通过 verify()，程序换了或改了之后要重新校验
+    bool verified{false};
+    // 当前程序一帧最多用到的槽位数，校验时求出；FCALL 保证 fp 之后至少有这么多槽位
+    size_t frame_window{FRAME_SLOTS};
+    /*
+     * 快速化：校验通过后复制一份私有的程序，执行时按观察到的情况把指令原地改写成特化的版本：
+     * 两个操作数都带浮点标记的 D 开头指令改成 *_F，直接按双精度计算。
+     * *_F 每次执行先检查前提，不成立时改回原指令重新执行（去优化），同一条指令去优化
+     * DEOPT_LIMIT 次后不再改写。改写只发生在副本上，共享程序的其他 VM、批量执行和快照看到的都是原程序；
+     * 程序换了或改了之后随重新校验一起重新复制。
+     */
+    static constexpr uint8_t DEOPT_LIMIT = 4;
+    std::vector<Op> code;
+    std::vector<uint8_t> deopt_count;   // 每条指令去优化的次数
+    // DEBUG_LOG 的输出队列，第一次输出日志时才创建
+    LogOptions log_options;
+    std::unique_ptr<LogRing> log;
+    /*
+     * 大整数模式（标记模式）：ADD/SUB/MUL/DIV/MOD 第一次溢出，或者第一次把浮点交给动态类型的位置时
+     * 切换过来，改用带标记的分派循环。标记为 TAG_BIG 的寄存器或帧槽位里存的是 bigs 中 BigInt 的指针，
+     * 能放回 int64 的结果总是存成普通整数；标记为 TAG_FLOAT 的存的是双精度浮点。
+     * 普通模式下动态类型的值一定是整数，静态类型是浮点的值不需要标记。
+     * 某次运行结束时已经没有大整数和带标记的浮点，就回到普通模式。
+     */
+    static constexpr uint8_t TAG_BIG = 1;
+    static constexpr uint8_t TAG_FLOAT = 2;
+    bool big_mode{false};
+    std::array<uint8_t, 255> reg_big{};
+    std::vector<uint8_t> frame_big;
+    BigHeap bigs;
+    /*
+     * MAP_NEW 建的表，寄存器里存的句柄是下标加一，0 不是有效句柄。
+     * reset_state() 时全部释放；函数看不到全局变量，call() 期间新建的表在返回时释放。
+     */
+    std::vector<std::unique_ptr<IntMap>> maps;
 
     [[nodiscard]] Value *get_value_from_pool(const size_t offest) const;
+    [[nodiscard]] Value *get_value_from_mem(uint8_t base, uint16_t offest);
+    bool check_program(std::span<const size_t> entries);
+    int dispatch();
+    template <bool Big> int execute();
+    void enter_big_mode();
+    void leave_big_mode();
+    size_t collect_bigs();
+    [[nodiscard]] BigInt big_operand(uint8_t r) const;
+    // 按标记把整数、大整数或浮点读成双精度
+    [[nodiscard]] double float_operand(uint8_t r) const;
+    // 有一边是浮点时按双精度比较
+    [[nodiscard]] int big_compare(uint8_t a, uint8_t b) const;
+    void set_big_result(uint8_t r, BigInt&& v);
+    bool big_arith(Opcode op, const uint8_t* operands);
+    // D 开头的通用算术指令遇到浮点标记时按双精度计算
+    void float_arith(Opcode op, const uint8_t* operands);
+    // 寄存器 r 里的句柄对应的表，不是有效句柄时报错并返回 nullptr
+    template <bool Big> IntMap* map_operand(uint8_t r);
+    LogRing& start_log();
 public:
     VirtualCore();
     VirtualCore(const VirtualCore&) = delete;
     VirtualCore& operator=(const VirtualCore&) = delete;
     VirtualCore(VirtualCore&&) = delete;
     explicit VirtualCore(LMXState ste);
-    explicit VirtualCore(LMXState ste, void* const_pool_top);
+    explicit VirtualCore(LMXState ste, void* const_pool_top, size_t const_pool_bytes = 0);
+    // 先校验程序（每个程序只校验一次），不通过时不执行并返回 -1
     int run();
+    /*
+     * 从宿主直接调用 entry 处的函数：清空调用栈，参数按调用约定放入参数寄存器，
+     * 函数 FRET 后回到 return_pc（必须是一条 HALT），返回值在 0 号寄存器。
+     * 不需要改写程序，也不会执行顶层代码。
+     */
+    int call(size_t entry, std::span<const int64_t> args, size_t return_pc);
+    // 同上，is_float[i] 为真的参数是双精度浮点的位模式，传给动态类型的参数时带上浮点标记
+    int call(size_t entry, std::span<const int64_t> args, std::span<const uint8_t> is_float, size_t return_pc);
+    // 清空寄存器、调用栈和帧，pc 回到 0；程序和校验结果保留
+    void reset_state();
+
+    // 把寄存器、顶层帧、程序和常量池写成快照，extra 原样附带；只能在两次执行之间、没有 map 时调用
+    bool save_snapshot(const std::string& path, std::span<const std::byte> extra, std::string& error) const;
+    // 换成快照里的状态，之后 run() 从保存时的 pc 继续；image 要比 VM 活得久
+    void restore(Snapshot& image);
 
     [[nodiscard]] std::vector<Op> *get_program() const { return ste.program; }
-    void set_program(std::vector<Op> *program) { ste.pc = 0;ste.program = program; }
+    [[nodiscard]] std::span<const std::byte> get_const_pool() const {
+        return {static_cast<const std::byte*>(const_pool_top), const_pool_top ? const_pool_bytes : 0};
+    }
+    void set_program(std::vector<Op> *program) { ste.pc = 0;ste.program = program; verified = false; }
+    // 原地修改了程序（比如 REPL 追加了指令）之后调用，下次 run() 重新校验
+    void program_changed() { verified = false; }
+    // 寄存器里是大整数时返回的是指针，用 register_is_big() 区分，register_string() 总能给出十进制值
     int64_t look_register(const size_t r) const { return ste.regs[r].i64; }
+    [[nodiscard]] double look_float(const size_t r) const { return ste.regs[r].f64; }
+    [[nodiscard]] bool register_is_big(const size_t r) const { return big_mode && reg_big[r] == TAG_BIG; }
+    // 带浮点标记，也就是动态类型的值运行时是浮点
+    [[nodiscard]] bool register_is_float(const size_t r) const { return big_mode && reg_big[r] == TAG_FLOAT; }
+    // as_float 为真时按浮点输出，用于静态类型是浮点、没有标记的值
+    [[nodiscard]] std::string register_string(size_t r, bool as_float = false) const;
+    // 当前帧第 slot 个槽位的十进制值，REPL 查看住在帧里的顶层变量
+    [[nodiscard]] std::string frame_string(size_t slot, bool as_float = false) const;
+    [[nodiscard]] const VMStats& stats() const { return counters; }
+    void reset_stats() { counters = {}; }
+    // 构建时是否打开了 LMX_VM_STATS，关闭时 stats() 始终为 0
+    static bool stats_enabled();
+
+    // 设置 DEBUG_LOG 队列的容量、溢出策略和输出目标；已有的队列先写完再按新设置重建
+    void set_log_options(const LogOptions& options);
+    // 等已经执行过的 DEBUG_LOG 全部写出，run() 返回前会调用
+    void flush_log() const { if (log) log->flush(); }
 };
 
 }